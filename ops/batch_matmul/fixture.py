@@ -6,7 +6,7 @@ import numpy as np
 
 logger = logging.getLogger(__name__)
 
-from ...shared import CUDATarget, CUDAContext
+from ...shared import CUDATarget, CUDAContext, CPUTarget, CPUContext
 
 
 @auto_scheduler.register_workload
@@ -80,3 +80,46 @@ class cuBLASBatchMatmulNNFixture:
                 tvm.nd.array(self.W_np, device=CUDAContext),
                 tvm.nd.array(np.empty(shape=topi.utils.get_const_tuple(self.Y.shape),
                                       dtype=np.float32), device=CUDAContext)]
+
+
+class _x86BatchMatmulFixture:
+    """
+    The fixed (i.e., not tuned for any shape) schedule of TOPI on the CPU.
+    """
+    __slots__ = 'B', 'M', 'K', 'N', 'fixed_kernel', 'X_np', 'W_np', 'Y', 'Y_np_expected'
+
+    def __init__(self, B, M, K, N, transpose_b):
+        self.B, self.M, self.K, self.N = B, M, K, N
+        self.X_np = np.random.uniform(-0.1, 0.1, size=(B, M, K)).astype(np.float32)
+        self.W_np = np.random.uniform(-0.1, 0.1, size=(B, N, K) if transpose_b else (B, K, N)) \
+                      .astype(np.float32)
+
+        X = te.placeholder((B, M, K), name='X')
+        W = te.placeholder((B, N, K) if transpose_b else (B, K, N), name='W')
+        with CPUTarget:
+            self.Y = topi.x86.batch_matmul(X, W, transpose_b=transpose_b)
+            sched = topi.x86.schedule_batch_matmul([self.Y])
+        self.fixed_kernel = tvm.build(sched, [X, W, self.Y], CPUTarget)
+
+        self.Y_np_expected = np.matmul(self.X_np,
+                                       self.W_np.transpose(0, 2, 1) if transpose_b else self.W_np)
+        module_data = self.module_data()
+        self.fixed_kernel(*module_data)
+        np.testing.assert_allclose(module_data[-1].asnumpy(), self.Y_np_expected,
+                                   rtol=1e-3, atol=1e-3)
+
+    def module_data(self):
+        return [tvm.nd.array(self.X_np, device=CPUContext),
+                tvm.nd.array(self.W_np, device=CPUContext),
+                tvm.nd.array(np.empty(shape=topi.utils.get_const_tuple(self.Y.shape),
+                                      dtype=np.float32), device=CPUContext)]
+
+
+class x86BatchMatmulNTFixture(_x86BatchMatmulFixture):
+    def __init__(self, B, M, K, N):
+        super().__init__(B, M, K, N, transpose_b=True)
+
+
+class x86BatchMatmulNNFixture(_x86BatchMatmulFixture):
+    def __init__(self, B, M, K, N):
+        super().__init__(B, M, K, N, transpose_b=False)
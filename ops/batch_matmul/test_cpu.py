@@ -0,0 +1,55 @@
+from tvm import tir
+
+import logging
+
+logger = logging.getLogger(__name__)
+
+from ...shared import tvm_dev_decor
+from ..shared.auto_scheduler import CPUAutoScheduler
+from ..shared.utils import get_seq_lens
+from .fixture import BatchMatmulNT, x86BatchMatmulNTFixture, \
+                     BatchMatmulNN, x86BatchMatmulNNFixture
+
+auto_scheduler = CPUAutoScheduler()
+
+
+@tvm_dev_decor
+def test_train_dynT():
+    B = 16
+    NH = 12
+    T = get_seq_lens()
+    H = 768
+
+    logger.info("Workload Instances: {}".format(T))
+    wkl_insts = [(t,) for t in T]
+
+    DynT = tir.DynShapeVar('T')
+
+    auto_scheduler.train(wkl_func=BatchMatmulNT,
+                         wkl_func_args=(B * NH, DynT, H // NH, DynT),
+                         shape_vars=[DynT], wkl_insts=wkl_insts,
+                         wkl_inst_weights=[1. for _ in wkl_insts],
+                         ffixed_fixture=x86BatchMatmulNTFixture,
+                         sched_func_name_prefix='batch_matmul_nt_{}xTx{}xT'.format(B * NH, H // NH)
+                         )
+
+
+@tvm_dev_decor
+def test_train_nn_dynT():
+    B = 16
+    NH = 12
+    T = get_seq_lens()
+    H = 768
+
+    logger.info("Workload Instances: {}".format(T))
+    wkl_insts = [(t,) for t in T]
+
+    DynT = tir.DynShapeVar('T')
+
+    auto_scheduler.train(wkl_func=BatchMatmulNN,
+                         wkl_func_args=(B * NH, DynT, DynT, H // NH),
+                         shape_vars=[DynT], wkl_insts=wkl_insts,
+                         wkl_inst_weights=[1. for _ in wkl_insts],
+                         ffixed_fixture=x86BatchMatmulNNFixture,
+                         sched_func_name_prefix='batch_matmul_nn_{}xTxTx{}'.format(B * NH, H // NH)
+                         )
@@ -6,7 +6,7 @@ import numpy as np
 
 logger = logging.getLogger(__name__)
 
-from ...shared import CUDATarget, CUDAContext
+from ...shared import CUDATarget, CUDAContext, CPUTarget, CPUContext
 
 
 @auto_scheduler.register_workload
@@ -67,3 +67,34 @@ class cuTLASSDenseFixture:
         np.testing.assert_allclose(self.Y_np_expected,
                                    cublas_fixture.Y_np_expected,
                                    rtol=1e-3, atol=1e-3)
+
+
+class x86DenseFixture:
+    """
+    The fixed (i.e., not tuned for any shape) schedule of TOPI on the CPU.
+    """
+    __slots__ = 'B', 'I', 'H', 'fixed_kernel', 'X_np', 'W_np', 'Y', 'Y_np_expected'
+
+    def __init__(self, B, I, H):
+        self.B, self.I, self.H = B, I, H
+        self.X_np = np.random.uniform(-0.1, 0.1, size=(B, I)).astype(np.float32)
+        self.W_np = np.random.uniform(-0.1, 0.1, size=(H, I)).astype(np.float32)
+
+        X = te.placeholder((B, I), name='X')
+        W = te.placeholder((H, I), name='W')
+        with CPUTarget:
+            self.Y = topi.x86.dense_nopack(X, W)
+            sched = topi.x86.schedule_dense_nopack([self.Y])
+        self.fixed_kernel = tvm.build(sched, [X, W, self.Y], CPUTarget)
+
+        self.Y_np_expected = np.matmul(self.X_np, self.W_np.T)
+        module_data = self.module_data()
+        self.fixed_kernel(*module_data)
+        np.testing.assert_allclose(module_data[-1].asnumpy(), self.Y_np_expected,
+                                   rtol=1e-3, atol=1e-3)
+
+    def module_data(self):
+        return [tvm.nd.array(self.X_np, device=CPUContext),
+                tvm.nd.array(self.W_np, device=CPUContext),
+                tvm.nd.array(np.empty(shape=topi.utils.get_const_tuple(self.Y.shape),
+                                      dtype=np.float32), device=CPUContext)]
@@ -0,0 +1,33 @@
+from tvm import tir
+
+import logging
+
+logger = logging.getLogger(__name__)
+
+from ...shared import tvm_dev_decor
+from ..shared.auto_scheduler import CPUAutoScheduler
+from ..shared.utils import cross_product, get_seq_lens
+from .fixture import Dense, x86DenseFixture
+
+auto_scheduler = CPUAutoScheduler()
+
+
+@tvm_dev_decor
+def test_train_dynT():
+    B = 16
+    T = get_seq_lens()
+    I = 768
+    H = 2304
+
+    wkl_insts = cross_product(T, (I, H))
+    logger.info("Workload Instances: {}".format(wkl_insts))
+
+    DynT, DynI, DynH = tir.DynShapeVar('T'), tir.DynShapeVar('I'), tir.DynShapeVar('H')
+
+    auto_scheduler.train(wkl_func=Dense,
+                         wkl_func_args=(B * DynT, DynI, DynH),
+                         shape_vars=[DynT, DynI, DynH], wkl_insts=wkl_insts,
+                         wkl_inst_weights=[1. for _ in wkl_insts],
+                         ffixed_fixture=x86DenseFixture,
+                         sched_func_name_prefix='dense_{}xTx{}x{}'.format(B, I, H)
+                         )
@@ -13,9 +13,10 @@ from math import prod
 
 logger = logging.getLogger(__name__)
 
-from ...shared import CUDATarget, CUDAContext, platform, rand_seed, use_tvm_base
+from ...shared import CUDATarget, CUDAContext, CPUTarget, CPUContext, \
+                      platform, rand_seed, use_tvm_base
 from ...shared.auto_scheduler import auto_sched_ntrials, get_log_filename, \
-                                     measure_ctx
+                                     local_runner, measure_ctx
 from ...shared.logger import AutoSchedTimer
 from .logger import PySchedLogger, TFLOPSLogger
 from .utils  import get_time_evaluator_results
@@ -38,18 +39,19 @@ class _AutoScheduler(abc.ABC):
         return sched_func_name
 
     def _train(self, func, args, sched_log_fname, shape_vars=None,
-               wkl_insts=None, wkl_inst_weights=None):
+               wkl_insts=None, wkl_inst_weights=None, target=CUDATarget,
+               runner=None):
         if shape_vars is not None:
             task = SearchTask(func=func, args=args,
                               shape_vars=shape_vars, wkl_insts=wkl_insts,
                               wkl_inst_weights=wkl_inst_weights,
-                              target=CUDATarget)
+                              target=target)
         else:
-            task = SearchTask(func=func, args=args, target=CUDATarget)
+            task = SearchTask(func=func, args=args, target=target)
         
         tune_option = TuningOptions(
                           num_measure_trials=auto_sched_ntrials,
-                          runner=measure_ctx.runner,
+                          runner=measure_ctx.runner if runner is None else runner,
                           measure_callbacks=[RecordToFile(sched_log_fname)]
                       )
 
@@ -348,3 +350,105 @@ class DietCodeAutoScheduler(_AutoScheduler):
             except Exception as e:
                 logger.warn("err_msg={}".format(e))
             tflops_logger.write('DietCode', instantiated_wkl_func_args, dietcode_jit_results, FLOPs)
+
+
+
+def _get_checked_results(kernel, module_data, Y_np_expected, ctx, extra_args=()):
+    """
+    Run the kernel once, check its output against the expected one, and time
+    it. Failures propagate to the caller instead of being logged as missing
+    results.
+    """
+    kernel(*module_data, *extra_args)
+    np.testing.assert_allclose(module_data[-1].asnumpy(), Y_np_expected,
+                               rtol=1e-3, atol=1e-3)
+    return get_time_evaluator_results(kernel, module_data + list(extra_args), ctx)
+
+
+class CPUAutoScheduler(_AutoScheduler):
+    """
+    The dynamic-shape experiments on the CPU (LLVM) target, which compare
+    DietCode, Ansor that tunes every workload instance on its own, and a fixed
+    schedule that is not tuned for any workload instance at all.
+    """
+    def train(self, wkl_func, wkl_func_args, shape_vars, wkl_insts, wkl_inst_weights,
+              ffixed_fixture, sched_func_name_prefix,
+              sched_results_log_fname="temp_workspace", append_log=False,
+              fflop_estimator=_default_fflop_estimator):
+        logger.info("{}{}".format(wkl_func.__name__, wkl_func_args))
+
+        from tvm.auto_scheduler import instantiate_dyn_args
+
+        # DietCode
+        with AutoSchedTimer("dietcode_autosched_timer.csv", append_log,
+                            sched_func_name_prefix):
+            _, dyn_wkl_dispatcher = \
+                    self._train(func=wkl_func, args=wkl_func_args,
+                                sched_log_fname=get_log_filename('dietcode', sched_func_name_prefix),
+                                shape_vars=shape_vars, wkl_insts=wkl_insts,
+                                wkl_inst_weights=wkl_inst_weights,
+                                target=CPUTarget, runner=local_runner)
+
+        # Ansor
+        ansor_sched_args_pairs = []
+        for wkl_inst_i, wkl_inst in enumerate(wkl_insts):
+            instantiated_wkl_func_args = \
+                    instantiate_dyn_args(wkl_func_args, shape_vars, wkl_inst)
+            sched_func_name = self._get_sched_func_name(wkl_func, instantiated_wkl_func_args)
+            with AutoSchedTimer("ansor_autosched_timer.csv",
+                                append_log or wkl_inst_i != 0, sched_func_name):
+                _, _, sched_args_pair = \
+                        self._train(func=wkl_func, args=instantiated_wkl_func_args,
+                                    sched_log_fname=get_log_filename('ansor', sched_func_name),
+                                    target=CPUTarget, runner=local_runner)
+            ansor_sched_args_pairs.append(sched_args_pair)
+
+        self.infer(wkl_func=wkl_func, wkl_func_args=wkl_func_args,
+                   shape_vars=shape_vars, wkl_insts=wkl_insts,
+                   ffixed_fixture=ffixed_fixture,
+                   dyn_wkl_dispatcher=dyn_wkl_dispatcher,
+                   ansor_sched_args_pairs=ansor_sched_args_pairs,
+                   sched_results_log_fname=sched_results_log_fname,
+                   append_log=append_log, fflop_estimator=fflop_estimator)
+
+    def infer(self, wkl_func, wkl_func_args, shape_vars, wkl_insts, ffixed_fixture,
+              dyn_wkl_dispatcher, ansor_sched_args_pairs,
+              sched_results_log_fname='temp_workspace', append_log=False,
+              fflop_estimator=_default_fflop_estimator):
+        tflops_logger = TFLOPSLogger(sched_results_log_fname + ".csv", append_log)
+
+        from tvm.auto_scheduler import instantiate_dyn_args
+
+        # DietCode is compiled once into a single module that takes the shape
+        # variables as trailing arguments and dispatches among the kernels at
+        # runtime, which is what gets measured for every workload instance.
+        ir_mod, _ = tvm.lower_dyn_wkl_dispatcher(dyn_wkl_dispatcher, CPUTarget)
+        dietcode_kernel = tvm.build(ir_mod, target=CPUTarget)
+
+        for wkl_inst, ansor_sched_args_pair in zip(wkl_insts, ansor_sched_args_pairs):
+            logger.info("Workload Instance={}".format(wkl_inst))
+
+            instantiated_wkl_func_args = \
+                    instantiate_dyn_args(wkl_func_args, shape_vars, wkl_inst)
+            fixed_fixture = ffixed_fixture(*instantiated_wkl_func_args)
+            module_data = fixed_fixture.module_data()
+
+            FLOPs = fflop_estimator(instantiated_wkl_func_args)
+
+            # Fixed Schedule
+            fixed_results = \
+                    get_time_evaluator_results(fixed_fixture.fixed_kernel,
+                                               module_data, CPUContext)
+            tflops_logger.write('Fixed', instantiated_wkl_func_args, fixed_results, FLOPs)
+
+            # Ansor
+            ansor_results = _get_checked_results(
+                    tvm.build(*ansor_sched_args_pair, target=CPUTarget),
+                    module_data, fixed_fixture.Y_np_expected, CPUContext)
+            tflops_logger.write('Ansor', instantiated_wkl_func_args, ansor_results, FLOPs)
+
+            # DietCode
+            dietcode_results = _get_checked_results(
+                    dietcode_kernel, module_data, fixed_fixture.Y_np_expected,
+                    CPUContext, extra_args=tuple(wkl_inst))
+            tflops_logger.write('DietCode', instantiated_wkl_func_args, dietcode_results, FLOPs)
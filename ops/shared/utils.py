@@ -1,3 +1,6 @@
+import os
+
+
 def get_time_evaluator_results(kernel, module_data, ctx, number=100, repeat=10,
                                min_repeat_ms=100):
     warmup_evaluator = kernel.time_evaluator(kernel.entry_name, ctx,
@@ -23,3 +26,14 @@ def cross_product(argA, argB):
             else:
                 args.append((a,  *b)) if isinstance(b, tuple) else args.append((a,  b))
     return args
+
+
+def get_seq_lens():
+    """
+    The sequence lengths to sweep, overridable by the comma-separated list in
+    the environment variable SEQ_LENS.
+    """
+    seq_lens = os.getenv('SEQ_LENS')
+    if seq_lens is None:
+        return list(range(5, 128, 19)) + [128]
+    return [int(T) for T in seq_lens.split(',')]
@@ -0,0 +1,20 @@
+#!/bin/bash -e
+
+PROJECT_ROOT=$(cd $(dirname ${BASH_SOURCE[0]}) && pwd)/..
+
+source ${PROJECT_ROOT}/environ/activate_dev.sh
+AUTO_SCHED_NTRIALS=${AUTO_SCHED_NTRIALS:-1000}
+
+cd ${PROJECT_ROOT}/ops/dense
+AUTO_SCHED_NTRIALS=${AUTO_SCHED_NTRIALS} pytest -s test_cpu.py::test_train_dynT
+
+mkdir -p 2_5-saved_artifacts
+cp *.csv 2_5-saved_artifacts
+
+cd ${PROJECT_ROOT}/ops/batch_matmul
+for test_name in test_train_dynT test_train_nn_dynT; do
+    AUTO_SCHED_NTRIALS=${AUTO_SCHED_NTRIALS} pytest -s test_cpu.py::${test_name}
+
+    mkdir -p 2_5-saved_artifacts/${test_name}
+    cp *.csv 2_5-saved_artifacts/${test_name}
+done
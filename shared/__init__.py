@@ -44,4 +44,9 @@ if not use_tvm_base:
 CUDATarget = tvm.target.Target(cuda_target)
 CUDAContext = tvm.cuda()
 
+# used by the CPU reproduction of the operator experiments
+cpu_target = os.getenv('CPU_TARGET', 'llvm')
+CPUTarget = tvm.target.Target(cpu_target)
+CPUContext = tvm.cpu()
+
 os.environ["TOKENIZERS_PARALLELISM"] = "false"
@@ -53,11 +53,14 @@ class AutoSchedTimer:
 "Task","Time Spent (s)"
 """)
 
-    def _write(self):
+    def _write(self, failed=False):
         with open(self.filename, 'a') as fout:
-            fout.write('\"{}\",\"{}\"\n'.format(self.attr, self.toc - self.tic))
+            if failed:
+                fout.write('\"{}\",-\n'.format(self.attr))
+            else:
+                fout.write('\"{}\",\"{}\"\n'.format(self.attr, self.toc - self.tic))
         logger.info("Auto-Scheduling Time for {} : {} s"
-                        .format(self.attr, self.toc - self.tic))
+                        .format(self.attr, '-' if failed else self.toc - self.tic))
 
     def __enter__(self):
         self.tic = time.time()
@@ -65,4 +68,4 @@ class AutoSchedTimer:
 
     def __exit__(self, exc_type, exc_val, exc_tb):
         self.toc = time.time()
-        self._write()
+        self._write(failed=exc_type is not None)
@@ -41,6 +41,7 @@
 // <bojian/DietCode>
 #include <tvm/tir/dyn_shape_var.h>
 
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -168,6 +169,9 @@ class AccessAnalyzer : public ObjectRef {
   TVM_DEFINE_OBJECT_REF_METHODS(AccessAnalyzer, ObjectRef, AccessAnalyzerNode);
 };
 
+// <bojian/DietCode>
+class ScheduleReplayCache;
+
 /*! \brief The auto-scheduler's computational graph and related program analyses. */
 class ComputeDAGNode : public Object {
  public:
@@ -191,6 +195,15 @@ class ComputeDAGNode : public Object {
   // Array<te::Tensor>     synthetic_tensors;
   // Array<te::Operation>  synthetic_ops;
 
+  // <bojian/DietCode>
+  /*!
+   * \brief The snapshots of the schedules after the prefixes of the transform
+   *        steps, so that ApplySteps only has to replay the divergent suffixes.
+   *        Null if disabled, which is the default. Not visited as it is only a
+   *        cache.
+   */
+  std::shared_ptr<ScheduleReplayCache> replay_cache;
+
   void VisitAttrs(tvm::AttrVisitor* v) {
     v->Visit("tensors", &tensors);
     v->Visit("ops", &ops);
@@ -287,10 +300,13 @@ class ComputeDAG : public ObjectRef {
 
  private:
   // <bojian/DietCode>
+  // replay_inst is the workload instance that keys the replay cache, nullptr
+  // to bypass the cache.
   std::pair<te::Schedule, Array<te::Tensor>>
   InstantiateAndApplySteps(const State& state, SyntheticExprReplacer& replacer,
                            Array<te::Stage>* stages,
-                           StageToAxesMap* stage_to_axes) const;
+                           StageToAxesMap* stage_to_axes,
+                           const std::vector<int64_t>* const replay_inst = nullptr) const;
 
  public:
   // <bojian/DietCode>
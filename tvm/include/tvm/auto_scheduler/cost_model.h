@@ -66,6 +66,22 @@ class CostModelNode : public Object {
                                       std::vector<float>* const scores) = 0;
 
 
+  // <bojian/DietCode>
+  /*!
+   * \brief Predict the scores of states, together with the standard deviations
+   *        of the predictions. The default has no notion of uncertainty and
+   *        reports deviations of 0.
+   * \param task The search task of states
+   * \param states The input states
+   * \param scores The predicted scores for all states
+   * \param stds The standard deviations of the predicted scores
+   */
+  virtual void PredictWithUncertainty(const SearchTask& task, const Array<State>& states,
+                                      std::vector<float>* scores, std::vector<float>* stds) {
+    Predict(task, states, scores);
+    stds->assign(scores->size(), 0.);
+  }
+
   /*!
    * \brief Predict the scores of all stages in states. This is the breakdown version of `Predict`
    * \param task The search task
@@ -148,6 +164,8 @@ class PythonBasedModelNode : public CostModelNode {
   // <bojian/DietCode>
   PackedFunc predict_for_all_instances_func;
   PackedFunc score_func;
+  /*! \brief Pointer to the uncertainty-aware predict function in python (optional) */
+  PackedFunc predict_uncertainty_func;
 
   /*! \brief Pointer to the predict funcion in python */
   PackedFunc predict_stage_func;
@@ -165,6 +183,10 @@ class PythonBasedModelNode : public CostModelNode {
                               std::vector<float>* const padding_penalty,
                               std::vector<float>* const scores) override final;
 
+  // <bojian/DietCode>
+  void PredictWithUncertainty(const SearchTask& task, const Array<State>& states,
+                              std::vector<float>* scores, std::vector<float>* stds) final;
+
 
   void PredictStages(const SearchTask& task, const Array<State>& states,
                      std::vector<float>* state_scores,
@@ -185,6 +207,8 @@ class PythonBasedModel : public CostModel {
    * \param update_func The pointer to the update function defined in python
    * \param predict_func The pointer to the prediction function defined in python
    * \param predict_stage_func The pointer to the prediction function defined in python
+   * \param predict_uncertainty_func The pointer to the uncertainty-aware prediction function
+   *        defined in python, which is optional
    */
   PythonBasedModel(PackedFunc update_func, PackedFunc predict_func,
 
@@ -192,7 +216,10 @@ class PythonBasedModel : public CostModel {
                    PackedFunc predict_for_all_instances_func,
                    PackedFunc score_func,
 
-                   PackedFunc predict_stage_func);
+                   PackedFunc predict_stage_func,
+
+                   // <bojian/DietCode>
+                   PackedFunc predict_uncertainty_func = nullptr);
 
   TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(PythonBasedModel, CostModel, PythonBasedModelNode);
 };
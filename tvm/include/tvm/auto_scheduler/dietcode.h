@@ -1,9 +1,15 @@
 #pragma once
 
+#include <tvm/auto_scheduler/search_policy.h>
 #include <tvm/auto_scheduler/search_task.h>
 #include <tvm/runtime/object.h>
+#include <tvm/runtime/packed_func.h>
 #include <tvm/ir/expr.h>
 
+#include <array>
+#include <map>
+#include <mutex>
+
 
 namespace tvm {
 namespace auto_scheduler {
@@ -47,6 +53,9 @@ class DynWklDispatcherNode : public Object {
   std::vector<State> states;
   std::unordered_map<size_t, size_t> inst_disp_map;
   // Map<Array<IntImm>, Integer> wkl_inst_func_gv_map;
+  // The throughput (in FLOPS) of each workload instance predicted at tuning
+  // time. Empty if the dispatcher is loaded from the records.
+  std::vector<float> inst_predicted_flops;
 
   void VisitAttrs(tvm::AttrVisitor* v) {
     v->Visit("search_task", &search_task);
@@ -58,6 +67,20 @@ class DynWklDispatcherNode : public Object {
   // Array<ObjectRef> GetSkeleton() const;
   IRModule GetSkeleton(const String& name) const;
   Array<ObjectRef> GenerateAndCompressIRMods(const String& prefix) const;
+  /*!
+   * \brief Get the adapted throughput of every workload instance on every
+   *        compressed state version, as the cost matrix of the dispatch.
+   *
+   * A state version is only feasible for the instances that share its
+   * out-of-bound marker (i.e., that it could have been compiled for), and
+   * the infeasible entries are 0.
+   * \param inst_state_ver_map The workload instances of each state version,
+   *        as returned by `GenerateAndCompressIRMods`.
+   * \param state_vers The state versions.
+   * \return The [wkl_insts x state_vers] adapted throughputs.
+   */
+  std::vector<float> GetAdaptedFlops(const Map<Integer, StateVer>& inst_state_ver_map,
+                                     const Array<StateVer>& state_vers) const;
 
   void EmbedComputeDAG(const ComputeDAG& compute_dag);
   static constexpr const char* _type_key = "auto_scheduler.DynWklDispatcher";
@@ -67,18 +90,127 @@ class DynWklDispatcherNode : public Object {
 class DynWklDispatcher : public ObjectRef {
  public:
   DynWklDispatcher(const SearchTask& search_task, std::vector<State>&& states,
-                   std::unordered_map<size_t, size_t>&& inst_disp_map);
+                   std::unordered_map<size_t, size_t>&& inst_disp_map,
+                   std::vector<float>&& inst_predicted_flops = {});
   TVM_DEFINE_OBJECT_REF_METHODS(DynWklDispatcher, ObjectRef,
                                 DynWklDispatcherNode);
   TVM_DEFINE_OBJECT_REF_COW_METHOD(DynWklDispatcherNode);
 };
 
 
+/*!
+ * \brief Runtime telemetry of a deployed dispatcher that guides the incremental
+ *        re-tuning.
+ *
+ * The calls are counted per leaf by the lowered dispatcher itself (see the
+ * `auto_scheduler.count_dispatches` pass config), and read back through the
+ * `runtime.GetDispatchCounts` PackedFunc under the name that the dispatcher is
+ * built with. The latencies are recorded per dispatched shape by the serving
+ * side, possibly only on a sample of the calls.
+ *
+ * All the methods are thread-safe, so that the serving threads can record
+ * latencies while the dispatcher gets re-tuned and hot-swapped.
+ */
+class DynWklTelemetryNode : public Object {
+ public:
+  /*!
+   * \brief The number of latency histogram bins. Bin k counts the latencies in
+   *        [2^k, 2^(k+1)) us, with the first and the last bin unbounded.
+   */
+  static constexpr const size_t kNumLatencyBins = 24;
+
+  struct ShapeStats {
+    int64_t wkl_inst_id = -1;  // -1 if the shape is not a workload instance
+    uint64_t num_samples = 0;
+    double mean_latency = 0.;  // in seconds
+    std::array<uint64_t, kNumLatencyBins> latency_hist{};
+  };
+
+  void VisitAttrs(tvm::AttrVisitor* v) {}
+
+  /*! \brief Record the latency of one invocation of the kernel on `shape_tuple`. */
+  void Record(const Array<IntImm>& shape_tuple, const double latency);
+  /*! \brief Report the statistics of every recorded shape. */
+  Array<Map<String, ObjectRef>> Report() const;
+  /*!
+   * \brief Select the workload instances that are hot (dispatched to a leaf
+   *        that receives at least `min_call_ratio` of all the calls) and
+   *        under-performing (achieve less than `max_flops_ratio` of their
+   *        predicted throughput).
+   */
+  Array<Integer> SelectRetuneInsts(const double min_call_ratio,
+                                   const double max_flops_ratio) const;
+  /*!
+   * \brief Replace the dispatcher without stopping the serving. The statistics
+   *        of the instances whose dispatched state changes are reset, and the
+   *        new dispatcher is handed to the hot-swap callback (if any), which
+   *        replaces the module that is serving (and hence its leaf counters).
+   */
+  void HotSwap(const DynWklDispatcher& new_dispatcher);
+  DynWklDispatcher GetDispatcher() const;
+  void Reset();
+
+  static constexpr const char* _type_key = "auto_scheduler.DynWklTelemetry";
+  TVM_DECLARE_FINAL_OBJECT_INFO(DynWklTelemetryNode, Object);
+
+ private:
+  friend class DynWklTelemetry;
+
+  /*! \brief The per-leaf call counts and the leaf of each workload instance. */
+  void GetDispatchCounts(std::vector<int64_t>* const leaf_counts,
+                         std::vector<int64_t>* const inst_leaf_ids) const;
+
+  mutable std::mutex mutex_;
+  /*!
+   * \brief Serializes the hot swaps, so that the changed instances are diffed
+   *        against the dispatcher that is being replaced, without holding
+   *        `mutex_` and hence blocking the serving threads.
+   */
+  std::mutex hot_swap_mutex_;
+  DynWklDispatcher dispatcher_;
+  /*! \brief The name that the dispatcher is built with, to read its counters. */
+  std::string dispatcher_name_;
+  /*! \brief Called with the new dispatcher on every hot swap, outside the lock. */
+  PackedFunc on_hot_swap_;
+  std::map<std::vector<int64_t>, size_t> wkl_inst_ids_;
+  /*!
+   * \brief The FLOPs of each workload instance, which only depend on the search
+   *        task and hence are computed once rather than under the lock.
+   */
+  std::vector<double> wkl_inst_flops_;
+  std::map<std::vector<int64_t>, ShapeStats> shape_stats_;
+};
+
+class DynWklTelemetry : public ObjectRef {
+ public:
+  explicit DynWklTelemetry(const DynWklDispatcher& dispatcher,
+                           PackedFunc on_hot_swap = nullptr,
+                           const String& dispatcher_name = "default_function");
+  TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(DynWklTelemetry, ObjectRef,
+                                        DynWklTelemetryNode);
+};
+
+/*!
+ * \brief Re-tune the hot and under-performing workload instances reported by
+ *        the telemetry for one search round, and hot-swap the dispatcher
+ *        with the re-tuned one.
+ * \return The re-tuned instances (empty if nothing needs to be re-tuned).
+ */
+Array<Integer> RetuneHotInsts(const DynWklTelemetry& telemetry,
+                              const SearchPolicy& search_policy,
+                              const ProgramMeasurer& measurer,
+                              const int num_measure, const double min_call_ratio,
+                              const double max_flops_ratio, const double boost);
+
+
 class DecisionTreeNodeNode : public Object {
  public:
   Optional<PrimExpr> predicate = Optional<PrimExpr>(nullptr);
   const DecisionTreeNodeNode* if_node = nullptr, * else_node = nullptr;
   Optional<StateVer> state_ver = Optional<StateVer>(nullptr);
+  // The references that keep `if_node` and `else_node` alive (empty if the
+  // caller owns the children, e.g., the nodes converted on the Python side).
+  Array<ObjectRef> children;
 
   void VisitAttrs(tvm::AttrVisitor* v) {
     v->Visit("predicate", &predicate);
@@ -96,11 +228,92 @@ class DecisionTreeNode : public ObjectRef {
   DecisionTreeNode(const PrimExpr& predicate,
                    const DecisionTreeNodeNode* const if_node,
                    const DecisionTreeNodeNode* const else_node);
+  DecisionTreeNode(const PrimExpr& predicate, const DecisionTreeNode& if_node,
+                   const DecisionTreeNode& else_node);
 
   TVM_DEFINE_OBJECT_REF_METHODS(DecisionTreeNode, ObjectRef,
                                 DecisionTreeNodeNode);
 };
 
 
+/*!
+ * \brief Build a cost-sensitive decision tree that dispatches the workload
+ *        instances to the candidate kernels.
+ *
+ * The misdispatch cost of a tree is the weighted average slowdown of the
+ * instances w.r.t. their best candidates, i.e.,
+ *
+ *   sum_i w_i * (max_c adapted_flops[i, c] / adapted_flops[i, tree(i)] - 1)
+ *   / sum_i w_i
+ *
+ * The shallowest tree (with at most `max_depth` levels of the predicates
+ * `shape_var <= value`) whose misdispatch cost is within
+ * `max_misdispatch_cost` is returned.
+ *
+ * \param adapted_flops The [wkl_insts x candidates] row-major matrix of the
+ *        throughputs of each instance on each candidate. Non-positive entries
+ *        mark the candidates that an instance must not be dispatched to.
+ * \param candidates The state versions of the candidate kernels.
+ */
+DecisionTreeNode BuildDispatchDecisionTree(
+    const Array<DynShapeVar>& shape_vars, const Array<Array<IntImm>>& wkl_insts,
+    const std::vector<float>& wkl_inst_weights,
+    const std::vector<float>& adapted_flops, const Array<StateVer>& candidates,
+    const double max_misdispatch_cost, const int max_depth = 8);
+
+/*!
+ * \brief The state versions that the leaves of the tree dispatch to, i.e., the
+ *        kernels that have to be compiled.
+ */
+Array<StateVer> GetDecisionTreeStateVers(const DecisionTreeNode& tree);
+
+/*!
+ * \brief The leaf that each workload instance is dispatched to, as the index
+ *        into `GetDecisionTreeStateVers(tree)`.
+ */
+Array<Integer> GetDecisionTreeLeafIds(const DecisionTreeNode& tree,
+                                      const Array<DynShapeVar>& shape_vars,
+                                      const Array<Array<IntImm>>& wkl_insts);
+
+
+/*!
+ * \brief The flattened form of a decision tree, i.e., a lookup table indexed by
+ *        the buckets that the thresholds of the predicates partition each
+ *        shape variable into.
+ *
+ * The bucket of shape variable k is the number of its thresholds that are
+ * smaller than the shape value, and the table cell is the bucket tuple in
+ * row-major order, hence the dispatch cost does not depend on the tree depth.
+ */
+class DispatchTable {
+ public:
+  // The sorted thresholds of each shape variable.
+  std::vector<std::vector<int64_t>> thresholds;
+  // The row-major strides of the buckets.
+  std::vector<size_t> strides;
+  // The leaf that each table cell dispatches to, as the index into `leaves`.
+  std::vector<size_t> cell_leaf_ids;
+  Array<StateVer> leaves;
+  // The leaf indices are stored in one byte each in the host code.
+  static constexpr size_t kMaxNumLeaves = 256;
+
+  DispatchTable() = default;
+  /*!
+   * \brief Flatten the tree. The table is left empty (i.e., `defined()` is
+   *        false) if the tree has any predicate other than `shape_var <= value`,
+   *        or if it has more than `max_num_cells` cells or `kMaxNumLeaves`
+   *        leaves.
+   */
+  DispatchTable(const DecisionTreeNode& tree, const Array<DynShapeVar>& shape_vars,
+                const size_t max_num_cells = 4096);
+
+  bool defined() const { return !cell_leaf_ids.empty(); }
+  size_t GetCell(const std::vector<int64_t>& shape_values) const;
+  StateVer Lookup(const std::vector<int64_t>& shape_values) const {
+    return leaves[cell_leaf_ids[GetCell(shape_values)]];
+  }
+};
+
+
 }  // namespace auto_scheduler
 }  // namespace tvm
@@ -49,6 +49,7 @@
 #define TVM_AUTO_SCHEDULER_LOOP_STATE_H_
 
 #include <dmlc/common.h>
+#include <tvm/auto_scheduler/object_pool.h>
 #include <tvm/auto_scheduler/transform_step.h>
 
 // <bojian/DietCode>
@@ -143,7 +144,7 @@ class Stage : public ObjectRef {
         StageAttributes attrs);
 
   TVM_DEFINE_OBJECT_REF_METHODS(Stage, ObjectRef, StageNode);
-  TVM_DEFINE_OBJECT_REF_COW_METHOD(StageNode);
+  TVM_DEFINE_POOLED_OBJECT_REF_COW_METHOD(StageNode);
 };
 
 /*! \brief Use stage_id to represent a stage. */
@@ -217,7 +218,7 @@ class AttachMap : public ObjectRef {
   AttachMap ApplyStageIdOffset(int start_id, int offset = 1) const;
 
   TVM_DEFINE_OBJECT_REF_METHODS(AttachMap, ObjectRef, AttachMapNode);
-  TVM_DEFINE_OBJECT_REF_COW_METHOD(AttachMapNode);
+  TVM_DEFINE_POOLED_OBJECT_REF_COW_METHOD(AttachMapNode);
 
  private:
   /*!
@@ -458,7 +459,7 @@ class State : public ObjectRef {
   // Array<Array<PrimExpr>> GetFactorizationScheme() const;
 
   TVM_DEFINE_OBJECT_REF_METHODS(State, ObjectRef, StateNode);
-  TVM_DEFINE_OBJECT_REF_COW_METHOD(StateNode);
+  TVM_DEFINE_POOLED_OBJECT_REF_COW_METHOD(StateNode);
 };
 
 }  // namespace auto_scheduler
@@ -53,6 +53,7 @@ namespace auto_scheduler {
 class SearchPolicy;
 // class SearchPolicyNode;
 class ProgramMeasurer;
+class MeasureMemo;
 
 class MeasureInput;
 class MeasureResult;
@@ -91,6 +92,12 @@ class MeasureInputNode : public Object {
 
   // <bojian/DietCode>
   Optional<Array<IntImm>> wkl_inst;
+  /*!
+   * \brief The workload instances to time a shape-generic build of the state
+   *        on (multi-shape measurement). The first one is the instance that
+   *        the costs of the measure result are reported on.
+   */
+  Optional<Array<Array<IntImm>>> multi_wkl_insts;
 
   void VisitAttrs(tvm::AttrVisitor* v) {
     v->Visit("task", &task);
@@ -98,6 +105,7 @@ class MeasureInputNode : public Object {
 
     // <bojian/DietCode>
     v->Visit("wkl_inst", &wkl_inst);
+    v->Visit("multi_wkl_insts", &multi_wkl_insts);
 
   }
 
@@ -118,11 +126,15 @@ class MeasureInput : public ObjectRef {
    * \brief The constructor.
    * \param task The SearchTask of this measure.
    * \param state The State to be measured.
+   * \param wkl_inst The workload instance to measure the state on.
+   * \param multi_wkl_insts The workload instances to time a shape-generic
+   *        build of the state on.
    */
   MeasureInput(SearchTask task, State state
   
                // <bojian/DietCode>
              , Optional<Array<IntImm>> wkl_inst = NullOpt
+             , Optional<Array<Array<IntImm>>> multi_wkl_insts = NullOpt
 
                );
 
@@ -187,6 +199,17 @@ class MeasureResultNode : public Object {
   double all_cost;
   /*! \brief The time stamps of this measurement. */
   double timestamp;
+  // <bojian/DietCode>
+  /*!
+   * \brief The mean time cost on each of the multi_wkl_insts of the measure
+   *        input, empty if it is not a multi-shape measurement.
+   */
+  Array<FloatImm> inst_costs;
+  /*!
+   * \brief The hardware event counts per run of the program (e.g., cycles and
+   *        LLC load misses), empty if they have not been collected.
+   */
+  Map<String, FloatImm> perf_counters;
 
   void VisitAttrs(tvm::AttrVisitor* v) {
     v->Visit("costs", &costs);
@@ -194,6 +217,8 @@ class MeasureResultNode : public Object {
     v->Visit("error_msg", &error_msg);
     v->Visit("all_cost", &all_cost);
     v->Visit("timestamp", &timestamp);
+    v->Visit("inst_costs", &inst_costs);
+    v->Visit("perf_counters", &perf_counters);
   }
 
   /*! \brief Do shallow copy. */
@@ -216,9 +241,13 @@ class MeasureResult : public ObjectRef {
    * \param error_msg The error message if there is any error.
    * \param all_cost The time cost of build and run.
    * \param timestamp The time stamps of this measurement.
+   * \param inst_costs The mean time cost on each of the workload instances of
+   *        a multi-shape measurement.
+   * \param perf_counters The hardware event counts per run of the program.
    */
   MeasureResult(Array<PrimExpr> costs, int error_no, String error_msg, double all_cost,
-                double timestamp);
+                double timestamp, Array<FloatImm> inst_costs = Array<FloatImm>(),
+                Map<String, FloatImm> perf_counters = Map<String, FloatImm>());
 
   TVM_DEFINE_OBJECT_REF_METHODS(MeasureResult, ObjectRef, MeasureResultNode);
 };
@@ -394,6 +423,28 @@ class LocalBuilder : public ProgramBuilder {
 /*! \brief LocalRunner that uses local CPU/GPU to measure the time cost of programs */
 class LocalRunnerNode : public ProgramRunnerNode {
  public:
+  // <bojian/DietCode>
+  /*!
+   * \brief The relative half-width of the confidence interval on the mean cost
+   *        at which the repeats stop early. 0 to always run all the repeats.
+   */
+  double adaptive_rel_ci_width = 0.;
+  /*!
+   * \brief The repeats also stop early once a program is known to be slower
+   *        than the best one of the batch by this ratio. 0 to disable.
+   */
+  double adaptive_bound_ratio = 0.;
+  /*!
+   * \brief Whether to collect the hardware event counts of the programs with
+   *        perf_event (on Linux CPUs only).
+   */
+  bool enable_perf_counters = false;
+  /*!
+   * \brief The number of interleaved rounds that the programs of each batch are
+   *        measured in. 0 to measure the programs one after another.
+   */
+  int interleaved_rounds = 0;
+
   Array<MeasureResult> Run(const Array<MeasureInput>& inputs,
                            const Array<BuildResult>& build_results, int verbose) final;
 
@@ -417,9 +468,15 @@ class LocalRunner : public ProgramRunner {
    * \param min_repeat_ms The minimum duration of one repeat in milliseconds.
    * \param cooldown_interval The cool down interval between two measurements.
    * \param enable_cpu_cache_flush Whether to flush cache on CPU between repeated measurements.
+   * \param adaptive_rel_ci_width The confidence interval width at which the repeats stop early.
+   * \param adaptive_bound_ratio The slowdown ratio at which the repeats stop early.
+   * \param enable_perf_counters Whether to collect the hardware event counts.
+   * \param interleaved_rounds The number of interleaved rounds of each batch.
    */
   LocalRunner(int timeout, int number, int repeat, int min_repeat_ms, double cooldown_interval,
-              bool enable_cpu_cache_flush);
+              bool enable_cpu_cache_flush, double adaptive_rel_ci_width = 0.,
+              double adaptive_bound_ratio = 0., bool enable_perf_counters = false,
+              int interleaved_rounds = 0);
 
   TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(LocalRunner, ProgramRunner, LocalRunnerNode);
 };
@@ -548,6 +605,10 @@ class ProgramMeasurerNode : public Object {
   void SilentMeasure(const SearchTask& task, const Array<MeasureInput>& inputs,
                      Array<MeasureResult>* results);
 
+  // <bojian/DietCode>
+  /*! \brief Get the measure memo among the callbacks, NullOpt if there is none. */
+  Optional<MeasureMemo> GetMeasureMemo() const;
+
   /*! \brief The default max continuous error setting. */
   static const int DEFAULT_MAX_CONTINUOUS_ERROR = 150;
 
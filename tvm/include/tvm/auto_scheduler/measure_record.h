@@ -32,6 +32,7 @@
 
 #include <fstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 
 namespace tvm {
@@ -72,6 +73,180 @@ class RecordToFile : public MeasureCallback {
   TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(RecordToFile, MeasureCallback, RecordToFileNode);
 };
 
+// <bojian/DietCode>
+/*!
+ * \brief An on-disk memo of the measurement results across tuning sessions.
+ *
+ * The memo is opted in by passing it as one of the measure callbacks. The
+ * program measurer then looks up the inputs in the memo before building and
+ * running them, and appends the new valid results to the memo file, which
+ * shares the format of the tuning logs.
+ */
+class MeasureMemoNode : public MeasureCallbackNode {
+ public:
+  /*! \brief The name of the memo file. */
+  String filename;
+  /*! \brief The results older than this (in seconds) are stale. Non-positive for never. */
+  double staleness_window;
+  /*! \brief The number of lookups and hits, for the hit rate report. */
+  int num_lookups = 0, num_hits = 0;
+
+  void VisitAttrs(tvm::AttrVisitor* v) {
+    v->Visit("filename", &filename);
+    v->Visit("staleness_window", &staleness_window);
+    v->Visit("num_lookups", &num_lookups);
+    v->Visit("num_hits", &num_hits);
+  }
+
+  /*!
+   * \brief Look up the result of a measure input.
+   * \return The memoized result, NullOpt if missing or stale.
+   */
+  Optional<MeasureResult> Lookup(const MeasureInput& input);
+  /*! \brief Memoize the valid results and append them to the memo file. */
+  void Record(const Array<MeasureInput>& inputs, const Array<MeasureResult>& results);
+
+  /*! \brief Nothing to be done, as the results are recorded by the measurer. */
+  void Callback(const SearchPolicy& policy, const ProgramMeasurer& measurer,
+                const Array<MeasureInput>& inputs, const Array<MeasureResult>& results) final {}
+
+  static constexpr const char* _type_key = "auto_scheduler.MeasureMemo";
+  TVM_DECLARE_FINAL_OBJECT_INFO(MeasureMemoNode, MeasureCallbackNode);
+
+ private:
+  friend class MeasureMemo;
+
+  bool IsStale(const MeasureResult& result) const;
+
+  std::unordered_map<std::string, MeasureResult> memo_;
+};
+
+/*!
+ * \brief Managed reference to MeasureMemoNode.
+ * \sa MeasureMemoNode
+ */
+class MeasureMemo : public MeasureCallback {
+ public:
+  /*!
+   * \brief The constructor, which loads the results that are not stale from the
+   *        memo file if it exists.
+   * \param filename The name of the memo file.
+   * \param staleness_window The results older than this (in seconds) are stale.
+   */
+  MeasureMemo(String filename, double staleness_window);
+
+  TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(MeasureMemo, MeasureCallback, MeasureMemoNode);
+};
+
+/*!
+ * \brief Get the fingerprint of a measure input, i.e., its workload key,
+ *        target, hardware parameters, transform steps and workload instances.
+ */
+std::string GetMeasureInputFingerprint(const MeasureInput& input);
+
+// <bojian/DietCode>
+/*!
+ * \brief A store of the tuning records in a log file, indexed by the workload
+ *        key, the target and (for dynamic tasks) the workload instance.
+ *
+ * The records of the dynamic tasks that are measured without a workload
+ * instance are keyed by the instance that their states are cherry-picked for
+ * (see ComputeDAG::CherryPickWorkloadInstance), which is the one they have
+ * been measured on, so that only the costs on the same instance are compared.
+ *
+ * Only the best `top_k` valid records of each key, and the latest dispatcher
+ * of each dynamic task, are kept. The byte offsets of those are saved to the
+ * side file `<filename>.index`, so that later loads only parse the indexed
+ * records and the ones appended after the index was saved. The index is
+ * rejected if the indexed bytes of the log file have changed since.
+ */
+class RecordStoreNode : public Object {
+ public:
+  /*! \brief The name of the log file. */
+  String filename;
+  /*! \brief The number of records kept per key. */
+  int top_k;
+
+  void VisitAttrs(tvm::AttrVisitor* v) {
+    v->Visit("filename", &filename);
+    v->Visit("top_k", &top_k);
+  }
+
+  /*!
+   * \brief Get the best record of a key.
+   * \return The (MeasureInput, MeasureResult) pair, NullOpt if there is none.
+   */
+  Optional<Array<ObjectRef>> GetBest(const String& workload_key, const Target& target,
+                                     const Optional<Array<IntImm>>& wkl_inst) const;
+  /*! \brief Get the kept records of all the keys, in the order of the keys' first appearance. */
+  std::pair<Array<MeasureInput>, Array<MeasureResult>> GetRecords() const;
+  /*! \brief Get the latest dispatchers of all the dynamic tasks. */
+  Array<DynWklDispatcher> GetDispatchers() const;
+  /*! \brief Append the records to the log file and index them. */
+  void Append(const Array<MeasureInput>& inputs, const Array<MeasureResult>& results);
+  /*! \brief Rewrite the log file with only the kept records and dispatchers. */
+  void Compact();
+
+  static constexpr const char* _type_key = "auto_scheduler.RecordStore";
+  TVM_DECLARE_FINAL_OBJECT_INFO(RecordStoreNode, Object);
+
+ private:
+  friend class RecordStore;
+
+  struct Entry {
+    double cost;
+    int64_t offset;
+    MeasureInput input;
+    MeasureResult result;
+  };
+
+  /*! \brief Index the records from `indexed_size_` to the end of the log file. */
+  void Scan();
+  /*! \brief Load the records at the offsets of the index file. */
+  bool LoadIndex();
+  /*! \brief Save the index file, unless it cannot be written (e.g., read-only directories). */
+  void SaveIndex() const;
+  /*! \brief Index one record, which starts at the byte offset `offset`. */
+  void Index(const ObjectRef& record, int64_t offset);
+  /*!
+   * \brief Get the workload instance that the input has been measured on,
+   *        NullOpt for static tasks or if the task cannot be recovered.
+   */
+  Optional<Array<IntImm>> GetMeasuredWklInst(const MeasureInput& input);
+
+  std::unordered_map<std::string, std::vector<Entry>> records_;
+  std::vector<std::string> record_keys_;
+  std::unordered_map<std::string, std::pair<int64_t, DynWklDispatcher>> dispatchers_;
+  std::vector<std::string> dispatcher_keys_;
+  /*!
+   * \brief The dynamic tasks, with their compute DAGs recovered from the
+   *        workload keys, by (workload_key, target). NullOpt if the workload
+   *        is not registered.
+   */
+  std::unordered_map<std::string, Optional<SearchTask>> dyn_tasks_;
+  /*! \brief The size of the log file that has been indexed. */
+  int64_t indexed_size_ = 0;
+  /*! \brief The FNV-1a hash of the bytes that have been indexed. */
+  uint64_t indexed_hash_ = kEmptyHash;
+
+  static constexpr uint64_t kEmptyHash = 14695981039346656037ULL;
+};
+
+class RecordStore : public ObjectRef {
+ public:
+  /*!
+   * \brief The constructor, which indexes the log file if it exists.
+   * \param filename The name of the log file.
+   * \param top_k The number of records kept per key.
+   * \param save_index Whether to save the index file if it is missing or
+   *        stale. Off for the read-only loaders, which do not write next to
+   *        the log file. Append and Compact always save it.
+   */
+  RecordStore(String filename, int top_k, bool save_index = false);
+
+  TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(RecordStore, ObjectRef, RecordStoreNode);
+};
+
 /*! \brief Log reader to load step logs from a file.*/
 class RecordReaderNode : public Object {
  public:
@@ -0,0 +1,163 @@
+#pragma once
+
+/*!
+ * \file auto_scheduler/object_pool.h
+ * \brief Round-scoped object pools for the states and steps of the search.
+ *
+ * Every search round creates and frees large numbers of short-lived
+ * copy-on-write State, Stage, Iterator and Step objects. Within a search
+ * round, the freed objects go to the free lists of the calling thread and
+ * the new ones are taken from there, which avoids the contention on malloc
+ * among the parallel_for workers. The free lists are capped, and are released
+ * once the round ends, so that the memory does not pile up over long tuning
+ * runs. Survivors of a round keep their own blocks and need no promotion.
+ */
+
+#include <tvm/runtime/memory.h>
+#include <tvm/runtime/object.h>
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace tvm {
+namespace auto_scheduler {
+
+
+/*! \brief Whether any search round is in progress. */
+TVM_DLL bool IsInSearchRound();
+
+/*! \brief The number of search rounds that have ended so far. */
+TVM_DLL uint64_t GetSearchRoundEpoch();
+
+/*!
+ * \brief The scope of a search round. The objects allocated by
+ *        make_pooled_object are recycled within the scope.
+ */
+class SearchRoundScope {
+ public:
+  TVM_DLL SearchRoundScope();
+  TVM_DLL ~SearchRoundScope();
+
+  SearchRoundScope(const SearchRoundScope&) = delete;
+  SearchRoundScope& operator=(const SearchRoundScope&) = delete;
+};
+
+
+class SearchRoundPoolAllocator
+    : public runtime::ObjAllocatorBase<SearchRoundPoolAllocator> {
+ public:
+  /*! \brief The maximum number of free blocks per object type and thread. */
+  static constexpr size_t kMaxFreeBlocksPerThread = 1 << 14;
+
+  template <typename T>
+  class Handler {
+   public:
+    using StorageType = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    template <typename... Args>
+    static T* New(SearchRoundPoolAllocator*, Args&&... args) {
+      StorageType* data = nullptr;
+      FreeList* free_list = LocalFreeList();
+      if (free_list != nullptr && !free_list->blocks.empty()) {
+        data = free_list->blocks.back();
+        free_list->blocks.pop_back();
+      } else {
+        data = new StorageType();
+      }
+      new (data) T(std::forward<Args>(args)...);
+      return reinterpret_cast<T*>(data);
+    }
+
+    static runtime::Object::FDeleter Deleter() { return Deleter_; }
+
+   private:
+    struct FreeList {
+      std::vector<StorageType*> blocks;
+      uint64_t epoch = 0;
+
+      void Release() {
+        for (StorageType* block : blocks) {
+          delete block;
+        }
+        blocks.clear();
+      }
+
+      ~FreeList() {
+        Release();
+        thread_exiting() = true;
+      }
+    };
+
+    /*!
+     * \brief Flag that the free list of the thread has been destructed, which
+     *        is trivially destructible and hence can be read at thread exit.
+     */
+    static bool& thread_exiting() {
+      static thread_local bool exiting = false;
+      return exiting;
+    }
+
+    /*!
+     * \brief Get the free list of the calling thread, with the blocks of the
+     *        rounds that have ended released. Null at thread exit.
+     */
+    static FreeList* LocalFreeList() {
+      if (thread_exiting()) {
+        return nullptr;
+      }
+      static thread_local FreeList free_list;
+      const uint64_t epoch = GetSearchRoundEpoch();
+      if (free_list.epoch != epoch) {
+        free_list.Release();
+        free_list.epoch = epoch;
+      }
+      return &free_list;
+    }
+
+    static void Deleter_(runtime::Object* objptr) {
+      T* tptr = static_cast<T*>(objptr);
+      tptr->T::~T();
+      StorageType* data = reinterpret_cast<StorageType*>(tptr);
+      if (IsInSearchRound()) {
+        FreeList* free_list = LocalFreeList();
+        if (free_list != nullptr && free_list->blocks.size() < kMaxFreeBlocksPerThread) {
+          free_list->blocks.push_back(data);
+          return;
+        }
+      }
+      delete data;
+    }
+  };
+};
+
+
+/*!
+ * \brief Allocate an object from the pools of the search round, which works
+ *        the same as make_object outside the search rounds.
+ */
+template <typename T, typename... Args>
+inline runtime::ObjectPtr<T> make_pooled_object(Args&&... args) {
+  return SearchRoundPoolAllocator().make_object<T>(std::forward<Args>(args)...);
+}
+
+
+/*!
+ * \brief Same as TVM_DEFINE_OBJECT_REF_COW_METHOD, except that the copies are
+ *        allocated from the pools of the search round.
+ */
+#define TVM_DEFINE_POOLED_OBJECT_REF_COW_METHOD(ObjectName)        \
+  ObjectName* CopyOnWrite() {                                     \
+    ICHECK(data_ != nullptr);                                     \
+    if (!data_.unique()) {                                        \
+      auto n = make_pooled_object<ObjectName>(*(operator->()));   \
+      ObjectPtr<Object>(std::move(n)).swap(data_);                \
+    }                                                             \
+    return static_cast<ObjectName*>(data_.get());                 \
+  }
+
+
+}  // namespace auto_scheduler
+}  // namespace tvm
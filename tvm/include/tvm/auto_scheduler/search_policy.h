@@ -47,6 +47,7 @@
 #include <tvm/node/node.h>
 
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -112,6 +113,40 @@ class PreloadMeasuredStates : public SearchCallback {
                                         PreloadMeasuredStatesNode);
 };
 
+/*! \brief Preload the measured states of similar tasks from a log file
+ *         (<bojian/DietCode>).
+ * The states are replayed onto the current task and used to warm-start the initial population
+ * of the evolutionary search, but are not treated as measured. */
+class PreloadTransferredStatesNode : public SearchCallbackNode {
+ public:
+  /*! \brief The name of the record log file. */
+  String filename;
+  /*! \brief The workload keys of the tasks to transfer the states from. */
+  Array<String> src_workload_keys;
+
+  void Callback(SearchPolicyNode* policy) final;
+
+  static constexpr const char* _type_key = "auto_scheduler.PreloadTransferredStates";
+  TVM_DECLARE_FINAL_OBJECT_INFO(PreloadTransferredStatesNode, SearchCallbackNode);
+};
+
+/*!
+ * \brief Managed reference to PreloadTransferredStatesNode.
+ * \sa PreloadTransferredStatesNode
+ */
+class PreloadTransferredStates : public SearchCallback {
+ public:
+  /*!
+   * \brief The constructor.
+   * \param filename The name of the record log file.
+   * \param src_workload_keys The workload keys of the tasks to transfer the states from.
+   */
+  PreloadTransferredStates(String filename, Array<String> src_workload_keys);
+
+  TVM_DEFINE_MUTABLE_OBJECT_REF_METHODS(PreloadTransferredStates, SearchCallback,
+                                        PreloadTransferredStatesNode);
+};
+
 /*! \brief Attribute keys of ops used for SearchPolicy. */
 struct SearchPolicyKey {
   /*! \brief Always apply unroll to the inner most iterator of the specificed iterators. */
@@ -138,6 +173,12 @@ class SearchPolicyNode : public Object {
 
   // <bojian/DietCode>
   std::vector<double> curr_inst_opt_prob;
+  /*!
+   * \brief Workload instances queued for re-tuning, mapped to the boost of
+   *        their optimization priority. The boosts are consumed by the next
+   *        search round.
+   */
+  std::unordered_map<size_t, double> retune_inst_boosts;
 
   void VisitAttrs(AttrVisitor* v) {
     v->Visit("search_task", &search_task);
@@ -172,12 +213,37 @@ class SearchPolicyNode : public Object {
   virtual std::pair<int, float>
   ContinueSearchOneRound(int num_measure, ProgramMeasurer measurer) = 0;
 
+  /*!
+   * \brief Queue workload instances of a dynamic task for incremental
+   *        re-tuning. The next `ContinueSearchOneRound` favors them when
+   *        picking the instance that each mutation targets.
+   * \param wkl_inst_ids The indices of the instances in `search_task->wkl_insts`.
+   * \param boost The factor that their optimization priority is scaled with.
+   */
+  void EnqueueRetuneInsts(const Array<Integer>& wkl_inst_ids, double boost);
+
   /*!
    * \brief Preload measured states from a log file to resume the state of the search policy.
    * \param log_file The name of the record log file.
    */
   void PreloadMeasuredStates(const String& log_file);
 
+  /*!
+   * \brief Preload the measured states of similar tasks from a log file, with
+   *        their throughputs rescaled to the FLOPs of the current task.
+   * \param log_file The name of the record log file.
+   * \param src_workload_keys The workload keys of the tasks to transfer the states from.
+   */
+  void PreloadTransferredStates(const String& log_file,
+                                const Array<String>& src_workload_keys);
+
+  /*!
+   * \brief Drop the transferred states that have been measured since, so that
+   *        their estimated throughputs no longer compete with the measured ones.
+   *        Called whenever the measurement results arrive.
+   */
+  void DropMeasuredTransferredStates();
+
   /*!
    * \brief Call SearchCallback with the current SearchPolicyNode
    * \param callbacks SearchCallback to be called.
@@ -199,6 +265,14 @@ class SearchPolicyNode : public Object {
   std::vector<State> measured_states_vector_;
   /*! \brief The throughputs of already measured states */
   std::vector<float> measured_states_throughputs_;
+  // <bojian/DietCode>
+  /*! \brief The states transferred from similar tasks and their estimated
+   *         throughputs on the current task. */
+  std::vector<State> transferred_states_;
+  std::vector<float> transferred_states_throughputs_;
+  /*! \brief The string format of the transferred states, to look them up in
+   *         `measured_states_set_`. */
+  std::vector<std::string> transferred_states_strs_;
 };
 
 /*!
@@ -166,6 +166,18 @@ TVM_DLL int TVMBackendParallelBarrier(int task_id, TVMParallelGroupEnv* penv);
  */
 TVM_DLL int TVMBackendRunOnce(void** handle, int (*f)(void*), void* cdata, int nbytes);
 
+// <bojian/DietCode>
+/*!
+ * \brief Count one call of the dynamic-shape dispatcher `name` into its leaf
+ *  `leaf_id`. The lowered host dispatchers call this before every kernel call,
+ *  and the counts are read with the `runtime.GetDispatchCounts` PackedFunc.
+ *
+ * \param name The name of the dispatcher.
+ * \param leaf_id The index of the leaf (i.e., of the kernel) that is called.
+ * \return 0 when no error is thrown, -1 when failure happens
+ */
+TVM_DLL int TVMBackendCountDispatch(const char* name, int leaf_id);
+
 #ifdef __cplusplus
 }  // TVM_EXTERN_C
 #endif
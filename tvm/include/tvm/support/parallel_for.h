@@ -67,6 +67,37 @@ TVM_DLL std::vector<std::vector<int>> rr_partitioner(int begin, int end, int ste
 TVM_DLL void parallel_for(int begin, int end, const std::function<void(int)>& f, int step = 1,
                           const PartitionerFuncType partitioner = rr_partitioner);
 
+/*!
+ * \brief Run the task function in parallel on a persistent work-stealing thread pool.
+ * Unlike `parallel_for`, no threads are created per call. The loop indexes are claimed in chunks
+ * by the workers of the pool and the calling thread. Idle threads steal the chunks of whichever
+ * loop is running, and a thread that waits for its loop to finish helps the other loops in the
+ * meantime, hence the calls can be nested.
+ * \param begin The start index of this parallel loop(inclusive).
+ * \param end The end index of this parallel loop(exclusive).
+ * \param f The task function to be excuted. Assert to take an int index as input with no output.
+ * \param step The traversal step to the index.
+ * \param grain_size The number of consecutive indexes claimed at a time. 0 for picking the chunk
+ * size dynamically, i.e., a fraction of the remaining indexes, so that the chunks are large at
+ * first and get smaller towards the end of the loop.
+ * \note The order of execution is not guaranteed, the for loop task should be thread independent
+ * and thread safe.
+ */
+TVM_DLL void parallel_for_dynamic(int begin, int end, const std::function<void(int)>& f,
+                                  int step = 1, int grain_size = 0);
+
+/*!
+ * \brief Set the number of threads (including the calling thread) of the pool that runs
+ * `parallel_for_dynamic`. By default, it is the value of the environment variable
+ * TVM_PARALLEL_FOR_NUM_THREADS, or the hardware concurrency if unset.
+ * \param num_threads The number of threads, which must be positive.
+ * \note This must not be called while a `parallel_for_dynamic` is running.
+ */
+TVM_DLL void SetParallelForNumThreads(int num_threads);
+
+/*! \brief Get the number of threads of the pool that runs `parallel_for_dynamic`. */
+TVM_DLL int GetParallelForNumThreads();
+
 }  // namespace support
 }  // namespace tvm
 
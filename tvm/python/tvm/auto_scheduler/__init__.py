@@ -43,7 +43,15 @@ from .measure import (
     LocalRPCMeasureContext,
     register_task_input_check_func,
 )
-from .measure_record import RecordToFile, RecordReader, load_best_record, load_records, save_records
+from .measure_record import (
+    RecordToFile,
+    RecordReader,
+    MeasureMemo,
+    RecordStore,
+    load_best_record,
+    load_records,
+    save_records,
+)
 from .relay_integration import (
     extract_tasks,
     extract_dyn_tasks,  # <bojian/DietCode>
@@ -53,14 +61,20 @@ from .relay_integration import (
 )
 from .search_task import SearchTask, TuningOptions, HardwareParams, create_task, auto_schedule
 
-from .dietcode import DynWklDispatcher, inline_dispatch, \
+from .dietcode import DynWklDispatcher, DynWklTelemetry, inline_dispatch, \
+                      make_host_dispatcher, \
                       replace_shape_vars, instantiate_dyn_args, \
-                      StateVer, DecisionTreeNode  # <bojian/DietCode>
+                      statically_validate_state, \
+                      StateVer, DecisionTreeNode, \
+                      build_dispatch_decision_tree, get_decision_tree_state_vers, \
+                      get_decision_tree_leaf_ids, \
+                      load_shape_histogram, select_wkl_insts  # <bojian/DietCode>
 
 from .search_policy import (
     EmptyPolicy,
     SketchPolicy,
     PreloadMeasuredStates,
+    PreloadTransferredStates,
     PreloadCustomSketchRule,
 )
 from .task_scheduler import TaskScheduler
@@ -142,6 +142,12 @@ class ComputeDAG(Object):
         state_obj = state if isinstance(state, StateObject) else state.state_object
         return _ffi_api.GetSchedArgsPairOnWklInst(self, state_obj, shape_vars, wkl_inst)
 
+    def get_shape_generic_sched_args_pair(self, state, shape_vars):
+        """Apply the state with the shape variables kept symbolic, so that the
+        built kernel takes the shape values as extra arguments."""
+        state_obj = state if isinstance(state, StateObject) else state.state_object
+        return _ffi_api.GetShapeGenericSchedArgsPair(self, state_obj, shape_vars)
+
     # def generate_synthetic_workload(self, state, hardware_params):
     #     state_obj = state if isinstance(state, StateObject) else state.state_object
     #     return _ffi_api.GenerateSyntheticWorkload(self, state_obj, hardware_params)
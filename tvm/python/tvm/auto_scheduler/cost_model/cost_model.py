@@ -154,6 +154,12 @@ class PythonBasedModel(CostModel):
             array_wrapper = np.ctypeslib.as_array(return_ptr, shape=ret.shape)
             array_wrapper[:] = ret
 
+        # <bojian/DietCode>
+        def predict_uncertainty_func(task, states, scores_ptr, stds_ptr):
+            scores_np_arr = _wrap_ptr_as_np_array(scores_ptr, (len(states),))
+            stds_np_arr = _wrap_ptr_as_np_array(stds_ptr, (len(states),))
+            scores_np_arr[:], stds_np_arr[:] = self.predict_with_uncertainty(task, states)
+
         self.__init_handle_by_constructor__(
             _ffi_api.PythonBasedModel, update_func, predict_func, 
             
@@ -161,7 +167,10 @@ class PythonBasedModel(CostModel):
             predict_for_all_instances_func,
             score_func,
             
-            predict_stage_func
+            predict_stage_func,
+
+            # <bojian/DietCode>
+            predict_uncertainty_func
         )
 
     def update(self, inputs, results):
@@ -199,6 +208,28 @@ class PythonBasedModel(CostModel):
     def predict_for_all_instances(self, task, states):
         raise NotImplementedError
 
+    # <bojian/DietCode>
+    def predict_with_uncertainty(self, task, states):
+        """Predict the scores of states, together with the standard deviations of the
+        predictions. By default, the predictions are deemed certain.
+
+        Parameters
+        ----------
+        search_task : SearchTask
+            The search task of states
+        states : List[State]
+            The input states
+
+        Returns
+        -------
+        scores: List[float]
+            The predicted scores for all states
+        stds: List[float]
+            The standard deviations of the predicted scores
+        """
+        scores = self.predict(task, states)
+        return scores, np.zeros(len(states))
+
 
     def predict_stages(self, task, states):
         """Predict the scores of all stages in states. This is the breakdown version of `predict`.
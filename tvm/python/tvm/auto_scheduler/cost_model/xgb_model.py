@@ -18,6 +18,7 @@
 
 """Cost model based on xgboost"""
 import multiprocessing
+import os
 import logging
 from collections import defaultdict
 
@@ -27,9 +28,17 @@ from tvm.autotvm.tuner.metric import max_curve
 from .cost_model import PythonBasedModel
 from ..feature import get_per_store_features_from_measure_pairs, \
                       get_per_store_features_from_states, \
-                      adapt_states_to_workloads
+                      adapt_states_to_workloads, \
+                      update_adaption_penalty_model, \
+                      save_adaption_penalty_model, \
+                      load_adaption_penalty_model, \
+                      get_cherry_picked_wkl_inst_ids, \
+                      get_shape_dependent_feature_mask, \
+                      get_perf_counter_metrics, \
+                      PERF_COUNTER_METRIC_NAMES
                       # <bojina/DietCode>
 from ..measure_record import RecordReader
+from ..dietcode import estimate_flop_for_inst
 
 xgb = None
 
@@ -104,6 +113,24 @@ class XGBModel(PythonBasedModel):
     adapative_training: bool = False
         Whether to use adapatie training, which reduces the training frequency when there are
         too many logs.
+    num_ensemble_models: int = 0
+        The number of extra models, each trained on a random subsample of the data, whose
+        spread serves as the uncertainty of the predictions (see `predict_with_uncertainty`).
+        0 to predict with no uncertainty.
+    shape_normalized_features: bool = False
+        Whether to normalize the features of dynamic tasks by the size of the workload instance
+        they are extracted on, and append the features that relate that instance to the one to
+        predict on (see `shape_normalize_features`). The model is then trained on the pooled
+        measurements of all the workload instances, including the per-instance costs of the
+        multi-shape measurements, and predicts on every workload instance separately.
+    perf_counter_targets: bool = False
+        Whether to train one extra model for each of the metrics derived from the hardware
+        event counts of the measurements (see `get_perf_counter_metrics`), which tell the
+        cache-bound programs from the compute-bound ones (see `predict_perf_counters`). The
+        metrics are appended to the features of the throughput model, as measured when
+        training and as predicted by the extra models otherwise (see
+        `append_perf_counter_features`). This needs the measurements from a `LocalRunner`
+        with `enable_perf_counters`.
     """
 
     def __init__(
@@ -113,6 +140,10 @@ class XGBModel(PythonBasedModel):
         seed=None,
         model_file=None,
         adapative_training=False,
+        # <bojian/DietCode>
+        num_ensemble_models=0,
+        shape_normalized_features=False,
+        perf_counter_targets=False,
     ):
         global xgb
         try:
@@ -145,6 +176,14 @@ class XGBModel(PythonBasedModel):
         self.verbose_eval = verbose_eval
         self.model_file = model_file
         self.adapative_training = adapative_training
+        # <bojian/DietCode>
+        self.num_ensemble_models = num_ensemble_models
+        self.ensemble_bsts = []
+        self.shape_normalized_features = shape_normalized_features
+        self.shape_dependent_feature_mask = None
+        self.wkl_inst_flop_cts = {}
+        self.perf_counter_targets = perf_counter_targets
+        self.perf_counter_bsts = {}
 
         super().__init__()
 
@@ -153,6 +192,8 @@ class XGBModel(PythonBasedModel):
         self.results = []
         self.last_train_length = 0
         self.inputs_feature_cache = []
+        # <bojian/DietCode> The shape-normalized (feature, label) samples of each input.
+        self.inputs_sample_cache = []
 
     def update(self, inputs, results):
         """Update the cost model according to new measurement results (training data).
@@ -171,6 +212,10 @@ class XGBModel(PythonBasedModel):
         self.inputs.extend(inputs)
         self.results.extend(results)
 
+        # <bojian/DietCode> The adaption penalties are calibrated online, on the
+        #                   new measurements only.
+        update_adaption_penalty_model(inputs, results)
+
         if (
             self.adapative_training
             and len(self.inputs) - self.last_train_length < self.last_train_length / 5
@@ -195,13 +240,44 @@ class XGBModel(PythonBasedModel):
             features[:n_cached] = self.inputs_feature_cache
             features = np.array(features, dtype=object)
         self.inputs_feature_cache = features
+        # <bojian/DietCode> The perf counter models are trained on the features as they are
+        #                   extracted, one sample per measurement.
+        if self.perf_counter_targets:
+            self._train_perf_counter_models(features, task_ids)
+        input_ids = np.arange(len(features))
+        if self.shape_normalized_features:
+            (
+                features,
+                normalized_throughputs,
+                task_ids,
+                input_ids,
+            ) = self._pool_samples_across_wkl_insts(features, normalized_throughputs, task_ids)
+        if self.perf_counter_targets:
+            features = append_perf_counter_features(
+                features, get_perf_counter_metrics(self.results)[input_ids]
+            )
         dtrain = pack_sum_xgbmatrix(
             features, normalized_throughputs, task_ids, normalized_throughputs
         )
 
         # train xgb model
-        self.bst = xgb.train(
-            self.xgb_params,
+        self.bst = self._train(self.xgb_params, dtrain, self.verbose_eval)
+
+        # <bojian/DietCode> Train the ensemble on random subsamples of the data.
+        self.ensemble_bsts = []
+        for model_id in range(self.num_ensemble_models):
+            xgb_params = dict(self.xgb_params)
+            xgb_params["subsample"] = 0.8
+            xgb_params["seed"] = self.xgb_params["seed"] + model_id + 1
+            self.ensemble_bsts.append(self._train(xgb_params, dtrain, 0))
+
+        # Update the model file if it has been set
+        if self.model_file:
+            self.save(self.model_file)
+
+    def _train(self, xgb_params, dtrain, verbose_eval):
+        return xgb.train(
+            xgb_params,
             dtrain,
             num_boost_round=10000,
             obj=pack_sum_square_error,
@@ -215,15 +291,11 @@ class XGBModel(PythonBasedModel):
                     ],
                     evals=[(dtrain, "tr")],
                     maximize=False,
-                    verbose_eval=self.verbose_eval,
+                    verbose_eval=verbose_eval,
                 )
             ],
         )
 
-        # Update the model file if it has been set
-        if self.model_file:
-            self.save(self.model_file)
-
     def predict(self, task, states):
         """Predict the scores of states
         Parameters
@@ -238,6 +310,8 @@ class XGBModel(PythonBasedModel):
             The predicted scores for all states
         """
         features = get_per_store_features_from_states(states, task)
+        # <bojian/DietCode>
+        features = self._get_model_features(task, states, features)
         if self.bst is not None and len(self.inputs) > self.num_warmup_sample:
             dtest, pack_ids = feature_to_pack_sum_xgbmatrix(features)
             raw_preds = self.bst.predict(dtest)
@@ -256,10 +330,55 @@ class XGBModel(PythonBasedModel):
         return ret
 
 
+    # <bojian/DietCode>
+    def predict_with_uncertainty(self, task, states):
+        """Predict the scores of states, together with the standard deviations of the
+        predictions of the ensemble.
+        Parameters
+        ----------
+        search_task : SearchTask
+            The search task of states
+        statse : List[State]
+            The input states
+        Returns
+        -------
+        scores: List[float]
+            The predicted scores for all states
+        stds: List[float]
+            The standard deviations of the predicted scores
+        """
+        features = get_per_store_features_from_states(states, task)
+        features = self._get_model_features(task, states, features)
+        stds = np.zeros(shape=(len(states),))
+        if self.bst is not None and len(self.inputs) > self.num_warmup_sample:
+            dtest, pack_ids = feature_to_pack_sum_xgbmatrix(features)
+            ret = predict_throughput_pack_sum(self.bst.predict(dtest), pack_ids)
+            if self.ensemble_bsts:
+                ensemble_preds = np.array(
+                    [
+                        predict_throughput_pack_sum(bst.predict(dtest), pack_ids)
+                        for bst in [self.bst] + self.ensemble_bsts
+                    ]
+                )
+                stds = np.std(ensemble_preds, axis=0)
+        else:
+            ret = np.ones(shape=(len(states),))
+
+        # Predict -inf for invalid states that failed to be lowered.
+        for idx, feature in enumerate(features):
+            if feature.min() == feature.max() == 0:
+                ret[idx] = float("-inf")
+                stds[idx] = 0.0
+
+        return ret, stds
+
     # <bojian/DietCode> Prediction function for dynamic workloads.
     def predict_for_all_instances(self, task, states):
         # copied from the above prediction function
         features = get_per_store_features_from_states(states, task)
+        if self.shape_normalized_features:
+            return self._predict_for_all_instances_shape_normalized(task, states, features)
+        features = self._get_model_features(task, states, features)
         if self.bst is not None and len(self.inputs) > self.num_warmup_sample:
             dtest, pack_ids = feature_to_pack_sum_xgbmatrix(features)
             raw_preds = self.bst.predict(dtest)
@@ -315,6 +434,8 @@ class XGBModel(PythonBasedModel):
         into a single float array.
         """
         features = get_per_store_features_from_states(states, task)
+        # <bojian/DietCode>
+        features = self._get_model_features(task, states, features)
         if self.bst is not None and len(self.inputs) > self.num_warmup_sample:
             dtest, pack_ids = feature_to_pack_sum_xgbmatrix(features)
             raw_preds = self.bst.predict(dtest)
@@ -342,6 +463,237 @@ class XGBModel(PythonBasedModel):
 
         return breakdown
 
+    # <bojian/DietCode>
+    def _train_perf_counter_models(self, features, task_ids):
+        metrics = get_perf_counter_metrics(self.results)
+        self.perf_counter_bsts = {}
+        for metric_id, name in enumerate(PERF_COUNTER_METRIC_NAMES):
+            valid = np.isfinite(metrics[:, metric_id])
+            if np.count_nonzero(valid) <= max(self.num_warmup_sample, 1):
+                continue
+            dtrain = pack_sum_xgbmatrix(
+                features[valid], metrics[valid, metric_id], np.array(task_ids)[valid]
+            )
+            self.perf_counter_bsts[name] = self._train(self.xgb_params, dtrain, 0)
+
+    def predict_perf_counters(self, task, states):
+        """Predict the metrics derived from the hardware event counts of the states.
+        Parameters
+        ----------
+        search_task : SearchTask
+            The search task of states
+        statse : List[State]
+            The input states
+        Returns
+        -------
+        metrics: Dict[str, np.ndarray]
+            The predicted metrics of all the states, for each of the names in
+            `PERF_COUNTER_METRIC_NAMES` that have enough measurements to train on
+        """
+        if not self.perf_counter_bsts:
+            return {}
+        metrics = self._predict_perf_counter_metrics(
+            get_per_store_features_from_states(states, task)
+        )
+        return {
+            name: metrics[:, metric_id]
+            for metric_id, name in enumerate(PERF_COUNTER_METRIC_NAMES)
+            if name in self.perf_counter_bsts
+        }
+
+    def _predict_perf_counter_metrics(self, features):
+        """The metrics in `PERF_COUNTER_METRIC_NAMES` predicted on the (per-store) features,
+        NaN for the metrics without a trained model."""
+        metrics = np.full((len(features), len(PERF_COUNTER_METRIC_NAMES)), np.nan)
+        if self.perf_counter_bsts:
+            dtest, pack_ids = feature_to_pack_sum_xgbmatrix(features)
+            for metric_id, name in enumerate(PERF_COUNTER_METRIC_NAMES):
+                if name in self.perf_counter_bsts:
+                    metrics[:, metric_id] = predict_throughput_pack_sum(
+                        self.perf_counter_bsts[name].predict(dtest), pack_ids
+                    )
+        return metrics
+
+    def _get_model_features(self, task, states, features, target_inst_id=None,
+                            feature_flop_cts=None, perf_counter_metrics=None):
+        """The features that the throughput model predicts on, i.e., the (shape-normalized)
+        per-store features, appended with the predicted perf counter metrics (if not given)."""
+        model_features = features
+        if self.shape_normalized_features:
+            model_features = self._shape_normalize_features(
+                task, states, features, target_inst_id, feature_flop_cts
+            )
+        if self.perf_counter_targets:
+            if perf_counter_metrics is None:
+                perf_counter_metrics = self._predict_perf_counter_metrics(features)
+            model_features = append_perf_counter_features(model_features, perf_counter_metrics)
+        return model_features
+
+    # <bojian/DietCode> Shape-normalized features for dynamic workloads.
+    def _get_wkl_inst_flop_cts(self, task):
+        """The FLOP counts of the workload instances of the task (of the task itself if it is
+        static), cached per workload key."""
+        if task.workload_key not in self.wkl_inst_flop_cts:
+            if not task.shape_vars:
+                flop_cts = [task.compute_dag.flop_ct]
+            else:
+                flop_cts = [
+                    estimate_flop_for_inst(task.compute_dag, task.shape_vars, wkl_inst)
+                    for wkl_inst in task.wkl_insts
+                ]
+            self.wkl_inst_flop_cts[task.workload_key] = np.maximum(
+                np.array(flop_cts, dtype=np.float64), 1.0
+            )
+        return self.wkl_inst_flop_cts[task.workload_key]
+
+    def _get_wkl_inst_id(self, task, wkl_inst):
+        """The index of the workload instance in task.wkl_insts, -1 if it is not there."""
+        wkl_inst = [int(v) for v in wkl_inst]
+        for inst_id, task_wkl_inst in enumerate(task.wkl_insts):
+            if [int(v) for v in task_wkl_inst] == wkl_inst:
+                return inst_id
+        return -1
+
+    def _get_feature_flop_cts(self, task, states):
+        """The FLOP counts of the workload instances that the features of the states are
+        extracted on."""
+        flop_cts = self._get_wkl_inst_flop_cts(task)
+        if not task.shape_vars:
+            return np.full((len(states),), flop_cts[0])
+        inst_ids = get_cherry_picked_wkl_inst_ids(task, states)
+        # Fall back to the largest instance if none of the instances can be cherry-picked.
+        return np.where(inst_ids >= 0, flop_cts[inst_ids], flop_cts.max())
+
+    def _shape_normalize_features(self, task, states, features, target_inst_id=None,
+                                  feature_flop_cts=None):
+        """Normalize the features of the states for predicting on the workload instance
+        `target_inst_id`, which defaults to the instances the features are extracted on."""
+        if self.shape_dependent_feature_mask is None:
+            self.shape_dependent_feature_mask = get_shape_dependent_feature_mask()
+        flop_cts = self._get_wkl_inst_flop_cts(task)
+        if feature_flop_cts is None:
+            feature_flop_cts = self._get_feature_flop_cts(task, states)
+        if target_inst_id is None:
+            target_flop_cts = feature_flop_cts
+        else:
+            target_flop_cts = np.full((len(states),), flop_cts[target_inst_id])
+        return shape_normalize_features(
+            features,
+            self.shape_dependent_feature_mask,
+            feature_flop_cts,
+            target_flop_cts,
+            flop_cts.max(),
+        )
+
+    def _get_pooled_samples(self, inp, res, feature, normalized_throughput):
+        """The shape-normalized (feature, label) samples of one measurement, one for the
+        workload instance it is measured on and one for every per-instance cost of the
+        multi-shape measurements.
+
+        The labels of the dynamic tasks are the throughputs (in TFLOPS) on the instances,
+        divided by the adaption penalties of the instances, which are multiplied back at
+        prediction (i.e., the model learns what the analytic penalties miss).
+        """
+        task = inp.task
+        feature_flop_ct = self._get_feature_flop_cts(task, [inp.state])
+        if not task.shape_vars or res.error_no != 0:
+            return [
+                (
+                    self._shape_normalize_features(
+                        task, [inp.state], [feature], feature_flop_cts=feature_flop_ct
+                    )[0],
+                    normalized_throughput,
+                )
+            ]
+        flop_cts = self._get_wkl_inst_flop_cts(task)
+        adaption_penalty = adapt_states_to_workloads(task, [inp.state], [1.0])[2][:, 0]
+
+        def get_sample(inst_id, cost):
+            label = flop_cts[inst_id] / max(adaption_penalty[inst_id], 1e-6) / cost / 1e12
+            return (
+                self._shape_normalize_features(
+                    task, [inp.state], [feature], inst_id, feature_flop_cts=feature_flop_ct
+                )[0],
+                label,
+            )
+
+        samples = []
+        inst_id = -1 if inp.wkl_inst is None else self._get_wkl_inst_id(task, inp.wkl_inst)
+        if inst_id >= 0:
+            samples.append(get_sample(inst_id, np.mean([c.value for c in res.costs])))
+        else:
+            # measured on the cherry-picked instance, with the label computed the same way
+            samples.append(
+                (
+                    self._shape_normalize_features(
+                        task, [inp.state], [feature], feature_flop_cts=feature_flop_ct
+                    )[0],
+                    normalized_throughput,
+                )
+            )
+        if inp.multi_wkl_insts is not None and len(res.inst_costs) == len(inp.multi_wkl_insts):
+            for wkl_inst, inst_cost in zip(inp.multi_wkl_insts, res.inst_costs):
+                inst_id = self._get_wkl_inst_id(task, wkl_inst)
+                if inst_id >= 0 and inst_cost.value > 0:
+                    samples.append(get_sample(inst_id, inst_cost.value))
+        return samples
+
+    def _pool_samples_across_wkl_insts(self, features, normalized_throughputs, task_ids):
+        """Replace the samples of the measurements by their shape-normalized samples on all
+        the workload instances they have been measured on, and also return the index of the
+        measurement that every sample comes from."""
+        for i in range(len(self.inputs_sample_cache), len(self.inputs)):
+            self.inputs_sample_cache.append(
+                self._get_pooled_samples(
+                    self.inputs[i], self.results[i], features[i], normalized_throughputs[i]
+                )
+            )
+        pooled_features, pooled_throughputs, pooled_task_ids, pooled_input_ids = [], [], [], []
+        for input_id, (samples, task_id) in enumerate(zip(self.inputs_sample_cache, task_ids)):
+            for feature, normalized_throughput in samples:
+                pooled_features.append(feature)
+                pooled_throughputs.append(normalized_throughput)
+                pooled_task_ids.append(task_id)
+                pooled_input_ids.append(input_id)
+        pooled_features_arr = np.empty((len(pooled_features),), dtype=object)
+        pooled_features_arr[:] = pooled_features
+        return (
+            pooled_features_arr,
+            np.array(pooled_throughputs, dtype=np.float32),
+            np.array(pooled_task_ids, dtype=np.int64),
+            np.array(pooled_input_ids, dtype=np.int64),
+        )
+
+    def _predict_for_all_instances_shape_normalized(self, task, states, features):
+        """Predict on every workload instance with the shape-normalized features, and adapt
+        the predictions with the adaption penalties."""
+        occupancy_penalty, padding_penalty, adaption_penalty = adapt_states_to_workloads(
+            task, states, [1.0] * len(states)
+        )
+        scores = np.ones(shape=(len(task.wkl_insts), len(states)))
+        if self.bst is not None and len(self.inputs) > self.num_warmup_sample:
+            feature_flop_cts = self._get_feature_flop_cts(task, states)
+            perf_counter_metrics = self._predict_perf_counter_metrics(features)
+            for inst_id in range(len(task.wkl_insts)):
+                normalized_features = self._get_model_features(
+                    task,
+                    states,
+                    features,
+                    inst_id,
+                    feature_flop_cts=feature_flop_cts,
+                    perf_counter_metrics=perf_counter_metrics,
+                )
+                dtest, pack_ids = feature_to_pack_sum_xgbmatrix(normalized_features)
+                scores[inst_id] = predict_throughput_pack_sum(self.bst.predict(dtest), pack_ids)
+        scores = scores * adaption_penalty
+
+        # Predict -inf for invalid states that failed to be lowered.
+        for idx, feature in enumerate(features):
+            if feature.min() == feature.max() == 0:
+                scores[:, idx] = float("-inf")
+
+        return occupancy_penalty, padding_penalty, scores.astype(np.float32)
+
     def update_from_file(self, file_name, n_lines=None):
         """Load measure records from a log file to update the cost model.
         This function can be used to pre-train the cost model with history log files.
@@ -370,6 +722,13 @@ class XGBModel(PythonBasedModel):
             The filename
         """
         self.bst.save_model(file_name)
+        # <bojian/DietCode> The ensemble for the uncertainty estimates and the
+        #                   learned calibration of the adaption penalties.
+        for model_id, bst in enumerate(self.ensemble_bsts):
+            bst.save_model("%s.ensemble.%d" % (file_name, model_id))
+        for name, bst in self.perf_counter_bsts.items():
+            bst.save_model("%s.perf_counter.%s" % (file_name, name))
+        save_adaption_penalty_model(file_name + ".adaption_penalty.json")
 
     def load(self, file_name: str):
         """Load the model from a file
@@ -382,6 +741,103 @@ class XGBModel(PythonBasedModel):
             self.bst = xgb.Booster(self.xgb_params)
         self.bst.load_model(file_name)
         self.num_warmup_sample = -1
+        self.ensemble_bsts = []
+        for model_id in range(self.num_ensemble_models):
+            ensemble_file_name = "%s.ensemble.%d" % (file_name, model_id)
+            if not os.path.exists(ensemble_file_name):
+                break
+            bst = xgb.Booster(self.xgb_params)
+            bst.load_model(ensemble_file_name)
+            self.ensemble_bsts.append(bst)
+        self.perf_counter_bsts = {}
+        for name in PERF_COUNTER_METRIC_NAMES:
+            perf_counter_file_name = "%s.perf_counter.%s" % (file_name, name)
+            if self.perf_counter_targets and os.path.exists(perf_counter_file_name):
+                bst = xgb.Booster(self.xgb_params)
+                bst.load_model(perf_counter_file_name)
+                self.perf_counter_bsts[name] = bst
+        if os.path.exists(file_name + ".adaption_penalty.json"):
+            load_adaption_penalty_model(file_name + ".adaption_penalty.json")
+
+
+# <bojian/DietCode>
+NUM_SHAPE_RELATIVE_FEATURES = 3
+
+
+def shape_normalize_features(features, mask, feature_flop_cts, target_flop_cts, max_flop_ct):
+    """Normalize the per-store features by the size of the workload instances they are
+    extracted on, so that the features of different instances are comparable.
+
+    The features selected by `mask` grow with the workload size. Since the features are in
+    the log space (i.e., log2(x + 1)), they are normalized by subtracting the log of the FLOP
+    count, which makes them the (log) amounts per floating point operation. Three
+    shape-relative features are appended to every row: the FLOP count of the instance the
+    features are extracted on and that of the instance to predict on, both relative to the
+    largest instance, and the log ratio of the two.
+
+    Parameters
+    ----------
+    features: np.ndarray
+        The per-store features of the states, each of shape [n_stores, vec_len]
+    mask: np.ndarray
+        The mask of the shape-dependent features, of shape [vec_len]
+    feature_flop_cts: np.ndarray
+        The FLOP counts of the instances that the features are extracted on
+    target_flop_cts: np.ndarray
+        The FLOP counts of the instances to predict on
+    max_flop_ct: float
+        The FLOP count of the largest instance
+
+    Returns
+    -------
+    features: np.ndarray
+        The normalized features, each of shape [n_stores, vec_len + NUM_SHAPE_RELATIVE_FEATURES].
+        The invalid (i.e., all-zero) features remain all-zero.
+    """
+    ret = np.empty((len(features),), dtype=object)
+    for i, feature in enumerate(features):
+        feature = np.array(feature, dtype=np.float32)
+        if feature.min() == feature.max() == 0:
+            ret[i] = np.zeros((feature.shape[0], feature.shape[1] + NUM_SHAPE_RELATIVE_FEATURES))
+            continue
+        feature[:, mask] -= np.log2(feature_flop_cts[i] + 1)
+        shape_relative_feature = [
+            feature_flop_cts[i] / max_flop_ct,
+            target_flop_cts[i] / max_flop_ct,
+            np.log2(target_flop_cts[i] / feature_flop_cts[i]),
+        ]
+        ret[i] = np.concatenate(
+            (feature, np.tile(shape_relative_feature, (feature.shape[0], 1))), axis=1
+        )
+    return ret
+
+
+def append_perf_counter_features(features, metrics):
+    """Append the metrics derived from the hardware event counts of the programs to every row
+    of their per-store features.
+
+    Parameters
+    ----------
+    features: np.ndarray
+        The per-store features of the programs, each of shape [n_stores, vec_len]
+    metrics: np.ndarray
+        The metrics in `PERF_COUNTER_METRIC_NAMES` of the programs, NaN (i.e., missing to
+        XGBoost) for the ones that are not known
+
+    Returns
+    -------
+    features: np.ndarray
+        The features, each of shape [n_stores, vec_len + len(PERF_COUNTER_METRIC_NAMES)]. The
+        invalid (i.e., all-zero) features remain all-zero.
+    """
+    ret = np.empty((len(features),), dtype=object)
+    for i, feature in enumerate(features):
+        feature = np.array(feature, dtype=np.float32)
+        if feature.min() == feature.max() == 0:
+            ret[i] = np.zeros((feature.shape[0], feature.shape[1] + metrics.shape[1]))
+            continue
+        ret[i] = np.concatenate((feature, np.tile(metrics[i], (feature.shape[0], 1))), axis=1)
+    return ret
 
 
 def feature_to_pack_sum_xgbmatrix(xs):
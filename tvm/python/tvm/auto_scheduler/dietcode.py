@@ -1,12 +1,34 @@
+import logging
+
 import tvm
 
 from tvm.runtime import Object
 from . import _ffi_api
+from .loop_state import State
+
+logger = logging.getLogger("auto_scheduler")
 
 
 # <bojian/DietCode>
 @tvm._ffi.register_object("auto_scheduler.DynWklDispatcher")
 class DynWklDispatcher(Object):
+    """Dispatcher from the workload instances of a dynamic search task to the
+    tuned states.
+
+    Parameters
+    ----------
+    search_task : SearchTask
+        The dynamic search task.
+    states : List[State]
+        The selected states.
+    inst_disp_map : Dict[int, int]
+        The mapping from the workload instance indices to the state indices.
+    """
+
+    def __init__(self, search_task, states, inst_disp_map):
+        self.__init_handle_by_constructor__(
+                _ffi_api.DynWklDispatcher, search_task, states,
+                {int(k): int(v) for k, v in inst_disp_map.items()})
 
     def dispatch(self, shape_tuple):
         sched, in_args = _ffi_api.DispatcherDispatch(
@@ -44,19 +66,114 @@ class DynWklDispatcher(Object):
     def embed_compute_dag(self, compute_dag):
         return _ffi_api.DispatcherEmbedComputeDAG(self, compute_dag)
 
+    def build(self, target="llvm", target_host=None, name="default_function"):
+        """Compile the dispatcher ahead of time into one runtime module that
+        holds the kernels of all the state versions as well as the dispatcher
+        itself.
+
+        On CPUs, the entry function `name` takes the tensors followed by the
+        shape variables, dispatches to the kernel of the given shape, and needs
+        no compilation at run time, so the module can be exported with
+        `export_library` and loaded as is. The dispatcher is lowered into a
+        decision tree or a lookup table depending on the
+        `auto_scheduler.dispatch_mode` pass config.
+        """
+        from tvm.driver.build_module import build as _build, lower_dyn_wkl_dispatcher
+
+        target = tvm.target.Target(target)
+        if target_host is None:
+            target_host = target if target.kind.name in ("llvm", "c") else "llvm"
+        ir_mod, _ = lower_dyn_wkl_dispatcher(self, target, target_host, name)
+        return _build(ir_mod, target=target, target_host=target_host, name=name)
+
+
+@tvm._ffi.register_object("auto_scheduler.DynWklTelemetry")
+class DynWklTelemetry(Object):
+    """Runtime telemetry of a deployed dispatcher.
+
+    The built dispatcher counts its calls per leaf (unless the
+    `auto_scheduler.count_dispatches` pass config is off), the serving side
+    reports the kernel latencies, possibly of a sample of the calls, through
+    `record` (or the `auto_scheduler.DynWklTelemetryRecord` PackedFunc), and
+    `retune` re-tunes the hot, under-performing workload instances and
+    hot-swaps the dispatcher.
+
+    Parameters
+    ----------
+    dispatcher : DynWklDispatcher
+        The dispatcher that is being served.
+    on_hot_swap : Optional[Callable[[DynWklDispatcher], None]]
+        Called with the new dispatcher on every hot swap, e.g., to build it
+        (with `DynWklDispatcher.build`) and replace the module that is serving.
+    name : str
+        The name that the dispatcher is built with, which its call counters
+        are kept under.
+    """
+
+    def __init__(self, dispatcher, on_hot_swap=None, name="default_function"):
+        self.__init_handle_by_constructor__(_ffi_api.DynWklTelemetry, dispatcher,
+                                            on_hot_swap, name)
+
+    @property
+    def dispatcher(self):
+        return _ffi_api.DynWklTelemetryGetDispatcher(self)
+
+    def record(self, shape_tuple, latency):
+        _ffi_api.DynWklTelemetryRecord(self, [int(v) for v in shape_tuple], latency)
+
+    def report(self):
+        """Returns a list of dicts with keys `shape`, `wkl_inst_id`,
+        `num_samples`, `mean_latency`, `latency_hist` and, if known,
+        `predicted_latency`, as well as `leaf_id` and `leaf_count` (the number
+        of calls into the leaf) for the workload instances."""
+        return [{k : v for k, v in shape_report.items()}
+                for shape_report in _ffi_api.DynWklTelemetryReport(self)]
+
+    def select_retune_insts(self, min_call_ratio=0.05, max_flops_ratio=0.8):
+        return [int(i) for i in
+                _ffi_api.DynWklTelemetrySelectRetuneInsts(self, min_call_ratio,
+                                                          max_flops_ratio)]
+
+    def hot_swap(self, dispatcher):
+        _ffi_api.DynWklTelemetryHotSwap(self, dispatcher)
+
+    def reset(self):
+        _ffi_api.DynWklTelemetryReset(self)
+
+    def retune(self, search_policy, measurer, num_measure,
+               min_call_ratio=0.05, max_flops_ratio=0.8, boost=4.0):
+        return [int(i) for i in
+                _ffi_api.RetuneHotInsts(self, search_policy, measurer, num_measure,
+                                        min_call_ratio, max_flops_ratio, boost)]
+
 
 # def inline_dispatch(skeleton_mod_host, merged_mod_dev, dyn_wkl_dispatcher):
 #     return _ffi_api.InlineDispatch(skeleton_mod_host, merged_mod_dev,
 #                                    dyn_wkl_dispatcher)
 def inline_dispatch(tensors, shape_vars, tree_classifier_root,
                     skeleton_mod_host, merged_mod_host, merged_mod_dev,
-                    name
+                    name, dispatch_mode="tree"
                     ):
+    """Inline the decision tree into the host skeleton.
+
+    `dispatch_mode` is either "tree", which lowers the tree into nested
+    branches, or "table", which flattens the tree into a lookup table on the
+    bucketed shape values so that the dispatch cost does not depend on the
+    tree depth.
+    """
     return _ffi_api.InlineDispatch(tensors, shape_vars,
                                    tree_classifier_root, 
                                    skeleton_mod_host, 
                                    merged_mod_host, merged_mod_dev,
-                                   name)
+                                   name, dispatch_mode)
+
+
+def make_host_dispatcher(tensors, shape_vars, tree_classifier_root, name,
+                         dispatch_mode="tree"):
+    """Make the host function `name` that calls into the kernels `name_{major}_{minor}`
+    of the same module following the decision tree."""
+    return _ffi_api.MakeHostDispatcher(tensors, shape_vars, tree_classifier_root,
+                                       name, dispatch_mode)
 
 
 def replace_shape_vars(wkl_func_args, shape_vars, new_shape_vars):
@@ -70,6 +187,32 @@ def instantiate_dyn_args(wkl_func_args, shape_vars, wkl_inst):
     return tuple([i.value for i in instantiated_dyn_args])
 
 
+def estimate_flop_for_inst(compute_dag, shape_vars, wkl_inst):
+    return _ffi_api.EstimateFlopForInst(compute_dag, shape_vars,
+                                        [int(v) for v in wkl_inst])
+
+def statically_validate_state(task, state, wkl_inst):
+    """Lower the state on the workload instance and estimate its resource usage
+    without building it. Returns the reason why the state is infeasible (or an
+    empty string if it is feasible), and the soft penalty on its throughput
+    (1.0 unless the local arrays of a CPU state spill out of the vector
+    registers)."""
+    if isinstance(state, State):
+        state = state.state_object
+    reason, penalty = _ffi_api.SearchPolicyUtilsStaticallyValidateState(
+                          task, state, [int(v) for v in wkl_inst])
+    return str(reason), penalty.value
+
+def estimate_task_flop_ct(task):
+    """The FLOP count of a search task. For a dynamic task, this is the average
+    over the workload instances, weighted by their frequencies."""
+    if not task.shape_vars:
+        return task.compute_dag.flop_ct
+    weight_sum = sum(w.value for w in task.wkl_inst_weights)
+    return sum(w.value * estimate_flop_for_inst(task.compute_dag, task.shape_vars, wkl_inst)
+               for wkl_inst, w in zip(task.wkl_insts, task.wkl_inst_weights)) / weight_sum
+
+
 @tvm._ffi.register_object("auto_scheduler.StateVer")
 class StateVer(Object):
     def __init__(self, major, minor):
@@ -89,3 +232,199 @@ class DecisionTreeNode(Object):
                 else_node,
                 state_ver
                 )
+
+
+def build_dispatch_decision_tree(shape_vars, wkl_insts, wkl_inst_weights,
+                                 adapted_flops, candidates,
+                                 max_misdispatch_cost=0., max_depth=8):
+    """Build the shallowest decision tree that dispatches the workload
+    instances to the candidate kernels within the misdispatch cost.
+
+    Parameters
+    ----------
+    shape_vars : List[DynShapeVar]
+        The shape variables that the predicates are made on.
+    wkl_insts : List[List[int]]
+        The workload instances.
+    wkl_inst_weights : List[float]
+        The weight of each workload instance.
+    adapted_flops : List[List[float]]
+        The [wkl_insts x candidates] throughputs of each instance on each
+        candidate. Non-positive entries mark the infeasible candidates.
+    candidates : List[StateVer]
+        The state versions of the candidate kernels.
+    max_misdispatch_cost : float
+        The maximum weighted average slowdown of the instances w.r.t. their
+        best candidates.
+    max_depth : int
+        The maximum number of levels of the tree.
+
+    Returns
+    -------
+    tree : DecisionTreeNode
+        The root of the decision tree.
+    """
+    adapted_flops = [float(flops) for row in adapted_flops for flops in row]
+    return _ffi_api.BuildDispatchDecisionTree(
+               shape_vars, wkl_insts, [float(w) for w in wkl_inst_weights],
+               adapted_flops, candidates, max_misdispatch_cost, max_depth)
+
+
+def get_decision_tree_state_vers(tree):
+    """The state versions that the leaves of the decision tree dispatch to."""
+    return _ffi_api.GetDecisionTreeStateVers(tree)
+
+
+def get_decision_tree_leaf_ids(tree, shape_vars, wkl_insts):
+    """The leaf that each workload instance is dispatched to, as the index into
+    `get_decision_tree_state_vers(tree)`."""
+    return [int(i) for i in
+            _ffi_api.GetDecisionTreeLeafIds(tree, shape_vars,
+                                            [[int(v) for v in wkl_inst]
+                                             for wkl_inst in wkl_insts])]
+
+
+# <bojian/DietCode> Workload instance selection from shape histograms.
+def load_shape_histogram(filename, delimiter=','):
+    """Load a shape histogram from a CSV file.
+
+    Every row is `dim_0, dim_1, ..., dim_{n-1}, count`. Rows that cannot be
+    parsed as integers (e.g., a header line) are skipped, and duplicated
+    shapes have their counts accumulated.
+
+    Returns
+    -------
+    shape_hist : Dict[Tuple[int], float]
+        The mapping from shape tuples to their observed frequencies.
+    """
+    import csv
+
+    shape_hist = {}
+    with open(filename, 'r') as fin:
+        for row in csv.reader(fin, delimiter=delimiter):
+            row = [v.strip() for v in row if v.strip()]
+            if len(row) < 2:
+                continue
+            try:
+                shape_tuple = tuple(int(v) for v in row[:-1])
+                count = float(row[-1])
+            except ValueError:
+                continue
+            shape_hist[shape_tuple] = shape_hist.get(shape_tuple, 0.) + count
+    return shape_hist
+
+
+def _round_up_shape(shape_tuple, align, ratio):
+    """Round every dimension up to a multiple of `align` and, if `ratio` > 1,
+    further up to the geometric grid `align * ceil(ratio ** k)`."""
+    import math
+
+    rounded = []
+    for v, a in zip(shape_tuple, align):
+        v = (v + a - 1) // a
+        if ratio > 1. and v > 1:
+            v = int(math.ceil(ratio ** math.ceil(math.log(v, ratio) - 1e-9)))
+        rounded.append(v * a)
+    return tuple(rounded)
+
+
+def select_wkl_insts(shape_hist, max_num_insts, align=1, max_num_buckets=256):
+    """Select a bounded set of representative workload instances from a
+    histogram of observed shapes.
+
+    Each observed shape is assigned to a representative that is no smaller in
+    any dimension, so that the kernel tuned for the representative can be
+    dispatched to it with padding. Shapes are first rounded up to `align` and,
+    if there are still more than `max_num_buckets` distinct ones, to a
+    geometric grid that is gradually coarsened. The buckets are then greedily
+    merged, always picking the pair whose merge adds the least expected
+    padding overhead, i.e.,
+
+        sum_{shape} freq(shape) * (prod(repr(shape)) / prod(shape) - 1),
+
+    until at most `max_num_insts` representatives remain.
+
+    Parameters
+    ----------
+    shape_hist : Union[str, Dict[Tuple[int], float]]
+        The shape histogram, or the path to a CSV file that stores it (see
+        `load_shape_histogram`).
+    max_num_insts : int
+        The maximum number of workload instances to return.
+    align : Union[int, Tuple[int]]
+        The alignment of each shape dimension.
+    max_num_buckets : int
+        The maximum number of buckets the greedy merging starts from.
+
+    Returns
+    -------
+    wkl_insts : List[Tuple[int]]
+        The representative workload instances, sorted in ascending order.
+    wkl_inst_weights : List[float]
+        The aggregated frequency of the shapes mapped to each instance.
+    """
+    import numpy as np
+
+    if isinstance(shape_hist, str):
+        shape_hist = load_shape_histogram(shape_hist)
+    shape_hist = {tuple(int(v) for v in shape_tuple) : float(freq)
+                  for shape_tuple, freq in shape_hist.items() if freq > 0}
+    assert shape_hist, "The shape histogram is empty"
+    assert max_num_insts >= 1, "max_num_insts={} must be positive".format(max_num_insts)
+    ndims = len(next(iter(shape_hist)))
+    assert all(len(shape_tuple) == ndims for shape_tuple in shape_hist), \
+           "All the shapes in the histogram must have the same rank"
+    if isinstance(align, int):
+        align = (align,) * ndims
+    max_num_buckets = max(max_num_buckets, max_num_insts)
+
+    # Every bucket keeps its representative shape (the aligned elementwise
+    # maximum of its members), its total frequency W, and
+    # S = sum(freq / prod(shape)), so that its padding overhead is
+    # prod(repr) * S - W.
+    ratio = 1.
+    while True:
+        buckets = {}
+        for shape_tuple, freq in shape_hist.items():
+            bucket = _round_up_shape(shape_tuple, align, ratio)
+            aligned_shape = _round_up_shape(shape_tuple, align, 1.)
+            repr_, W, S = buckets.get(bucket, (aligned_shape, 0., 0.))
+            buckets[bucket] = (tuple(max(a, b) for a, b in zip(repr_, aligned_shape)),
+                               W + freq,
+                               S + freq / float(np.prod(shape_tuple, dtype=np.float64)))
+        if len(buckets) <= max_num_buckets:
+            break
+        ratio = 1.0625 if ratio == 1. else ratio * 1.25
+
+    reprs = np.array([v[0] for v in buckets.values()], dtype=np.float64)
+    W = np.array([v[1] for v in buckets.values()], dtype=np.float64)
+    S = np.array([v[2] for v in buckets.values()], dtype=np.float64)
+    alive = np.ones(len(buckets), dtype=bool)
+
+    def padding_cost(reprs, W, S):
+        return np.prod(reprs, axis=-1) * S - W
+
+    while np.count_nonzero(alive) > max_num_insts:
+        idx = np.nonzero(alive)[0]
+        merged_reprs = np.maximum(reprs[idx, None, :], reprs[None, idx, :])
+        delta = padding_cost(merged_reprs, W[idx, None] + W[None, idx],
+                             S[idx, None] + S[None, idx]) \
+                - padding_cost(reprs[idx], W[idx], S[idx])[:, None] \
+                - padding_cost(reprs[idx], W[idx], S[idx])[None, :]
+        np.fill_diagonal(delta, np.inf)
+        i, j = np.unravel_index(np.argmin(delta), delta.shape)
+        i, j = idx[i], idx[j]
+        reprs[i] = np.maximum(reprs[i], reprs[j])
+        W[i] += W[j]
+        S[i] += S[j]
+        alive[j] = False
+
+    idx = np.nonzero(alive)[0]
+    total_overhead = np.sum(padding_cost(reprs[idx], W[idx], S[idx])) / np.sum(W[idx])
+    wkl_insts = [tuple(int(v) for v in reprs[i]) for i in idx]
+    wkl_inst_weights = [float(W[i]) for i in idx]
+    order = sorted(range(len(wkl_insts)), key=lambda k: wkl_insts[k])
+    logger.info("Selected {} workload instances out of {} distinct shapes, "
+                "expected padding overhead={:.2f}%"
+                .format(len(order), len(shape_hist), total_overhead * 100))
+    return [wkl_insts[k] for k in order], [wkl_inst_weights[k] for k in order]
@@ -209,7 +209,9 @@ class ApplyHistoryBest(DispatchContext):
             print("Loading records")
             # assert False, "Start of loading the records"
 
-            records = load_records(records)
+            # Only the best records are needed, which are looked up from the
+            # index of the records.
+            records = load_records(records, top_k=1 if n_lines is None else None)
 
             # <bojian/DietCode>
             # assert False, "Finished loading the records"
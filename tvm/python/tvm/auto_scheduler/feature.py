@@ -27,10 +27,13 @@ The feature specification is defined by `src/auto_scheduler/feature.cc::FeatureS
 """
 
 from typing import List, Tuple, Union, Optional
+import json
 import struct
 
 import numpy as np
 
+from tvm.tir import FloatImm
+
 from .loop_state import State, StateObject
 from .measure import MeasureInput, MeasureResult
 from . import _ffi_api
@@ -263,3 +266,103 @@ def adapt_states_to_workloads(task: "SearchTask",
     elif isinstance(states[0], StateObject):
         state_objects = states
     return [arr.asnumpy() for arr in _ffi_api.AdaptStatesToWorkloads(task, state_objects, scores)]
+
+
+def get_cherry_picked_wkl_inst_ids(task: "SearchTask",
+                                   states: List[Union[State, StateObject]]) -> np.ndarray:
+    """The index (into task.wkl_insts) of the workload instance that the features of
+    each state are extracted on (for dynamic tasks only)."""
+    if isinstance(states[0], State):
+        state_objects = [s.state_object for s in states]
+    elif isinstance(states[0], StateObject):
+        state_objects = states
+    return np.array(
+        [inst_id.value for inst_id in _ffi_api.GetCherryPickedWorkloadInstanceIds(task, state_objects)],
+        dtype=np.int64,
+    )
+
+
+# The suffixes of the feature names whose values grow with the workload size,
+# e.g., the number of float operations and the bytes accessed by each buffer.
+SHAPE_DEPENDENT_FEATURE_SUFFIXES = (
+    "_mad", "_addsub", "_mul", "_divmod", "_cmp", "_mathfunc", "_otherfunc",
+    "bool_op", "select_op", "blockIdx_x_len", "blockIdx_y_len", "blockIdx_z_len",
+    ".bytes", ".unique_bytes", ".lines", ".unique_lines", "outer_prod",
+)
+
+
+def get_shape_dependent_feature_mask(max_n_bufs: Optional[int] = None) -> np.ndarray:
+    """The mask of the features that grow with the workload size (see
+    `SHAPE_DEPENDENT_FEATURE_SUFFIXES`), which are normalized by the workload size
+    when the features are shape-normalized."""
+    names = get_per_store_feature_names(max_n_bufs)
+    return np.array(
+        [str(name).endswith(SHAPE_DEPENDENT_FEATURE_SUFFIXES) for name in names], dtype=bool
+    )
+
+
+# The metrics derived from the hardware event counts of the measure results: the
+# instructions per cycle, and the L1D load, LLC load and branch misses per kilo-instructions.
+PERF_COUNTER_METRIC_NAMES = ("ipc", "l1d_mpki", "llc_mpki", "branch_mpki")
+
+
+def get_perf_counter_metrics(results: List[MeasureResult]) -> np.ndarray:
+    """Get the metrics in `PERF_COUNTER_METRIC_NAMES` from the hardware event counts of the
+    measure results.
+
+    Parameters
+    ----------
+    results: List[MeasureResult]
+        The measure results
+
+    Returns
+    -------
+    metrics: np.ndarray
+        The metrics, of shape [len(results), len(PERF_COUNTER_METRIC_NAMES)], which are NaN
+        for the results without (all of) the needed event counts
+    """
+    metrics = np.full((len(results), len(PERF_COUNTER_METRIC_NAMES)), np.nan)
+    for i, res in enumerate(results):
+        counts = {str(name): count.value for name, count in res.perf_counters.items()}
+        instructions = counts.get("instructions", 0.0)
+        if instructions <= 0:
+            continue
+        if counts.get("cycles", 0.0) > 0:
+            metrics[i, 0] = instructions / counts["cycles"]
+        for j, name in enumerate(("l1d_load_misses", "llc_load_misses", "branch_misses")):
+            if name in counts:
+                metrics[i, j + 1] = counts[name] / instructions * 1000
+    return metrics
+
+
+def update_adaption_penalty_model(inputs, results):
+    """Update the learned calibration of the adaption penalties with the
+    per-instance costs of the multi-shape measurements (if any)."""
+    _ffi_api.UpdateAdaptionPenaltyModel(inputs, results)
+
+
+def get_adaption_penalty_exponents(task):
+    """The learned exponents of the (occupancy, padding) adaption penalties of
+    the task, (1.0, 1.0) if nothing has been learned."""
+    return tuple(w.value for w in _ffi_api.GetAdaptionPenaltyExponents(task))
+
+
+def reset_adaption_penalty_model():
+    _ffi_api.ResetAdaptionPenaltyModel()
+
+
+def save_adaption_penalty_model(file_name):
+    """Save the sufficient statistics of the adaption penalty calibration."""
+    stats = {str(workload_key): [field.value for field in fields]
+             for workload_key, fields in _ffi_api.GetAdaptionPenaltyModelStats().items()}
+    with open(file_name, "w") as fout:
+        json.dump(stats, fout)
+
+
+def load_adaption_penalty_model(file_name):
+    """Replace the adaption penalty calibration with the one saved in the file."""
+    with open(file_name, "r") as fin:
+        stats = json.load(fin)
+    _ffi_api.SetAdaptionPenaltyModelStats(
+        {workload_key: [FloatImm("float64", field) for field in fields]
+         for workload_key, fields in stats.items()})
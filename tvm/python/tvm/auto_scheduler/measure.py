@@ -73,6 +73,10 @@ logger = logging.getLogger("auto_scheduler")
 # We use 1e10 instead of sys.float_info.max for better readability in log
 MAX_FLOAT = 1e10
 
+# <bojian/DietCode>
+# The minimum number of repeats before the adaptive timing may stop early
+ADAPTIVE_MIN_REPEAT = 3
+
 
 class BuildFunc:
     """store build_func name and callable to class variable.
@@ -128,11 +132,17 @@ class MeasureInput(Object):
         The SearchTask of this measurement.
     state : Union[State, StateObject]
         The State to be measured.
+    wkl_inst : Optional[List[int]]
+        The workload instance to measure the state on.
+    multi_wkl_insts : Optional[List[List[int]]]
+        The workload instances to time a shape-generic build of the state on.
     """
 
-    def __init__(self, task, state):
+    def __init__(self, task, state, wkl_inst=None, multi_wkl_insts=None):
         state = state if isinstance(state, StateObject) else state.state_object
-        self.__init_handle_by_constructor__(_ffi_api.MeasureInput, task, state)
+        self.__init_handle_by_constructor__(
+            _ffi_api.MeasureInput, task, state, wkl_inst, multi_wkl_insts
+        )
 
     def serialize(self):
         """Custom serialization to workaround MeasureInput not exposing all its
@@ -197,13 +207,31 @@ class MeasureResult(Object):
         The time cost of build and run.
     timestamp : float
         The time stamps of this measurement.
+    inst_costs : Optional[List[float]]
+        The mean time cost on each workload instance of a multi-shape measurement.
+    perf_counters : Optional[Dict[str, float]]
+        The hardware event counts per run of the program (see `PERF_COUNTER_NAMES`).
     """
 
-    def __init__(self, costs, error_no, error_msg, all_cost, timestamp):
+    def __init__(
+        self, costs, error_no, error_msg, all_cost, timestamp, inst_costs=None, perf_counters=None
+    ):
         error_msg = error_msg if error_msg else ""
+        inst_costs = inst_costs if inst_costs else []
+        perf_counters = {
+            name: tvm.tir.FloatImm("float64", count)
+            for name, count in (perf_counters if perf_counters else {}).items()
+        }
 
         self.__init_handle_by_constructor__(
-            _ffi_api.MeasureResult, costs, error_no, error_msg, all_cost, timestamp
+            _ffi_api.MeasureResult,
+            costs,
+            error_no,
+            error_msg,
+            all_cost,
+            timestamp,
+            inst_costs,
+            perf_counters,
         )
 
 
@@ -252,7 +280,7 @@ def recover_measure_input(inp, rebuild_state=False):
     else:
         new_state = inp.state
 
-    return MeasureInput(new_task, new_state)
+    return MeasureInput(new_task, new_state, inp.wkl_inst, inp.multi_wkl_insts)
 
 
 @tvm._ffi.register_object("auto_scheduler.ProgramBuilder")
@@ -394,6 +422,27 @@ class LocalRunner(ProgramRunner):
         its actual latency during end-to-end inference.
         To make this option effective, the argument `number` should also be set to 1.
         This is only has effect on CPU task.
+    adaptive_rel_ci_width : float = 0.0
+        If positive, `repeat` becomes the maximum number of repeats, and the repeats stop
+        early once the half-width of the 95% confidence interval on the mean cost falls
+        below this fraction of the mean.
+    adaptive_bound_ratio : float = 0.0
+        If positive (and `adaptive_rel_ci_width` is positive as well), the repeats also stop
+        early once a program is known to be slower than the best one of the same batch by
+        this ratio, since it will not be picked anyway.
+    enable_perf_counters : bool = False
+        Whether to count the hardware events (cycles, instructions, L1D/LLC load misses and
+        branch misses) of each program with perf_event, which are stored in the
+        `perf_counters` of the results. This only has effect on CPU tasks on Linux, and the
+        events that the kernel does not permit counting are left out.
+    interleaved_rounds : int = 0
+        If positive, the programs of each batch are loaded together and measured in this
+        many rounds, each of which runs one repeat of every program in a rotated order,
+        instead of all the repeats of one program after another. The first valid program
+        of the batch serves as the reference kernel, which is rerun at the start of every
+        round to correct the costs of the round for frequency scaling and background load,
+        and the outliers among the corrected costs are rejected with the median absolute
+        deviation. `repeat`, the adaptive repeats and the perf counters do not apply.
     """
 
     def __init__(
@@ -404,6 +453,11 @@ class LocalRunner(ProgramRunner):
         min_repeat_ms=100,
         cooldown_interval=0.0,
         enable_cpu_cache_flush=False,
+        # <bojian/DietCode>
+        adaptive_rel_ci_width=0.0,
+        adaptive_bound_ratio=0.0,
+        enable_perf_counters=False,
+        interleaved_rounds=0,
     ):
         if enable_cpu_cache_flush:
             number = 1
@@ -417,6 +471,10 @@ class LocalRunner(ProgramRunner):
             min_repeat_ms,
             cooldown_interval,
             enable_cpu_cache_flush,
+            adaptive_rel_ci_width,
+            adaptive_bound_ratio,
+            enable_perf_counters,
+            interleaved_rounds,
         )
 
 
@@ -623,6 +681,8 @@ def _local_build_worker(inp_serialized, build_func, verbose):
     error_no = MeasureErrorNo.NO_ERROR
     error_msg = None
     args = []
+    # <bojian/DietCode> shape-generic builds take the shape values as well
+    shape_args = []
 
     try:
         # <bojian/DietCode> 
@@ -632,7 +692,12 @@ def _local_build_worker(inp_serialized, build_func, verbose):
         if task.shape_vars is not None:
             # dynamic search task
             # _ffi_api.PrintStateSplitFactors(task.compute_dag, inp.state)
-            if inp.wkl_inst is not None:
+            if inp.multi_wkl_insts is not None:
+                sch, args = task.compute_dag.get_shape_generic_sched_args_pair(
+                                inp.state, task.shape_vars
+                            )
+                shape_args = list(task.shape_vars)
+            elif inp.wkl_inst is not None:
                 print("Measuring on wkl_inst={}".format(inp.wkl_inst))
                 sch, args = task.compute_dag.get_sched_args_pair_on_wkl_inst(
                                 inp.state, task.shape_vars, inp.wkl_inst
@@ -662,7 +727,7 @@ def _local_build_worker(inp_serialized, build_func, verbose):
 
         try:
             with transform.PassContext():
-                func = build_module.build(sch, args, target=task.target)
+                func = build_module.build(sch, list(args) + shape_args, target=task.target)
             func.export_library(filename, build_func)
         # pylint: disable=broad-except
         except Exception:
@@ -901,6 +966,70 @@ def prepare_runner_args(inp, build_res):
     return args
 
 
+# <bojian/DietCode>
+def _prepare_single_shape_args(build_res, args, dev, random_fill):
+    """Copy the given arguments to the device, and randomly fill the missing ones."""
+    args = list(args)
+    # pylint: disable=consider-using-enumerate
+    for idx in range(len(args)):
+        if args[idx] is None:
+            build_res_arg = build_res.args[idx]
+            empty_array = ndarray.empty(
+                get_const_tuple(build_res_arg.shape), build_res_arg.dtype, dev
+            )
+            random_fill(empty_array)
+            args[idx] = empty_array
+        else:
+            args[idx] = ndarray.array(args[idx], dev)
+    return args
+
+
+def _prepare_multi_shape_args(inp, build_res, args, dev, random_fill):
+    """Allocate the buffers of a multi-shape measurement w.r.t. the largest workload
+    instance, and create views of them for each of the instances.
+
+    Returns
+    -------
+    inst_args : List[List[Union[NDArray, int]]]
+        The arguments of the shape-generic kernel on each workload instance, i.e., the
+        views followed by the shape values.
+    """
+    shape_vars = inp.task.shape_vars
+    multi_wkl_insts = [[int(v) for v in wkl_inst] for wkl_inst in inp.multi_wkl_insts]
+    analyzer = tvm.arith.Analyzer()
+
+    def _get_shape(tensor, wkl_inst):
+        vmap = {shape_var: tvm.tir.const(v, shape_var.dtype)
+                for shape_var, v in zip(shape_vars, wkl_inst)}
+        return tuple(int(analyzer.simplify(tvm.tir.stmt_functor.substitute(dim, vmap)))
+                     for dim in tensor.shape)
+
+    inst_shapes = [[_get_shape(arg, wkl_inst) for arg in build_res.args]
+                   for wkl_inst in multi_wkl_insts]
+    # pylint: disable=consider-using-enumerate
+    for idx in range(len(args)):
+        if args[idx] is None:
+            max_shape = tuple(max(dims) for dims in zip(*[shapes[idx] for shapes in inst_shapes]))
+            args[idx] = ndarray.empty(max_shape, build_res.args[idx].dtype, dev)
+            random_fill(args[idx])
+        else:
+            args[idx] = ndarray.array(args[idx], dev)
+    return [[arg._create_view(shape) for arg, shape in zip(args, shapes)] + wkl_inst
+            for shapes, wkl_inst in zip(inst_shapes, multi_wkl_insts)]
+
+
+def _time_multi_shape(time_f, inst_args):
+    """Time the shape-generic kernel on each workload instance. The costs on the first
+    instance are reported as the costs of the measurement."""
+    costs, inst_costs = None, []
+    for args in inst_args:
+        results = time_f(*args).results
+        if costs is None:
+            costs = results
+        inst_costs.append(float(np.mean(results)))
+    return costs, inst_costs
+
+
 def _timed_eval_func(
     inp_serialized,
     build_res,
@@ -911,11 +1040,18 @@ def _timed_eval_func(
     cooldown_interval,
     enable_cpu_cache_flush,
     verbose,
+    # <bojian/DietCode>
+    adaptive_rel_ci_width=0.0,
+    upper_bound=0.0,
+    enable_perf_counters=False,
 ):
     inp = MeasureInput.deserialize(inp_serialized)
     tic = time.time()
     error_no = 0
     error_msg = None
+    # <bojian/DietCode>
+    inst_costs = None
+    perf_counters = None
     try:
         func = module.load_module(build_res.filename)
         dev = ndarray.device(str(inp.task.target), 0)
@@ -925,14 +1061,30 @@ def _timed_eval_func(
         # the PackedFunc as an object. Currently, we pass function name to work
         # around it.
         f_prepare = "cache_flush_cpu_non_first_arg" if enable_cpu_cache_flush else ""
-        time_f = func.time_evaluator(
-            func.entry_name,
-            dev,
-            number=number,
-            repeat=repeat,
-            min_repeat_ms=min_repeat_ms,
-            f_preproc=f_prepare,
-        )
+        # <bojian/DietCode>
+        if adaptive_rel_ci_width > 0 and repeat >= ADAPTIVE_MIN_REPEAT:
+            time_f = func.adaptive_time_evaluator(
+                func.entry_name,
+                dev,
+                number=number,
+                min_repeat=ADAPTIVE_MIN_REPEAT,
+                max_repeat=repeat,
+                min_repeat_ms=min_repeat_ms,
+                rel_ci_width=adaptive_rel_ci_width,
+                # The costs of the shape-generic kernels are compared on all the
+                # workload instances, hence no bound on the first instance alone.
+                upper_bound=upper_bound if inp.multi_wkl_insts is None else 0.0,
+                f_preproc=f_prepare,
+            )
+        else:
+            time_f = func.time_evaluator(
+                func.entry_name,
+                dev,
+                number=number,
+                repeat=repeat,
+                min_repeat_ms=min_repeat_ms,
+                f_preproc=f_prepare,
+            )
     # pylint: disable=broad-except
     except Exception:
         costs = (MAX_FLOAT,)
@@ -944,19 +1096,34 @@ def _timed_eval_func(
             random_fill = tvm.get_global_func("tvm.contrib.random.random_fill", True)
             assert random_fill, "Please make sure USE_RANDOM is ON in the config.cmake"
             assert len(args) == len(build_res.args)
-            # pylint: disable=consider-using-enumerate
-            for idx in range(len(args)):
-                if args[idx] is None:
-                    build_res_arg = build_res.args[idx]
-                    empty_array = ndarray.empty(
-                        get_const_tuple(build_res_arg.shape), build_res_arg.dtype, dev
+            # <bojian/DietCode>
+            if inp.multi_wkl_insts is not None:
+                inst_args = _prepare_multi_shape_args(inp, build_res, args, dev, random_fill)
+                dev.sync()
+                costs, inst_costs = _time_multi_shape(time_f, inst_args)
+                args = inst_args[0]
+            else:
+                args = _prepare_single_shape_args(build_res, args, dev, random_fill)
+                dev.sync()
+                prof_res = time_f(*args)
+                costs = prof_res.results
+                if verbose >= 2 and hasattr(prof_res, "variance"):
+                    print(
+                        "(#samples=%d, var=%.3g)" % (len(costs), prof_res.variance),
+                        end="",
+                        flush=True,
                     )
-                    random_fill(empty_array)
-                    args[idx] = empty_array
-                else:
-                    args[idx] = ndarray.array(args[idx], dev)
-            dev.sync()
-            costs = time_f(*args).results
+
+            # <bojian/DietCode> The events are counted on the same arguments as the
+            #                   costs, and failing to count them is not an error.
+            if enable_perf_counters and dev.device_type == tvm.cpu().device_type:
+                try:
+                    perf_counters = func.perf_counter_evaluator(
+                        func.entry_name, dev, number=number, f_preproc=f_prepare
+                    )(*args)
+                # pylint: disable=broad-except
+                except Exception:
+                    perf_counters = None
 
             # <bojian/DietCode>
             # del func
@@ -979,7 +1146,163 @@ def _timed_eval_func(
             print("*", end="", flush=True)
         else:
             print("*E", end="", flush=True)  # Run error
-    return costs, error_no, error_msg, toc - tic + build_res.time_cost, toc
+    return (
+        costs,
+        error_no,
+        error_msg,
+        toc - tic + build_res.time_cost,
+        toc,
+        inst_costs,
+        perf_counters,
+    )
+
+
+# <bojian/DietCode>
+# The samples that are further than this many (scaled) median absolute deviations from
+# the median are rejected as outliers by the interleaved measurements.
+INTERLEAVED_MAD_THRESHOLD = 3.0
+
+
+def _reject_outliers(costs, threshold=INTERLEAVED_MAD_THRESHOLD):
+    """Keep the costs within `threshold` (scaled) median absolute deviations of the median.
+    The MAD is scaled by 1.4826 to be consistent with the standard deviation of normally
+    distributed costs."""
+    costs = np.array(costs, dtype=np.float64)
+    median = np.median(costs)
+    mad = 1.4826 * np.median(np.abs(costs - median))
+    if mad <= 0:
+        return tuple(costs[costs == median])
+    return tuple(costs[np.abs(costs - median) <= threshold * mad])
+
+
+def _interleaved_eval_func(
+    inps_serialized,
+    build_results,
+    args_list,
+    number,
+    rounds,
+    min_repeat_ms,
+    enable_cpu_cache_flush,
+    verbose,
+):
+    """Measure the programs of a batch in `rounds` interleaved rounds, each of which runs one
+    repeat of every program, in a rotated order so that no program is always run right
+    after another. The first valid program is pinned as the reference kernel for the whole
+    batch, which is run at the start of every round, and the costs of each round are divided
+    by the drift of the reference cost of the round w.r.t. its median. The drift correction
+    is skipped if the reference fails. The outliers of the (drift-corrected) costs are then
+    rejected with the median absolute deviation."""
+    tic = time.time()
+    f_prepare = "cache_flush_cpu_non_first_arg" if enable_cpu_cache_flush else ""
+    random_fill = tvm.get_global_func("tvm.contrib.random.random_fill", True)
+    assert random_fill, "Please make sure USE_RANDOM is ON in the config.cmake"
+
+    # The (time_f, [args of each workload instance], is_multi_shape) of each program,
+    # None if invalid.
+    progs = []
+    errors = [(0, None)] * len(build_results)
+    for prog_id, (inp_serialized, build_res, args) in enumerate(
+        zip(inps_serialized, build_results, args_list)
+    ):
+        progs.append(None)
+        if build_res is None:
+            continue
+        inp = MeasureInput.deserialize(inp_serialized)
+        try:
+            func = module.load_module(build_res.filename)
+            dev = ndarray.device(str(inp.task.target), 0)
+            time_f = func.time_evaluator(
+                func.entry_name,
+                dev,
+                number=number,
+                repeat=1,
+                min_repeat_ms=min_repeat_ms,
+                f_preproc=f_prepare,
+            )
+        # pylint: disable=broad-except
+        except Exception:
+            errors[prog_id] = (MeasureErrorNo.COMPILE_DEVICE, make_traceback_info())
+            continue
+        try:
+            assert len(args) == len(build_res.args)
+            if inp.multi_wkl_insts is not None:
+                inst_args = _prepare_multi_shape_args(inp, build_res, args, dev, random_fill)
+            else:
+                inst_args = [_prepare_single_shape_args(build_res, args, dev, random_fill)]
+            dev.sync()
+            progs[prog_id] = (time_f, inst_args, inp.multi_wkl_insts is not None)
+        # pylint: disable=broad-except
+        except Exception:
+            errors[prog_id] = (MeasureErrorNo.RUNTIME_DEVICE, make_traceback_info())
+
+    valid_prog_ids = [prog_id for prog_id, prog in enumerate(progs) if prog is not None]
+    # inst_samples[prog_id][inst_id][round_id]
+    inst_samples = [
+        [[] for _ in prog[1]] if prog is not None else [] for prog in progs
+    ]
+    ref_prog_id = valid_prog_ids[0] if valid_prog_ids else None
+    ref_samples = []
+    for round_id in range(rounds):
+        if ref_prog_id is not None:
+            ref_time_f, ref_inst_args, _ = progs[ref_prog_id]
+            try:
+                ref_samples.append(ref_time_f(*ref_inst_args[0]).results[0])
+            # pylint: disable=broad-except
+            except Exception:
+                errors[ref_prog_id] = (MeasureErrorNo.RUNTIME_DEVICE, make_traceback_info())
+                valid_prog_ids.remove(ref_prog_id)
+                ref_prog_id, ref_samples = None, []
+        if not valid_prog_ids:
+            break
+        shift = round_id % len(valid_prog_ids)
+        for prog_id in valid_prog_ids[shift:] + valid_prog_ids[:shift]:
+            time_f, inst_args, _ = progs[prog_id]
+            try:
+                for inst_id, args in enumerate(inst_args):
+                    inst_samples[prog_id][inst_id].append(time_f(*args).results[0])
+            # pylint: disable=broad-except
+            except Exception:
+                errors[prog_id] = (MeasureErrorNo.RUNTIME_DEVICE, make_traceback_info())
+        valid_prog_ids = [prog_id for prog_id in valid_prog_ids if errors[prog_id][0] == 0]
+        if ref_prog_id not in valid_prog_ids:
+            ref_prog_id, ref_samples = None, []
+
+    drifts = np.array(ref_samples) / np.median(ref_samples) if ref_samples else 1.0
+    if verbose >= 2 and ref_samples:
+        print("(drift=[%.3f, %.3f])" % (drifts.min(), drifts.max()), end="", flush=True)
+
+    toc = time.time()
+    num_progs = max(sum(build_res is not None for build_res in build_results), 1)
+    rets = []
+    for prog_id, build_res in enumerate(build_results):
+        if build_res is None:
+            rets.append(None)
+            continue
+        error_no, error_msg = errors[prog_id]
+        costs, inst_costs = (MAX_FLOAT,), None
+        if error_no == 0 and progs[prog_id] is not None:
+            # The costs on the first workload instance are reported as the costs of the
+            # multi-shape measurements, the same as `_time_multi_shape`.
+            robust_inst_costs = [
+                _reject_outliers(np.array(samples) / drifts) for samples in inst_samples[prog_id]
+            ]
+            costs = robust_inst_costs[0]
+            if progs[prog_id][2]:
+                inst_costs = [float(np.mean(inst_cost)) for inst_cost in robust_inst_costs]
+        shutil.rmtree(os.path.dirname(build_res.filename))
+        if verbose >= 1:
+            print("*" if error_no == 0 else "*E", end="", flush=True)
+        rets.append(
+            (
+                costs,
+                error_no,
+                error_msg,
+                (toc - tic) / num_progs + build_res.time_cost,
+                toc,
+                inst_costs,
+            )
+        )
+    return rets
 
 
 @tvm._ffi.register_func("auto_scheduler.local_runner.run")
@@ -993,6 +1316,11 @@ def local_run(
     cooldown_interval=0,
     enable_cpu_cache_flush=False,
     verbose=1,
+    # <bojian/DietCode>
+    adaptive_rel_ci_width=0.0,
+    adaptive_bound_ratio=0.0,
+    enable_perf_counters=False,
+    interleaved_rounds=0,
 ):
     """
     Run function of LocalRunner to test the performance of the input BuildResults.
@@ -1032,6 +1360,16 @@ def local_run(
         This is only has effect on CPU task.
     verbose: int = 1
         Verbosity level. 0 for silent, 1 to output information during program measuring.
+    adaptive_rel_ci_width : float = 0.0
+        The confidence interval width at which the repeats stop early. 0 to disable.
+    adaptive_bound_ratio : float = 0.0
+        The slowdown w.r.t. the best program of the batch at which the repeats stop early.
+        0 to disable.
+    enable_perf_counters : bool = False
+        Whether to count the hardware events of the programs (on Linux CPUs only).
+    interleaved_rounds : int = 0
+        If positive, the programs of the batch are measured in this many interleaved rounds
+        instead of one after another (see `_interleaved_eval_func`).
 
     Returns
     -------
@@ -1039,9 +1377,25 @@ def local_run(
         The measure results of these MeasureInputs.
     """
 
-    measure_results = []
     assert len(inputs) == len(build_results), "Measure input size should be equal to build results"
+    # <bojian/DietCode>
+    if interleaved_rounds > 0:
+        return _interleaved_local_run(
+            inputs,
+            build_results,
+            timeout,
+            number,
+            interleaved_rounds,
+            min_repeat_ms,
+            cooldown_interval,
+            enable_cpu_cache_flush,
+            verbose,
+        )
+
+    measure_results = []
     worker = PopenWorker()
+    # <bojian/DietCode> The best mean cost of the batch so far.
+    best_cost = None
     for inp, build_res in zip(inputs, build_results):
         if build_res.error_no != 0:
             res = (
@@ -1067,6 +1421,11 @@ def local_run(
                     cooldown_interval,
                     enable_cpu_cache_flush,
                     verbose,
+                    adaptive_rel_ci_width,
+                    best_cost * adaptive_bound_ratio
+                    if best_cost is not None and adaptive_bound_ratio > 0
+                    else 0.0,
+                    enable_perf_counters,
                 ),
             )
             if isinstance(res, TimeoutError):
@@ -1092,6 +1451,9 @@ def local_run(
 
                 # <bojian/DietCode>
                 # assert False, "RUNTIME_DEVICE error caught"
+            elif res[1] == MeasureErrorNo.NO_ERROR:
+                mean_cost = float(np.mean(res[0]))
+                best_cost = mean_cost if best_cost is None else min(best_cost, mean_cost)
 
         measure_results.append(MeasureResult(*res))
 
@@ -1101,6 +1463,81 @@ def local_run(
     return measure_results
 
 
+# <bojian/DietCode>
+def _interleaved_local_run(
+    inputs,
+    build_results,
+    timeout,
+    number,
+    rounds,
+    min_repeat_ms,
+    cooldown_interval,
+    enable_cpu_cache_flush,
+    verbose,
+):
+    """Measure the whole batch in one worker with `_interleaved_eval_func`. The timeout
+    scales with the number of programs, since every program is run as many times as it is
+    by `_timed_eval_func`. If the worker times out or crashes, the programs are measured
+    again one after another by `local_run`, so that only the programs that hang or crash
+    fail."""
+    valid_build_results = [
+        build_res if build_res.error_no == 0 else None for build_res in build_results
+    ]
+    num_valid = sum(build_res is not None for build_res in valid_build_results)
+    rets = [None] * len(inputs)
+    if num_valid > 0:
+        rets = call_func_with_timeout(
+            PopenWorker(),
+            timeout * num_valid,
+            _interleaved_eval_func,
+            args=(
+                [inp.serialize() for inp in inputs],
+                valid_build_results,
+                [
+                    prepare_runner_args(inp, build_res) if build_res is not None else None
+                    for inp, build_res in zip(inputs, valid_build_results)
+                ],
+                number,
+                rounds,
+                min_repeat_ms,
+                enable_cpu_cache_flush,
+                verbose,
+            ),
+        )
+        time.sleep(cooldown_interval)
+        if isinstance(rets, Exception):
+            if verbose >= 1:
+                print("*T" if isinstance(rets, TimeoutError) else "*E", end="", flush=True)
+            return local_run(
+                inputs,
+                build_results,
+                timeout,
+                number,
+                rounds,
+                min_repeat_ms,
+                cooldown_interval,
+                enable_cpu_cache_flush,
+                verbose,
+            )
+
+    measure_results = []
+    for build_res, res in zip(build_results, rets):
+        if build_res.error_no != 0:
+            res = (
+                (MAX_FLOAT,),
+                build_res.error_no,
+                build_res.error_msg,
+                build_res.time_cost,
+                time.time(),
+            )
+        measure_results.append(MeasureResult(*res))
+
+    if verbose >= 1:
+        print("", flush=True)
+
+    return measure_results
+
+
 def _rpc_run(
     inp_serialized,
     build_res,
@@ -1121,6 +1558,8 @@ def _rpc_run(
     tic = time.time()
     error_no = 0
     error_msg = None
+    # <bojian/DietCode>
+    inst_costs = None
     try:
         # upload built module
         remote = request_remote(key, host, port, priority, timeout)
@@ -1157,31 +1596,40 @@ def _rpc_run(
             ), "Please make sure USE_RANDOM is ON in the config.cmake on the remote devices"
 
             assert len(args) == len(build_res.args)
-            # pylint: disable=consider-using-enumerate
-            for idx in range(len(args)):
-                if args[idx] is None:
-                    build_res_arg = build_res.args[idx]
-                    empty_array = ndarray.empty(
-                        get_const_tuple(build_res_arg.shape), build_res_arg.dtype, dev
-                    )
-                    random_fill(empty_array)
-                    args[idx] = empty_array
-                else:
-                    args[idx] = ndarray.array(args[idx], dev)
+            # <bojian/DietCode>
+            if inp.multi_wkl_insts is not None:
+                inst_args = _prepare_multi_shape_args(inp, build_res, args, dev, random_fill)
+            else:
+                # pylint: disable=consider-using-enumerate
+                for idx in range(len(args)):
+                    if args[idx] is None:
+                        build_res_arg = build_res.args[idx]
+                        empty_array = ndarray.empty(
+                            get_const_tuple(build_res_arg.shape), build_res_arg.dtype, dev
+                        )
+                        random_fill(empty_array)
+                        args[idx] = empty_array
+                    else:
+                        args[idx] = ndarray.array(args[idx], dev)
+                inst_args = [args]
             dev.sync()
 
             # First run for check that the kernel is correct
 
             # <bojian/DietCode>
             # try:
-            func.entry_func(*args)
+            func.entry_func(*inst_args[0])
             # except Exception:
             #     assert False, "Exception caught when executing func={} with args={}" \
             #                   .format(func, args)
 
             dev.sync()
 
-            costs = time_f(*args).results
+            # <bojian/DietCode>
+            if inp.multi_wkl_insts is not None:
+                costs, inst_costs = _time_multi_shape(time_f, inst_args)
+            else:
+                costs = time_f(*args).results
 
             # <bojian/DietCode>
             # print(costs)
@@ -1218,7 +1666,7 @@ def _rpc_run(
         else:
             print("*E", end="")  # Run error
 
-    return costs, error_no, error_msg, toc - tic + build_res.time_cost, toc
+    return costs, error_no, error_msg, toc - tic + build_res.time_cost, toc, inst_costs
 
 
 def _rpc_run_worker(args):
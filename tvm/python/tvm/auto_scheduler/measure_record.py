@@ -51,6 +51,102 @@ class RecordToFile(MeasureCallback):
         self.__init_handle_by_constructor__(_ffi_api.RecordToFile, filename)
 
 
+# <bojian/DietCode>
+@tvm._ffi.register_object("auto_scheduler.MeasureMemo")
+class MeasureMemo(MeasureCallback):
+    """
+    An on-disk memo of the measurement results across tuning sessions. Passing it
+    as one of the measure callbacks makes the program measurer skip the inputs
+    that have been measured before (with the same workload key, target, hardware
+    parameters, transform steps and workload instances).
+
+    Parameters
+    ----------
+    filename : str
+        The memo file, which shares the format of the tuning logs.
+    staleness_window : float
+        The results older than this (in seconds) are stale and measured again.
+        Non-positive for never.
+    """
+
+    def __init__(self, filename, staleness_window=0.0):
+        dirname = os.path.dirname(os.path.abspath(filename))
+        if not os.path.exists(dirname):
+            os.makedirs(dirname)
+        self.__init_handle_by_constructor__(_ffi_api.MeasureMemo, filename, staleness_window)
+
+    @property
+    def hit_rate(self):
+        """The ratio of the lookups that hit the memo."""
+        return self.num_hits / self.num_lookups if self.num_lookups > 0 else 0.0
+
+
+# <bojian/DietCode>
+@tvm._ffi.register_object("auto_scheduler.RecordStore")
+class RecordStore(Object):
+    """
+    A store of the tuning records in a log file, indexed by the workload key, the target
+    and (for dynamic tasks) the workload instance. Only the best `top_k` valid records of
+    each key, and the latest dispatcher of each dynamic task, are kept. The byte offsets of
+    those are saved to the side file `<filename>.index`, so that later loads only parse the
+    indexed records and the ones appended after. The index is rejected if the indexed bytes of
+    the log file have changed since.
+
+    The records of dynamic tasks that are measured without a workload instance are keyed by
+    the instance that their states are cherry-picked for, which is the one they are measured
+    on.
+
+    Parameters
+    ----------
+    filename : str
+        The log file.
+    top_k : int = 1
+        The number of records kept per key.
+    save_index : bool = False
+        Whether to save the index file if it is missing or stale. Appending to or compacting
+        the log file always saves it (unless its directory is not writable).
+    """
+
+    def __init__(self, filename, top_k=1, save_index=False):
+        self.__init_handle_by_constructor__(_ffi_api.RecordStore, filename, top_k, save_index)
+
+    def best(self, workload_key, target, wkl_inst=None):
+        """Get the best record of a key.
+
+        Returns
+        -------
+        ret : Optional[Tuple[MeasureInput, MeasureResult]]
+            The best record, None if there is none.
+        """
+        if isinstance(target, str):
+            target = tvm.target.Target(target)
+        ret = _ffi_api.RecordStoreGetBest(self, workload_key, target, wkl_inst)
+        return (ret[0], ret[1]) if ret is not None else None
+
+    def records(self):
+        """Get the kept records of all the keys.
+
+        Returns
+        -------
+        inputs : List[MeasureInput]
+        results : List[MeasureResult]
+        """
+        inputs, results = _ffi_api.RecordStoreGetRecords(self)
+        return inputs, results
+
+    def dispatchers(self):
+        """Get the latest dispatchers of all the dynamic tasks."""
+        return _ffi_api.RecordStoreGetDispatchers(self)
+
+    def append(self, inputs, results):
+        """Append the records to the log file and index them."""
+        _ffi_api.RecordStoreAppend(self, inputs, results)
+
+    def compact(self):
+        """Rewrite the log file with only the kept records and dispatchers."""
+        _ffi_api.RecordStoreCompact(self)
+
+
 @tvm._ffi.register_object("auto_scheduler.RecordReader")
 class RecordReader(Object):
     """
@@ -190,7 +286,7 @@ def dump_record_to_string(inp, res):
     return _ffi_api.WriteMeasureRecords(inp, res)
 
 
-def load_records(filename):
+def load_records(filename, top_k=None):
     """
     Load measurement records from a file.
 
@@ -198,6 +294,9 @@ def load_records(filename):
     ----------
     filename : str
         File name to load log from.
+    top_k : Optional[int]
+        If not None, only load the best `top_k` valid records of each workload key, target
+        and workload instance, and the latest dispatchers, through the indexed RecordStore.
 
     Returns
     -------
@@ -212,6 +311,10 @@ def load_records(filename):
     """
     # <bojian/DietCode>
     # return zip(*RecordReader(filename).read_lines())
+    if top_k is not None:
+        store = RecordStore(filename, top_k)
+        inputs, results = store.records()
+        return zip(inputs, results), store.dispatchers()
     inputs, results, dispatchers = RecordReader(filename).read_lines()
     return zip(inputs, results), dispatchers
 
@@ -259,7 +362,10 @@ def load_best_record(filename, workload_key=None, target=None, include_compatibl
     result : auto_scheduler.measure.MeasureResult
         The best State's MeasureResult from this log fine.
     """
-    log_reader = RecordReader(filename)
+    # <bojian/DietCode> Only the best record of each workload key, target and
+    #                   workload instance can be the best one, hence the index.
+    # log_reader = RecordReader(filename)
+    log_reader = zip(*RecordStore(filename).records())
     best_cost = 1e30
     best_inp = None
     best_res = None
@@ -366,9 +472,12 @@ def distill_record_file(in_file, out_file):
 def main():
     """The main function for CLI."""
     parser = argparse.ArgumentParser()
-    parser.add_argument("--mode", choices=["distill"], default="distill")
+    parser.add_argument("--mode", choices=["distill", "compact"], default="distill")
     parser.add_argument("-i", "--input", type=str, help="input file")
     parser.add_argument("-o", "--output", type=str, default=None, help="output file")
+    parser.add_argument(
+        "-k", "--top-k", type=int, default=1, help="records kept per key in the compact mode"
+    )
 
     args = parser.parse_args()
     logging.basicConfig()
@@ -377,12 +486,18 @@ def main():
     if args.mode == "distill":
         args.output = args.output or args.input + ".best.json"
         distill_record_file(args.input, args.output)
+    # <bojian/DietCode>
+    elif args.mode == "compact":
+        RecordStore(args.input, args.top_k).compact()
+        logger.info("Compacted %s to the best %d records per key", args.input, args.top_k)
 
 
 """
 Usage:
 * Distill the best entries from a large log file
 e.g. python -m tvm.auto_scheduler.measure_record --mode distill -i input.json
+* Compact a large log file in place to the best k entries per key
+e.g. python -m tvm.auto_scheduler.measure_record --mode compact -i input.json -k 4
 """
 if __name__ == "__main__":
     main()
@@ -46,6 +46,7 @@ from .dispatcher import DispatchContext
 from .search_task import SearchTask
 from .utils import get_const_tuple
 from .workload_registry import register_workload_tensors
+from .dietcode import select_wkl_insts  # <bojian/DietCode>
 
 logger = logging.getLogger("auto_scheduler")
 
@@ -235,7 +236,7 @@ def cache_dyn_func(func, prim_fn_var):
     return func
 
 
-def extract_dyn_tasks(mod, params, target):
+def extract_dyn_tasks(mod, params, target, max_num_wkl_insts=None):
     target, _ = Target.check_and_update_host_consist(target, None)
     env = TracingEnvironment(TracingMode.EXTRACT_COMPLEX_TASK_ONLY)
 
@@ -309,12 +310,20 @@ def extract_dyn_tasks(mod, params, target):
             shape_value_freq_pairs[inst.shape_tuple] = inst.weight * 1.
             weight += inst.weight
         print("shape_value_freq_pairs={}".format(shape_value_freq_pairs))
+        if max_num_wkl_insts is not None:
+            wkl_insts, wkl_inst_weights = \
+                    select_wkl_insts(shape_value_freq_pairs, max_num_wkl_insts)
+        else:
+            wkl_insts = list(shape_value_freq_pairs.keys())
+            wkl_inst_weights = list(shape_value_freq_pairs.values())
+        dyn_args = tuple([tir.DynShapeVar(v) for v in shape_vars])
         tasks.append(
                 SearchTask(func=wkl_func,
-                           args=tuple([tir.DynShapeVar(v) for v in shape_vars]),
+                           args=dyn_args,
                            target=target,
-                           shape_vars=shape_vars,
-                           shape_value_freq_pairs=shape_value_freq_pairs
+                           shape_vars=list(dyn_args),
+                           wkl_insts=wkl_insts,
+                           wkl_inst_weights=wkl_inst_weights
                            )
                 )
 
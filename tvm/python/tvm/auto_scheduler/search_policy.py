@@ -61,6 +61,29 @@ class PreloadMeasuredStates(SearchCallback):
         self.__init_handle_by_constructor__(_ffi_api.PreloadMeasuredStates, filename)
 
 
+@tvm._ffi.register_object("auto_scheduler.PreloadTransferredStates")
+class PreloadTransferredStates(SearchCallback):
+    """A SearchCallback to warm-start a search policy with the measured states of similar tasks
+    (<bojian/DietCode>).
+
+    The states are replayed onto the task of the search policy, and their throughputs are
+    rescaled to its FLOPs. They join the initial population of the evolutionary search, but are
+    not treated as measured.
+
+    Parameters
+    ----------
+    filename : str
+        The name of the record file.
+    src_workload_keys : List[str]
+        The workload keys of the tasks to transfer the states from.
+    """
+
+    def __init__(self, filename, src_workload_keys):
+        self.__init_handle_by_constructor__(
+            _ffi_api.PreloadTransferredStates, filename, src_workload_keys
+        )
+
+
 @tvm._ffi.register_object("auto_scheduler.PreloadCustomSketchRule")
 class PreloadCustomSketchRule(SearchCallback):
     """
@@ -118,6 +141,20 @@ class SearchPolicy(Object):
         """
         return _ffi_api.SearchPolicyContinueSearchOneRound(self, num_measure, measurer)
 
+    def enqueue_retune_insts(self, wkl_inst_ids, boost=4.0):
+        """
+        Queue workload instances of a dynamic task so that the next search round
+        favors them (<bojian/DietCode>).
+
+        Parameters
+        ----------
+        wkl_inst_ids: List[int]
+            The indices of the workload instances in the search task.
+        boost: float = 4.0
+            The factor that their optimization priority is scaled with.
+        """
+        _ffi_api.SearchPolicyEnqueueRetuneInsts(self, wkl_inst_ids, boost)
+
     def set_verbose(self, verbose):
         """
         Set the verbosity level of the search policy.
@@ -191,6 +228,24 @@ class SketchPolicy(SearchPolicy):
         "max_innermost_split_factor": 64,
         "max_vectorize_size": 16,
         "disable_change_compute_location": 0,
+        # <bojian/DietCode> Time each state on this many more workload instances
+        # with a shape-generic build (multi-shape measurement).
+        "num_multi_shape_measure_insts": 0,
+        # <bojian/DietCode> Pick the states to measure by "eps_greedy", or by the
+        # upper confidence bound ("ucb") or the expected improvement ("ei") of the
+        # cost model predictions.
+        "batch_selection": "eps_greedy",
+        "ucb_kappa": 1.0,
+        # <bojian/DietCode> Trade the latency of the final dispatch for fewer kernels
+        # and less code: the costs of every distinct kernel and of every KiB of
+        # lowered code, relative to the mean slowdown of the workload instances.
+        "dispatcher_kernel_weight": 0.0,
+        "dispatcher_code_size_weight": 0.0,
+        # <bojian/DietCode> Shift the sampling budget towards the sketches with the
+        # better best predicted and measured scores, and drop the ones whose upper
+        # bound (with the predictions raised by ucb_kappa standard deviations)
+        # relative to the best sketch falls below this threshold.
+        "sketch_prune_threshold": 0.0,
     }
 
     def __init__(
@@ -241,6 +296,33 @@ class SketchPolicy(SearchPolicy):
                 print(s)
         return sketches
 
+    def get_sketch_id(self, state):
+        """Get the sketch that a state is sampled from, among the sketches of the search.
+        This python interface is mainly used for debugging and testing.
+
+        Parameters
+        ----------
+        state : State
+            The state
+
+        Returns
+        -------
+        sketch_id : int
+            The index of the sketch, -1 if there is none (e.g., before the search starts).
+        """
+        return _ffi_api.SketchPolicyGetSketchId(self, state)
+
+    def get_dropped_sketch_ids(self):
+        """Get the sketches dropped by the sketch pruning (see `sketch_prune_threshold`).
+        This python interface is mainly used for debugging and testing.
+
+        Returns
+        -------
+        sketch_ids : List[int]
+            The indices of the dropped sketches.
+        """
+        return [int(sketch_id) for sketch_id in _ffi_api.SketchPolicyGetDroppedSketchIds(self)]
+
     def sample_initial_population(self):
         """Sample initial population.
         This python interface is mainly used for debugging and testing.
@@ -254,6 +336,18 @@ class SketchPolicy(SearchPolicy):
         states = _ffi_api.SketchPolicySampleInitialPopulation(self)
         return states
 
+    def get_seed_states(self):
+        """Get the measured states, and those transferred from similar tasks, that join the
+        initial population of the evolutionary search (<bojian/DietCode>).
+        This python interface is mainly used for debugging and testing.
+
+        Returns
+        -------
+        states: List[State]
+            The seed states
+        """
+        return _ffi_api.SketchPolicyGetSeedStates(self)
+
     def evolutionary_search(self, init_populations, out_size):
         """Perform evolutionary search.
         This python interface is mainly used for debugging and testing.
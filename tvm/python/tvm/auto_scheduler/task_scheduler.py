@@ -29,11 +29,16 @@ import logging
 
 import numpy as np
 
-from .search_policy import SearchPolicy, SketchPolicy, PreloadMeasuredStates
+from tvm.te.tensor import ComputeOp
+
+from .search_policy import SearchPolicy, SketchPolicy, PreloadMeasuredStates, \
+                           PreloadTransferredStates
 from .cost_model import RandomModel, XGBModel
 from .utils import array_mean
 from .measure import ProgramMeasurer
 from .measure_record import RecordReader
+from .dietcode import estimate_flop_for_inst, estimate_task_flop_ct  # <bojian/DietCode>
+from .feature import get_cherry_picked_wkl_inst_ids  # <bojian/DietCode>
 from . import _ffi_api
 
 logger = logging.getLogger("auto_scheduler")
@@ -48,6 +53,8 @@ def make_search_policies(
     load_model_file=None,
     load_log_file=None,
     adapative_training=False,
+    transfer_log_file=None,
+    transfer_src_keys=None,
 ):
     """Make a list of search policies for a list of search tasks.
     It creates one policy per task.
@@ -74,6 +81,12 @@ def make_search_policies(
     adapative_training: bool = False
         Option used by XGBModel to reduce the model training frequency when there're too
         many logs.
+    transfer_log_file: Optional[str]
+        Warm-start the cost model and the initial population of every task with the records of
+        its similar tasks in this file (<bojian/DietCode>).
+    transfer_src_keys: Optional[List[List[str]]]
+        The workload keys of the similar tasks of every task, as returned by
+        `find_transfer_sources`.
 
     Returns
     -------
@@ -97,6 +110,13 @@ def make_search_policies(
             elif load_log_file:
                 logger.info("TaskScheduler: Reload measured states and train the model...")
                 cost_model.update_from_file(load_log_file)
+            # <bojian/DietCode>
+            if transfer_log_file and transfer_src_keys:
+                logger.info("TaskScheduler: Warm-start the model with the similar tasks...")
+                _update_model_from_similar_tasks(
+                    cost_model, transfer_log_file,
+                    set(key for src_keys in transfer_src_keys for key in src_keys)
+                )
         elif model_type == "random":
             cost_model = RandomModel()
         else:
@@ -107,17 +127,24 @@ def make_search_policies(
                 # use the log file to restore the status of search policies.
                 init_search_callbacks = [PreloadMeasuredStates(load_log_file)]
             else:
-                init_search_callbacks = None
-            search_policies = [
-                SketchPolicy(
-                    task,
-                    cost_model,
-                    params=search_policy_params,
-                    verbose=verbose,
-                    init_search_callbacks=init_search_callbacks,
+                init_search_callbacks = []
+            search_policies = []
+            for task_idx, task in enumerate(tasks):
+                task_init_search_callbacks = list(init_search_callbacks)
+                # <bojian/DietCode>
+                if transfer_log_file and transfer_src_keys and transfer_src_keys[task_idx]:
+                    task_init_search_callbacks.append(
+                        PreloadTransferredStates(transfer_log_file, transfer_src_keys[task_idx])
+                    )
+                search_policies.append(
+                    SketchPolicy(
+                        task,
+                        cost_model,
+                        params=search_policy_params,
+                        verbose=verbose,
+                        init_search_callbacks=task_init_search_callbacks or None,
+                    )
                 )
-                for task in tasks
-            ]
         else:
             raise ValueError("Invalid search policy: " + search_policy)
     else:
@@ -130,7 +157,7 @@ def make_search_policies(
     return search_policies
 
 
-def derive_similarity_tag(dag, log_base=1.618):
+def derive_similarity_tag(dag, log_base=1.618, flop_ct=None):
     """Derive the tag for similarity check from one computational DAG.
     The DAGs with the same tag are considered as similar tasks.
 
@@ -144,6 +171,8 @@ def derive_similarity_tag(dag, log_base=1.618):
         The input computational DAG
     log_base: float = 1.618
         The base of log to normalize FLOPS
+    flop_ct: Optional[float]
+        The FLOP count to use instead of `dag.flop_ct` (e.g., for dynamic tasks).
 
     Returns
     -------
@@ -156,10 +185,92 @@ def derive_similarity_tag(dag, log_base=1.618):
         if tag:
             ret += op.attrs["auto_scheduler_task_scheduler_tag"] + "_"
     if ret:
-        ret += "%d" % int(math.log(dag.flop_ct + 1, log_base))
+        flop_ct = dag.flop_ct if flop_ct is None else flop_ct
+        ret += "%d" % int(math.log(flop_ct + 1, log_base))
     return ret
 
 
+# <bojian/DietCode>
+def derive_structure_tag(dag):
+    """Derive the tag for transferring the measured states from one computational DAG.
+    Unlike `derive_similarity_tag`, the tag does not depend on the shapes, so that, e.g., dense
+    layers with different K and N (or dynamic ones) share the same tag.
+
+    The tag format is <op1-tag>:<num-spatial-axes>:<num-reduce-axes>_<op2-tag>... where an
+    op tag is its "auto_scheduler_task_scheduler_tag" attribute if any, else its TOPI tag.
+
+    Parameters
+    ----------
+    dag: ComputeDAG
+        The input computational DAG
+
+    Returns
+    -------
+    tag: str
+        The tag of this computational DAG, "" if no compute op has been tagged.
+    """
+    ret = []
+    for op in dag.ops:
+        if not isinstance(op, ComputeOp):
+            continue
+        tag = op.attrs.get("auto_scheduler_task_scheduler_tag", None) if op.attrs else None
+        tag = tag if tag else op.tag
+        if not tag:
+            return ""
+        ret.append("%s:%d:%d" % (tag, len(op.axis), len(op.reduce_axis)))
+    return "_".join(ret)
+
+
+def find_transfer_sources(tasks, log_file):
+    """Find, for every task, the structurally similar tasks that have measurement records in the
+    log file (<bojian/DietCode>).
+
+    Parameters
+    ----------
+    tasks: List[SearchTask]
+        The tasks to transfer the measured states to.
+    log_file: str
+        The record log file.
+
+    Returns
+    -------
+    src_keys: List[List[str]]
+        The workload keys of the similar tasks of every task.
+    """
+    tag_to_src_keys = {}
+    visited_keys = set()
+    for inp, _ in RecordReader(log_file):
+        key = (inp.task.workload_key, inp.task.target.kind.name)
+        if key in visited_keys:
+            continue
+        visited_keys.add(key)
+        try:
+            tag = derive_structure_tag(inp.task.compute_dag)
+        except Exception:  # pylint: disable=broad-except
+            # The workload of the record might have not been registered.
+            continue
+        if tag:
+            tag_to_src_keys.setdefault((tag, key[1]), []).append(key[0])
+
+    src_keys = []
+    for task in tasks:
+        tag = derive_structure_tag(task.compute_dag)
+        candidate_keys = tag_to_src_keys.get((tag, task.target.kind.name), []) if tag else []
+        src_keys.append([key for key in candidate_keys if key != task.workload_key])
+    return src_keys
+
+
+def _update_model_from_similar_tasks(cost_model, log_file, src_keys):
+    """Train the cost model with the records of the given workload keys."""
+    inputs, results = [], []
+    for inp, res in RecordReader(log_file):
+        if inp.task.workload_key in src_keys:
+            inputs.append(inp)
+            results.append(res)
+    if inputs:
+        cost_model.update(inputs, results)
+
+
 class TaskScheduler:
     """
     Allocate the time resources when tuning multiple tasks together.
@@ -175,7 +286,10 @@ class TaskScheduler:
         sum(weight[t] * latency[t]), where weight[t] is the weight of a task
         and the lantecy[t] is the lantecy of the task.
         If not provided, the task scheduer will assign equal weights to all
-        tasks (i.e., the objective function is sum(latency[t])).
+        tasks (i.e., the objective function is sum(latency[t])), except for
+        the dynamic tasks, whose latency is the expected latency over their
+        workload instances and are hence weighted by the sum of the instance
+        weights, as if every instance were a task by itself.
     objective_func: Optional[Callable[List[float] -> float]]
         The objective function to be minimized.
         The objective function accepts the current latencies of all tasks and returns the
@@ -202,6 +316,9 @@ class TaskScheduler:
     callbacks: Optional[List[TaskSchedulerCallback]]
         The task scheduler callbacks that will be called before and after tuning a task.
         If None, PrintTableInfo and LogEstimatedLatency callback will be used.
+    transfer_log_file: Optional[str]
+        Warm-start every task with the records of its structurally similar tasks in this file.
+        See `find_transfer_sources` and `PreloadTransferredStates`.
     """
 
     def __init__(
@@ -217,11 +334,18 @@ class TaskScheduler:
         gamma: float = 0.5,
         backward_window_size: int = 3,
         callbacks=None,
+        transfer_log_file: str = None,
     ):
         self.tasks = tasks
         if objective_func:  # use custom objective function
             self.objective_func = objective_func
         else:  # use weighted sum
+            # <bojian/DietCode> Dynamic tasks count by their instance weights.
+            if not task_weights and any(task.shape_vars for task in tasks):
+                task_weights = [
+                    sum(w.value for w in task.wkl_inst_weights) if task.shape_vars else 1.0
+                    for task in tasks
+                ]
             if task_weights:
                 self.objective_func = lambda costs: sum(c * w for c, w in zip(costs, task_weights))
             else:
@@ -230,6 +354,7 @@ class TaskScheduler:
         self.strategy = strategy
         self.load_log_file = load_log_file
         self.load_model_file = load_model_file
+        self.transfer_log_file = transfer_log_file
         self.alpha = alpha
         self.beta = beta
         self.gamma = gamma
@@ -263,24 +388,24 @@ class TaskScheduler:
 
 
         # Build similarity groups
-        # <bojian/DietCode> Comment out similarity group, since we are now
-        #                   automatically grouping tasks together into a 
-        #                   single dynamic search task.
-        # self.task_tags = []  # task_id -> tag
-        # self.tag_to_group_id = {}  # tag -> group_id
-        # self.group_task_ids = []  # group_id -> all task ids in this group
-        # self.flop_cts = []  # task_id -> the number of floating ops
-        # for i, task in enumerate(self.tasks):
-        #     tag = derive_similarity_tag(task.compute_dag)
-        #     self.task_tags.append(tag)
-        #     self.flop_cts.append(task.compute_dag.flop_ct)
-        #     if not tag:
-        #         continue
-
-        #     if tag not in self.tag_to_group_id:
-        #         self.tag_to_group_id[tag] = len(self.tag_to_group_id)
-        #         self.group_task_ids.append([])
-        #     self.group_task_ids[self.tag_to_group_id[tag]].append(i)
+        # <bojian/DietCode> The FLOP count of a dynamic task is the weighted
+        #                   average over its workload instances.
+        self.task_tags = []  # task_id -> tag
+        self.tag_to_group_id = {}  # tag -> group_id
+        self.group_task_ids = []  # group_id -> all task ids in this group
+        self.flop_cts = []  # task_id -> the number of floating ops
+        for i, task in enumerate(self.tasks):
+            flop_ct = estimate_task_flop_ct(task)
+            tag = derive_similarity_tag(task.compute_dag, flop_ct=flop_ct)
+            self.task_tags.append(tag)
+            self.flop_cts.append(flop_ct)
+            if not tag:
+                continue
+
+            if tag not in self.tag_to_group_id:
+                self.tag_to_group_id[tag] = len(self.tag_to_group_id)
+                self.group_task_ids.append([])
+            self.group_task_ids[self.tag_to_group_id[tag]].append(i)
 
     def tune(
         self,
@@ -342,6 +467,11 @@ class TaskScheduler:
         if self.load_log_file:
             self._restore_status(self.load_log_file, self.num_measures_per_round)
 
+        # <bojian/DietCode> find the similar tasks to warm-start from
+        transfer_src_keys = None
+        if self.transfer_log_file:
+            transfer_src_keys = find_transfer_sources(self.tasks, self.transfer_log_file)
+
         # make one search policy for one task
         self.search_policies = make_search_policies(
             search_policy,
@@ -352,6 +482,8 @@ class TaskScheduler:
             self.load_model_file,
             self.load_log_file,
             adapative_training,
+            self.transfer_log_file,
+            transfer_src_keys,
         )
 
         # do a round robin first to warm up
@@ -406,20 +538,17 @@ class TaskScheduler:
                     g_next_1 = self.best_costs[i] - (self.best_costs[i] / self.task_cts[i])
 
                     g_next_2 = self.beta * 1e30
-                    
-                    
-                    # <bojian/DietCode>
-                    # group_id = self.tag_to_group_id.get(self.task_tags[i], None)
-                    # if group_id is not None and len(self.group_task_ids[group_id]) > 1:
-                    #     best_flops = max(
-                    #         [
-                    #             self.flop_cts[j] / self.best_costs[j]
-                    #             for j in self.group_task_ids[group_id]
-                    #         ]
-                    #     )
-                    #     g_next_2 = self.beta * self.flop_cts[i] / best_flops
-
-                    
+
+                    group_id = self.tag_to_group_id.get(self.task_tags[i], None)
+                    if group_id is not None and len(self.group_task_ids[group_id]) > 1:
+                        best_flops = max(
+                            [
+                                self.flop_cts[j] / self.best_costs[j]
+                                for j in self.group_task_ids[group_id]
+                            ]
+                        )
+                        g_next_2 = self.beta * self.flop_cts[i] / best_flops
+
                     g_next = min(g_next_1, g_next_2)
                     forward_grad = g_next - self.best_costs[i]
 
@@ -438,12 +567,8 @@ class TaskScheduler:
                 raise ValueError("Invalid strategy: " + self.strategy)
 
             self._tune_task(task_idx)
+            self._adjust_similarity_group(task_idx)
 
-
-            # <bojian/DietCode>
-            # self._adjust_similarity_group(task_idx)
-
-            
             if self.cur_score < self.best_score:
                 self.best_score = self.cur_score
                 self.best_ct = self.ct
@@ -520,28 +645,25 @@ class TaskScheduler:
         """compute the objective function"""
         return self.objective_func(costs)
 
-    
-    # <bojian/DietCode>
-    # def _adjust_similarity_group(self, task_idx):
-    #     """adjust the similarity group for the selected task"""
-    #     group_id = self.tag_to_group_id.get(self.task_tags[task_idx], None)
-    #     if group_id is None or len(self.group_task_ids[group_id]) <= 1:
-    #         return
-
-    #     group_ids = self.group_task_ids[group_id]
-    #     best_group_flops = max([self.flop_cts[j] / self.best_costs[j] for j in group_ids])
-    #     cur_flops = self.flop_cts[task_idx] / self.best_costs[task_idx]
-
-    #     # if we tune a task for many times but it still cannot achieve
-    #     # a similar speed to the fastest one in its group, this means this task
-    #     # is actually not similar to other tasks in its group.
-    #     # So we will remove it from its original group.
-    #     if cur_flops < best_group_flops / self.beta and self.task_cts[task_idx] > 5 + max(
-    #         self.task_cts[j] for j in group_ids if j != task_idx
-    #     ):
-    #         self.task_tags[task_idx] = None
-    #         group_ids.remove(task_idx)
+    def _adjust_similarity_group(self, task_idx):
+        """adjust the similarity group for the selected task"""
+        group_id = self.tag_to_group_id.get(self.task_tags[task_idx], None)
+        if group_id is None or len(self.group_task_ids[group_id]) <= 1:
+            return
+
+        group_ids = self.group_task_ids[group_id]
+        best_group_flops = max([self.flop_cts[j] / self.best_costs[j] for j in group_ids])
+        cur_flops = self.flop_cts[task_idx] / self.best_costs[task_idx]
 
+        # if we tune a task for many times but it still cannot achieve
+        # a similar speed to the fastest one in its group, this means this task
+        # is actually not similar to other tasks in its group.
+        # So we will remove it from its original group.
+        if cur_flops < best_group_flops / self.beta and self.task_cts[task_idx] > 5 + max(
+            self.task_cts[j] for j in group_ids if j != task_idx
+        ):
+            self.task_tags[task_idx] = None
+            group_ids.remove(task_idx)
 
     def _restore_status(self, log_file, num_measures_per_round):
         """restore task_cts and best_costs from a log file"""
@@ -549,6 +671,12 @@ class TaskScheduler:
         workload_key_to_task_id = {t.workload_key: i for i, t in enumerate(self.tasks)}
         total_ct = -1
 
+        # (task_idx, task_ct, cost) of the valid records
+        valid_records = []
+        # <bojian/DietCode> The records of the dynamic tasks that do not carry
+        # their workload instance, by task, as (index into valid_records, state).
+        pending_dyn_records = {}
+
         for total_ct, (inp, res) in enumerate(RecordReader(log_file)):
             if str(inp.task.target) != str_target:
                 continue
@@ -560,9 +688,44 @@ class TaskScheduler:
 
             if res.error_no == 0:
                 cost = array_mean(res.costs)
-                if cost < self.best_costs[task_idx]:
-                    self.best_costs[task_idx] = cost
-                    self.task_best_cts[task_idx] = self.task_cts[task_idx]
+                # <bojian/DietCode> A record of a dynamic task only measures
+                # one workload instance. Estimate the expected latency by
+                # assuming that all the instances run at its throughput.
+                task = self.tasks[task_idx]
+                if task.shape_vars:
+                    if inp.wkl_inst is None:
+                        # The state has been measured on the instance that it
+                        # is cherry-picked for, see SketchPolicy.
+                        pending_dyn_records.setdefault(task_idx, []).append(
+                            (len(valid_records), inp.state))
+                    else:
+                        inst_flop_ct = estimate_flop_for_inst(
+                            task.compute_dag, task.shape_vars, inp.wkl_inst)
+                        cost = self.flop_cts[task_idx] / (inst_flop_ct / cost)
+                valid_records.append((task_idx, self.task_cts[task_idx], cost))
+
+        # <bojian/DietCode> Cherry-pick the instances of each task in one batch.
+        for task_idx, records in pending_dyn_records.items():
+            task = self.tasks[task_idx]
+            inst_ids = get_cherry_picked_wkl_inst_ids(task, [state for _, state in records])
+            for (record_idx, _), inst_id in zip(records, inst_ids):
+                _, task_ct, cost = valid_records[record_idx]
+                if inst_id < 0:
+                    # The cost cannot be rescaled without the instance.
+                    valid_records[record_idx] = None
+                    continue
+                inst_flop_ct = estimate_flop_for_inst(
+                    task.compute_dag, task.shape_vars, task.wkl_insts[inst_id])
+                valid_records[record_idx] = \
+                    (task_idx, task_ct, self.flop_cts[task_idx] / (inst_flop_ct / cost))
+
+        for record in valid_records:
+            if record is None:
+                continue
+            task_idx, task_ct, cost = record
+            if cost < self.best_costs[task_idx]:
+                self.best_costs[task_idx] = cost
+                self.task_best_cts[task_idx] = task_ct
 
         for idx in range(len(self.tasks)):
             if self.task_cts[idx] - self.task_best_cts[idx] > self.early_stopping_task:
@@ -629,7 +792,7 @@ class PrintTableInfo(TaskSchedulerCallback):
             )
             speed_str = (
                 "%.2f"
-                % (task_scheduler.tasks[i].compute_dag.flop_ct / task_scheduler.best_costs[i] / 1e9)
+                % (task_scheduler.flop_cts[i] / task_scheduler.best_costs[i] / 1e9)
                 if task_scheduler.best_costs[i] < 1e9
                 else "-"
             )
@@ -89,81 +89,36 @@ def schedule_to_module(
 
 
 # <bojian/DietCode>
-def _convert_decision_tree(tree, # feature_names
-                           features):
-    from sklearn.tree import _tree
-    from ..auto_scheduler import StateVer, DecisionTreeNode
-
-    tree_ = tree.tree_
-    # print("features={}, tree.features={}".format(features, tree_.feature))
-    # assert len(features) == len(tree_.feature), \
-    #        "The number features must be consistent"
-    # feature_name = [
-    #     feature_names[i] if i != _tree.TREE_UNDEFINED else "undefined!"
-    #     for i in tree_.feature
-    # ]
-    features = [features[i] if i != _tree.TREE_UNDEFINED else None
-                for i in tree_.feature
-                ]
-    # print("def tree({}):".format(", ".join(feature_names)))
-    # CAUTION!: MUST store all the nodes otherwise they will be released
-    tree_classifier_nodes = []
-
-    def _recurse(node=0, depth=1):
-        # indent = "  " * depth
-        if tree_.feature[node] != _tree.TREE_UNDEFINED:
-            # name = feature_name[node]
-            var = features[node]
-            threshold = int(tree_.threshold[node])
-            # print("{}if {} <= {}:".format(indent, var, threshold))
-            if_node = _recurse(tree_.children_left[node], depth + 1)
-            # print("{}else:  # if {} > {}".format(indent, var, threshold))
-            else_node = _recurse(tree_.children_right[node], depth + 1)
-            tree_classifier_nodes.insert(
-                    0, 
-                    DecisionTreeNode(predicate=(var <= threshold),
-                                     if_node=if_node, else_node=else_node))
-            return tree_classifier_nodes[0]
-        else:
-            # print("{}return {}".format(indent, tree_.value[node]))
-            # print(tree_.value[node])
-            state_ver = StateVer(int(tree_.value[node][0][0]),
-                                 int(tree_.value[node][1][0]))
-
-            tree_classifier_nodes.insert(
-                    0, DecisionTreeNode(state_ver=state_ver))
-            return tree_classifier_nodes[0]
-
-    _recurse()
-    return tree_classifier_nodes
-
-
-def _train_decision_tree(wkl_insts, wkl_inst_id_state_ver_map):
-    from sklearn import tree
-    tree_classifier = tree.DecisionTreeRegressor()
-
-    X = []
-    Y = []
-
-    def _wkl_inst_id_to_list(wkl_inst_id):
-        wkl_inst = wkl_insts[wkl_inst_id.value]
-        return [i.value for i in list(wkl_inst)]
-
-    for wkl_inst_id, state_ver in wkl_inst_id_state_ver_map.items():
-        print("{} : {}".format(wkl_inst_id, state_ver))
-        X.append(_wkl_inst_id_to_list(wkl_inst_id))
-        Y.append([state_ver.major.value, state_ver.minor.value])
-
-    # X = [[5, 768, 2304],
-    #      [10, 768, 2304],
-    #      [5, 768, 3072],
-    #      [12, 768, 2304]
-    #      ]
-    # Y = [[0, 0], [0, 1], [1, 0], [2, 0]]
-
-    print("X={}, Y={}".format(X, Y))
-    tree_classifier.fit(X, Y)
-    return tree_classifier
+def _build_decision_tree(dyn_wkl_dispatcher, wkl_inst_id_state_ver_map,
+                         max_misdispatch_cost):
+    """Build the dispatching decision tree natively, on the adapted throughput
+    of every workload instance on every compiled state version. The instances
+    can be dispatched to any state version that shares their out-of-bound
+    marker, so that the tree trades up to `max_misdispatch_cost` of slowdown
+    for fewer branches and kernels."""
+    from ..auto_scheduler import build_dispatch_decision_tree
+    from ..auto_scheduler import _ffi_api as _auto_scheduler_ffi_api
+
+    search_task = dyn_wkl_dispatcher.search_task
+    state_vers = {wkl_inst_id.value: state_ver for wkl_inst_id, state_ver
+                  in wkl_inst_id_state_ver_map.items()}
+    candidates, cand_keys = [], set()
+    for wkl_inst_id in range(len(search_task.wkl_insts)):
+        state_ver = state_vers[wkl_inst_id]
+        key = (state_ver.major.value, state_ver.minor.value)
+        if key not in cand_keys:
+            cand_keys.add(key)
+            candidates.append(state_ver)
+    adapted_flops = [[flops.value for flops in row] for row in
+                     _auto_scheduler_ffi_api.DispatcherGetAdaptedFlops(
+                         dyn_wkl_dispatcher, wkl_inst_id_state_ver_map, candidates)]
+    wkl_inst_weights = [w.value for w in search_task.wkl_inst_weights] \
+                       if search_task.wkl_inst_weights else \
+                       [1.] * len(search_task.wkl_insts)
+    return build_dispatch_decision_tree(
+               search_task.shape_vars,
+               [[i.value for i in wkl_inst] for wkl_inst in search_task.wkl_insts],
+               wkl_inst_weights, adapted_flops, candidates, max_misdispatch_cost)
 
 
 _check_no_opt_status = \
@@ -276,17 +231,46 @@ def lower_dyn_wkl_dispatcher(
     
     # print("state_ver_ir_mod_map={}, wkl_inst_id_state_ver_map={}"
     #           .format(state_ver_ir_mod_map, wkl_inst_id_state_ver_map))
-    tree = _train_decision_tree(dyn_wkl_dispatcher.search_task.wkl_insts, wkl_inst_id_state_ver_map)
-    
+    max_misdispatch_cost = PassContext.current().config.get(
+                               "auto_scheduler.max_misdispatch_cost", None)
+    tree_classifier_root = _build_decision_tree(
+                               dyn_wkl_dispatcher, wkl_inst_id_state_ver_map,
+                               max_misdispatch_cost.value if max_misdispatch_cost is not None
+                               else 0.)
     shape_vars = dyn_wkl_dispatcher.search_task.shape_vars
 
-    tree_classifier_nodes = _convert_decision_tree(tree, shape_vars)
-    tree_classifier_root = tree_classifier_nodes[0]
-    print(tree_classifier_root)
+    from tvm import auto_scheduler
 
+    if PassContext.current().config.get("auto_scheduler.count_dispatches", True):
+        # The lowered dispatcher counts its calls per leaf, under its name. Map
+        # every workload instance to its leaf for the telemetry, which also
+        # resets the counts of the module that gets replaced.
+        inst_leaf_ids = auto_scheduler.get_decision_tree_leaf_ids(
+                            tree_classifier_root, shape_vars,
+                            dyn_wkl_dispatcher.search_task.wkl_insts)
+        tvm.get_global_func("runtime.SetDispatchInstLeafIds")(
+            name, tvm.runtime.ShapeTuple(inst_leaf_ids))
+
+    # only compile the kernels that the decision tree dispatches to
+    state_ver_ir_mod_map = {(state_ver.major.value, state_ver.minor.value): ir_mod
+                            for state_ver, ir_mod in state_ver_ir_mod_map.items()}
     input_mods = []
-    for _, ir_mod in state_ver_ir_mod_map.items():
-        input_mods.append(ir_mod)
+    for state_ver in auto_scheduler.get_decision_tree_state_vers(tree_classifier_root):
+        input_mods.append(state_ver_ir_mod_map[(state_ver.major.value,
+                                                state_ver.minor.value)])
+
+    tensor_args = dyn_wkl_dispatcher.search_task.compute_dag.tensors
+    dispatch_mode = PassContext.current().config.get("auto_scheduler.dispatch_mode", "tree")
+
+    if ndarray.device(target.kind.name, 0).device_type == ndarray.cpu(0).device_type:
+        # On CPUs, the kernels are host functions themselves, and the dispatcher
+        # calls into them directly within the same module. The module is left
+        # unoptimized for `build` to go through the regular pipeline.
+        dispatcher_mod = auto_scheduler.make_host_dispatcher(
+                             tensor_args, shape_vars, tree_classifier_root, name,
+                             dispatch_mode)
+        return [_merge_ir_mods(input_mods + [dispatcher_mod]),
+                list(tensor_args) + list(shape_vars)]
 
     merged_mod = _merge_ir_mods(# dyn_wkl_dispatcher, input_mods
                                 input_mods
@@ -303,15 +287,13 @@ def lower_dyn_wkl_dispatcher(
     # print("skeleton_mod_host={}, merged_mod_dev={}"
     #           .format(skeleton_mod_host, merged_mod_dev))
     # print("skeleton_mod_host={}".format(skeleton_mod_host))
-    from tvm import auto_scheduler
 
-    tensor_args = dyn_wkl_dispatcher.search_task.compute_dag.tensors
 
     skeleton_mod_host = auto_scheduler.inline_dispatch(
                             tensor_args, shape_vars,
                             tree_classifier_root,
                             skeleton_mod_host, merged_mod_host, merged_mod_dev,
-                            name)
+                            name, dispatch_mode)
     print("skeleton_mod_host={}".format(skeleton_mod_host))
 
     # if ret_rt_mod:
@@ -32,6 +32,16 @@ from . import _ffi_api
 
 # profile result of time evaluator
 ProfileResult = namedtuple("ProfileResult", ["mean", "results"])
+# <bojian/DietCode>
+AdaptiveProfileResult = namedtuple("AdaptiveProfileResult", ["mean", "results", "variance"])
+# <bojian/DietCode> The hardware events counted by the perf counter evaluator, in order.
+PERF_COUNTER_NAMES = (
+    "cycles",
+    "instructions",
+    "l1d_load_misses",
+    "llc_load_misses",
+    "branch_misses",
+)
 
 
 class Module(object):
@@ -237,6 +247,132 @@ class Module(object):
         except NameError:
             raise NameError("time_evaluate is only supported when RPC is enabled")
 
+    # <bojian/DietCode>
+    def adaptive_time_evaluator(
+        self,
+        func_name,
+        dev,
+        number=1,
+        min_repeat=3,
+        max_repeat=100,
+        min_repeat_ms=0,
+        rel_ci_width=0.02,
+        upper_bound=0.0,
+        f_preproc="",
+    ):
+        """Get an evaluator that, unlike :any:`time_evaluator`, repeats the measurement
+        only until the mean time cost is known well enough. This is only available for
+        local modules.
+
+        Parameters
+        ----------
+        func_name: str
+            The name of the function in the module.
+
+        dev: Device
+            The device we should run this function on.
+
+        number: int
+            The number of times to run this function for taking average.
+
+        min_repeat: int, optional
+            The minimum number of times to repeat the measurement, which is at least 2.
+
+        max_repeat: int, optional
+            The maximum number of times to repeat the measurement.
+
+        min_repeat_ms: int, optional
+            The minimum duration of one `repeat` in milliseconds.
+
+        rel_ci_width: float, optional
+            The repeats stop once the half-width of the 95% confidence interval on the
+            mean falls below `rel_ci_width` of the mean.
+
+        upper_bound: float, optional
+            The repeats also stop once the lower end of the confidence interval exceeds
+            `upper_bound` (in seconds), i.e., once the function is known to be slower
+            than that. Non-positive to disable.
+
+        f_preproc: str, optional
+            The preprocess function name we want to execute before each `repeat`.
+
+        Returns
+        -------
+        ftimer : function
+            The function that takes same argument as func and returns an
+            AdaptiveProfileResult, whose `results` has as many time costs (in seconds)
+            as the number of repeats that have been run, and whose `variance` is the
+            sample variance of those.
+        """
+        feval = _ffi_api.AdaptiveTimeEvaluator(
+            self,
+            func_name,
+            dev.device_type,
+            dev.device_id,
+            number,
+            min_repeat,
+            max_repeat,
+            min_repeat_ms,
+            rel_ci_width,
+            upper_bound,
+            f_preproc,
+        )
+
+        def evaluator(*args):
+            """Internal wrapped evaluator."""
+            blob = feval(*args)
+            num_samples = len(blob) // struct.calcsize("@d")
+            results = struct.unpack("@" + ("d" * num_samples), blob)
+            mean = sum(results) / float(num_samples)
+            variance = sum((result - mean) ** 2 for result in results) / float(num_samples - 1)
+            return AdaptiveProfileResult(mean=mean, results=results, variance=variance)
+
+        return evaluator
+
+    # <bojian/DietCode>
+    def perf_counter_evaluator(self, func_name, dev, number=1, f_preproc=""):
+        """Get an evaluator that counts the hardware events of running the function with
+        perf_event, summed over all the threads of the process. This is only available for
+        local modules on Linux CPUs.
+
+        Parameters
+        ----------
+        func_name: str
+            The name of the function in the module.
+
+        dev: Device
+            The device we should run this function on, which must be CPU.
+
+        number: int
+            The number of times to run this function for taking average.
+
+        f_preproc: str, optional
+            The preprocess function name we want to execute before the counted runs.
+
+        Returns
+        -------
+        fcounter : function
+            The function that takes same argument as func and returns a dict from the
+            names in `PERF_COUNTER_NAMES` to the average counts per run. The events that
+            cannot be counted (e.g., when perf_event_open is not permitted) are left out.
+        """
+        feval = _ffi_api.PerfCounterEvaluator(
+            self,
+            func_name,
+            dev.device_type,
+            dev.device_id,
+            number,
+            f_preproc,
+        )
+
+        def evaluator(*args):
+            """Internal wrapped evaluator."""
+            blob = feval(*args)
+            counts = struct.unpack("@" + ("d" * len(PERF_COUNTER_NAMES)), blob)
+            return {name: count for name, count in zip(PERF_COUNTER_NAMES, counts) if count >= 0}
+
+        return evaluator
+
     def _collect_from_import_tree(self, filter_func):
         """Helper function to collect modules from the tree matching a filter_func, then return it.
 
@@ -240,6 +240,19 @@ class NDArray(NDArrayBase):
             return self._copyto(res)
         raise ValueError("Unsupported target type %s" % str(type(target)))
 
+    # <bojian/DietCode>
+    def _create_view(self, shape):
+        """Create a view of a (smaller) shape that shares the data of this array.
+
+        Parameters
+        ----------
+        shape : Union[tvm.runtime.ShapeTuple, Sequence[int]]
+            The shape of the view, whose size must not exceed that of this array.
+        """
+        if not isinstance(shape, tvm.runtime.ShapeTuple):
+            shape = tvm.runtime.ShapeTuple([int(dim) for dim in shape])
+        return _ffi_api.TVMArrayCreateView(self, shape)
+
 
 def device(dev_type, dev_id=0):
     """Construct a TVM device with given device type and id.
@@ -251,6 +251,17 @@ def conv2d_winograd_nhwc_auto_scheduler_test(
     return [inputs, kernel_pack, output]
 
 
+class StateHashCostModel(auto_scheduler.cost_model.PythonBasedModel):
+    """A deterministic cost model that rates the states by their printed forms, so
+    that the searches with the same seed pick the same candidates"""
+
+    def update(self, inputs, results):
+        pass
+
+    def predict(self, task, states):
+        return [(hash(str(state)) % 1000) / 1000.0 for state in states]
+
+
 def get_tiled_matmul():
     """Get a compute dag and a state for tiled matmul"""
     A, B, C = matmul_auto_scheduler_test(512, 512, 512)
@@ -73,8 +73,11 @@ AutoSchedule(SearchPolicy search_policy, TuningOptions tuning_options) {
 
   // <bojian/DietCode>
   if (IsDynTask(search_policy->search_task)) {
+    std::vector<float> inst_predicted_flops =
+        measurer->best_inst_flops[search_policy->search_task->workload_key];
     return DynWklDispatcher(search_policy->search_task,
-                            std::move(states), std::move(inst_disp_map));
+                            std::move(states), std::move(inst_disp_map),
+                            std::move(inst_predicted_flops));
   } else {
     CHECK(states.size() == 1);
     State state = Downcast<State>(states[0]);
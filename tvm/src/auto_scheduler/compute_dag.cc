@@ -38,6 +38,8 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <list>
+#include <mutex>
 #include <queue>
 #include <unordered_map>
 #include <unordered_set>
@@ -577,6 +579,211 @@ void CheckComputeValidity(const te::Schedule& sch) {
   }
 }
 
+// <bojian/DietCode>
+/*!
+ * \brief A LRU cache of the schedules after the prefixes of transform steps.
+ *
+ * The candidates that come from the same sketch or parent state share the
+ * step objects of their common prefix, hence the prefixes are keyed by the
+ * identities of their steps. An entry holds references to its steps so that
+ * those identities cannot be reused while the entry is alive.
+ *
+ * The schedules that are instantiated on a workload instance are built on
+ * their own (synthetic) tensors, hence they are further keyed by the instance
+ * and hold the tensors that they have been built on.
+ */
+class ScheduleReplayCache {
+ public:
+  /*! \brief The number of steps between two consecutive snapshots. */
+  static constexpr size_t kSnapshotInterval = 4;
+
+  explicit ScheduleReplayCache(const size_t capacity) : capacity_(capacity) {}
+
+  /*!
+   * \brief Get the keys of the prefixes of the steps that end at the snapshot
+   *        points, i.e., the i-th key is for the first (i + 1) * kSnapshotInterval
+   *        steps.
+   * \param inst The workload instance, empty if the steps are not instantiated.
+   */
+  static std::vector<size_t> GetPrefixKeys(const Array<Step>& transform_steps,
+                                           const std::vector<int64_t>& inst = {}) {
+    std::vector<size_t> prefix_keys;
+    size_t key = 0;
+    for (const int64_t shape_value : inst) {
+      key = dmlc::HashCombine(key, shape_value);
+    }
+    for (size_t i = 0; i < transform_steps.size(); ++i) {
+      key = dmlc::HashCombine(key, std::hash<const Object*>()(transform_steps[i].get()));
+      if ((i + 1) % kSnapshotInterval == 0) {
+        prefix_keys.push_back(key);
+      }
+    }
+    return prefix_keys;
+  }
+
+  /*!
+   * \brief Restore a copy of the snapshot of the longest cached prefix.
+   * \param tensors The tensors that the snapshot has been built on.
+   * \return The length of the prefix, 0 if none of the prefixes is cached.
+   */
+  size_t Lookup(const Array<Step>& transform_steps, const std::vector<int64_t>& inst,
+                const std::vector<size_t>& prefix_keys, te::Schedule* schedule,
+                Array<te::Stage>* stages, StageToAxesMap* stage_to_axes,
+                Array<te::Tensor>* tensors) {
+    Entry entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = prefix_keys.size(); i > 0; --i) {
+        auto entry_it = entries_.find(prefix_keys[i - 1]);
+        if (entry_it != entries_.end() && entry_it->second.inst == inst &&
+            IsPrefixOf(entry_it->second.steps, transform_steps)) {
+          entry = entry_it->second;
+          lru_list_.splice(lru_list_.begin(), lru_list_, entry.lru_it);
+          break;
+        }
+      }
+    }
+    // The snapshots are never mutated once inserted, hence they can be copied
+    // without holding the lock.
+    if (!entry.schedule.defined() ||
+        !CopySnapshot(entry.schedule, entry.stages, entry.stage_to_axes, schedule, stages,
+                      stage_to_axes)) {
+      return 0;
+    }
+    *tensors = entry.tensors;
+    return entry.steps.size();
+  }
+
+  /*! \brief Insert a copy of the snapshot after the first num_steps steps. */
+  void Insert(const Array<Step>& transform_steps, const std::vector<int64_t>& inst,
+              const size_t num_steps, const size_t key, const te::Schedule& schedule,
+              const Array<te::Stage>& stages, const StageToAxesMap& stage_to_axes,
+              const Array<te::Tensor>& tensors) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (Contains(transform_steps, inst, key)) {
+        return;
+      }
+    }
+    Entry entry;
+    if (!CopySnapshot(schedule, stages, stage_to_axes, &entry.schedule, &entry.stages,
+                      &entry.stage_to_axes)) {
+      return;
+    }
+    entry.steps = Array<Step>(transform_steps.begin(), transform_steps.begin() + num_steps);
+    entry.inst = inst;
+    entry.tensors = tensors;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Another thread might have inserted the same prefix in the meantime.
+    if (Contains(transform_steps, inst, key)) {
+      return;
+    }
+    auto entry_it = entries_.find(key);
+    if (entry_it != entries_.end()) {
+      // Evict the entry whose key collides.
+      lru_list_.erase(entry_it->second.lru_it);
+      entries_.erase(entry_it);
+    }
+    lru_list_.push_front(key);
+    entry.lru_it = lru_list_.begin();
+    entries_.emplace(key, std::move(entry));
+    if (entries_.size() > capacity_) {
+      entries_.erase(lru_list_.back());
+      lru_list_.pop_back();
+    }
+  }
+
+ private:
+  struct Entry {
+    Array<Step> steps;
+    std::vector<int64_t> inst;
+    te::Schedule schedule;
+    Array<te::Stage> stages;
+    StageToAxesMap stage_to_axes;
+    Array<te::Tensor> tensors;
+    std::list<size_t>::iterator lru_it;
+  };
+
+  /*! \brief Whether the prefix is cached under the key. Requires `mutex_`. */
+  bool Contains(const Array<Step>& transform_steps, const std::vector<int64_t>& inst,
+                const size_t key) const {
+    auto entry_it = entries_.find(key);
+    return entry_it != entries_.end() && entry_it->second.inst == inst &&
+           IsPrefixOf(entry_it->second.steps, transform_steps);
+  }
+
+  static bool IsPrefixOf(const Array<Step>& prefix, const Array<Step>& transform_steps) {
+    if (prefix.size() > transform_steps.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < prefix.size(); ++i) {
+      if (!prefix[i].same_as(transform_steps[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /*!
+   * \brief Deep copy the schedule, and remap the stages of the copy, so that
+   *        replaying the steps on the copy leaves the original untouched.
+   * \return False if any of the stages does not belong to the schedule.
+   */
+  static bool CopySnapshot(const te::Schedule& schedule, const Array<te::Stage>& stages,
+                           const StageToAxesMap& stage_to_axes, te::Schedule* new_schedule,
+                           Array<te::Stage>* new_stages, StageToAxesMap* new_stage_to_axes) {
+    te::Schedule schedule_copy = schedule.copy();
+    std::unordered_map<const Object*, te::Stage> stage_map;
+    for (size_t i = 0; i < schedule->stages.size(); ++i) {
+      stage_map[schedule->stages[i].get()] = schedule_copy->stages[i];
+    }
+    for (size_t i = 0; i < schedule->groups.size(); ++i) {
+      stage_map[schedule->groups[i].get()] = schedule_copy->groups[i];
+    }
+    Array<te::Stage> stages_copy;
+    StageToAxesMap stage_to_axes_copy;
+    for (const te::Stage& stage : stages) {
+      auto stage_it = stage_map.find(stage.get());
+      if (stage_it == stage_map.end()) {
+        return false;
+      }
+      stages_copy.push_back(stage_it->second);
+    }
+    for (const auto& kv : stage_to_axes) {
+      auto stage_it = stage_map.find(kv.first.get());
+      if (stage_it == stage_map.end()) {
+        return false;
+      }
+      stage_to_axes_copy.Set(stage_it->second, kv.second);
+    }
+    *new_schedule = schedule_copy;
+    *new_stages = stages_copy;
+    *new_stage_to_axes = stage_to_axes_copy;
+    return true;
+  }
+
+  size_t capacity_;
+  std::unordered_map<size_t, Entry> entries_;
+  /*! \brief The keys from the most to the least recently used. */
+  std::list<size_t> lru_list_;
+  std::mutex mutex_;
+};
+
+// <bojian/DietCode>
+/*!
+ * \brief Make the replay cache of DIETCODE_SCHED_REPLAY_CACHE_SIZE entries.
+ *
+ * The cache is disabled (i.e., 0) by default, as every miss copies the whole
+ * schedule at each snapshot point and the mutated children of a round rarely
+ * share enough of their prefixes to pay for that. Enable it only where the
+ * ApplySteps phases of auto_scheduler_benchmark_test show a win.
+ */
+std::shared_ptr<ScheduleReplayCache> MakeScheduleReplayCache() {
+  const size_t capacity = dmlc::GetEnv("DIETCODE_SCHED_REPLAY_CACHE_SIZE", 0);
+  return capacity == 0 ? nullptr : std::make_shared<ScheduleReplayCache>(capacity);
+}
+
 ComputeDAG::ComputeDAG(Array<te::Tensor> tensors) {
   auto node = make_object<ComputeDAGNode>();
   node->tensors = std::move(tensors);
@@ -598,6 +805,8 @@ ComputeDAG::ComputeDAG(Array<te::Tensor> tensors) {
 
   node->flop_ct = FlopEstimator().EstimateFlop(node->ops);
   node->init_state = State(node->ops);
+  // <bojian/DietCode>
+  node->replay_cache = MakeScheduleReplayCache();
   data_ = std::move(node);
 }
 
@@ -625,6 +834,8 @@ ComputeDAG::ComputeDAG(const te::Schedule& sch) {
   node->access_analyzer = AccessAnalyzer(node->tensors);
   node->flop_ct = FlopEstimator().EstimateFlop(node->ops);
   node->init_state = State(node->ops);
+  // <bojian/DietCode>
+  node->replay_cache = MakeScheduleReplayCache();
   data_ = std::move(node);
 }
 
@@ -1076,27 +1287,48 @@ std::pair<te::Schedule, Array<te::Tensor>> ComputeDAG::ApplySteps(
   if (stage_to_axes == nullptr) {
     stage_to_axes = &temp_stage_to_axes;
   }
-  Array<te::Operation> out_ops;
-  for (const auto& op : operator->()->ops) {
-    if (operator->()->access_analyzer.IsOutput(op)) {
-      out_ops.push_back(op);
+
+  // <bojian/DietCode> Resume from the snapshot of the longest cached prefix.
+  ScheduleReplayCache* const replay_cache =
+      stages->empty() && stage_to_axes->empty() ? operator->()->replay_cache.get() : nullptr;
+  std::vector<size_t> prefix_keys;
+  te::Schedule schedule;
+  size_t num_replayed_steps = 0;
+  if (replay_cache != nullptr) {
+    Array<te::Tensor> tensors;
+    prefix_keys = ScheduleReplayCache::GetPrefixKeys(transform_steps);
+    num_replayed_steps = replay_cache->Lookup(transform_steps, {}, prefix_keys, &schedule,
+                                              stages, stage_to_axes, &tensors);
+  }
+
+  if (num_replayed_steps == 0) {
+    Array<te::Operation> out_ops;
+    for (const auto& op : operator->()->ops) {
+      if (operator->()->access_analyzer.IsOutput(op)) {
+        out_ops.push_back(op);
+      }
     }
-  }
 
-  // Create the initial schedule
-  te::Schedule schedule = te::create_schedule(out_ops);
+    // Create the initial schedule
+    schedule = te::create_schedule(out_ops);
 
-  // init axes
-  for (const auto& x : operator->()->ops) {
-    const te::Stage& stage = schedule[x];
-    stages->push_back(stage);
-    UpdateStageToAxesMap(stage, stage_to_axes);
+    // init axes
+    for (const auto& x : operator->()->ops) {
+      const te::Stage& stage = schedule[x];
+      stages->push_back(stage);
+      UpdateStageToAxesMap(stage, stage_to_axes);
+    }
   }
 
   // Apply the history steps to TVM schedule
   // Call each step's ApplyToSchedule method
-  for (const auto& step : transform_steps) {
-    StepApplyToSchedule(step, stages, stage_to_axes, &schedule, transform_steps);
+  for (size_t i = num_replayed_steps; i < transform_steps.size(); ++i) {
+    StepApplyToSchedule(transform_steps[i], stages, stage_to_axes, &schedule, transform_steps);
+    if (replay_cache != nullptr && (i + 1) % ScheduleReplayCache::kSnapshotInterval == 0) {
+      replay_cache->Insert(transform_steps, {}, i + 1,
+                           prefix_keys[(i + 1) / ScheduleReplayCache::kSnapshotInterval - 1],
+                           schedule, *stages, *stage_to_axes, operator->()->tensors);
+    }
   }
 
   // <bojian/DietCode>
@@ -1316,8 +1548,18 @@ ComputeDAG::InstantiateAndApplySteps(
     axes_to_extents.Set(shape_vars[i], shape_values[i]);
   }
   SyntheticExprReplacer synthetic_expr_replacer(axes_to_extents);
+  // The replay cache is only used on the concrete instances.
+  std::vector<int64_t> inst;
+  for (const PrimExpr& shape_value : shape_values) {
+    const IntImmNode* const shape_value_imm = shape_value.as<IntImmNode>();
+    if (shape_value_imm == nullptr) {
+      return InstantiateAndApplySteps(state_mutable_copy, synthetic_expr_replacer,
+                                      nullptr, nullptr);
+    }
+    inst.push_back(shape_value_imm->value);
+  }
   return InstantiateAndApplySteps(state_mutable_copy, synthetic_expr_replacer,
-                                  nullptr, nullptr);
+                                  nullptr, nullptr, &inst);
 }
 
 
@@ -1548,7 +1790,8 @@ ComputeDAG::CherryPickWorkloadInstanceAndApplySteps(
 std::pair<te::Schedule, Array<te::Tensor>>
 ComputeDAG::InstantiateAndApplySteps(
     const State& state, SyntheticExprReplacer& replacer,
-    Array<te::Stage>* stages, StageToAxesMap* stage_to_axes) const {
+    Array<te::Stage>* stages, StageToAxesMap* stage_to_axes,
+    const std::vector<int64_t>* const replay_inst) const {
   Array<te::Tensor> synthetic_tensors;
 
   Array<te::Stage> tmp_stages;
@@ -1559,6 +1802,35 @@ ComputeDAG::InstantiateAndApplySteps(
   if (stage_to_axes == nullptr) {
     stage_to_axes = &tmp_stage_to_axes;
   }
+
+  // Resume from the snapshot of the longest cached prefix on the same instance.
+  ScheduleReplayCache* const replay_cache =
+      replay_inst != nullptr && stages->empty() && stage_to_axes->empty()
+          ? operator->()->replay_cache.get() : nullptr;
+  std::vector<size_t> prefix_keys;
+  size_t num_replayed_steps = 0;
+  te::Schedule synthetic_sch;
+  if (replay_cache != nullptr) {
+    prefix_keys = ScheduleReplayCache::GetPrefixKeys(state->transform_steps, *replay_inst);
+    num_replayed_steps =
+        replay_cache->Lookup(state->transform_steps, *replay_inst, prefix_keys, &synthetic_sch,
+                             stages, stage_to_axes, &synthetic_tensors);
+  }
+  if (num_replayed_steps != 0) {
+    for (size_t i = 0; i < operator->()->tensors.size(); ++i) {
+      replacer.producer_subst_map.Set(operator->()->tensors[i], synthetic_tensors[i]);
+    }
+    for (size_t i = num_replayed_steps; i < state->transform_steps.size(); ++i) {
+      StepApplyToSchedule(state->transform_steps[i], stages, stage_to_axes, &synthetic_sch,
+                          state->transform_steps);
+      if ((i + 1) % ScheduleReplayCache::kSnapshotInterval == 0) {
+        replay_cache->Insert(state->transform_steps, *replay_inst, i + 1,
+                             prefix_keys[(i + 1) / ScheduleReplayCache::kSnapshotInterval - 1],
+                             synthetic_sch, *stages, *stage_to_axes, synthetic_tensors);
+      }
+    }
+    return std::make_pair(synthetic_sch, synthetic_tensors);
+  }
   arith::Analyzer analyzer;
 
   for (const te::Tensor& t : operator->()->tensors) {
@@ -1623,7 +1895,7 @@ ComputeDAG::InstantiateAndApplySteps(
       out_ops.push_back(op);
     }
   }
-  te::Schedule synthetic_sch = te::create_schedule(out_ops);
+  synthetic_sch = te::create_schedule(out_ops);
   // LOG(INFO) << lower(synthetic_sch, synthetic_tensors, "main", {});
 
   // Array<te::Operation> synthetic_ops;
@@ -1646,10 +1918,15 @@ ComputeDAG::InstantiateAndApplySteps(
   // LOG(INFO) << "transform_steps.size()="
   //           << state_mutable_copy->transform_steps.size();
 
-  for (const Step& step : state->transform_steps) {
+  for (size_t i = 0; i < state->transform_steps.size(); ++i) {
     // LOG(INFO) << "Applying step=" << step;
-    StepApplyToSchedule(step, stages, stage_to_axes, &synthetic_sch,
+    StepApplyToSchedule(state->transform_steps[i], stages, stage_to_axes, &synthetic_sch,
                         state->transform_steps);
+    if (replay_cache != nullptr && (i + 1) % ScheduleReplayCache::kSnapshotInterval == 0) {
+      replay_cache->Insert(state->transform_steps, *replay_inst, i + 1,
+                           prefix_keys[(i + 1) / ScheduleReplayCache::kSnapshotInterval - 1],
+                           synthetic_sch, *stages, *stage_to_axes, synthetic_tensors);
+    }
   }
   // LOG(INFO) << "Finished applying the transformation steps";
   // if (enable_verbose_logging) {
@@ -1702,7 +1979,7 @@ ComputeDAG::InferBoundOnCherryPickedWorkload(const Array<State>& states,
   Array<State> out_states(states.size(), State());
 
   // LOG(WARNING) << "Parallel InferBound has been made sequential";
-  support::parallel_for(0, states.size(),
+  support::parallel_for_dynamic(0, states.size(),
                         [this, &states, &out_states, &task](const size_t i) {
   // enable_verbose_logging = (i == 0);
   // for (size_t i = 0; i < states.size(); ++i) {
@@ -1804,7 +2081,7 @@ State ComputeDAG::InferBound(const State& state) const {
 Array<State> ComputeDAG::InferBound(const Array<State>& states) const {
   Array<State> out_states(states.size(), State());
 
-  support::parallel_for(0, states.size(), [this, &states, &out_states](int i) {
+  support::parallel_for_dynamic(0, states.size(), [this, &states, &out_states](int i) {
     try {
       out_states.Set(i, (states[i].defined()) ? this->InferBound(states[i]) : states[i]);
     } catch (Error& e) {
@@ -1962,6 +2239,14 @@ TVM_REGISTER_GLOBAL("auto_scheduler.GetSchedArgsPairOnWklInst")
     });
 
 
+TVM_REGISTER_GLOBAL("auto_scheduler.GetShapeGenericSchedArgsPair")
+    .set_body_typed([](const ComputeDAG& dag, const State& state,
+                       const Array<DynShapeVar>& shape_vars) {
+      std::pair<te::Schedule, Array<te::Tensor>> sched_and_args =
+          dag.InstantiateAndApplySteps(state, shape_vars, ToPrimExprArray(shape_vars));
+      return Array<ObjectRef>{sched_and_args.first, sched_and_args.second};
+    });
+
 TVM_REGISTER_GLOBAL("auto_scheduler.ComputeDAGApplyStepsFromState")
     .set_body_typed([](const ComputeDAG& dag, const State& state, int layout_rewrite) {
       te::Schedule sch;
@@ -69,7 +69,10 @@ PythonBasedModel::PythonBasedModel(PackedFunc update_func, PackedFunc predict_fu
                                    PackedFunc predict_for_all_instances_func,
                                    PackedFunc score_func,
 
-                                   PackedFunc predict_stage_func) {
+                                   PackedFunc predict_stage_func,
+
+                                   // <bojian/DietCode>
+                                   PackedFunc predict_uncertainty_func) {
   auto node = make_object<PythonBasedModelNode>();
   node->update_func = std::move(update_func);
   node->predict_func = std::move(predict_func);
@@ -79,6 +82,7 @@ PythonBasedModel::PythonBasedModel(PackedFunc update_func, PackedFunc predict_fu
   node->score_func = score_func;
 
   node->predict_stage_func = std::move(predict_stage_func);
+  node->predict_uncertainty_func = std::move(predict_uncertainty_func);
   data_ = std::move(node);
 }
 
@@ -112,6 +116,22 @@ void PythonBasedModelNode::PredictForAllInstances(
 }
 
 
+// <bojian/DietCode>
+void PythonBasedModelNode::PredictWithUncertainty(const SearchTask& task,
+                                                  const Array<State>& states,
+                                                  std::vector<float>* scores,
+                                                  std::vector<float>* stds) {
+  if (predict_uncertainty_func == nullptr) {
+    CostModelNode::PredictWithUncertainty(task, states, scores, stds);
+    return;
+  }
+  scores->resize(states.size());
+  stds->resize(states.size());
+  predict_uncertainty_func(task, states, static_cast<void*>(scores->data()),
+                           static_cast<void*>(stds->data()));
+}
+
+
 void PythonBasedModelNode::PredictStages(const SearchTask& task, const Array<State>& states,
                                          std::vector<float>* state_scores,
                                          std::vector<std::vector<float>>* stage_scores) {
@@ -198,14 +218,20 @@ TVM_REGISTER_GLOBAL("auto_scheduler.PythonBasedModel")
                        PackedFunc predict_for_all_instances_func,
                        PackedFunc score_func,
 
-                       PackedFunc predict_stage_func) {
+                       PackedFunc predict_stage_func,
+
+                       // <bojian/DietCode>
+                       PackedFunc predict_uncertainty_func) {
       return PythonBasedModel(update_func, predict_func,
       
                               // <bojian/DietCode>
                               predict_for_all_instances_func,
                               score_func,
 
-                              predict_stage_func);
+                              predict_stage_func,
+
+                              // <bojian/DietCode>
+                              predict_uncertainty_func);
     });
 
 TVM_REGISTER_GLOBAL("auto_scheduler.CostModelUpdate")
@@ -224,5 +250,18 @@ TVM_REGISTER_GLOBAL("auto_scheduler.CostModelPredict")
       return ret;
     });
 
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("auto_scheduler.CostModelPredictWithUncertainty")
+    .set_body_typed([](CostModel model, SearchTask task, Array<State> states) {
+      std::vector<float> scores, stds;
+      model->PredictWithUncertainty(task, states, &scores, &stds);
+      Array<FloatImm> ret_scores, ret_stds;
+      for (size_t i = 0; i < scores.size(); ++i) {
+        ret_scores.push_back(FloatImm(DataType::Float(32), scores[i]));
+        ret_stds.push_back(FloatImm(DataType::Float(32), stds[i]));
+      }
+      return Array<Array<FloatImm>>{ret_scores, ret_stds};
+    });
+
 }  // namespace auto_scheduler
 }  // namespace tvm
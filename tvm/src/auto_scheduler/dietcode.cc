@@ -1,10 +1,18 @@
 #include <tvm/auto_scheduler/dietcode.h>
 
 // <bojian/DietCode>
+#include <tvm/arith/analyzer.h>
 #include <tvm/driver/driver_api.h>
 #include <tvm/ir/function.h>
+#include <tvm/runtime/container/shape_tuple.h>
+#include <tvm/runtime/registry.h>
+#include <tvm/tir/stmt_functor.h>
 #include <tvm/tir/transform.h>
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
 #include "./utils.h"
 
 
@@ -24,11 +32,13 @@ TVM_STATIC_IR_FUNCTOR(ReprPrinter, vtable)
 
 DynWklDispatcher::DynWklDispatcher(
     const SearchTask& search_task, std::vector<State>&& states,
-    std::unordered_map<size_t, size_t>&& inst_disp_map) {
+    std::unordered_map<size_t, size_t>&& inst_disp_map,
+    std::vector<float>&& inst_predicted_flops) {
   ObjectPtr<DynWklDispatcherNode> node = make_object<DynWklDispatcherNode>();
   node->search_task = search_task;
   node->states = std::move(states);
   node->inst_disp_map = std::move(inst_disp_map);
+  node->inst_predicted_flops = std::move(inst_predicted_flops);
   data_ = std::move(node);
 }
 
@@ -165,6 +175,84 @@ DynWklDispatcherNode::GenerateAndCompressIRMods(const String& prefix) const {
   return {compressed_ir_mods, new_inst_disp_map};
 }
 
+std::vector<float>
+DynWklDispatcherNode::GetAdaptedFlops(const Map<Integer, StateVer>& inst_state_ver_map,
+                                      const Array<StateVer>& state_vers) const {
+  const Array<DynShapeVar>& shape_vars = search_task->shape_vars.value();
+  const size_t num_insts = search_task->wkl_insts.size(),
+               num_state_vers = state_vers.size();
+  std::unordered_map<size_t, State> inferred_states;
+  // (state_id, inst_id) -> occupancy x padding penalty, OOB marker
+  std::map<std::pair<size_t, size_t>, std::pair<float, std::vector<bool>>> adaptions;
+  auto get_adaption = [&](const size_t state_id, const size_t inst_id)
+      -> const std::pair<float, std::vector<bool>>& {
+    auto adaption_it = adaptions.find({state_id, inst_id});
+    if (adaption_it != adaptions.end()) {
+      return adaption_it->second;
+    }
+    auto state_it = inferred_states.find(state_id);
+    if (state_it == inferred_states.end()) {
+      state_it = inferred_states.emplace(
+                     state_id, search_task->compute_dag.InferBound(states[state_id])).first;
+    }
+    float occupancy_penalty, padding_penalty, penalty;
+    AdaptStateToWorkload(search_task, state_it->second, search_task->wkl_insts[inst_id], 1.,
+                         &occupancy_penalty, &padding_penalty, &penalty);
+    return adaptions.emplace(
+        std::make_pair(state_id, inst_id),
+        std::make_pair(penalty, state_it->second.GetOOBMarkerOnWklInst(
+                                    shape_vars, search_task->wkl_insts[inst_id]))
+    ).first->second;
+  };
+
+  std::vector<float> adapted_flops(num_insts * num_state_vers, 0.);
+  for (size_t c = 0; c < num_state_vers; ++c) {
+    const size_t state_id = state_vers[c]->major->value;
+    // The instances that the state version has been compiled for give its OOB
+    // marker and (if predicted at tuning time) its base throughput, from which
+    // the adapted throughputs are scaled back.
+    std::vector<bool> oob_marker;
+    double base_flops = 0.;
+    size_t num_compiled_insts = 0;
+    for (const auto& inst_state_ver : inst_state_ver_map) {
+      if (!StructuralEqual()(inst_state_ver.second, state_vers[c])) {
+        continue;
+      }
+      const size_t inst_id = inst_state_ver.first->value;
+      const std::pair<float, std::vector<bool>>& adaption = get_adaption(state_id, inst_id);
+      oob_marker = adaption.second;
+      base_flops += inst_predicted_flops.empty() || adaption.first <= 0.
+                        ? 1. : inst_predicted_flops[inst_id] / adaption.first;
+      ++num_compiled_insts;
+    }
+    CHECK(num_compiled_insts > 0) << state_vers[c] << " has not been compiled for any instance";
+    base_flops /= num_compiled_insts;
+    for (size_t i = 0; i < num_insts; ++i) {
+      const std::pair<float, std::vector<bool>>& adaption = get_adaption(state_id, i);
+      if (adaption.second == oob_marker) {
+        adapted_flops[i * num_state_vers + c] = base_flops * adaption.first;
+      }
+    }
+  }
+  return adapted_flops;
+}
+
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklDispatcher")
+    .set_body_typed([](const SearchTask& search_task, const Array<State>& states,
+                       const Map<Integer, Integer>& inst_disp_map) {
+      std::vector<State> states_vec(states.begin(), states.end());
+      std::unordered_map<size_t, size_t> inst_disp_map_vec;
+      for (const auto& kv : inst_disp_map) {
+        CHECK(kv.second->value >= 0 &&
+              static_cast<size_t>(kv.second->value) < states_vec.size())
+            << "Workload instance " << kv.first << " is dispatched to an "
+               "invalid state " << kv.second;
+        inst_disp_map_vec[kv.first->value] = kv.second->value;
+      }
+      return DynWklDispatcher(search_task, std::move(states_vec),
+                              std::move(inst_disp_map_vec));
+    });
 
 TVM_REGISTER_GLOBAL("auto_scheduler.DispatcherDispatch")
     .set_body_typed([](const DynWklDispatcher& dispatcher, const int wkl_id) {
@@ -177,6 +265,23 @@ TVM_REGISTER_GLOBAL("auto_scheduler.DispatcherDispatchToState")
       return dispatcher->DispatchToState(wkl_id);
     });
 
+TVM_REGISTER_GLOBAL("auto_scheduler.DispatcherGetAdaptedFlops")
+    .set_body_typed([](const DynWklDispatcher& dispatcher,
+                       const Map<Integer, StateVer>& inst_state_ver_map,
+                       const Array<StateVer>& state_vers) {
+      std::vector<float> adapted_flops =
+          dispatcher->GetAdaptedFlops(inst_state_ver_map, state_vers);
+      Array<Array<FloatImm>> adapted_flops_rows;
+      for (size_t i = 0; i < adapted_flops.size(); i += state_vers.size()) {
+        Array<FloatImm> row;
+        for (size_t c = 0; c < state_vers.size(); ++c) {
+          row.push_back(FloatImm(DataType::Float(32), adapted_flops[i + c]));
+        }
+        adapted_flops_rows.push_back(row);
+      }
+      return adapted_flops_rows;
+    });
+
 TVM_REGISTER_GLOBAL("auto_scheduler.DispatcherGetSkeleton")
     .set_body_typed([](const DynWklDispatcher& dispatcher,
                        const String& name) {
@@ -213,6 +318,281 @@ TVM_REGISTER_GLOBAL("auto_scheduler.DispatcherEmbedComputeDAG")
 
 TVM_REGISTER_NODE_TYPE(DynWklDispatcherNode);
 
+
+static inline std::vector<int64_t> ToShapeKey(const Array<IntImm>& shape_tuple) {
+  std::vector<int64_t> shape_key;
+  shape_key.reserve(shape_tuple.size());
+  for (const IntImm& v : shape_tuple) {
+    shape_key.push_back(v->value);
+  }
+  return shape_key;
+}
+
+static inline Array<IntImm> FromShapeKey(const std::vector<int64_t>& shape_key) {
+  Array<IntImm> shape_tuple;
+  for (const int64_t v : shape_key) {
+    shape_tuple.push_back(Integer(v));
+  }
+  return shape_tuple;
+}
+
+DynWklTelemetry::DynWklTelemetry(const DynWklDispatcher& dispatcher,
+                                 PackedFunc on_hot_swap,
+                                 const String& dispatcher_name) {
+  ObjectPtr<DynWklTelemetryNode> node = make_object<DynWklTelemetryNode>();
+  node->dispatcher_ = dispatcher;
+  node->dispatcher_name_ = dispatcher_name;
+  node->on_hot_swap_ = std::move(on_hot_swap);
+  const SearchTask& search_task = dispatcher->search_task;
+  for (size_t i = 0; i < search_task->wkl_insts.size(); ++i) {
+    node->wkl_inst_ids_[ToShapeKey(search_task->wkl_insts[i])] = i;
+    node->wkl_inst_flops_.push_back(EstimateFlopForInst(
+        search_task->compute_dag, search_task->shape_vars.value(),
+        search_task->wkl_insts[i]));
+  }
+  data_ = std::move(node);
+}
+
+void DynWklTelemetryNode::Record(const Array<IntImm>& shape_tuple,
+                                 const double latency) {
+  std::vector<int64_t> shape_key = ToShapeKey(shape_tuple);
+  size_t bin_id = 0;
+  for (double latency_us = latency * 1e6;
+       latency_us >= 2. && bin_id + 1 < kNumLatencyBins;
+       latency_us /= 2.) {
+    ++bin_id;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto stats_it = shape_stats_.find(shape_key);
+  if (stats_it == shape_stats_.end()) {
+    ShapeStats stats;
+    auto wkl_inst_id_it = wkl_inst_ids_.find(shape_key);
+    if (wkl_inst_id_it != wkl_inst_ids_.end()) {
+      stats.wkl_inst_id = wkl_inst_id_it->second;
+    }
+    stats_it = shape_stats_.emplace(std::move(shape_key), stats).first;
+  }
+  ShapeStats& stats = stats_it->second;
+  ++stats.num_samples;
+  stats.mean_latency += (latency - stats.mean_latency) / stats.num_samples;
+  ++stats.latency_hist[bin_id];
+}
+
+void DynWklTelemetryNode::GetDispatchCounts(std::vector<int64_t>* const leaf_counts,
+                                            std::vector<int64_t>* const inst_leaf_ids) const {
+  static const PackedFunc* get_dispatch_counts =
+      runtime::Registry::Get("runtime.GetDispatchCounts");
+  static const PackedFunc* get_dispatch_inst_leaf_ids =
+      runtime::Registry::Get("runtime.GetDispatchInstLeafIds");
+  CHECK(get_dispatch_counts != nullptr && get_dispatch_inst_leaf_ids != nullptr);
+  runtime::ShapeTuple counts = (*get_dispatch_counts)(dispatcher_name_),
+                      leaf_ids = (*get_dispatch_inst_leaf_ids)(dispatcher_name_);
+  leaf_counts->assign(counts.begin(), counts.end());
+  inst_leaf_ids->assign(leaf_ids.begin(), leaf_ids.end());
+}
+
+Array<Map<String, ObjectRef>> DynWklTelemetryNode::Report() const {
+  // Take a snapshot under the lock, and build the report outside of it.
+  std::map<std::vector<int64_t>, ShapeStats> shape_stats;
+  DynWklDispatcher dispatcher;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shape_stats = shape_stats_;
+    dispatcher = dispatcher_;
+  }
+  std::vector<int64_t> leaf_counts, inst_leaf_ids;
+  GetDispatchCounts(&leaf_counts, &inst_leaf_ids);
+  Array<Map<String, ObjectRef>> report;
+  for (const auto& shape_stats_pair : shape_stats) {
+    const ShapeStats& stats = shape_stats_pair.second;
+    Array<IntImm> latency_hist;
+    for (const uint64_t bin_count : stats.latency_hist) {
+      latency_hist.push_back(IntImm(DataType::Int(64), bin_count));
+    }
+    Map<String, ObjectRef> shape_report{
+        {"shape", FromShapeKey(shape_stats_pair.first)},
+        {"wkl_inst_id", Integer(stats.wkl_inst_id)},
+        {"num_samples", IntImm(DataType::Int(64), stats.num_samples)},
+        {"mean_latency", FloatImm(DataType::Float(64), stats.mean_latency)},
+        {"latency_hist", latency_hist}};
+    if (stats.wkl_inst_id != -1 &&
+        static_cast<size_t>(stats.wkl_inst_id) < inst_leaf_ids.size()) {
+      const int64_t leaf_id = inst_leaf_ids[stats.wkl_inst_id];
+      shape_report.Set("leaf_id", IntImm(DataType::Int(64), leaf_id));
+      shape_report.Set("leaf_count",
+                       IntImm(DataType::Int(64),
+                              static_cast<size_t>(leaf_id) < leaf_counts.size()
+                                  ? leaf_counts[leaf_id] : 0));
+    }
+    if (stats.wkl_inst_id != -1 &&
+        !dispatcher->inst_predicted_flops.empty()) {
+      shape_report.Set(
+          "predicted_latency",
+          FloatImm(DataType::Float(64),
+                   wkl_inst_flops_[stats.wkl_inst_id] /
+                   dispatcher->inst_predicted_flops[stats.wkl_inst_id]));
+    }
+    report.push_back(shape_report);
+  }
+  return report;
+}
+
+Array<Integer>
+DynWklTelemetryNode::SelectRetuneInsts(const double min_call_ratio,
+                                       const double max_flops_ratio) const {
+  std::vector<int64_t> leaf_counts, inst_leaf_ids;
+  GetDispatchCounts(&leaf_counts, &inst_leaf_ids);
+  const int64_t total_count =
+      std::accumulate(leaf_counts.begin(), leaf_counts.end(), int64_t(0));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Array<Integer> wkl_inst_ids;
+  if (total_count == 0 || dispatcher_->inst_predicted_flops.empty()) {
+    return wkl_inst_ids;
+  }
+  for (const auto& shape_stats_pair : shape_stats_) {
+    const ShapeStats& stats = shape_stats_pair.second;
+    if (stats.wkl_inst_id == -1 ||
+        static_cast<size_t>(stats.wkl_inst_id) >= inst_leaf_ids.size() ||
+        stats.num_samples == 0 || stats.mean_latency <= 0.) {
+      continue;
+    }
+    const int64_t leaf_id = inst_leaf_ids[stats.wkl_inst_id];
+    if (static_cast<size_t>(leaf_id) >= leaf_counts.size() ||
+        leaf_counts[leaf_id] < min_call_ratio * total_count) {
+      continue;
+    }
+    if (wkl_inst_flops_[stats.wkl_inst_id] / stats.mean_latency <
+        max_flops_ratio * dispatcher_->inst_predicted_flops[stats.wkl_inst_id]) {
+      wkl_inst_ids.push_back(Integer(stats.wkl_inst_id));
+    }
+  }
+  return wkl_inst_ids;
+}
+
+void DynWklTelemetryNode::HotSwap(const DynWklDispatcher& new_dispatcher) {
+  std::lock_guard<std::mutex> hot_swap_lock(hot_swap_mutex_);
+
+  const DynWklDispatcher old_dispatcher = GetDispatcher();
+  CHECK(new_dispatcher->search_task->workload_key ==
+        old_dispatcher->search_task->workload_key)
+      << "Unable to hot-swap to a dispatcher of a different workload";
+  CHECK(new_dispatcher->search_task->wkl_insts.size() ==
+        old_dispatcher->search_task->wkl_insts.size());
+  // Diff the dispatched states outside the lock, as the serving threads keep
+  // recording in the meantime.
+  std::unordered_set<int64_t> changed_wkl_inst_ids;
+  for (size_t i = 0; i < old_dispatcher->search_task->wkl_insts.size(); ++i) {
+    if (old_dispatcher->DispatchToState(i).ToStr() !=
+        new_dispatcher->DispatchToState(i).ToStr()) {
+      changed_wkl_inst_ids.insert(i);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& shape_stats_pair : shape_stats_) {
+      ShapeStats& stats = shape_stats_pair.second;
+      if (changed_wkl_inst_ids.count(stats.wkl_inst_id)) {
+        stats = ShapeStats{stats.wkl_inst_id};
+      }
+    }
+    dispatcher_ = new_dispatcher;
+  }
+  if (on_hot_swap_ != nullptr) {
+    on_hot_swap_(new_dispatcher);
+  }
+}
+
+DynWklDispatcher DynWklTelemetryNode::GetDispatcher() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dispatcher_;
+}
+
+void DynWklTelemetryNode::Reset() {
+  static const PackedFunc* reset_dispatch_counts =
+      runtime::Registry::Get("runtime.ResetDispatchCounts");
+  CHECK(reset_dispatch_counts != nullptr);
+  (*reset_dispatch_counts)(dispatcher_name_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  shape_stats_.clear();
+}
+
+TVM_REGISTER_NODE_TYPE(DynWklTelemetryNode);
+
+Array<Integer> RetuneHotInsts(const DynWklTelemetry& telemetry,
+                              const SearchPolicy& search_policy,
+                              const ProgramMeasurer& measurer,
+                              const int num_measure, const double min_call_ratio,
+                              const double max_flops_ratio, const double boost) {
+  const std::string& workload_key = search_policy->search_task->workload_key;
+  CHECK(workload_key == telemetry->GetDispatcher()->search_task->workload_key);
+
+  Array<Integer> wkl_inst_ids =
+      telemetry->SelectRetuneInsts(min_call_ratio, max_flops_ratio);
+  if (wkl_inst_ids.empty()) {
+    return wkl_inst_ids;
+  }
+  StdCout(search_policy->verbose) << "Re-tuning the workload instances="
+                                  << wkl_inst_ids << std::endl;
+  search_policy->EnqueueRetuneInsts(wkl_inst_ids, boost);
+  search_policy->ContinueSearchOneRound(num_measure, measurer);
+
+  if (!measurer->best_inst_disp_map.count(workload_key)) {
+    LOG(WARNING) << "No valid state has been found in the re-tuning round";
+    return wkl_inst_ids;
+  }
+  std::vector<State> states = measurer->best_states[workload_key];
+  std::unordered_map<size_t, size_t> inst_disp_map =
+      measurer->best_inst_disp_map[workload_key];
+  std::vector<float> inst_predicted_flops = measurer->best_inst_flops[workload_key];
+  telemetry->HotSwap(
+      DynWklDispatcher(telemetry->GetDispatcher()->search_task, std::move(states),
+                       std::move(inst_disp_map), std::move(inst_predicted_flops)));
+  return wkl_inst_ids;
+}
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetry")
+    .set_body_typed([](const DynWklDispatcher& dispatcher,
+                       PackedFunc on_hot_swap, const String& dispatcher_name) {
+      return DynWklTelemetry(dispatcher, on_hot_swap, dispatcher_name);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetryRecord")
+    .set_body_typed([](DynWklTelemetry telemetry, const Array<IntImm>& shape_tuple,
+                       const double latency) {
+      telemetry->Record(shape_tuple, latency);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetryReport")
+    .set_body_typed([](const DynWklTelemetry& telemetry) {
+      return telemetry->Report();
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetrySelectRetuneInsts")
+    .set_body_typed([](const DynWklTelemetry& telemetry, const double min_call_ratio,
+                       const double max_flops_ratio) {
+      return telemetry->SelectRetuneInsts(min_call_ratio, max_flops_ratio);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetryHotSwap")
+    .set_body_typed([](DynWklTelemetry telemetry, const DynWklDispatcher& dispatcher) {
+      telemetry->HotSwap(dispatcher);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetryGetDispatcher")
+    .set_body_typed([](const DynWklTelemetry& telemetry) {
+      return telemetry->GetDispatcher();
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.DynWklTelemetryReset")
+    .set_body_typed([](DynWklTelemetry telemetry) {
+      telemetry->Reset();
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RetuneHotInsts")
+    .set_body_typed(RetuneHotInsts);
+
 StateVer::StateVer(const int major, const int minor) {
   ObjectPtr<StateVerNode> node = make_object<StateVerNode>();
   node->major = Integer(major);
@@ -244,6 +624,14 @@ DecisionTreeNode::DecisionTreeNode(const PrimExpr& predicate,
   data_ = std::move(node);
 }
 
+DecisionTreeNode::DecisionTreeNode(const PrimExpr& predicate,
+                                   const DecisionTreeNode& if_node,
+                                   const DecisionTreeNode& else_node)
+    : DecisionTreeNode(predicate, if_node.get(), else_node.get()) {
+  DecisionTreeNodeNode* const node = static_cast<DecisionTreeNodeNode*>(get_mutable());
+  node->children = {if_node, else_node};
+}
+
 static void printDecisionTreeRecursively(
     std::ostream& out,
     const DecisionTreeNodeNode* const tree_node,
@@ -282,8 +670,8 @@ TVM_REGISTER_GLOBAL("auto_scheduler.DecisionTreeNode")
         CHECK(if_node);
         CHECK(else_node);
         CHECK(!state_ver);
-        return DecisionTreeNode(predicate.value(), if_node.value().operator->(),
-                                else_node.value().operator->());
+        return DecisionTreeNode(predicate.value(), if_node.value(),
+                                else_node.value());
       }
       if (state_ver) {
         CHECK(!predicate);
@@ -297,6 +685,392 @@ TVM_REGISTER_GLOBAL("auto_scheduler.DecisionTreeNode")
 
 TVM_REGISTER_NODE_TYPE(DecisionTreeNodeNode);
 
+
+namespace {
+
+/*!
+ * \brief Greedy top-down builder of the cost-sensitive dispatch trees. The
+ *        misdispatch costs are unnormalized (i.e., not divided by the total
+ *        weight) internally.
+ */
+class DispatchTreeBuilder {
+ public:
+  // The cost of dispatching an instance to a candidate that it must not be
+  // dispatched to, per unit weight. It is finite so that the splits that
+  // separate the infeasible instances are still ranked.
+  static constexpr double kInfeasibleCost = 1e6;
+
+  DispatchTreeBuilder(const Array<DynShapeVar>& shape_vars,
+                      const Array<Array<IntImm>>& wkl_insts,
+                      const std::vector<float>& wkl_inst_weights,
+                      const std::vector<float>& adapted_flops,
+                      const Array<StateVer>& candidates)
+      : shape_vars_(shape_vars), candidates_(candidates),
+        num_insts_(wkl_insts.size()), num_cands_(candidates.size()) {
+    CHECK(num_cands_ > 0) << "No candidate has been given";
+    CHECK(wkl_inst_weights.size() == num_insts_);
+    CHECK(adapted_flops.size() == num_insts_ * num_cands_)
+        << "The adapted flops matrix is expected to be of shape ["
+        << num_insts_ << " x " << num_cands_ << "]";
+    shape_values_.resize(num_insts_);
+    for (size_t i = 0; i < num_insts_; ++i) {
+      CHECK(wkl_insts[i].size() == shape_vars.size());
+      for (const IntImm& dim : wkl_insts[i]) {
+        shape_values_[i].push_back(dim->value);
+      }
+    }
+    costs_.resize(num_insts_ * num_cands_);
+    for (size_t i = 0; i < num_insts_; ++i) {
+      float best_flops = 0.;
+      for (size_t c = 0; c < num_cands_; ++c) {
+        best_flops = std::max(best_flops, adapted_flops[i * num_cands_ + c]);
+      }
+      for (size_t c = 0; c < num_cands_; ++c) {
+        const float flops = adapted_flops[i * num_cands_ + c];
+        costs_[i * num_cands_ + c] =
+            wkl_inst_weights[i] *
+            (flops > 0 ? best_flops / flops - 1. : kInfeasibleCost);
+      }
+    }
+  }
+
+  /*! \brief Build the tree greedily with at most `max_depth` levels. */
+  DecisionTreeNode Build(const int max_depth, double* const cost) const {
+    std::vector<size_t> inst_ids(num_insts_);
+    std::iota(inst_ids.begin(), inst_ids.end(), 0);
+    return BuildRecursively(inst_ids, max_depth, cost);
+  }
+
+ private:
+  /*! \brief The best candidate for all the instances and its cost. */
+  std::pair<size_t, double> BestLeaf(const std::vector<size_t>& inst_ids) const {
+    size_t best_cand = 0;
+    double best_cost = std::numeric_limits<double>::max();
+    for (size_t c = 0; c < num_cands_; ++c) {
+      double cost = 0.;
+      for (const size_t i : inst_ids) {
+        cost += costs_[i * num_cands_ + c];
+      }
+      if (cost < best_cost) {
+        best_cand = c;
+        best_cost = cost;
+      }
+    }
+    return {best_cand, best_cost};
+  }
+
+  DecisionTreeNode BuildRecursively(const std::vector<size_t>& inst_ids,
+                                    const int depth, double* const cost) const {
+    std::pair<size_t, double> leaf = BestLeaf(inst_ids);
+    *cost = leaf.second;
+    if (depth == 0 || leaf.second <= 0.) {
+      return DecisionTreeNode(candidates_[leaf.first]);
+    }
+    // Find the split `shape_var <= threshold` that minimizes the total cost of
+    // the two resulting leaves.
+    size_t split_var = 0;
+    int64_t split_threshold = 0;
+    double split_cost = leaf.second;
+    // Among the equally good splits, the most balanced one keeps the tree
+    // shallow.
+    size_t split_imbalance = inst_ids.size();
+    bool found_split = false;
+
+    for (size_t k = 0; k < shape_vars_.size(); ++k) {
+      std::vector<int64_t> values;
+      for (const size_t i : inst_ids) {
+        values.push_back(shape_values_[i][k]);
+      }
+      std::sort(values.begin(), values.end());
+      values.erase(std::unique(values.begin(), values.end()), values.end());
+      // The last value does not separate any instance.
+      for (size_t j = 0; j + 1 < values.size(); ++j) {
+        std::vector<size_t> if_inst_ids, else_inst_ids;
+        Partition(inst_ids, k, values[j], &if_inst_ids, &else_inst_ids);
+        const double cost =
+            BestLeaf(if_inst_ids).second + BestLeaf(else_inst_ids).second;
+        const size_t imbalance =
+            std::max(if_inst_ids.size(), else_inst_ids.size()) -
+            std::min(if_inst_ids.size(), else_inst_ids.size());
+        if (cost < split_cost ||
+            (found_split && cost == split_cost && imbalance < split_imbalance)) {
+          split_var = k;
+          split_threshold = values[j];
+          split_cost = cost;
+          split_imbalance = imbalance;
+          found_split = true;
+        }
+      }
+    }
+    if (!found_split) {
+      return DecisionTreeNode(candidates_[leaf.first]);
+    }
+    std::vector<size_t> if_inst_ids, else_inst_ids;
+    Partition(inst_ids, split_var, split_threshold, &if_inst_ids, &else_inst_ids);
+    double if_cost, else_cost;
+    DecisionTreeNode if_node = BuildRecursively(if_inst_ids, depth - 1, &if_cost),
+                     else_node = BuildRecursively(else_inst_ids, depth - 1, &else_cost);
+    *cost = if_cost + else_cost;
+    const DynShapeVar& shape_var = shape_vars_[split_var];
+    return DecisionTreeNode(
+        shape_var <= IntImm(shape_var->dtype, split_threshold), if_node, else_node);
+  }
+
+  void Partition(const std::vector<size_t>& inst_ids, const size_t var_id,
+                 const int64_t threshold, std::vector<size_t>* const if_inst_ids,
+                 std::vector<size_t>* const else_inst_ids) const {
+    for (const size_t i : inst_ids) {
+      if (shape_values_[i][var_id] <= threshold) {
+        if_inst_ids->push_back(i);
+      } else {
+        else_inst_ids->push_back(i);
+      }
+    }
+  }
+
+  const Array<DynShapeVar>& shape_vars_;
+  const Array<StateVer>& candidates_;
+  const size_t num_insts_, num_cands_;
+  std::vector<std::vector<int64_t>> shape_values_;
+  std::vector<double> costs_;
+};
+
+void CollectDecisionTreeStateVers(
+    const DecisionTreeNodeNode* const tree_node,
+    std::unordered_set<StateVer, StructuralHash, StructuralEqual>* const visited,
+    Array<StateVer>* const state_vers) {
+  CHECK(tree_node != nullptr);
+  if (tree_node->predicate) {
+    CollectDecisionTreeStateVers(tree_node->if_node, visited, state_vers);
+    CollectDecisionTreeStateVers(tree_node->else_node, visited, state_vers);
+  } else {
+    CHECK(tree_node->state_ver);
+    if (visited->insert(tree_node->state_ver.value()).second) {
+      state_vers->push_back(tree_node->state_ver.value());
+    }
+  }
+}
+
+}  // namespace anonymous
+
+
+DecisionTreeNode BuildDispatchDecisionTree(
+    const Array<DynShapeVar>& shape_vars, const Array<Array<IntImm>>& wkl_insts,
+    const std::vector<float>& wkl_inst_weights,
+    const std::vector<float>& adapted_flops, const Array<StateVer>& candidates,
+    const double max_misdispatch_cost, const int max_depth) {
+  CHECK(!wkl_insts.empty()) << "No workload instance has been given";
+  DispatchTreeBuilder builder(shape_vars, wkl_insts, wkl_inst_weights,
+                              adapted_flops, candidates);
+  const double weight_sum = std::accumulate(wkl_inst_weights.begin(),
+                                            wkl_inst_weights.end(), 0.);
+  CHECK(weight_sum > 0.) << "The workload instance weights sum to 0";
+
+  DecisionTreeNode tree;
+  double cost = 0.;
+  // Deepen the tree until it is accurate enough. Since the greedy builder only
+  // splits a node when the split strictly reduces the cost, the tree stops
+  // growing once no split helps any more.
+  for (int depth = 0; depth <= max_depth; ++depth) {
+    tree = builder.Build(depth, &cost);
+    if (cost / weight_sum <= max_misdispatch_cost) {
+      break;
+    }
+  }
+  CHECK(cost / weight_sum < DispatchTreeBuilder::kInfeasibleCost * 1e-3)
+      << "Unable to build a decision tree with at most " << max_depth
+      << " levels that dispatches every instance to a feasible candidate";
+  if (cost / weight_sum > max_misdispatch_cost) {
+    LOG(WARNING) << "The misdispatch cost (" << cost / weight_sum << ") "
+                    "exceeds the threshold (" << max_misdispatch_cost << ") "
+                    "with " << max_depth << " levels";
+  }
+  return tree;
+}
+
+Array<StateVer> GetDecisionTreeStateVers(const DecisionTreeNode& tree) {
+  std::unordered_set<StateVer, StructuralHash, StructuralEqual> visited;
+  Array<StateVer> state_vers;
+  CollectDecisionTreeStateVers(tree.get(), &visited, &state_vers);
+  return state_vers;
+}
+
+Array<Integer> GetDecisionTreeLeafIds(const DecisionTreeNode& tree,
+                                      const Array<DynShapeVar>& shape_vars,
+                                      const Array<Array<IntImm>>& wkl_insts) {
+  std::unordered_map<StateVer, int, StructuralHash, StructuralEqual> leaf_ids;
+  for (const StateVer& state_ver : GetDecisionTreeStateVers(tree)) {
+    leaf_ids.emplace(state_ver, leaf_ids.size());
+  }
+  arith::Analyzer analyzer;
+  Array<Integer> inst_leaf_ids;
+  for (const Array<IntImm>& wkl_inst : wkl_insts) {
+    CHECK(wkl_inst.size() == shape_vars.size());
+    auto fshape_value = [&shape_vars, &wkl_inst](const tir::Var& var) -> Optional<PrimExpr> {
+      for (size_t k = 0; k < shape_vars.size(); ++k) {
+        if (shape_vars[k]->name_hint == var->name_hint) {
+          return wkl_inst[k];
+        }
+      }
+      return NullOpt;
+    };
+    const DecisionTreeNodeNode* tree_node = tree.get();
+    while (tree_node->predicate) {
+      const IntImmNode* const cond = analyzer.Simplify(
+          tir::Substitute(tree_node->predicate.value(), fshape_value)).as<IntImmNode>();
+      CHECK(cond != nullptr) << "Unable to evaluate the predicate "
+                             << tree_node->predicate << " on " << wkl_inst;
+      tree_node = cond->value ? tree_node->if_node : tree_node->else_node;
+    }
+    CHECK(tree_node->state_ver);
+    inst_leaf_ids.push_back(Integer(leaf_ids.at(tree_node->state_ver.value())));
+  }
+  return inst_leaf_ids;
+}
+
+namespace {
+
+/*!
+ * \brief Decompose the predicate `shape_var <= value` into the index of the
+ *        shape variable and the value.
+ * \return False if the predicate is not of the form.
+ */
+bool DecomposeDecisionTreePredicate(const PrimExpr& predicate,
+                                    const Array<DynShapeVar>& shape_vars,
+                                    size_t* const var_id, int64_t* const threshold) {
+  const tir::LENode* const le = predicate.as<tir::LENode>();
+  if (le == nullptr) {
+    return false;
+  }
+  const VarNode* const var = le->a.as<VarNode>();
+  const IntImmNode* const value = le->b.as<IntImmNode>();
+  if (var == nullptr || value == nullptr) {
+    return false;
+  }
+  for (size_t k = 0; k < shape_vars.size(); ++k) {
+    if (shape_vars[k]->name_hint == var->name_hint) {
+      *var_id = k;
+      *threshold = value->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CollectDecisionTreeThresholds(const DecisionTreeNodeNode* const tree_node,
+                                   const Array<DynShapeVar>& shape_vars,
+                                   std::vector<std::vector<int64_t>>* const thresholds) {
+  if (!tree_node->predicate) {
+    return true;
+  }
+  size_t var_id;
+  int64_t threshold;
+  if (!DecomposeDecisionTreePredicate(tree_node->predicate.value(), shape_vars,
+                                      &var_id, &threshold)) {
+    return false;
+  }
+  (*thresholds)[var_id].push_back(threshold);
+  return CollectDecisionTreeThresholds(tree_node->if_node, shape_vars, thresholds) &&
+         CollectDecisionTreeThresholds(tree_node->else_node, shape_vars, thresholds);
+}
+
+}  // namespace anonymous
+
+
+DispatchTable::DispatchTable(const DecisionTreeNode& tree,
+                             const Array<DynShapeVar>& shape_vars,
+                             const size_t max_num_cells) {
+  std::vector<std::vector<int64_t>> var_thresholds(shape_vars.size());
+  if (!CollectDecisionTreeThresholds(tree.get(), shape_vars, &var_thresholds)) {
+    return;
+  }
+  size_t num_cells = 1;
+  for (std::vector<int64_t>& var_threshold : var_thresholds) {
+    std::sort(var_threshold.begin(), var_threshold.end());
+    var_threshold.erase(std::unique(var_threshold.begin(), var_threshold.end()),
+                        var_threshold.end());
+    num_cells *= var_threshold.size() + 1;
+    if (num_cells > max_num_cells) {
+      return;
+    }
+  }
+  thresholds = std::move(var_thresholds);
+  strides.assign(shape_vars.size(), 1);
+  for (int k = static_cast<int>(shape_vars.size()) - 2; k >= 0; --k) {
+    strides[k] = strides[k + 1] * (thresholds[k + 1].size() + 1);
+  }
+
+  std::unordered_map<StateVer, size_t, StructuralHash, StructuralEqual> leaf_ids;
+  std::vector<int64_t> shape_values(shape_vars.size());
+  cell_leaf_ids.reserve(num_cells);
+  for (size_t cell = 0; cell < num_cells; ++cell) {
+    // Every bucket is represented by its largest value (the smallest one for
+    // the last bucket), which is consistent with all the predicates.
+    for (size_t k = 0; k < shape_vars.size(); ++k) {
+      const size_t bucket = (cell / strides[k]) % (thresholds[k].size() + 1);
+      shape_values[k] = bucket < thresholds[k].size()
+                            ? thresholds[k][bucket]
+                            : (thresholds[k].empty() ? 0 : thresholds[k].back() + 1);
+    }
+    const DecisionTreeNodeNode* tree_node = tree.get();
+    while (tree_node->predicate) {
+      size_t var_id;
+      int64_t threshold;
+      DecomposeDecisionTreePredicate(tree_node->predicate.value(), shape_vars,
+                                     &var_id, &threshold);
+      tree_node = shape_values[var_id] <= threshold ? tree_node->if_node
+                                                    : tree_node->else_node;
+    }
+    CHECK(tree_node->state_ver);
+    const StateVer& state_ver = tree_node->state_ver.value();
+    auto leaf_it = leaf_ids.find(state_ver);
+    if (leaf_it == leaf_ids.end()) {
+      leaf_it = leaf_ids.emplace(state_ver, leaves.size()).first;
+      leaves.push_back(state_ver);
+    }
+    cell_leaf_ids.push_back(leaf_it->second);
+  }
+  if (leaves.size() > kMaxNumLeaves) {
+    *this = DispatchTable();
+  }
+}
+
+size_t DispatchTable::GetCell(const std::vector<int64_t>& shape_values) const {
+  size_t cell = 0;
+  for (size_t k = 0; k < thresholds.size(); ++k) {
+    const size_t bucket =
+        std::lower_bound(thresholds[k].begin(), thresholds[k].end(), shape_values[k]) -
+        thresholds[k].begin();
+    cell += bucket * strides[k];
+  }
+  return cell;
+}
+
+TVM_REGISTER_GLOBAL("auto_scheduler.BuildDispatchDecisionTree")
+    .set_body_typed([](const Array<DynShapeVar>& shape_vars,
+                       const Array<Array<IntImm>>& wkl_insts,
+                       const Array<FloatImm>& wkl_inst_weights,
+                       const Array<FloatImm>& adapted_flops,
+                       const Array<StateVer>& candidates,
+                       const double max_misdispatch_cost, const int max_depth) {
+      std::vector<float> wkl_inst_weights_vec, adapted_flops_vec;
+      for (const FloatImm& w : wkl_inst_weights) {
+        wkl_inst_weights_vec.push_back(w->value);
+      }
+      for (const FloatImm& flops : adapted_flops) {
+        adapted_flops_vec.push_back(flops->value);
+      }
+      return BuildDispatchDecisionTree(shape_vars, wkl_insts, wkl_inst_weights_vec,
+                                       adapted_flops_vec, candidates,
+                                       max_misdispatch_cost, max_depth);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.GetDecisionTreeStateVers")
+    .set_body_typed(GetDecisionTreeStateVers);
+
+TVM_REGISTER_GLOBAL("auto_scheduler.GetDecisionTreeLeafIds")
+    .set_body_typed(GetDecisionTreeLeafIds);
+
 TVM_REGISTER_GLOBAL("driver.GenerateAndCompressIRMods")
     .set_body_typed([](const DynWklDispatcher& dyn_wkl_dispatcher,
                        const String& prefix) -> Array<ObjectRef> {
@@ -363,6 +1137,13 @@ TVM_REGISTER_GLOBAL("auto_scheduler.ReplaceShapeVars")
 TVM_REGISTER_GLOBAL("auto_scheduler.InstantiateDynArgs")
     .set_body_typed(InstantiateDynArgs);
 
+TVM_REGISTER_GLOBAL("auto_scheduler.EstimateFlopForInst")
+    .set_body_typed([](const ComputeDAG& compute_dag,
+                       const Array<DynShapeVar>& shape_vars,
+                       const Array<IntImm>& wkl_inst) {
+      return EstimateFlopForInst(compute_dag, shape_vars, wkl_inst);
+    });
+
 
 }  // namespace auto_scheduler
 }  // namespace tvm
@@ -1,9 +1,13 @@
+#include <tvm/tir/buffer.h>
 #include <tvm/tir/builtin.h>
+#include <tvm/tir/function.h>
 #include <tvm/tir/stmt_functor.h>
 #include <tvm/tir/transform.h>
 #include <tvm/auto_scheduler/dietcode.h>
 #include "./utils.h"
 
+#include <functional>
+
 
 namespace tvm {
 namespace auto_scheduler {
@@ -246,21 +250,29 @@ class ShapeVarReplacer : public StmtExprMutator {
   }
 };
 
-class ArgsExtractor : public StmtExprVisitor {
- private:
-  std::string func_name_;
+/*!
+ * \brief Index the arguments of all the calls in the host functions by the
+ *        names of the callees, so that they are only scanned once.
+ */
+class CallArgsIndexer : public StmtExprVisitor {
  public:
-  Optional<Array<PrimExpr>> call_args;
-  ArgsExtractor(const std::string& func_name) : func_name_(func_name) {}
+  std::unordered_map<std::string, Array<PrimExpr>> call_args;
+
+  explicit CallArgsIndexer(const IRModule& mod) {
+    for (const auto& gv_func_pair : mod->functions) {
+      if (const PrimFuncNode* const primf = gv_func_pair.second.as<PrimFuncNode>()) {
+        this->operator()(primf->body);
+      }
+    }
+  }
  protected:
   void VisitExpr_(const CallNode* op) override final {
     if (!op->args.defined() || op->args.size() == 0) {
       return;
     }
     if (const StringImmNode* const func_name = op->args[0].as<StringImmNode>()) {
-      if (func_name_ == std::string(func_name->value)) {
-        call_args = op->args;
-      }
+      // all the calls to the same kernel share the same arguments
+      call_args.emplace(func_name->value, op->args);
     }
   }
 };
@@ -295,82 +307,190 @@ class ArgsReplacer : public ExprMutator {
 };
 
 
+Stmt LowerTreeDispatch(const DecisionTreeNodeNode* const tree_node,
+                       const std::function<PrimExpr(const PrimExpr&)>& fshape_var,
+                       const std::function<Stmt(const StateVer&)>& fkernel_call) {
+  if (tree_node->predicate) {
+    CHECK(tree_node->if_node);
+    CHECK(tree_node->else_node);
+    return IfThenElse(fshape_var(tree_node->predicate.value()),
+                      LowerTreeDispatch(tree_node->if_node, fshape_var, fkernel_call),
+                      LowerTreeDispatch(tree_node->else_node, fshape_var, fkernel_call));
+  } else {
+    CHECK(tree_node->state_ver);
+    return fkernel_call(tree_node->state_ver.value());
+  }
+}
+
+/*!
+ * \brief Dispatch through the lookup table. The table cell is computed with
+ *        branch-free comparisons, and mapped to the leaf index by a constant
+ *        byte array (a private constant global of the host module) that stores
+ *        one leaf index per cell. The kernel calls are then selected by a dense
+ *        chain of equality tests on the leaf index, which LLVM folds into a
+ *        switch and lowers into a jump table (TIR has no switch statement nor
+ *        indirect calls to express the call table directly).
+ */
+Stmt LowerTableDispatch(const DispatchTable& dispatch_table,
+                        const Array<DynShapeVar>& shape_vars,
+                        const std::function<PrimExpr(const PrimExpr&)>& fshape_var,
+                        const std::function<Stmt(const StateVer&)>& fkernel_call) {
+  const DataType cell_dtype = DataType::Int(32);
+  PrimExpr cell_expr = IntImm(cell_dtype, 0);
+  for (size_t k = 0; k < shape_vars.size(); ++k) {
+    if (dispatch_table.thresholds[k].empty()) {
+      continue;
+    }
+    PrimExpr shape_var = fshape_var(shape_vars[k]);
+    PrimExpr bucket;
+    for (const int64_t threshold : dispatch_table.thresholds[k]) {
+      PrimExpr gt = Cast(cell_dtype, shape_var > IntImm(shape_var.dtype(), threshold));
+      bucket = bucket.defined() ? bucket + gt : gt;
+    }
+    cell_expr = cell_expr + bucket * IntImm(cell_dtype, dispatch_table.strides[k]);
+  }
+  Var cell("dispatch_cell", cell_dtype);
+
+  // The leaf indices fit in one byte each, and the string constants of both
+  // the LLVM and the C host codegen are length-delimited (escaped in C).
+  CHECK_LE(dispatch_table.leaves.size(), DispatchTable::kMaxNumLeaves);
+  std::string leaf_table;
+  leaf_table.reserve(dispatch_table.cell_leaf_ids.size());
+  for (const size_t leaf_id : dispatch_table.cell_leaf_ids) {
+    leaf_table.push_back(static_cast<char>(static_cast<uint8_t>(leaf_id)));
+  }
+  Var table("dispatch_leaf_table", PointerType(PrimType(DataType::UInt(8))));
+  Var leaf("dispatch_leaf", cell_dtype);
+  PrimExpr leaf_expr = Cast(cell_dtype, Load(DataType::UInt(8), table, cell, const_true()));
+
+  // The last leaf is the fall-through case.
+  Stmt body = fkernel_call(dispatch_table.leaves[dispatch_table.leaves.size() - 1]);
+  for (int leaf_id = static_cast<int>(dispatch_table.leaves.size()) - 2; leaf_id >= 0;
+       --leaf_id) {
+    body = IfThenElse(leaf == IntImm(cell_dtype, leaf_id),
+                      fkernel_call(dispatch_table.leaves[leaf_id]), body);
+  }
+  return LetStmt(table, StringImm(leaf_table),
+                 LetStmt(cell, cell_expr, LetStmt(leaf, leaf_expr, body)));
+}
+
+/*!
+ * \brief Lower the dispatcher into the host code, using the table if it is
+ *        defined and the tree otherwise.
+ * \param fshape_var Map the shape variables to the ones of the host function.
+ * \param fkernel_call Make the call into the kernel of a state version.
+ * \param count_name If not empty, every kernel call is preceded by a call to
+ *        `TVMBackendCountDispatch(count_name, leaf_id)`, where the leaf ids are
+ *        the indices into `GetDecisionTreeStateVers(tree)`.
+ */
+Stmt LowerDispatch(const DecisionTreeNode& tree, const DispatchTable& dispatch_table,
+                   const Array<DynShapeVar>& shape_vars,
+                   const std::function<PrimExpr(const PrimExpr&)>& fshape_var,
+                   const std::function<Stmt(const StateVer&)>& fkernel_call,
+                   const std::string& count_name) {
+  std::function<Stmt(const StateVer&)> fcounted_kernel_call = fkernel_call;
+  if (!count_name.empty()) {
+    std::unordered_map<StateVer, int, StructuralHash, StructuralEqual> leaf_ids;
+    for (const StateVer& state_ver : GetDecisionTreeStateVers(tree)) {
+      leaf_ids.emplace(state_ver, leaf_ids.size());
+    }
+    fcounted_kernel_call = [leaf_ids, &count_name, &fkernel_call](const StateVer& state_ver) {
+      Stmt count = Evaluate(Call(DataType::Int(32), builtin::call_extern(),
+                                 {StringImm("TVMBackendCountDispatch"), StringImm(count_name),
+                                  IntImm(DataType::Int(32), leaf_ids.at(state_ver))}));
+      return SeqStmt({count, fkernel_call(state_ver)});
+    };
+  }
+  if (dispatch_table.defined()) {
+    return LowerTableDispatch(dispatch_table, shape_vars, fshape_var, fcounted_kernel_call);
+  }
+  return LowerTreeDispatch(tree.get(), fshape_var, fcounted_kernel_call);
+}
+
+/*! \brief The name to count the dispatches under, empty if they are not counted. */
+std::string GetDispatchCountName(const std::string& name) {
+  const bool count_dispatches =
+      tvm::transform::PassContext::Current()
+          ->GetConfig<Bool>("auto_scheduler.count_dispatches", Bool(true))
+          .value();
+  return count_dispatches ? name : "";
+}
+
+std::string GetKernelName(const std::string& name_prefix, const StateVer& state_ver,
+                          const std::string& name_suffix = "") {
+  return name_prefix + "_" + std::to_string(state_ver->major->value)
+                     + "_" + std::to_string(state_ver->minor->value) +
+         name_suffix;
+}
+
+DispatchTable MakeDispatchTable(const DecisionTreeNode& tree,
+                                const Array<DynShapeVar>& shape_vars,
+                                const String& dispatch_mode) {
+  CHECK(dispatch_mode == "tree" || dispatch_mode == "table")
+      << "Unknown dispatch_mode=" << dispatch_mode << ", expected tree or table";
+  if (dispatch_mode == "tree") {
+    return DispatchTable();
+  }
+  DispatchTable dispatch_table(tree, shape_vars);
+  if (!dispatch_table.defined()) {
+    LOG(WARNING) << "Unable to flatten the decision tree into a lookup table, "
+                    "falling back to the tree dispatch";
+  }
+  return dispatch_table;
+}
+
+
 class InlineDispatchTransform : public StmtExprMutator {
  private:
   Array<te::Tensor> tensors_;
   Array<DynShapeVar> orig_shape_vars_;
   DecisionTreeNode tree_classifier_root_;
-  IRModule merged_mod_host_;
+  const CallArgsIndexer& call_args_index_;
+  const DispatchTable& dispatch_table_;
   Array<Var> shape_vars_;
   String name_prefix_;
+  std::string count_name_;
 
  private:
 
-  Array<PrimExpr> LocateCallArgs(const std::string& func_name) const {
-    ArgsExtractor extractor(func_name);
-    for (const auto& gv_func_pair : merged_mod_host_->functions) {
-      extractor(Downcast<PrimFunc>(gv_func_pair.second)->body);
-      if (extractor.call_args) {
-        return extractor.call_args.value();
-      }
-    }
-    LOG(FATAL) << "func_name=" << func_name << " not found";
-    return Array<PrimExpr>();
+  const Array<PrimExpr>& LocateCallArgs(const std::string& func_name) const {
+    auto call_args_it = call_args_index_.call_args.find(func_name);
+    CHECK(call_args_it != call_args_index_.call_args.end())
+        << "func_name=" << func_name << " not found";
+    return call_args_it->second;
   }
 
-  Stmt Dispatch(const DecisionTreeNodeNode* const tree_node,
-                ShapeVarReplacer& shape_var_replacer,
-                const CallNode* const orig_call_op,
-                const std::string& name_prefix,
-                const std::string& name_suffix) const {
-    if (tree_node->predicate) {
-      CHECK(tree_node->if_node);
-      CHECK(tree_node->else_node);
-      return IfThenElse(shape_var_replacer(tree_node->predicate.value()),
-                        Dispatch(tree_node->if_node, shape_var_replacer, orig_call_op,
-                                 name_prefix, name_suffix),
-                        Dispatch(tree_node->else_node, shape_var_replacer, orig_call_op,
-                                 name_prefix, name_suffix));
-    } else {
-      CHECK(tree_node->state_ver);
-      std::string func_name = 
-          name_prefix + "_" + std::to_string(tree_node->state_ver.value()->major->value)
-                      + "_" + std::to_string(tree_node->state_ver.value()->minor->value) +
-          name_suffix;
-      Array<PrimExpr> merged_mod_host_args = LocateCallArgs(func_name),
-                      new_args;
-                      // new_args = orig_call_op->args;
-      ArgsReplacer args_replacer(orig_call_op->args);
-
-      // CHECK(new_args.size() == merged_mod_host_args.size())
-      //     << "new_args=" << new_args << " does not match that of "
-      //        "merged_mod_host_args=" << merged_mod_host_args;
-      // new_args.Set(0, StringImm(func_name));
-      // for (size_t i = tensors_.size() + orig_shape_vars_.size() + 1;
-      //      i < new_args.size(); ++i) {
-      //   new_args.Set(i, replacer(merged_mod_host_args[i]));
-      // }
-      new_args.push_back(StringImm(func_name));
-      for (size_t i = 1; i < merged_mod_host_args.size(); ++i) {
-        new_args.push_back(args_replacer(merged_mod_host_args[i]));
-      }
-
-      return Evaluate(Call(orig_call_op->dtype,
-                           orig_call_op->op,
-                           new_args));
+  Stmt CallKernel(const StateVer& state_ver,
+                  const CallNode* const orig_call_op,
+                  const std::string& name_prefix,
+                  const std::string& name_suffix) const {
+    std::string func_name = GetKernelName(name_prefix, state_ver, name_suffix);
+    const Array<PrimExpr>& merged_mod_host_args = LocateCallArgs(func_name);
+    Array<PrimExpr> new_args;
+    ArgsReplacer args_replacer(orig_call_op->args);
+
+    new_args.push_back(StringImm(func_name));
+    for (size_t i = 1; i < merged_mod_host_args.size(); ++i) {
+      new_args.push_back(args_replacer(merged_mod_host_args[i]));
     }
+    return Evaluate(Call(orig_call_op->dtype,
+                         orig_call_op->op,
+                         new_args));
   }
 
  public:
   InlineDispatchTransform(const Array<te::Tensor>& tensors,
                           const Array<DynShapeVar>& shape_vars,
                           const DecisionTreeNode& tree_classifier_root,
-                          const IRModule& merged_mod_host,
+                          const CallArgsIndexer& call_args_index,
+                          const DispatchTable& dispatch_table,
                           const String& name_prefix)
       : tensors_(tensors), orig_shape_vars_(shape_vars),
         tree_classifier_root_(tree_classifier_root),
-        merged_mod_host_(merged_mod_host),
-        name_prefix_(name_prefix)
+        call_args_index_(call_args_index),
+        dispatch_table_(dispatch_table),
+        name_prefix_(name_prefix),
+        count_name_(GetDispatchCountName(name_prefix))
         {}
   Stmt VisitStmt_(const LetStmtNode* op) override final {
     auto shape_var_it =
@@ -391,10 +511,15 @@ class InlineDispatchTransform : public StmtExprMutator {
         return StmtExprMutator::VisitStmt_(op);
       }
       ShapeVarReplacer replacer(shape_vars_);
-      return Dispatch(tree_classifier_root_.get(), replacer, call_op,
-                      func_name.substr(0, name_prefix_pos + name_prefix_.size()),
-                      func_name.substr(name_prefix_pos + name_prefix_.size())
-                      );
+      std::string name_prefix = func_name.substr(0, name_prefix_pos + name_prefix_.size()),
+                  name_suffix = func_name.substr(name_prefix_pos + name_prefix_.size());
+      return LowerDispatch(
+          tree_classifier_root_, dispatch_table_, orig_shape_vars_,
+          [&replacer](const PrimExpr& expr) { return replacer(expr); },
+          [this, call_op, &name_prefix, &name_suffix](const StateVer& state_ver) {
+            return CallKernel(state_ver, call_op, name_prefix, name_suffix);
+          },
+          count_name_);
     }
     return StmtExprMutator::VisitStmt_(op);
   }
@@ -412,9 +537,13 @@ IRModule InlineDispatch(// IRModule skeleton_mod_host,
                         IRModule skeleton_mod_host,
                         const IRModule& merged_mod_host,
                         const IRModule& merged_mod_dev,
-                        const String& name_prefix
+                        const String& name_prefix,
+                        const String& dispatch_mode
                         ) {
   // InlineDispatchAnalysis analysis(dyn_wkl_dispatcher);
+  CallArgsIndexer call_args_index(merged_mod_host);
+  DispatchTable dispatch_table =
+      MakeDispatchTable(tree_classifier_root, shape_vars, dispatch_mode);
 
   IRModuleNode* const mutable_skeleton_mod_host =
       skeleton_mod_host.CopyOnWrite();
@@ -435,7 +564,8 @@ IRModule InlineDispatch(// IRModule skeleton_mod_host,
       //                                   );
       InlineDispatchTransform transform(tensors, shape_vars,
                                         tree_classifier_root,
-                                        merged_mod_host,
+                                        call_args_index,
+                                        dispatch_table,
                                         name_prefix);
       PrimFuncNode* const mutable_primf = primf_ref.CopyOnWrite();
       mutable_primf->body = transform(primf_node->body);
@@ -449,6 +579,56 @@ IRModule InlineDispatch(// IRModule skeleton_mod_host,
 
 TVM_REGISTER_GLOBAL("auto_scheduler.InlineDispatch").set_body_typed(InlineDispatch);
 
+IRModule MakeHostDispatcher(const Array<te::Tensor>& tensors,
+                            const Array<DynShapeVar>& shape_vars,
+                            const DecisionTreeNode& tree_classifier_root,
+                            const String& name, const String& dispatch_mode) {
+  DispatchTable dispatch_table =
+      MakeDispatchTable(tree_classifier_root, shape_vars, dispatch_mode);
+  Array<Var> params;
+  Map<Var, Buffer> buffer_map;
+  Array<PrimExpr> packed_buffers;
+  for (const te::Tensor& tensor : tensors) {
+    Buffer buffer = decl_buffer(tensor->shape, tensor->dtype, tensor->op->name);
+    Var param(tensor->op->name, DataType::Handle());
+    params.push_back(param);
+    buffer_map.Set(param, buffer);
+    // pass the buffer as a DLTensor, same as tvm.tir.call_packed
+    packed_buffers.push_back(
+        Call(DataType::Handle(), builtin::tvm_stack_make_array(),
+             {buffer->data, Call(DataType::Handle(), builtin::tvm_stack_make_shape(),
+                                 buffer->shape),
+              IntImm(DataType::Int(32), 0),
+              IntImm(DataType::Int(32), buffer->shape.size()),
+              make_zero(buffer->dtype), buffer->elem_offset}));
+  }
+  for (const DynShapeVar& shape_var : shape_vars) {
+    params.push_back(shape_var);
+  }
+  Stmt body = LowerDispatch(
+      tree_classifier_root, dispatch_table, shape_vars,
+      [](const PrimExpr& expr) { return expr; },
+      [&name, &packed_buffers, &shape_vars](const StateVer& state_ver) {
+        // The kernels are defined in the same module and are called directly.
+        Array<PrimExpr> args{StringImm(GetKernelName(name, state_ver))};
+        args.insert(args.end(), packed_buffers.begin(), packed_buffers.end());
+        args.insert(args.end(), shape_vars.begin(), shape_vars.end());
+        return Evaluate(Call(DataType::Int(32), builtin::tvm_call_cpacked(), args));
+      },
+      GetDispatchCountName(name));
+  PrimFunc dispatcher(params, body, VoidType(), buffer_map);
+  dispatcher = WithAttr(std::move(dispatcher), tvm::attr::kGlobalSymbol, name);
+  dispatcher = WithAttr(std::move(dispatcher), tir::attr::kNoAlias, Bool(true));
+  dispatcher = WithAttr(std::move(dispatcher), "tir.is_entry_func", Bool(true));
+  return IRModule({{GlobalVar(name), dispatcher}});
+}
+
+TVM_REGISTER_GLOBAL("auto_scheduler.MakeHostDispatcher").set_body_typed(MakeHostDispatcher);
+
+TVM_REGISTER_PASS_CONFIG_OPTION("auto_scheduler.dispatch_mode", String);
+TVM_REGISTER_PASS_CONFIG_OPTION("auto_scheduler.max_misdispatch_cost", FloatImm);
+TVM_REGISTER_PASS_CONFIG_OPTION("auto_scheduler.count_dispatches", Bool);
+
 }  // namespace auto_scheduler
 
 
@@ -41,8 +41,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "search_policy/utils.h"
@@ -1408,7 +1412,7 @@ void GetPerStoreFeaturesFromStates(const Array<State>& states, const SearchTask&
   // GetPerStoreFeaturesWorkerFunc(task, states[skip_first_n_feature_extraction], max_n_bufs,
   //                               &(*features)[skip_first_n_feature_extraction], &error_ct);
   // enable_verbose_logging = false;
-  support::parallel_for(
+  support::parallel_for_dynamic(
       skip_first_n_feature_extraction, states.size(),
   // for (size_t i = skip_first_n_feature_extraction + 1; i < states.size(); ++i) {
       [&task, &states, &max_n_bufs, &features, &error_ct](int i) {
@@ -1427,7 +1431,7 @@ void GetPerStoreFeaturesFromStates(const Array<State>& states, const std::vector
 
   std::atomic<int> error_ct(0);
 
-  support::parallel_for(skip_first_n_feature_extraction, states.size(),
+  support::parallel_for_dynamic(skip_first_n_feature_extraction, states.size(),
                         [&tasks, &states, &max_n_bufs, &features, &error_ct](int i) {
                           GetPerStoreFeaturesWorkerFunc(tasks[i], states[i], max_n_bufs,
                                                         &(*features)[i], &error_ct);
@@ -1768,12 +1772,16 @@ TVM_REGISTER_GLOBAL("auto_scheduler.GetPerStoreFeatureNames")
 
 
 // <bojian/DietCode>
-void AdaptStateToWorkload(const SearchTask& task, const State& state,
-                          const Array<IntImm>& wkl_inst,
-                          const float score, float* const occupancy_penalty,
-                          float* const padding_penalty,
-                          float* const adapted_score
-                          ) {
+namespace {
+
+/*!
+ * \brief The analytic occupancy and padding penalties of adapting the state to
+ *        the workload instance.
+ */
+void GetAnalyticAdaptionPenalties(const SearchTask& task, const State& state,
+                                  const Array<IntImm>& wkl_inst,
+                                  float* const occupancy_penalty,
+                                  float* const padding_penalty) {
   Map<String, IntImm> shape_var_value_map;
   Array<DynShapeVar> shape_vars = task->shape_vars.value();
 
@@ -1902,8 +1910,194 @@ void AdaptStateToWorkload(const SearchTask& task, const State& state,
     *occupancy_penalty =
         1. * grid_size / floor_by(grid_size, task->hardware_params->num_cores);
   }
+}
+
+/*! \brief The regularization strength towards the analytic exponents. */
+constexpr double kRidgeLambda = 1.;
+/*! \brief The upper bound of the learned exponents. */
+constexpr double kMaxExponent = 4.;
+
+/*!
+ * \brief Learned calibration of the analytic adaption penalties, i.e.,
+ *
+ *          adapted_score = score * occupancy_penalty ^ w_occ
+ *                                * padding_penalty ^ w_pad
+ *
+ *        The exponents are fitted per workload with a ridge regression towards
+ *        the analytic ones (1, 1), on the throughput ratios between the
+ *        workload instances of the multi-shape measurements. Only the
+ *        sufficient statistics are kept so that the model can be updated
+ *        online.
+ *
+ *        The exponents are read for every (state, instance) pair of the
+ *        search, hence they are solved on updates and published as an
+ *        immutable snapshot, so that the readers never take the mutex that
+ *        serializes the writers.
+ */
+class AdaptionPenaltyModel {
+ public:
+  /*! \brief The flattened sufficient statistics, as in `SufficientStats`. */
+  static constexpr size_t kNumStatsFields = 7;
+
+  static AdaptionPenaltyModel* Global() {
+    static AdaptionPenaltyModel inst;
+    return &inst;
+  }
+
+  void Update(const Array<MeasureInput>& inputs, const Array<MeasureResult>& results) {
+    CHECK(inputs.size() == results.size());
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool updated = false;
+    for (size_t input_id = 0; input_id < inputs.size(); ++input_id) {
+      const SearchTask& task = inputs[input_id]->task;
+      const Optional<Array<Array<IntImm>>>& multi_wkl_insts =
+          inputs[input_id]->multi_wkl_insts;
+      const Array<FloatImm>& inst_costs = results[input_id]->inst_costs;
+      if (!IsDynTask(task) || !multi_wkl_insts || results[input_id]->error_no != 0 ||
+          inst_costs.size() != multi_wkl_insts.value().size()) {
+        continue;
+      }
+      // The throughputs are relative to the one on the first instance, so that
+      // the score predicted for the state cancels out.
+      std::vector<double> log_occupancy_penalties, log_padding_penalties, log_throughputs;
+      for (size_t i = 0; i < inst_costs.size(); ++i) {
+        const Array<IntImm>& wkl_inst = multi_wkl_insts.value()[i];
+        float occupancy_penalty, padding_penalty;
+        GetAnalyticAdaptionPenalties(task, inputs[input_id]->state, wkl_inst,
+                                     &occupancy_penalty, &padding_penalty);
+        log_occupancy_penalties.push_back(std::log(occupancy_penalty));
+        log_padding_penalties.push_back(std::log(padding_penalty));
+        log_throughputs.push_back(
+            std::log(EstimateFlopForInst(task->compute_dag, task->shape_vars.value(), wkl_inst) /
+                     inst_costs[i]->value));
+      }
+      SufficientStats& stats = stats_[task->workload_key];
+      for (size_t i = 1; i < inst_costs.size(); ++i) {
+        const double x[2] = {log_occupancy_penalties[i] - log_occupancy_penalties[0],
+                             log_padding_penalties[i] - log_padding_penalties[0]},
+                     y = log_throughputs[i] - log_throughputs[0];
+        if (!std::isfinite(x[0]) || !std::isfinite(x[1]) || !std::isfinite(y)) {
+          continue;
+        }
+        for (int r = 0; r < 2; ++r) {
+          for (int c = 0; c < 2; ++c) {
+            stats.xtx[r][c] += x[r] * x[c];
+          }
+          stats.xty[r] += x[r] * y;
+        }
+        ++stats.num_samples;
+        updated = true;
+      }
+    }  // for (input_id ∈ inputs.size())
+    if (updated) {
+      PublishExponents();
+    }
+  }
+
+  /*! \brief The exponents (w_occ, w_pad) of the workload. */
+  std::pair<double, double> GetExponents(const std::string& workload_key) const {
+    std::shared_ptr<const ExponentsMap> exponents = std::atomic_load(&exponents_);
+    auto exponents_iter = exponents->find(workload_key);
+    if (exponents_iter == exponents->end()) {
+      return std::make_pair(1., 1.);
+    }
+    return exponents_iter->second;
+  }
+
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.clear();
+    PublishExponents();
+  }
+
+  /*! \brief The sufficient statistics of every workload, for persistence. */
+  Map<String, Array<FloatImm>> GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Map<String, Array<FloatImm>> ret;
+    for (const auto& kv : stats_) {
+      const SufficientStats& stats = kv.second;
+      Array<FloatImm> fields;
+      for (const double field :
+           {stats.xtx[0][0], stats.xtx[0][1], stats.xtx[1][0], stats.xtx[1][1],
+            stats.xty[0], stats.xty[1], static_cast<double>(stats.num_samples)}) {
+        fields.push_back(FloatImm(DataType::Float(64), field));
+      }
+      ret.Set(kv.first, fields);
+    }
+    return ret;
+  }
+
+  /*! \brief Replace the sufficient statistics with the persisted ones. */
+  void SetStats(const Map<String, Array<FloatImm>>& persisted_stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.clear();
+    for (const auto& kv : persisted_stats) {
+      const Array<FloatImm>& fields = kv.second;
+      CHECK(fields.size() == kNumStatsFields)
+          << "Malformed adaption penalty statistics of workload_key=" << kv.first;
+      SufficientStats& stats = stats_[kv.first];
+      stats.xtx[0][0] = fields[0]->value;
+      stats.xtx[0][1] = fields[1]->value;
+      stats.xtx[1][0] = fields[2]->value;
+      stats.xtx[1][1] = fields[3]->value;
+      stats.xty[0] = fields[4]->value;
+      stats.xty[1] = fields[5]->value;
+      stats.num_samples = static_cast<size_t>(fields[6]->value);
+    }
+    PublishExponents();
+  }
+
+ private:
+  struct SufficientStats {
+    double xtx[2][2] = {{0., 0.}, {0., 0.}};
+    double xty[2] = {0., 0.};
+    size_t num_samples = 0;
+  };
+  using ExponentsMap = std::unordered_map<std::string, std::pair<double, double>>;
+
+  /*! \brief Solve the exponents of every workload. Requires `mutex_`. */
+  void PublishExponents() {
+    auto exponents = std::make_shared<ExponentsMap>();
+    for (const auto& kv : stats_) {
+      const SufficientStats& stats = kv.second;
+      if (stats.num_samples == 0) {
+        continue;
+      }
+      // (X^T X + lambda I) w = X^T y + lambda w_0, with w_0 = (1, 1)
+      const double a = stats.xtx[0][0] + kRidgeLambda, b = stats.xtx[0][1],
+                   c = stats.xtx[1][0], d = stats.xtx[1][1] + kRidgeLambda,
+                   e = stats.xty[0] + kRidgeLambda, f = stats.xty[1] + kRidgeLambda;
+      const double det = a * d - b * c;
+      auto clamp = [](const double w) { return std::max(0., std::min(w, kMaxExponent)); };
+      (*exponents)[kv.first] =
+          std::make_pair(clamp((d * e - b * f) / det), clamp((a * f - c * e) / det));
+    }
+    std::atomic_store(&exponents_, std::shared_ptr<const ExponentsMap>(std::move(exponents)));
+  }
+
+  mutable std::mutex mutex_;  // serializes the writers of `stats_`
+  std::unordered_map<std::string, SufficientStats> stats_;
+  std::shared_ptr<const ExponentsMap> exponents_ = std::make_shared<const ExponentsMap>();
+};
+
+}  // namespace anonymous
 
-  // temporarily assign the occupancy penalty to be 1.0
+void AdaptStateToWorkload(const SearchTask& task, const State& state,
+                          const Array<IntImm>& wkl_inst,
+                          const float score, float* const occupancy_penalty,
+                          float* const padding_penalty,
+                          float* const adapted_score
+                          ) {
+  GetAnalyticAdaptionPenalties(task, state, wkl_inst, occupancy_penalty, padding_penalty);
+  // calibrate the analytic penalties with the measured per-instance data
+  const std::pair<double, double> exponents =
+      AdaptionPenaltyModel::Global()->GetExponents(task->workload_key);
+  if (exponents.first != 1.) {
+    *occupancy_penalty = std::pow(*occupancy_penalty, exponents.first);
+  }
+  if (exponents.second != 1.) {
+    *padding_penalty = std::pow(*padding_penalty, exponents.second);
+  }
   *adapted_score = score * (*occupancy_penalty) * (*padding_penalty);
   // if (enable_verbose_logging) {
   //   LOG(INFO) << "adapted_score=" << *adapted_score;
@@ -1925,7 +2119,7 @@ Array<NDArray> AdaptStatesToWorkloads(
                        &adapted_scores[0]);
   // enable_verbose_logging = false;
 
-  support::parallel_for(
+  support::parallel_for_dynamic(
       1, task->wkl_insts.size() * states.size(),
       [&states, &task, &scores, &occupancy_penalty,
        &padding_penalty, &adapted_scores]
@@ -1963,6 +2157,63 @@ TVM_REGISTER_GLOBAL("auto_scheduler.AdaptStatesToWorkloads")
       }
       );
 
+TVM_REGISTER_GLOBAL("auto_scheduler.GetCherryPickedWorkloadInstanceIds")
+    .set_body_typed(
+      [](const SearchTask& task, const Array<State>& states) -> Array<Integer> {
+        CHECK(IsDynTask(task))
+            << "Cherry-picking only makes sense for dynamic workloads";
+        std::vector<int> inst_ids(states.size(), -1);
+        support::parallel_for_dynamic(
+            0, states.size(),
+            [&task, &states, &inst_ids](const size_t state_id) {
+              const Array<IntImm> cherry_picked_wkl_inst = std::get<0>(
+                  task->compute_dag.CherryPickWorkloadInstance(states[state_id], task));
+              for (size_t inst_id = 0; inst_id < task->wkl_insts.size(); ++inst_id) {
+                const Array<IntImm>& wkl_inst = task->wkl_insts[inst_id];
+                if (wkl_inst.size() == cherry_picked_wkl_inst.size() &&
+                    std::equal(wkl_inst.begin(), wkl_inst.end(),
+                               cherry_picked_wkl_inst.begin(),
+                               [](const IntImm& lhs, const IntImm& rhs) {
+                                 return lhs->value == rhs->value;
+                               })) {
+                  inst_ids[state_id] = inst_id;
+                  break;
+                }
+              }
+            }
+        );
+        Array<Integer> ret;
+        for (const int inst_id : inst_ids) {
+          ret.push_back(inst_id);
+        }
+        return ret;
+      }
+      );
+
+TVM_REGISTER_GLOBAL("auto_scheduler.UpdateAdaptionPenaltyModel")
+    .set_body_typed([](const Array<MeasureInput>& inputs, const Array<MeasureResult>& results) {
+      AdaptionPenaltyModel::Global()->Update(inputs, results);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.GetAdaptionPenaltyExponents")
+    .set_body_typed([](const SearchTask& task) {
+      const std::pair<double, double> exponents =
+          AdaptionPenaltyModel::Global()->GetExponents(task->workload_key);
+      return Array<FloatImm>{FloatImm(DataType::Float(64), exponents.first),
+                             FloatImm(DataType::Float(64), exponents.second)};
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.ResetAdaptionPenaltyModel")
+    .set_body_typed([]() { AdaptionPenaltyModel::Global()->Reset(); });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.GetAdaptionPenaltyModelStats")
+    .set_body_typed([]() { return AdaptionPenaltyModel::Global()->GetStats(); });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.SetAdaptionPenaltyModelStats")
+    .set_body_typed([](const Map<String, Array<FloatImm>>& stats) {
+      AdaptionPenaltyModel::Global()->SetStats(stats);
+    });
+
 
 }  // namespace auto_scheduler
 }  // namespace tvm
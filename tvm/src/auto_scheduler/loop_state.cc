@@ -44,7 +44,7 @@ TVM_REGISTER_NODE_TYPE(IteratorNode);
 /********** Iterator **********/
 Iterator::Iterator(String name, Range range, IteratorKind iter_kind, IteratorAnnotation annotation,
                    const std::vector<Iterator>* orig_iters) {
-  auto node = make_object<IteratorNode>();
+  auto node = make_pooled_object<IteratorNode>();
   node->name = std::move(name);
   node->range = std::move(range);
   node->iter_kind = iter_kind;
@@ -57,7 +57,7 @@ Iterator::Iterator(String name, Range range, IteratorKind iter_kind, IteratorAnn
 
 /********** Stage **********/
 Stage::Stage(te::Operation op) {
-  auto node = make_object<StageNode>();
+  auto node = make_pooled_object<StageNode>();
   if (op->IsInstance<te::ComputeOpNode>()) {
     node->op_type = StageKind::kCompute;
     auto* pop = op.as<te::ComputeOpNode>();
@@ -84,7 +84,7 @@ Stage::Stage(te::Operation op) {
 
 Stage::Stage(te::Operation op, StageKind op_type, const Array<Iterator>& iters,
              ComputeAtKind compute_at, StageAttributes attrs) {
-  auto node = make_object<StageNode>();
+  auto node = make_pooled_object<StageNode>();
   node->op = std::move(op);
   node->op_type = op_type;
   node->iters = iters;
@@ -161,7 +161,7 @@ void AttachMap::DeleteStageEntry(AttachMapNode* pnode, int stage_id) {
 }
 
 AttachMap AttachMap::ApplyStageIdOffset(int start_id, int offset) const {
-  AttachMap map = AttachMap(make_object<AttachMapNode>());
+  AttachMap map = AttachMap(make_pooled_object<AttachMapNode>());
   auto pmap = map.CopyOnWrite();
   for (const auto& x : operator->()->stage_to_attach_iter) {
     auto key = x.first;
@@ -192,11 +192,11 @@ AttachMap AttachMap::ApplyStageIdOffset(int start_id, int offset) const {
 
 /********** State **********/
 State::State(const Array<te::Operation>& ops) {
-  auto node = make_object<StateNode>();
+  auto node = make_pooled_object<StateNode>();
   for (const auto& op : ops) {
     node->stages.push_back(Stage(op));
   }
-  node->attach_map = AttachMap(make_object<AttachMapNode>());
+  node->attach_map = AttachMap(make_pooled_object<AttachMapNode>());
   node->concrete = true;
   data_ = std::move(node);
 }
@@ -23,6 +23,7 @@
  */
 
 #include <tvm/auto_scheduler/measure.h>
+#include <tvm/auto_scheduler/measure_record.h>
 #include <tvm/runtime/registry.h>
 
 // <bojian/DietCode>
@@ -66,6 +67,7 @@ MeasureInput::MeasureInput(SearchTask task, State state
 
                            // <bojian/DietCode>
                          , Optional<Array<IntImm>> wkl_inst
+                         , Optional<Array<Array<IntImm>>> multi_wkl_insts
 
                            ) {
   auto node = make_object<MeasureInputNode>();
@@ -74,6 +76,7 @@ MeasureInput::MeasureInput(SearchTask task, State state
 
   // <bojian/DietCode>
   node->wkl_inst = std::move(wkl_inst);
+  node->multi_wkl_insts = std::move(multi_wkl_insts);
 
   data_ = std::move(node);
 }
@@ -82,6 +85,11 @@ MeasureInput MeasureInputNode::copy() const {
   auto node = make_object<MeasureInputNode>();
   node->task = task;
   node->state = state;
+
+  // <bojian/DietCode>
+  node->wkl_inst = wkl_inst;
+  node->multi_wkl_insts = multi_wkl_insts;
+
   return MeasureInput(node);
 }
 
@@ -97,13 +105,16 @@ BuildResult::BuildResult(String filename, Array<te::Tensor> args, int error_no,
 }
 
 MeasureResult::MeasureResult(Array<PrimExpr> costs, int error_no, String error_msg, double all_cost,
-                             double timestamp) {
+                             double timestamp, Array<FloatImm> inst_costs,
+                             Map<String, FloatImm> perf_counters) {
   auto node = make_object<MeasureResultNode>();
   node->costs = std::move(costs);
   node->error_no = error_no;
   node->error_msg = std::move(error_msg);
   node->all_cost = all_cost;
   node->timestamp = timestamp;
+  node->inst_costs = std::move(inst_costs);
+  node->perf_counters = std::move(perf_counters);
   data_ = std::move(node);
 }
 
@@ -114,6 +125,8 @@ MeasureResult MeasureResultNode::copy() const {
   node->error_msg = error_msg;
   node->all_cost = all_cost;
   node->timestamp = timestamp;
+  node->inst_costs = inst_costs;
+  node->perf_counters = perf_counters;
   return MeasureResult(node);
 }
 
@@ -139,7 +152,9 @@ Array<BuildResult> LocalBuilderNode::Build(const Array<MeasureInput>& inputs, in
 
 /********** LocalRunner **********/
 LocalRunner::LocalRunner(int timeout, int number, int repeat, int min_repeat_ms,
-                         double cooldown_interval, bool enable_cpu_cache_flush) {
+                         double cooldown_interval, bool enable_cpu_cache_flush,
+                         double adaptive_rel_ci_width, double adaptive_bound_ratio,
+                         bool enable_perf_counters, int interleaved_rounds) {
   ObjectPtr<LocalRunnerNode> node = make_object<LocalRunnerNode>();
   node->timeout = timeout;
   node->number = number;
@@ -147,6 +162,10 @@ LocalRunner::LocalRunner(int timeout, int number, int repeat, int min_repeat_ms,
   node->min_repeat_ms = min_repeat_ms;
   node->cooldown_interval = cooldown_interval;
   node->enable_cpu_cache_flush = enable_cpu_cache_flush;
+  node->adaptive_rel_ci_width = adaptive_rel_ci_width;
+  node->adaptive_bound_ratio = adaptive_bound_ratio;
+  node->enable_perf_counters = enable_perf_counters;
+  node->interleaved_rounds = interleaved_rounds;
   data_ = std::move(node);
 }
 
@@ -155,7 +174,8 @@ Array<MeasureResult> LocalRunnerNode::Run(const Array<MeasureInput>& inputs,
   if (const auto* f = runtime::Registry::Get("auto_scheduler.local_runner.run")) {
     Array<MeasureResult> results =
         (*f)(inputs, build_results, timeout, number, repeat, min_repeat_ms, cooldown_interval,
-             enable_cpu_cache_flush, verbose);
+             enable_cpu_cache_flush, verbose, adaptive_rel_ci_width, adaptive_bound_ratio,
+             enable_perf_counters, interleaved_rounds);
     return results;
   }
   LOG(FATAL) << "auto_scheduler.local_runner.run is not registered. "
@@ -544,6 +564,12 @@ Array<MeasureResult> ProgramMeasurerNode::Measure(const SearchTask& task,
 
   }  // IsDynTask(task)
 
+  // <bojian/DietCode>
+  if (Optional<MeasureMemo> memo = GetMeasureMemo()) {
+    StdCout(verbose) << "Measure memo hits: " << memo.value()->num_hits << "/"
+                     << memo.value()->num_lookups << std::endl;
+  }
+
   PrintTimeElapsed(t_begin, "measurement", verbose);
 
   return results;
@@ -554,14 +580,45 @@ void ProgramMeasurerNode::SilentMeasure(const SearchTask& task, const Array<Meas
   results->clear();
   results->reserve(inputs.size());
 
+  // <bojian/DietCode> Short-circuit the inputs that are in the measure memo.
+  Optional<MeasureMemo> memo = GetMeasureMemo();
+  std::vector<Optional<MeasureResult>> memo_results(inputs.size());
+  Array<MeasureInput> unmemoized_inputs;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (memo) {
+      memo_results[i] = memo.value()->Lookup(inputs[i]);
+    }
+    if (!memo_results[i]) {
+      unmemoized_inputs.push_back(inputs[i]);
+    }
+  }
+
   // Call builder and runner
-  Array<BuildResult> build_res_batch = builder->Build(inputs, verbose);
-  Array<MeasureResult> result_batch = runner->Run(inputs, build_res_batch, verbose);
+  Array<MeasureResult> result_batch;
+  if (!unmemoized_inputs.empty()) {
+    Array<BuildResult> build_res_batch = builder->Build(unmemoized_inputs, verbose);
+    result_batch = runner->Run(unmemoized_inputs, build_res_batch, verbose);
+  }
+  if (memo) {
+    memo.value()->Record(unmemoized_inputs, result_batch);
+  }
 
   // Store result batch
-  for (auto& res : result_batch) {
-    results->push_back(res);
+  for (size_t i = 0, j = 0; i < inputs.size(); ++i) {
+    results->push_back(memo_results[i] ? memo_results[i].value() : result_batch[j++]);
+  }
+}
+
+// <bojian/DietCode>
+Optional<MeasureMemo> ProgramMeasurerNode::GetMeasureMemo() const {
+  if (callbacks) {
+    for (const MeasureCallback& callback : callbacks.value()) {
+      if (callback->IsInstance<MeasureMemoNode>()) {
+        return Downcast<MeasureMemo>(callback);
+      }
+    }
   }
+  return NullOpt;
 }
 
 /********** Printing functions **********/
@@ -606,9 +663,13 @@ TVM_STATIC_IR_FUNCTOR(ReprPrinter, vtable)
     });
 
 /********** Measure interface API for ffi **********/
-TVM_REGISTER_GLOBAL("auto_scheduler.MeasureInput").set_body_typed([](SearchTask task, State state) {
-  return MeasureInput(task, state);
-});
+TVM_REGISTER_GLOBAL("auto_scheduler.MeasureInput")
+    .set_body_typed([](SearchTask task, State state,
+                       // <bojian/DietCode>
+                       Optional<Array<IntImm>> wkl_inst,
+                       Optional<Array<Array<IntImm>>> multi_wkl_insts) {
+      return MeasureInput(task, state, wkl_inst, multi_wkl_insts);
+    });
 
 TVM_REGISTER_GLOBAL("auto_scheduler.BuildResult")
     .set_body_typed([](String filename, Array<te::Tensor> args, int error_no, String error_msg,
@@ -618,8 +679,11 @@ TVM_REGISTER_GLOBAL("auto_scheduler.BuildResult")
 
 TVM_REGISTER_GLOBAL("auto_scheduler.MeasureResult")
     .set_body_typed([](Array<PrimExpr> costs, int error_no, String error_msg, double all_cost,
-                       double timestamp) {
-      return MeasureResult(costs, error_no, error_msg, all_cost, timestamp);
+                       double timestamp,
+                       // <bojian/DietCode>
+                       Array<FloatImm> inst_costs, Map<String, FloatImm> perf_counters) {
+      return MeasureResult(costs, error_no, error_msg, all_cost, timestamp, inst_costs,
+                           perf_counters);
     });
 
 TVM_REGISTER_GLOBAL("auto_scheduler.PythonBasedMeasureCallback")
@@ -649,9 +713,12 @@ TVM_REGISTER_GLOBAL("auto_scheduler.LocalBuilder")
 
 TVM_REGISTER_GLOBAL("auto_scheduler.LocalRunner")
     .set_body_typed([](int timeout, int number, int repeat, int min_repeat_ms,
-                       double cooldown_interval, bool enable_cpu_cache_flush) {
+                       double cooldown_interval, bool enable_cpu_cache_flush,
+                       double adaptive_rel_ci_width, double adaptive_bound_ratio,
+                       bool enable_perf_counters, int interleaved_rounds) {
       return LocalRunner(timeout, number, repeat, min_repeat_ms, cooldown_interval,
-                         enable_cpu_cache_flush);
+                         enable_cpu_cache_flush, adaptive_rel_ci_width, adaptive_bound_ratio,
+                         enable_perf_counters, interleaved_rounds);
     });
 
 TVM_REGISTER_GLOBAL("auto_scheduler.RPCRunner")
@@ -35,8 +35,13 @@
 // <bojian/DietCode>
 #include <tvm/node/serialization.h>
 #include <tvm/tir/dyn_shape_var.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -306,6 +311,9 @@ struct Handler<::tvm::auto_scheduler::MeasureInputNode> {
     if (data.wkl_inst) {
       writer->WriteArrayItem(SaveJSON(data.wkl_inst.value()));
     }
+    if (data.multi_wkl_insts) {
+      writer->WriteArrayItem(SaveJSON(data.multi_wkl_insts.value()));
+    }
 
     writer->EndArray();
   }
@@ -340,14 +348,19 @@ struct Handler<::tvm::auto_scheduler::MeasureInputNode> {
 
     // <bojian/DietCode>
     // LOG(INFO) << "Loading state=" << data->state;
-    if (s) {
+    // Both the workload instance and the multi-shape workload instances are
+    // optional, and are told apart by their element types.
+    while (s) {
       std::string str_value;
       reader->Read(&str_value);
-      data->wkl_inst = Downcast<Array<IntImm>>(LoadJSON(str_value));
+      Array<ObjectRef> wkl_inst_or_insts = Downcast<Array<ObjectRef>>(LoadJSON(str_value));
+      if (!wkl_inst_or_insts.empty() && wkl_inst_or_insts[0]->IsInstance<::tvm::ArrayNode>()) {
+        data->multi_wkl_insts = Downcast<Array<Array<IntImm>>>(wkl_inst_or_insts);
+      } else {
+        data->wkl_inst = Downcast<Array<IntImm>>(wkl_inst_or_insts);
+      }
       s = reader->NextArrayItem();
     }
-
-    ICHECK(!s);
   }
 };
 
@@ -367,6 +380,21 @@ struct Handler<::tvm::auto_scheduler::MeasureResultNode> {
     writer->WriteArrayItem(data.error_no);
     writer->WriteArrayItem(data.all_cost);
     writer->WriteArrayItem(static_cast<int>((data.timestamp)));
+
+    // <bojian/DietCode> The per-instance costs and the hardware event counts
+    // are optional, and written only if any of them is present.
+    if (!data.inst_costs.empty() || !data.perf_counters.empty()) {
+      std::vector<double> inst_costs;
+      for (const auto& x : data.inst_costs) {
+        inst_costs.push_back(x->value);
+      }
+      writer->WriteArrayItem(inst_costs);
+      std::map<std::string, double> perf_counters;
+      for (const auto& kv : data.perf_counters) {
+        perf_counters[kv.first] = kv.second->value;
+      }
+      writer->WriteArrayItem(perf_counters);
+    }
     writer->EndArray();
   }
   inline static void Read(dmlc::JSONReader* reader,
@@ -391,6 +419,24 @@ struct Handler<::tvm::auto_scheduler::MeasureResultNode> {
     ICHECK(s);
     reader->Read(&data->timestamp);
     s = reader->NextArrayItem();
+
+    // <bojian/DietCode>
+    data->inst_costs.clear();
+    data->perf_counters.clear();
+    if (s) {
+      reader->Read(&double_list);
+      for (const auto& i : double_list) {
+        data->inst_costs.push_back(::tvm::FloatImm(::tvm::DataType::Float(64), i));
+      }
+      s = reader->NextArrayItem();
+      ICHECK(s);
+      std::map<std::string, double> perf_counters;
+      reader->Read(&perf_counters);
+      for (const auto& kv : perf_counters) {
+        data->perf_counters.Set(kv.first, ::tvm::FloatImm(::tvm::DataType::Float(64), kv.second));
+      }
+      s = reader->NextArrayItem();
+    }
     ICHECK(!s);
   }
 };
@@ -477,6 +523,9 @@ namespace auto_scheduler {
 
 TVM_REGISTER_OBJECT_TYPE(RecordToFileNode);
 TVM_REGISTER_OBJECT_TYPE(RecordReaderNode);
+// <bojian/DietCode>
+TVM_REGISTER_OBJECT_TYPE(MeasureMemoNode);
+TVM_REGISTER_OBJECT_TYPE(RecordStoreNode);
 
 RecordToFile::RecordToFile(String filename) {
   auto node = make_object<RecordToFileNode>();
@@ -624,6 +673,457 @@ void RecordToFileNode::Callback(const SearchPolicy& policy,
   }
 }
 
+// <bojian/DietCode>
+std::string GetMeasureInputFingerprint(const MeasureInput& input) {
+  std::ostringstream os;
+  dmlc::JSONWriter writer(&os);
+  writer.BeginArray(false);
+  writer.WriteArrayItem(std::string(input->task->workload_key));
+  writer.WriteArrayItem(input->task->target->str());
+  if (input->task->hardware_params.defined()) {
+    writer.WriteArrayItem(*input->task->hardware_params.operator->());
+  }
+  writer.WriteArrayItem(*input->state.operator->());
+  if (input->wkl_inst) {
+    writer.WriteArrayItem(SaveJSON(input->wkl_inst.value()));
+  }
+  if (input->multi_wkl_insts) {
+    writer.WriteArrayItem(SaveJSON(input->multi_wkl_insts.value()));
+  }
+  writer.EndArray();
+  return os.str();
+}
+
+MeasureMemo::MeasureMemo(String filename, double staleness_window) {
+  auto node = make_object<MeasureMemoNode>();
+  node->filename = std::move(filename);
+  node->staleness_window = staleness_window;
+
+  std::ifstream infile(node->filename);
+  std::string line;
+  while (std::getline(infile, line)) {
+    if (line.empty() || line[0] == '#' || line[0] == ' ') {
+      continue;
+    }
+    // The records of the dynamic workload dispatchers are skipped.
+    const ArrayNode* record = ReadMeasureRecord(line).as<ArrayNode>();
+    if (record == nullptr) {
+      continue;
+    }
+    MeasureInput input = Downcast<MeasureInput>(record->at(0));
+    MeasureResult result = Downcast<MeasureResult>(record->at(1));
+    if (result->error_no == static_cast<int>(MeasureErrorNO::kNoError) &&
+        !node->IsStale(result)) {
+      node->memo_[GetMeasureInputFingerprint(input)] = result;
+    }
+  }
+  data_ = std::move(node);
+}
+
+bool MeasureMemoNode::IsStale(const MeasureResult& result) const {
+  if (staleness_window <= 0) {
+    return false;
+  }
+  const double now = std::chrono::duration<double>(
+                         std::chrono::system_clock::now().time_since_epoch()).count();
+  return now - result->timestamp > staleness_window;
+}
+
+Optional<MeasureResult> MeasureMemoNode::Lookup(const MeasureInput& input) {
+  ++num_lookups;
+  auto memo_it = memo_.find(GetMeasureInputFingerprint(input));
+  if (memo_it == memo_.end() || IsStale(memo_it->second)) {
+    return NullOpt;
+  }
+  ++num_hits;
+  return memo_it->second;
+}
+
+void MeasureMemoNode::Record(const Array<MeasureInput>& inputs,
+                             const Array<MeasureResult>& results) {
+  Array<MeasureInput> valid_inputs;
+  Array<MeasureResult> valid_results;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (results[i]->error_no == static_cast<int>(MeasureErrorNO::kNoError)) {
+      memo_[GetMeasureInputFingerprint(inputs[i])] = results[i];
+      valid_inputs.push_back(inputs[i]);
+      valid_results.push_back(results[i]);
+    }
+  }
+  if (!valid_inputs.empty()) {
+    std::ofstream ofs(filename, std::ofstream::app);
+    WriteMeasureRecords(&ofs, valid_inputs, valid_results);
+  }
+}
+
+// <bojian/DietCode>
+namespace {
+
+std::string GetRecordStoreKey(const String& workload_key, const Target& target,
+                              const Optional<Array<IntImm>>& wkl_inst) {
+  std::ostringstream os;
+  os << workload_key << "\n" << target->str();
+  if (wkl_inst) {
+    os << "\n";
+    for (const IntImm& dim : wkl_inst.value()) {
+      os << dim->value << ",";
+    }
+  }
+  return os.str();
+}
+
+int64_t GetFileSize(const std::string& filename) {
+  std::ifstream infile(filename, std::ifstream::ate | std::ifstream::binary);
+  return infile ? static_cast<int64_t>(infile.tellg()) : 0;
+}
+
+/*! \brief The last modification time of the file, -1 if it does not exist. */
+int64_t GetFileMTime(const std::string& filename) {
+  struct stat file_stat;
+  return stat(filename.c_str(), &file_stat) == 0 ? static_cast<int64_t>(file_stat.st_mtime)
+                                                 : -1;
+}
+
+/*! \brief Continue the FNV-1a hash `hash` with the bytes. */
+uint64_t HashBytes(uint64_t hash, const char* data, const size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/*!
+ * \brief Hash the first `size` bytes of the file, continuing from `hash`.
+ * \return False if the file is shorter than `size` bytes.
+ */
+bool HashFilePrefix(const std::string& filename, int64_t size, uint64_t* hash) {
+  std::ifstream infile(filename, std::ifstream::binary);
+  std::vector<char> buffer(1 << 20);
+  while (size > 0) {
+    infile.read(buffer.data(), std::min<int64_t>(size, buffer.size()));
+    if (infile.gcount() == 0) {
+      return false;
+    }
+    *hash = HashBytes(*hash, buffer.data(), infile.gcount());
+    size -= infile.gcount();
+  }
+  return true;
+}
+
+/*!
+ * \brief Read the line that starts at the byte offset `offset`.
+ * \return Whether the offset is at the start of a complete line.
+ */
+bool ReadLineAt(std::ifstream* infile, const int64_t offset, std::string* line) {
+  infile->clear();
+  if (offset > 0) {
+    infile->seekg(offset - 1);
+    if (infile->get() != '\n') {
+      return false;
+    }
+  } else {
+    infile->seekg(0);
+  }
+  return std::getline(*infile, *line) && !infile->eof();
+}
+
+}  // namespace anonymous
+
+constexpr uint64_t RecordStoreNode::kEmptyHash;
+
+RecordStore::RecordStore(String filename, int top_k, bool save_index) {
+  CHECK_GT(top_k, 0) << "At least 1 record has to be kept per key";
+  auto node = make_object<RecordStoreNode>();
+  node->filename = std::move(filename);
+  node->top_k = top_k;
+  if (!node->LoadIndex()) {
+    node->records_.clear();
+    node->record_keys_.clear();
+    node->dispatchers_.clear();
+    node->dispatcher_keys_.clear();
+    node->indexed_size_ = 0;
+    node->indexed_hash_ = RecordStoreNode::kEmptyHash;
+  }
+  const int64_t indexed_size = node->indexed_size_;
+  node->Scan();
+  if (save_index && node->indexed_size_ != indexed_size) {
+    node->SaveIndex();
+  }
+  data_ = std::move(node);
+}
+
+void RecordStoreNode::Index(const ObjectRef& record, const int64_t offset) {
+  if (const auto* dispatcher = record.as<DynWklDispatcherNode>()) {
+    std::string key = GetRecordStoreKey(dispatcher->search_task->workload_key,
+                                        dispatcher->search_task->target, NullOpt);
+    auto dispatcher_it = dispatchers_.find(key);
+    if (dispatcher_it == dispatchers_.end()) {
+      dispatcher_keys_.push_back(key);
+      dispatchers_.emplace(std::move(key),
+                           std::make_pair(offset, GetRef<DynWklDispatcher>(dispatcher)));
+    } else if (dispatcher_it->second.first < offset) {
+      dispatcher_it->second = std::make_pair(offset, GetRef<DynWklDispatcher>(dispatcher));
+    }
+    return;
+  }
+  const auto* inp_res_pair = record.as<ArrayNode>();
+  if (inp_res_pair == nullptr) {
+    return;
+  }
+  MeasureInput input = Downcast<MeasureInput>(inp_res_pair->at(0));
+  MeasureResult result = Downcast<MeasureResult>(inp_res_pair->at(1));
+  if (result->error_no != static_cast<int>(MeasureErrorNO::kNoError)) {
+    return;
+  }
+  std::string key = GetRecordStoreKey(input->task->workload_key, input->task->target,
+                                      GetMeasuredWklInst(input));
+  auto records_it = records_.find(key);
+  if (records_it == records_.end()) {
+    record_keys_.push_back(key);
+    records_it = records_.emplace(std::move(key), std::vector<Entry>()).first;
+  }
+  std::vector<Entry>& entries = records_it->second;
+  Entry entry{FloatArrayMean(result->costs), offset, std::move(input), std::move(result)};
+  auto entry_it = std::upper_bound(
+      entries.begin(), entries.end(), entry,
+      [](const Entry& lhs, const Entry& rhs) { return lhs.cost < rhs.cost; });
+  if (entry_it - entries.begin() < top_k) {
+    entries.insert(entry_it, std::move(entry));
+    if (static_cast<int>(entries.size()) > top_k) {
+      entries.pop_back();
+    }
+  }
+}
+
+Optional<Array<IntImm>> RecordStoreNode::GetMeasuredWklInst(const MeasureInput& input) {
+  if (input->wkl_inst || !IsDynTask(input->task)) {
+    return input->wkl_inst;
+  }
+  SearchTask task = input->task;
+  if (!task->compute_dag.defined()) {
+    // The tasks read from the log file do not have their compute DAGs, hence
+    // rebuild those from the workload keys.
+    const std::string task_key = GetRecordStoreKey(task->workload_key, task->target, NullOpt);
+    auto task_it = dyn_tasks_.find(task_key);
+    if (task_it == dyn_tasks_.end()) {
+      const auto* workload_key_to_tensors =
+          tvm::runtime::Registry::Get("auto_scheduler.workload_key_to_tensors");
+      Optional<SearchTask> recovered_task;
+      if (workload_key_to_tensors != nullptr) {
+        try {
+          Array<te::Tensor> tensors = (*workload_key_to_tensors)(task->workload_key);
+          recovered_task = SearchTask(ComputeDAG(tensors), task->workload_key, task->target,
+                                      task->target_host, task->hardware_params,
+                                      task->layout_rewrite_option, task->task_input_names,
+                                      task->shape_vars, task->wkl_insts, task->wkl_inst_weights);
+        } catch (std::exception& e) {
+          // The workload has not been registered, hence the records of the task
+          // are kept under the same key as before.
+        }
+      }
+      task_it = dyn_tasks_.emplace(task_key, recovered_task).first;
+    }
+    if (!task_it->second) {
+      return NullOpt;
+    }
+    task = task_it->second.value();
+  }
+  Array<IntImm> wkl_inst =
+      std::get<0>(task->compute_dag.CherryPickWorkloadInstance(input->state, task));
+  if (wkl_inst.empty()) {
+    return NullOpt;
+  }
+  return wkl_inst;
+}
+
+void RecordStoreNode::Scan() {
+  std::ifstream infile(filename, std::ifstream::binary);
+  if (!infile) {
+    return;
+  }
+  infile.seekg(indexed_size_);
+  std::string line;
+  int64_t offset = indexed_size_;
+  while (std::getline(infile, line)) {
+    if (infile.eof()) {
+      // The last line is still being written.
+      break;
+    }
+    if (!line.empty() && line[0] != '#' && line[0] != ' ') {
+      Index(ReadMeasureRecord(line), offset);
+    }
+    line.push_back('\n');
+    indexed_hash_ = HashBytes(indexed_hash_, line.data(), line.size());
+    offset += line.size();
+  }
+  indexed_size_ = offset;
+}
+
+bool RecordStoreNode::LoadIndex() {
+  std::ifstream index_file(std::string(filename) + ".index");
+  std::string log_version;
+  int index_top_k;
+  int64_t indexed_size, indexed_mtime;
+  uint64_t indexed_hash;
+  if (!(index_file >> log_version >> index_top_k >> indexed_size >> indexed_mtime >>
+        indexed_hash) ||
+      log_version != AUTO_SCHEDULER_LOG_VERSION || index_top_k < top_k) {
+    return false;
+  }
+  // The log file might have been rewritten since the index was saved. If it
+  // has not grown, it must not have been modified at all, and otherwise (i.e.,
+  // appended to) the indexed bytes must not have changed.
+  const int64_t file_size = GetFileSize(filename);
+  uint64_t hash = kEmptyHash;
+  if (indexed_size > file_size ||
+      (indexed_size == file_size && indexed_mtime != GetFileMTime(filename)) ||
+      !HashFilePrefix(filename, indexed_size, &hash) || hash != indexed_hash) {
+    return false;
+  }
+  std::ifstream infile(filename, std::ifstream::binary);
+  std::string line;
+  int64_t offset;
+  while (index_file >> offset) {
+    if (offset >= indexed_size || !ReadLineAt(&infile, offset, &line)) {
+      return false;
+    }
+    ObjectRef record = ReadMeasureRecord(line);
+    if (!record.defined()) {
+      return false;
+    }
+    Index(record, offset);
+  }
+  indexed_size_ = indexed_size;
+  indexed_hash_ = indexed_hash;
+  return true;
+}
+
+void RecordStoreNode::SaveIndex() const {
+  std::vector<int64_t> offsets;
+  for (const auto& records_kv : records_) {
+    for (const Entry& entry : records_kv.second) {
+      offsets.push_back(entry.offset);
+    }
+  }
+  for (const auto& dispatchers_kv : dispatchers_) {
+    offsets.push_back(dispatchers_kv.second.first);
+  }
+  // in the file order, so that the records are read sequentially
+  std::sort(offsets.begin(), offsets.end());
+  // Write to a temporary file first, so that concurrent loads never see a
+  // partially written index.
+  const std::string index_filename = std::string(filename) + ".index";
+  const std::string tmp_index_filename = index_filename + ".tmp";
+  {
+    std::ofstream index_file(tmp_index_filename);
+    if (!index_file) {
+      return;
+    }
+    index_file << AUTO_SCHEDULER_LOG_VERSION << " " << top_k << " " << indexed_size_ << " "
+               << GetFileMTime(filename) << " " << indexed_hash_ << "\n";
+    for (const int64_t offset : offsets) {
+      index_file << offset << "\n";
+    }
+    if (!index_file) {
+      std::remove(tmp_index_filename.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_index_filename.c_str(), index_filename.c_str()) != 0) {
+    std::remove(tmp_index_filename.c_str());
+  }
+}
+
+Optional<Array<ObjectRef>> RecordStoreNode::GetBest(
+    const String& workload_key, const Target& target,
+    const Optional<Array<IntImm>>& wkl_inst) const {
+  auto records_it = records_.find(GetRecordStoreKey(workload_key, target, wkl_inst));
+  if (records_it == records_.end() || records_it->second.empty()) {
+    return NullOpt;
+  }
+  const Entry& best = records_it->second.front();
+  return Array<ObjectRef>{best.input, best.result};
+}
+
+std::pair<Array<MeasureInput>, Array<MeasureResult>> RecordStoreNode::GetRecords() const {
+  Array<MeasureInput> inputs;
+  Array<MeasureResult> results;
+  for (const std::string& key : record_keys_) {
+    for (const Entry& entry : records_.at(key)) {
+      inputs.push_back(entry.input);
+      results.push_back(entry.result);
+    }
+  }
+  return std::make_pair(inputs, results);
+}
+
+Array<DynWklDispatcher> RecordStoreNode::GetDispatchers() const {
+  Array<DynWklDispatcher> dispatchers;
+  for (const std::string& key : dispatcher_keys_) {
+    dispatchers.push_back(dispatchers_.at(key).second);
+  }
+  return dispatchers;
+}
+
+void RecordStoreNode::Append(const Array<MeasureInput>& inputs,
+                             const Array<MeasureResult>& results) {
+  CHECK_EQ(inputs.size(), results.size());
+  // Index the records that have been appended by other writers in the meantime.
+  Scan();
+  std::ofstream ofs(filename, std::ofstream::app | std::ofstream::binary);
+  int64_t offset = GetFileSize(filename);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::ostringstream os;
+    WriteMeasureRecords(&os, {inputs[i]}, {results[i]});
+    const std::string record = os.str();
+    ofs << record;
+    Index(Array<ObjectRef>{inputs[i], results[i]}, offset);
+    indexed_hash_ = HashBytes(indexed_hash_, record.data(), record.size());
+    offset += record.size();
+  }
+  ofs.close();
+  indexed_size_ = offset;
+  SaveIndex();
+}
+
+void RecordStoreNode::Compact() {
+  Scan();
+  std::vector<int64_t> offsets;
+  for (const auto& records_kv : records_) {
+    for (const Entry& entry : records_kv.second) {
+      offsets.push_back(entry.offset);
+    }
+  }
+  for (const auto& dispatchers_kv : dispatchers_) {
+    offsets.push_back(dispatchers_kv.second.first);
+  }
+  std::sort(offsets.begin(), offsets.end());
+
+  const std::string compact_filename = std::string(filename) + ".compact";
+  {
+    std::ifstream infile(filename, std::ifstream::binary);
+    std::ofstream ofs(compact_filename, std::ofstream::binary);
+    std::string line;
+    for (const int64_t offset : offsets) {
+      CHECK(ReadLineAt(&infile, offset, &line))
+          << "The record at offset " << offset << " of " << filename << " is corrupted";
+      ofs << line << "\n";
+    }
+  }
+  CHECK_EQ(std::rename(compact_filename.c_str(), filename.c_str()), 0)
+      << "Failed to replace " << filename << " with the compacted log";
+
+  records_.clear();
+  record_keys_.clear();
+  dispatchers_.clear();
+  dispatcher_keys_.clear();
+  indexed_size_ = 0;
+  indexed_hash_ = kEmptyHash;
+  Scan();
+  SaveIndex();
+}
+
 RecordReader::RecordReader(String filename) {
   auto node = make_object<RecordReaderNode>();
   node->filename = filename;
@@ -734,6 +1234,39 @@ TVM_REGISTER_GLOBAL("auto_scheduler.RecordToFile").set_body_typed([](const Strin
   return RecordToFile(filename);
 });
 
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("auto_scheduler.MeasureMemo")
+    .set_body_typed([](const String& filename, double staleness_window) {
+      return MeasureMemo(filename, staleness_window);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RecordStore")
+    .set_body_typed([](const String& filename, int top_k, bool save_index) {
+      return RecordStore(filename, top_k, save_index);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RecordStoreGetBest")
+    .set_body_typed([](RecordStore store, const String& workload_key, const Target& target,
+                       Optional<Array<IntImm>> wkl_inst) {
+      return store->GetBest(workload_key, target, wkl_inst);
+    });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RecordStoreGetRecords").set_body_typed([](RecordStore store) {
+  const auto& res = store->GetRecords();
+  return Array<ObjectRef>{res.first, res.second};
+});
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RecordStoreGetDispatchers")
+    .set_body_typed([](RecordStore store) { return store->GetDispatchers(); });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RecordStoreAppend")
+    .set_body_typed([](RecordStore store, Array<MeasureInput> inputs,
+                       Array<MeasureResult> results) { store->Append(inputs, results); });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.RecordStoreCompact").set_body_typed([](RecordStore store) {
+  store->Compact();
+});
+
 TVM_REGISTER_GLOBAL("auto_scheduler.RecordReader").set_body_typed([](const String& filename) {
   return RecordReader(filename);
 });
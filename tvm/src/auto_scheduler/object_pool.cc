@@ -0,0 +1,38 @@
+#include <tvm/auto_scheduler/object_pool.h>
+
+#include <atomic>
+
+
+namespace tvm {
+namespace auto_scheduler {
+
+
+namespace {
+
+std::atomic<int> num_active_search_rounds{0};
+std::atomic<uint64_t> search_round_epoch{0};
+
+}  // namespace anonymous
+
+
+bool IsInSearchRound() {
+  return num_active_search_rounds.load(std::memory_order_relaxed) > 0;
+}
+
+uint64_t GetSearchRoundEpoch() {
+  return search_round_epoch.load(std::memory_order_relaxed);
+}
+
+SearchRoundScope::SearchRoundScope() {
+  ++num_active_search_rounds;
+}
+
+SearchRoundScope::~SearchRoundScope() {
+  if (--num_active_search_rounds == 0) {
+    ++search_round_epoch;
+  }
+}
+
+
+}  // namespace auto_scheduler
+}  // namespace tvm
@@ -34,6 +34,7 @@ namespace auto_scheduler {
 TVM_REGISTER_OBJECT_TYPE(SearchCallbackNode);
 TVM_REGISTER_OBJECT_TYPE(SearchPolicyNode);
 TVM_REGISTER_OBJECT_TYPE(PreloadMeasuredStatesNode);
+TVM_REGISTER_OBJECT_TYPE(PreloadTransferredStatesNode);
 
 void SearchPolicyNode::PreloadMeasuredStates(const String& log_file) {
   RecordReader reader = RecordReader(log_file);
@@ -97,6 +98,120 @@ void SearchPolicyNode::PreloadMeasuredStates(const String& log_file) {
   }
 }
 
+// <bojian/DietCode>
+void SearchPolicyNode::PreloadTransferredStates(const String& log_file,
+                                                const Array<String>& src_workload_keys) {
+  std::unordered_set<std::string> src_workload_key_set;
+  for (const String& workload_key : src_workload_keys) {
+    if (workload_key != search_task->workload_key) {
+      src_workload_key_set.insert(workload_key);
+    }
+  }
+  RecordReader reader = RecordReader(log_file);
+  const auto& res = reader->ReadLines(-1);
+  const Array<MeasureInput>& inputs = std::get<0>(res);
+  const Array<MeasureResult>& results = std::get<1>(res);
+
+  // The throughputs of the dynamic tasks are in FLOPS, whereas those of the
+  // static ones are the reciprocal of the latency.
+  const double dst_flop_ct = IsDynTask(search_task) ? 1. : search_task->compute_dag->flop_ct;
+  std::unordered_set<std::string> transferred_states_set;
+  size_t num_failed = 0;
+
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const MeasureInput& inp = inputs[i];
+    if (!src_workload_key_set.count(inp->task->workload_key) ||
+        inp->task->target->kind->name != search_task->target->kind->name ||
+        results[i]->error_no != 0) {
+      continue;
+    }
+    double src_flop_ct;
+    if (IsDynTask(inp->task)) {
+      src_flop_ct = inp->wkl_inst ?
+          EstimateFlopForInst(inp->task->compute_dag, inp->task->shape_vars.value(),
+                              inp->wkl_inst.value()) :
+          std::get<1>(inp->task->compute_dag.CherryPickWorkloadInstance(inp->state,
+                                                                       inp->task));
+    } else {
+      src_flop_ct = inp->task->compute_dag->flop_ct;
+    }
+    if (src_flop_ct <= 0. || dst_flop_ct <= 0.) {
+      continue;
+    }
+
+    State state = search_task->compute_dag->init_state;
+    try {
+      auto pstate = state.CopyOnWrite();
+      pstate->transform_steps = inp->state->transform_steps;
+      for (const auto& step : pstate->transform_steps) {
+        StepApplyToState(step, &state, search_task->compute_dag);
+      }
+      state = search_task->compute_dag.InferBound(state);
+    } catch (const dmlc::Error& e) {
+      // The states of structurally mismatched tasks cannot be replayed.
+      ++num_failed;
+      continue;
+    }
+    std::string state_str = state.ToStr();
+    if (measured_states_set_.count(state_str) || transferred_states_set.count(state_str)) {
+      continue;
+    }
+    transferred_states_set.insert(state_str);
+    transferred_states_strs_.push_back(std::move(state_str));
+    transferred_states_.push_back(std::move(state));
+    transferred_states_throughputs_.push_back(
+        src_flop_ct / FloatArrayMean(results[i]->costs) / dst_flop_ct);
+  }
+
+  StdCout(verbose) << "SearchPolicy: Transferred " << transferred_states_set.size()
+                   << " states (" << num_failed << " failed) from " << log_file << " to "
+                   << search_task->workload_key << std::endl;
+}
+
+void SearchPolicyNode::DropMeasuredTransferredStates() {
+  size_t num_kept = 0;
+  for (size_t i = 0; i < transferred_states_.size(); ++i) {
+    if (measured_states_set_.count(transferred_states_strs_[i])) {
+      continue;
+    }
+    if (num_kept != i) {
+      transferred_states_[num_kept] = std::move(transferred_states_[i]);
+      transferred_states_throughputs_[num_kept] = transferred_states_throughputs_[i];
+      transferred_states_strs_[num_kept] = std::move(transferred_states_strs_[i]);
+    }
+    ++num_kept;
+  }
+  transferred_states_.resize(num_kept);
+  transferred_states_throughputs_.resize(num_kept);
+  transferred_states_strs_.resize(num_kept);
+}
+
+void SearchPolicyNode::EnqueueRetuneInsts(const Array<Integer>& wkl_inst_ids,
+                                          double boost) {
+  CHECK(IsDynTask(search_task));
+  CHECK_GT(boost, 0.);
+  for (const Integer& wkl_inst_id : wkl_inst_ids) {
+    CHECK(wkl_inst_id->value >= 0 &&
+          static_cast<size_t>(wkl_inst_id->value) < search_task->wkl_insts.size())
+        << "wkl_inst_id=" << wkl_inst_id << " is out of range";
+    retune_inst_boosts[wkl_inst_id->value] = boost;
+  }
+  if (curr_inst_opt_prob.empty()) {
+    // The boosts will be picked up when the probabilities are first computed.
+    return;
+  }
+  std::vector<float> inst_opt_priority(curr_inst_opt_prob.size());
+  for (size_t i = 0; i < curr_inst_opt_prob.size(); ++i) {
+    inst_opt_priority[i] =
+        curr_inst_opt_prob[i] - (i == 0 ? 0. : curr_inst_opt_prob[i - 1]);
+    auto boost_it = retune_inst_boosts.find(i);
+    if (boost_it != retune_inst_boosts.end()) {
+      inst_opt_priority[i] *= boost_it->second;
+    }
+  }
+  ComputePrefixSumProb(inst_opt_priority, &curr_inst_opt_prob);
+}
+
 void SearchPolicyNode::RunCallbacks(const Array<SearchCallback>& callbacks) {
   for (const auto& callback : callbacks) {
     callback->Callback(this);
@@ -113,6 +228,18 @@ void PreloadMeasuredStatesNode::Callback(SearchPolicyNode* policy) {
   policy->PreloadMeasuredStates(filename);
 }
 
+PreloadTransferredStates::PreloadTransferredStates(String filename,
+                                                   Array<String> src_workload_keys) {
+  auto node = make_object<PreloadTransferredStatesNode>();
+  node->filename = std::move(filename);
+  node->src_workload_keys = std::move(src_workload_keys);
+  data_ = std::move(node);
+}
+
+void PreloadTransferredStatesNode::Callback(SearchPolicyNode* policy) {
+  policy->PreloadTransferredStates(filename, src_workload_keys);
+}
+
 TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyRunCallbacks")
     .set_body_typed([](SearchPolicy policy, Optional<Array<SearchCallback>> callbacks) {
       if (callbacks) {
@@ -121,6 +248,11 @@ TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyRunCallbacks")
     });
 
 
+TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyEnqueueRetuneInsts")
+    .set_body_typed([](SearchPolicy policy, Array<Integer> wkl_inst_ids, double boost) {
+      policy->EnqueueRetuneInsts(wkl_inst_ids, boost);
+    });
+
 TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyContinueSearchOneRound")
     .set_body_typed([](SearchPolicy policy, int num_measure, ProgramMeasurer measurer) {
       // <bojian/DietCode>
@@ -146,5 +278,10 @@ TVM_REGISTER_GLOBAL("auto_scheduler.PreloadMeasuredStates").set_body_typed([](St
   return PreloadMeasuredStates(filename);
 });
 
+TVM_REGISTER_GLOBAL("auto_scheduler.PreloadTransferredStates")
+    .set_body_typed([](String filename, Array<String> src_workload_keys) {
+      return PreloadTransferredStates(filename, src_workload_keys);
+    });
+
 }  // namespace auto_scheduler
 }  // namespace tvm
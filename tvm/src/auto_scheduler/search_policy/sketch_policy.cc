@@ -30,11 +30,14 @@
 #include <tvm/support/parallel_for.h>
 
 #include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <queue>
 #include <set>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -84,10 +87,10 @@ SketchPolicy::SketchPolicy(SearchTask task, CostModel program_cost_model,
   // <bojian/DietCode>
   int max_innermost_split_factor =
       GetIntParam(node->params, SketchParamKey::max_innermost_split_factor);
-  if (IsDynTask(node->search_task)) {
-    if (!IsGPUTask(node->search_task)) {
-      LOG(FATAL) << "Non-GPU dynamic tasks have not been supported";
-    }
+  // The joint factorization memo samples with the thread-block constraints of
+  // the GPU sketches. Dynamic CPU tasks fall back to the static memo on the
+  // largest workload instance (see InitFillTileSize).
+  if (IsDynTask(node->search_task) && IsGPUTask(node->search_task)) {
     LOG(INFO) << "Initialized the split factor cache: " << node->search_task->hardware_params
               << " w/ max_innermost_split_factor=" << max_innermost_split_factor;
     node->dietcode_split_memo =
@@ -204,6 +207,10 @@ void SketchPolicyNode::CalculateInstOptProb(const ProgramMeasurer& measurer) {
     
     inst_opt_priority.push_back(
         flop * search_task->wkl_inst_weights[i]->value / best_inst_flops[i]);
+    auto boost_it = retune_inst_boosts.find(i);
+    if (boost_it != retune_inst_boosts.end()) {
+      inst_opt_priority.back() *= boost_it->second;
+    }
   }
   ComputePrefixSumProb(inst_opt_priority, &curr_inst_opt_prob);
   LOG(INFO) << "curr_inst_opt_prob=" << ArrayToString(curr_inst_opt_prob);
@@ -354,6 +361,7 @@ SketchPolicyNode::Search(int n_trials, int early_stopping, int num_measure_per_i
               );
 
         }  // for (input_id ∈ inputs.size())
+        RecordMeasuredInstThroughputs(inputs, results);
 
       } else {
         for (const auto& res : results) {
@@ -363,6 +371,7 @@ SketchPolicyNode::Search(int n_trials, int early_stopping, int num_measure_per_i
 
         }
       }
+      DropMeasuredTransferredStates();
 
     }  // while (ct < n_trials)
 
@@ -389,27 +398,113 @@ SketchPolicyNode::Search(int n_trials, int early_stopping, int num_measure_per_i
                                );
         }
       }  // for (state_id ∈ candidate_states.size())
-
-      bool changed_adapted_candidate_flops = false;
-
-      std::vector<size_t> wkl_inst_ids, next_wkl_inst_ids;
-      for (size_t inst_id = 0; inst_id < search_task->wkl_insts.size(); ++inst_id) {
-        wkl_inst_ids.push_back(inst_id);
+      // Use the measured throughputs instead of the adapted ones wherever the
+      // states have been timed on the instances by multi-shape measurement.
+      for (const std::pair<const std::pair<size_t, size_t>, float>& kv :
+           measured_inst_throughputs_) {
+        adapted_candidate_flops[kv.first.second * measured_states_vector_.size() +
+                                kv.first.first] = kv.second;
       }
 
+      bool changed_adapted_candidate_flops = false;
+      const size_t num_states = measured_states_vector_.size();
+      // (inst_id x num_states + state_id) pairs that have been statically
+      // validated, and that have been fully built, respectively
+      std::unordered_set<size_t> validated_pairs, built_pairs;
 
       std::unordered_map<size_t, size_t> inst_id_disp_map;
       std::vector<State> selected_candidate_states;
       std::vector<float> selected_candidate_flops;
       std::vector<float> inst_predicted_flops;
 
+      // Weigh the latency against the number of kernels and the code size.
+      const double kernel_weight =
+          params.count(SketchParamKey::dispatcher_kernel_weight)
+              ? GetDoubleParam(params, SketchParamKey::dispatcher_kernel_weight) : 0.;
+      const double code_size_weight =
+          params.count(SketchParamKey::dispatcher_code_size_weight)
+              ? GetDoubleParam(params, SketchParamKey::dispatcher_code_size_weight) : 0.;
+      std::vector<int64_t> state_code_sizes;
+      if (code_size_weight != 0.) {
+        // estimated on the largest workload instance, which unrolls the most
+        size_t largest_inst_id = 0;
+        double largest_flop_ct = 0.;
+        for (size_t inst_id = 0; inst_id < search_task->wkl_insts.size(); ++inst_id) {
+          const double flop_ct =
+              EstimateFlopForInst(search_task->compute_dag, search_task->shape_vars.value(),
+                                  search_task->wkl_insts[inst_id]);
+          if (flop_ct > largest_flop_ct) {
+            largest_inst_id = inst_id;
+            largest_flop_ct = flop_ct;
+          }
+        }
+        state_code_sizes.assign(num_states, 0);
+        support::parallel_for_dynamic(0, num_states, [&](const int state_id) {
+          state_code_sizes[state_id] =
+              EstimateCodeSize(search_task, measured_states_vector_[state_id],
+                               search_task->wkl_insts[largest_inst_id]);
+        });
+        for (size_t state_id = 0; state_id < num_states; ++state_id) {
+          // the states that fail to lower are never dispatched
+          if (state_code_sizes[state_id] < 0) {
+            state_code_sizes[state_id] = 0;
+            for (size_t inst_id = 0; inst_id < search_task->wkl_insts.size(); ++inst_id) {
+              adapted_candidate_flops[inst_id * num_states + state_id] = 0.;
+            }
+          }
+        }
+      }
+      std::vector<float> inst_weights;
+      if (search_task->wkl_inst_weights.size() == search_task->wkl_insts.size()) {
+        for (const FloatImm& weight : search_task->wkl_inst_weights) {
+          inst_weights.push_back(weight->value);
+        }
+      }
+
       do {
+        changed_adapted_candidate_flops = false;
 
-        TopKDispatcher dispatcher;
+        TopKDispatcher dispatcher(128, kernel_weight, code_size_weight);
         std::unordered_map<size_t, size_t> raw_inst_id_disp_map =
-            dispatcher.dispatch(adapted_candidate_flops, measured_states_vector_.size());
-        // record the selected candidate states
+            dispatcher.dispatch(adapted_candidate_flops, num_states, state_code_sizes,
+                                inst_weights);
+
+        // Reject the dispatched pairs that exceed the hardware resources by
+        // lowering them only, so that the full builds below are only spent on
+        // the survivors.
+        for (const auto& inst_state_pair : raw_inst_id_disp_map) {
+          const size_t inst_id = inst_state_pair.first,
+                       state_id = inst_state_pair.second,
+                       pair_id = inst_id * num_states + state_id;
+          if (adapted_candidate_flops[pair_id] <= 0. ||
+              !validated_pairs.insert(pair_id).second) {
+            continue;
+          }
+          double penalty = 1.;
+          std::string reason =
+              StaticallyValidateState(search_task, measured_states_vector_[state_id],
+                                      search_task->wkl_insts[inst_id], &penalty);
+          if (reason.empty() && penalty < 1.) {
+            adapted_candidate_flops[pair_id] *= penalty;
+            changed_adapted_candidate_flops = true;
+          }
+          if (!reason.empty()) {
+            StdCout(verbose) << "Statically rejected wkl_inst="
+                             << search_task->wkl_insts[inst_id] << " under "
+                                "state="
+                             << OptionalMatrixToString(
+                                  measured_states_vector_[state_id].GetSplitFactors()
+                                ) << " with "
+                                "reason=" << reason << std::endl;
+            adapted_candidate_flops[pair_id] = 0.;
+            changed_adapted_candidate_flops = true;
+          }
+        }
+        if (changed_adapted_candidate_flops) {
+          continue;
+        }
 
+        // record the selected candidate states
         std::tie(inst_id_disp_map,
                  selected_candidate_states,
                  selected_candidate_flops,
@@ -420,8 +515,15 @@ SketchPolicyNode::Search(int n_trials, int early_stopping, int num_measure_per_i
                                            search_task->wkl_insts,
                                            adapted_candidate_flops);
 
+        std::vector<size_t> wkl_inst_ids;
         std::vector<MeasureInput> test_inputs;
-        for (const size_t inst_id : wkl_inst_ids) {
+        for (const auto& inst_state_pair : raw_inst_id_disp_map) {
+          const size_t inst_id = inst_state_pair.first,
+                       pair_id = inst_id * num_states + inst_state_pair.second;
+          if (adapted_candidate_flops[pair_id] <= 0. || built_pairs.count(pair_id)) {
+            continue;
+          }
+          wkl_inst_ids.push_back(inst_id);
           test_inputs.push_back(
                 MeasureInput(search_task,
                              selected_candidate_states[inst_id_disp_map[inst_id]],
@@ -430,28 +532,33 @@ SketchPolicyNode::Search(int n_trials, int early_stopping, int num_measure_per_i
               );
         }
         Array<BuildResult> build_results =
-            measurer->builder->Build(test_inputs, verbose);
+            test_inputs.empty() ? Array<BuildResult>()
+                                : measurer->builder->Build(test_inputs, verbose);
         CHECK(build_results.size() == test_inputs.size());
 
-        next_wkl_inst_ids.clear();
         for (size_t inst_i = 0; inst_i < wkl_inst_ids.size(); ++inst_i) {
 
           const size_t inst_id = wkl_inst_ids[inst_i],
-                       state_id = inst_id_disp_map[inst_id];
+                       state_id = raw_inst_id_disp_map[inst_id],
+                       pair_id = inst_id * num_states + state_id;
 
           if (build_results[inst_i]->error_no != 0) {
             LOG(INFO) << "Build failed on wkl_inst="
-                           << search_task->wkl_insts[state_id] << " under "
+                           << search_task->wkl_insts[inst_id] << " under "
                          "state="
                            << OptionalMatrixToString(
-                                selected_candidate_states[state_id].GetSplitFactors()
+                                measured_states_vector_[state_id].GetSplitFactors()
                               ) << " with "
                          "error_msg=" << build_results[inst_i]->error_msg;
-            adapted_candidate_flops[inst_id * measured_states_vector_.size() + state_id] = 0.;
-
-            next_wkl_inst_ids.push_back(inst_id);
+            adapted_candidate_flops[pair_id] = 0.;
+            changed_adapted_candidate_flops = true;
+          } else {
+            built_pairs.insert(pair_id);
           }
         }
+        if (changed_adapted_candidate_flops) {
+          continue;
+        }
 
         std::vector<std::string> selected_candidate_str_repr;
         std::ostringstream strout;
@@ -465,7 +572,7 @@ SketchPolicyNode::Search(int n_trials, int early_stopping, int num_measure_per_i
           strout.clear();
         }
         Map<Array<IntImm>, Integer> inst_disp_map;
-        for (const std::pair<size_t, size_t>& inst_state_pair : inst_id_disp_map) {
+        for (const auto& inst_state_pair : inst_id_disp_map) {
           inst_disp_map.Set(search_task->wkl_insts[inst_state_pair.first],
                             Integer(inst_state_pair.second));
         }
@@ -557,6 +664,11 @@ std::pair<int, float>
 SketchPolicyNode::ContinueSearchOneRound(
     int num_measure, ProgramMeasurer measurer) {
   num_measure_per_iter_ = num_measure;
+  // <bojian/DietCode> The re-tuning boosts are only in effect (and hence
+  //                   consumed by this round) if the instance probabilities
+  //                   have been computed. Otherwise, they are kept until the
+  //                   probabilities are first computed at the end of the round.
+  const bool retune_inst_boosts_in_effect = !curr_inst_opt_prob.empty();
 
   Array<State> best_states, random_states;
   Array<MeasureInput> inputs;
@@ -591,7 +703,10 @@ SketchPolicyNode::ContinueSearchOneRound(
   PrintTitle("Measure", verbose);
   results = measurer->Measure(search_task, GetRef<SearchPolicy>(this), inputs);
 
-  // <bojian/DietCode>
+  // <bojian/DietCode> The re-tuning boosts only last for one round.
+  if (retune_inst_boosts_in_effect) {
+    retune_inst_boosts.clear();
+  }
   if (IsDynTask(search_task)) {
     CalculateInstOptProb(measurer);
   }
@@ -624,6 +739,7 @@ SketchPolicyNode::ContinueSearchOneRound(
             // flop_ct / FloatArrayMean(results[input_id]->costs)
           );
     }  // for (input_id ∈ inputs.size())
+    RecordMeasuredInstThroughputs(inputs, results);
 
   } else {
     for (const auto& res : results) {
@@ -633,6 +749,7 @@ SketchPolicyNode::ContinueSearchOneRound(
 
     }
   }
+  DropMeasuredTransferredStates();
 
   auto t_begin = std::chrono::high_resolution_clock::now();
 
@@ -645,11 +762,15 @@ SketchPolicyNode::ContinueSearchOneRound(
   // <bojian/DietCode>
   // return std::make_pair(std::move(inputs), std::move(results));
   if (IsDynTask(search_task)) {
+    const std::vector<float>& best_inst_flops =
+        measurer->best_inst_flops[search_task->workload_key];
+    // No valid state has been found yet.
+    if (best_inst_flops.empty()) {
+      return std::make_pair<int, float>(inputs.size(), 1e10);
+    }
     return std::make_pair<int, float>(
                inputs.size(),
-               ComputeFlopWeightedLatency(
-                 search_task, measurer->best_inst_flops[search_task->workload_key]
-               )
+               ComputeFlopWeightedLatency(search_task, best_inst_flops)
              );
   } else {
     return std::make_pair<int, float>(
@@ -662,38 +783,29 @@ SketchPolicyNode::ContinueSearchOneRound(
 }
 
 Array<State> SketchPolicyNode::SearchOneRound(int num_random_states, Array<State>* random_states) {
-  // Get parameters
-  int population = GetIntParam(params, SketchParamKey::EvolutionarySearch::population);
-  int num_use_measured = std::min(
-      static_cast<int>(measured_states_vector_.size()),
-      static_cast<int>(
-          GetDoubleParam(params, SketchParamKey::SampleInitPopulation::use_measured_ratio) *
-          population));
+  // <bojian/DietCode> Recycle the states and steps that are discarded within
+  //                   the round (e.g., by the sampling and the mutation).
+  SearchRoundScope search_round_scope;
 
   // 1. Generate sketches
   if (sketch_cache_.empty()) {
     sketch_cache_ = GenerateSketches();
   }
+  // <bojian/DietCode> Shift the budget away from the dominated sketches.
+  const double sketch_prune_threshold =
+      params.count(SketchParamKey::sketch_prune_threshold)
+          ? GetDoubleParam(params, SketchParamKey::sketch_prune_threshold) : 0.;
+  if (sketch_prune_threshold > 0) {
+    UpdateSketchBudget(sketch_prune_threshold);
+  }
 
   // 2. Sample the init population
   Array<State> init_population = SampleInitPopulation(sketch_cache_);
 
   // 3. Perform evolutionary search.
   // Also insert already measured good states to the initial population
-
-  LOG(INFO) << "num_use_measured=" << num_use_measured;
-
-  std::vector<int> indices = Argsort(measured_states_throughputs_);
-  for (int i = 0; i < num_use_measured; i++) {
-
-    // <bojian/DietCode>
-    // LOG(INFO) << "Pushing state="
-    //                << OptionalMatrixToString(
-    //                     measured_states_vector_[indices[i]].GetSplitFactors()
-    //                   ) << " w/ " 
-    //              "measured throughput=" << measured_states_throughputs_[indices[i]];
-
-    init_population.push_back(measured_states_vector_[indices[i]]);
+  for (const State& state : GetSeedStates()) {
+    init_population.push_back(state);
   }
   // Sample some random states for eps-greedy
   if (num_random_states > 0 && random_states != nullptr) {
@@ -724,6 +836,47 @@ Array<State> SketchPolicyNode::SearchOneRound(int num_random_states, Array<State
   return EvolutionarySearch(init_population, num_measure_per_iter_ * 2);
 }
 
+// <bojian/DietCode>
+Array<State> SketchPolicyNode::GetSeedStates() {
+  int population = GetIntParam(params, SketchParamKey::EvolutionarySearch::population);
+  const int num_use_measured_budget = static_cast<int>(
+      GetDoubleParam(params, SketchParamKey::SampleInitPopulation::use_measured_ratio) *
+      population);
+  int num_use_measured = std::min(static_cast<int>(measured_states_vector_.size()),
+                                  num_use_measured_budget);
+  auto is_dropped_sketch = [this](const int sketch_id) {
+    return sketch_id != -1 && sketch_dropped_[sketch_id];
+  };
+
+  LOG(INFO) << "num_use_measured=" << num_use_measured;
+
+  Array<State> seed_states;
+  std::vector<int> indices = Argsort(measured_states_throughputs_);
+  // Skip the measured states of the dropped sketches, and give their share to
+  // the states of the other sketches.
+  for (size_t i = 0; i < indices.size() &&
+                     seed_states.size() < static_cast<size_t>(num_use_measured); i++) {
+    if (static_cast<size_t>(indices[i]) < measured_states_sketch_ids_.size() &&
+        is_dropped_sketch(measured_states_sketch_ids_[indices[i]])) {
+      continue;
+    }
+    seed_states.push_back(measured_states_vector_[indices[i]]);
+  }
+  // Fill the rest of the measured-state budget with the states transferred
+  // from similar tasks.
+  std::vector<int> transferred_indices = Argsort(transferred_states_throughputs_);
+  for (size_t i = 0; i < transferred_indices.size() &&
+                     seed_states.size() < static_cast<size_t>(num_use_measured_budget);
+       ++i) {
+    const State& state = transferred_states_[transferred_indices[i]];
+    if (!sketch_dropped_.empty() && is_dropped_sketch(GetSketchId(state))) {
+      continue;
+    }
+    seed_states.push_back(state);
+  }
+  return seed_states;
+}
+
 Array<State> SketchPolicyNode::GenerateSketches() {
   const State& init_state = search_task->compute_dag->init_state;
 
@@ -816,6 +969,17 @@ Array<State> SketchPolicyNode::SampleInitPopulation(const Array<State>& sketches
     rand_gens.push_back(std::mt19937(rand_gen()));
   }
 
+  // <bojian/DietCode> Sample the sketches by their budget if it has been
+  //                   updated for them, and evenly otherwise.
+  const bool sample_sketches_by_budget =
+      !sketch_sample_probs_.empty() && sketches.same_as(sketch_cache_);
+  auto choose_sketch = [this, &sketches, sample_sketches_by_budget](std::mt19937* const rng) {
+    return sketches[sample_sketches_by_budget
+                        ? static_cast<size_t>(RandomChoose(sketch_sample_probs_, rng))
+                        : (*rng)() % sketches.size()];
+  };
+  std::vector<float> out_scores, out_stds;
+
   std::unordered_set<std::string> explored_state_strs;
   size_t iter = 1;
   size_t unchange_cnt = 0;
@@ -826,7 +990,7 @@ Array<State> SketchPolicyNode::SampleInitPopulation(const Array<State>& sketches
     is_sample_init_population_1st_iter = true;
     // enable_verbose_logging = true;
     {
-      State tmp_s = sketches[(rand_gens[0])() % sketches.size()];
+      State tmp_s = choose_sketch(&rand_gens[0]);
       bool valid = true;
       for (const auto& rule : init_rules) {
         if (rule->Apply(this, &tmp_s, &rand_gens[0]) ==
@@ -843,14 +1007,14 @@ Array<State> SketchPolicyNode::SampleInitPopulation(const Array<State>& sketches
     // enable_verbose_logging = false;
 
     // Sample a batch of states randomly
-    support::parallel_for(// 0 
+    support::parallel_for_dynamic(// 0 
                           // <bojian/DietCode> Changed the starting index from 0 -> 1.
                           1
-                        , population, [this, &temp_states, &sketches, &rand_gens](int index) {
+                        , population, [this, &temp_states, &choose_sketch, &rand_gens](int index) {
     // for (int index = 1; index < population; ++index) {
 
       // Randomly choose a sketch
-      State tmp_s = sketches[(rand_gens[index])() % sketches.size()];
+      State tmp_s = choose_sketch(&rand_gens[index]);
       // Apply random annotation rules one by one
       bool valid = true;
       for (const auto& rule : init_rules) {
@@ -918,13 +1082,23 @@ Array<State> SketchPolicyNode::SampleInitPopulation(const Array<State>& sketches
       // }
       cand_states = search_task->compute_dag.InferBound(cand_states);
       PruneInvalidState(search_task, &cand_states);
-      program_cost_model->Predict(search_task, cand_states, &pop_scores);
+      // <bojian/DietCode> The sketch budget needs the uncertainties of the
+      //                   predictions to bound the sketches optimistically.
+      std::vector<float> pop_stds;
+      if (sample_sketches_by_budget) {
+        program_cost_model->PredictWithUncertainty(search_task, cand_states, &pop_scores,
+                                                   &pop_stds);
+      } else {
+        program_cost_model->Predict(search_task, cand_states, &pop_scores);
+      }
 
       for (size_t i = 0; i < cand_states.size(); i++) {
         const auto state_str = cand_states[i].ToStr();
         if (pop_scores[i] > -1e10 && explored_state_strs.count(state_str) == 0) {
           explored_state_strs.insert(state_str);
           out_states.push_back(std::move(cand_states[i]));
+          out_scores.push_back(pop_scores[i]);
+          out_stds.push_back(pop_stds.empty() ? 0.f : pop_stds[i]);
           unchange_cnt = 0;  // Reset the counter once we found a valid state
         } else {
 
@@ -968,6 +1142,11 @@ Array<State> SketchPolicyNode::SampleInitPopulation(const Array<State>& sketches
   double duration = std::chrono::duration_cast<std::chrono::duration<double>>(
                         std::chrono::high_resolution_clock::now() - tic_begin)
                         .count();
+  // <bojian/DietCode>
+  if (sample_sketches_by_budget) {
+    RecordSketchPredictedScores(out_states, out_scores, out_stds);
+  }
+
   StdCout(verbose) << "Sample Initial Population\t#s: " << out_states.size()
                    << "\tfail_ct: " << fail_ct << "\tTime elapsed: " << std::fixed
                    << std::setprecision(2) << duration << std::endl;
@@ -1015,7 +1194,6 @@ Array<State> SketchPolicyNode::EvolutionarySearch(const Array<State>& init_popul
   float max_score = -1e-10f;
   pop_scores.reserve(population);
   pop_selection_probs.reserve(population);
-  std::uniform_real_distribution<> dis(0.0, 1.0);
 
   // mutation rules
   int mutation_success_ct, mutation_fail_ct;
@@ -1170,31 +1348,43 @@ Array<State> SketchPolicyNode::EvolutionarySearch(const Array<State>& init_popul
     // }
 
 
-    // Do mutation
-    while (pnext->size() < population) {
-
-      // <bojian/DietCode>
-      // PrintTitle("Evolutionary Search (Mutation Rule)", verbose);
-
-      State tmp_s = (*pnow)[RandomChoose(pop_selection_probs, &rand_gen)];
-
-      if (dis(rand_gen) < mutation_prob) {
-        const auto& rule = mutation_rules[RandomChoose(rule_selection_probs, &rand_gen)];
-        if (rule->Apply(this, &tmp_s, &rand_gen) == PopulationGenerationRule::ResultKind::kValid) {
-          pnext->push_back(std::move(tmp_s));
-          mutation_success_ct++;
-
-          // <bojian/DietCode>
-          // if (std::dynamic_pointer_cast<MutateInnermostTileSize>(rule)) {
-          //   LOG(FATAL) << "End of a successful innermost tile size mutation";
-          // }
-
-        } else {
-          mutation_fail_ct++;
-        }
-      } else {
-        pnext->push_back(std::move(tmp_s));
-      }
+    // Do mutation. Each slot of the next population draws from its own random
+    // number generator that is derived from the seed, so that the results are
+    // identical regardless of the number of threads.
+    const std::mt19937::result_type round_seed = rand_gen();
+    std::vector<State> next_states(population - pnext->size());
+    std::vector<int> slot_success_cts(next_states.size(), 0),
+                     slot_fail_cts(next_states.size(), 0);
+    support::parallel_for_dynamic(0, next_states.size(),
+        [this, &pnow, &pop_selection_probs, &rule_selection_probs, mutation_prob,
+         round_seed, &next_states, &slot_success_cts, &slot_fail_cts](int slot) {
+          std::seed_seq slot_seed{round_seed, static_cast<std::mt19937::result_type>(slot)};
+          std::mt19937 slot_rand_gen(slot_seed);
+          std::uniform_real_distribution<> slot_dis(0.0, 1.0);
+
+          while (true) {
+            State tmp_s = (*pnow)[RandomChoose(pop_selection_probs, &slot_rand_gen)];
+
+            if (slot_dis(slot_rand_gen) < mutation_prob) {
+              const auto& rule =
+                  mutation_rules[RandomChoose(rule_selection_probs, &slot_rand_gen)];
+              if (rule->Apply(this, &tmp_s, &slot_rand_gen) ==
+                  PopulationGenerationRule::ResultKind::kValid) {
+                next_states[slot] = std::move(tmp_s);
+                slot_success_cts[slot]++;
+                return;
+              }
+              slot_fail_cts[slot]++;
+            } else {
+              next_states[slot] = std::move(tmp_s);
+              return;
+            }
+          }
+        });
+    for (size_t slot = 0; slot < next_states.size(); ++slot) {
+      pnext->push_back(std::move(next_states[slot]));
+      mutation_success_ct += slot_success_cts[slot];
+      mutation_fail_ct += slot_fail_cts[slot];
     }
 
     std::swap(pnext, pnow);
@@ -1279,6 +1469,15 @@ Array<State> SketchPolicyNode::EvolutionarySearch(const Array<State>& init_popul
 Array<MeasureInput> SketchPolicyNode::PickStatesWithEpsGreedy(const Array<State>& best_states,
                                                               const Array<State>& random_states,
                                                               int remaining_n_trials) {
+  // <bojian/DietCode>
+  if (params.count(SketchParamKey::batch_selection)) {
+    std::string selection = GetStringParam(params, SketchParamKey::batch_selection);
+    if (selection != "eps_greedy") {
+      return PickStatesWithUncertainty(best_states, random_states, remaining_n_trials,
+                                       selection);
+    }
+  }
+
   int num_random =
       static_cast<int>(GetDoubleParam(params, SketchParamKey::eps_greedy) * num_measure_per_iter_);
   int num_good = num_measure_per_iter_ - num_random;
@@ -1313,15 +1512,7 @@ Array<MeasureInput> SketchPolicyNode::PickStatesWithEpsGreedy(const Array<State>
     }
 
     // Check if it has already been measured
-    std::string state_str = state.ToStr();
-    if (!measured_states_set_.count(state_str)) {
-      measured_states_set_.insert(std::move(state_str));
-      
-      // <bojian/DietCode>
-      measured_states_vector_.push_back(state);
-      
-      inputs.push_back(MeasureInput(search_task, state));
-    }
+    AddMeasureInput(state, &inputs);
   }
 
   // <bojian/DietCode>
@@ -1330,6 +1521,371 @@ Array<MeasureInput> SketchPolicyNode::PickStatesWithEpsGreedy(const Array<State>
   return inputs;
 }
 
+// <bojian/DietCode>
+bool SketchPolicyNode::AddMeasureInput(const State& state, Array<MeasureInput>* inputs) {
+  std::string state_str = state.ToStr();
+  if (measured_states_set_.count(state_str)) {
+    return false;
+  }
+  measured_states_set_.insert(std::move(state_str));
+  measured_states_vector_.push_back(state);
+
+  if (IsDynTask(search_task)) {
+    Array<Array<IntImm>> multi_wkl_insts = GetMultiShapeMeasureInsts(state);
+    inputs->push_back(MeasureInput(search_task, state, NullOpt,
+                                   multi_wkl_insts.empty()
+                                       ? Optional<Array<Array<IntImm>>>(NullOpt)
+                                       : multi_wkl_insts));
+  } else {
+    inputs->push_back(MeasureInput(search_task, state));
+  }
+  return true;
+}
+
+Array<MeasureInput> SketchPolicyNode::PickStatesWithUncertainty(const Array<State>& best_states,
+                                                                const Array<State>& random_states,
+                                                                int remaining_n_trials,
+                                                                const std::string& selection) {
+  CHECK(selection == "ucb" || selection == "ei")
+      << "Unknown batch selection " << selection << ", which has to be one of "
+      << "eps_greedy, ucb or ei";
+  const double kappa =
+      params.count(SketchParamKey::ucb_kappa) ? GetDoubleParam(params, SketchParamKey::ucb_kappa)
+                                              : 1.;
+
+  // The candidates are the unmeasured states of both the best and the random ones.
+  Array<State> candidates;
+  std::unordered_set<std::string> candidate_strs;
+  for (const Array<State>* states : {&best_states, &random_states}) {
+    for (const State& state : *states) {
+      std::string state_str = state.ToStr();
+      if (!measured_states_set_.count(state_str) && candidate_strs.insert(state_str).second) {
+        candidates.push_back(state);
+      }
+    }
+  }
+  if (candidates.empty()) {
+    return {};
+  }
+
+  std::vector<float> means, stds;
+  program_cost_model->PredictWithUncertainty(search_task, candidates, &means, &stds);
+  if (IsDynTask(search_task)) {
+    // The predictions above are on the instances that the candidates are
+    // cherry-picked on, which differ from one candidate to another. Score the
+    // candidates by their adapted throughputs weighted over all the instances
+    // instead, with the relative uncertainties of the predictions carried over.
+    std::vector<float> occupancy_penalty, padding_penalty, adapted_scores;
+    program_cost_model->PredictForAllInstances(search_task, candidates, &occupancy_penalty,
+                                               &padding_penalty, &adapted_scores);
+    const size_t num_insts = search_task->wkl_insts.size();
+    std::vector<double> inst_weights(num_insts, 1.);
+    for (size_t inst_id = 0; inst_id < search_task->wkl_inst_weights.size(); ++inst_id) {
+      inst_weights[inst_id] = search_task->wkl_inst_weights[inst_id]->value;
+    }
+    const double weight_sum = std::accumulate(inst_weights.begin(), inst_weights.end(), 0.);
+    for (size_t cand_id = 0; cand_id < candidates.size(); ++cand_id) {
+      double weighted_score = 0.;
+      for (size_t inst_id = 0; inst_id < num_insts; ++inst_id) {
+        weighted_score +=
+            inst_weights[inst_id] * adapted_scores[inst_id * candidates.size() + cand_id];
+      }
+      weighted_score /= weight_sum;
+      if (std::isinf(means[cand_id]) || std::isinf(weighted_score)) {
+        means[cand_id] = -std::numeric_limits<float>::infinity();
+        stds[cand_id] = 0.;
+        continue;
+      }
+      stds[cand_id] = means[cand_id] > 0 ? stds[cand_id] * weighted_score / means[cand_id] : 0.;
+      means[cand_id] = weighted_score;
+    }
+  }
+  float incumbent = -std::numeric_limits<float>::infinity();
+  for (const float mean : means) {
+    incumbent = std::max(incumbent, mean);
+  }
+  std::vector<float> acquisitions(candidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (std::isinf(means[i])) {
+      // invalid states that failed to be lowered
+      acquisitions[i] = -std::numeric_limits<float>::infinity();
+    } else if (selection == "ucb") {
+      acquisitions[i] = means[i] + kappa * stds[i];
+    } else if (stds[i] > 0) {
+      const double z = (means[i] - incumbent) / stds[i];
+      const double cdf = 0.5 * std::erfc(-z / std::sqrt(2.));
+      const double pdf = std::exp(-0.5 * z * z) / std::sqrt(2. * M_PI);
+      acquisitions[i] = (means[i] - incumbent) * cdf + stds[i] * pdf;
+    } else {
+      acquisitions[i] = means[i] - incumbent;
+    }
+  }
+
+  // Group the candidates by the workload instances that they are cherry-picked
+  // on, which are then taken round-robin, the most promising group first.
+  std::vector<std::vector<int>> groups;
+  if (IsDynTask(search_task)) {
+    std::unordered_map<std::string, size_t> group_ids;
+    for (const int cand_id : Argsort(acquisitions)) {
+      std::ostringstream wkl_inst_strout;
+      wkl_inst_strout << std::get<0>(
+          search_task->compute_dag.CherryPickWorkloadInstance(candidates[cand_id], search_task));
+      auto group_it = group_ids.emplace(wkl_inst_strout.str(), groups.size()).first;
+      if (group_it->second == groups.size()) {
+        groups.emplace_back();
+      }
+      groups[group_it->second].push_back(cand_id);
+    }
+  } else {
+    groups.push_back(Argsort(acquisitions));
+  }
+
+  Array<MeasureInput> inputs;
+  const int num_inputs = std::min(num_measure_per_iter_, remaining_n_trials);
+  for (size_t offset = 0; static_cast<int>(inputs.size()) < num_inputs; ++offset) {
+    bool has_more = false;
+    for (const std::vector<int>& group : groups) {
+      if (offset >= group.size()) {
+        continue;
+      }
+      has_more = true;
+      if (static_cast<int>(inputs.size()) < num_inputs &&
+          !std::isinf(acquisitions[group[offset]])) {
+        AddMeasureInput(candidates[group[offset]], &inputs);
+      }
+    }
+    if (!has_more) {
+      break;
+    }
+  }
+
+  StdCout(verbose) << "batch_selection=" << selection << ", num_candidates=" << candidates.size()
+                   << ", num_groups=" << groups.size() << ", num_picked=" << inputs.size()
+                   << std::endl;
+  return inputs;
+}
+
+// <bojian/DietCode>
+Array<Array<IntImm>> SketchPolicyNode::GetMultiShapeMeasureInsts(const State& state) const {
+  const int num_insts = params.count(SketchParamKey::num_multi_shape_measure_insts)
+                            ? GetIntParam(params, SketchParamKey::num_multi_shape_measure_insts)
+                            : 0;
+  Array<Array<IntImm>> multi_wkl_insts;
+  if (num_insts <= 0) {
+    return multi_wkl_insts;
+  }
+  multi_wkl_insts.push_back(
+      std::get<0>(search_task->compute_dag.CherryPickWorkloadInstance(state, search_task)));
+  // followed by the instances that weigh the most in the final dispatch
+  std::vector<float> weights;
+  for (size_t inst_id = 0; inst_id < search_task->wkl_insts.size(); ++inst_id) {
+    weights.push_back(inst_id < search_task->wkl_inst_weights.size()
+                          ? search_task->wkl_inst_weights[inst_id]->value
+                          : 1.);
+  }
+  for (const int inst_id : Argsort(weights)) {
+    if (static_cast<int>(multi_wkl_insts.size()) > num_insts) {
+      break;
+    }
+    if (!StructuralEqual()(search_task->wkl_insts[inst_id], multi_wkl_insts[0])) {
+      multi_wkl_insts.push_back(search_task->wkl_insts[inst_id]);
+    }
+  }
+  return multi_wkl_insts;
+}
+
+void SketchPolicyNode::RecordMeasuredInstThroughputs(const Array<MeasureInput>& inputs,
+                                                     const Array<MeasureResult>& results) {
+  CHECK(inputs.size() == results.size());
+  CHECK(measured_states_throughputs_.size() >= inputs.size());
+  const size_t state_id_offset = measured_states_throughputs_.size() - inputs.size();
+
+  for (size_t input_id = 0; input_id < inputs.size(); ++input_id) {
+    const Optional<Array<Array<IntImm>>>& multi_wkl_insts = inputs[input_id]->multi_wkl_insts;
+    const Array<FloatImm>& inst_costs = results[input_id]->inst_costs;
+    if (!multi_wkl_insts || results[input_id]->error_no != 0 ||
+        inst_costs.size() != multi_wkl_insts.value().size()) {
+      continue;
+    }
+    for (size_t i = 0; i < inst_costs.size(); ++i) {
+      for (size_t inst_id = 0; inst_id < search_task->wkl_insts.size(); ++inst_id) {
+        if (!StructuralEqual()(search_task->wkl_insts[inst_id], multi_wkl_insts.value()[i])) {
+          continue;
+        }
+        measured_inst_throughputs_[std::make_pair(state_id_offset + input_id, inst_id)] =
+            EstimateFlopForInst(search_task->compute_dag, search_task->shape_vars.value(),
+                                search_task->wkl_insts[inst_id]) /
+            inst_costs[i]->value;
+      }
+    }
+  }  // for (input_id ∈ inputs.size())
+}
+
+/*!
+ * \brief The signatures of the structural transform steps of a state, i.e.,
+ *        the steps that add stages, inline them or tile their loops. The split
+ *        lengths are left out as those are filled in by the sampling. The other
+ *        steps (e.g., compute_at, fuse, annotation and pragma) are left out as
+ *        well, since the init rules and the mutations rewrite them.
+ */
+static std::vector<std::string> GetSketchStepSignatures(const State& state) {
+  std::vector<std::string> step_signatures;
+  for (const Step& step : state->transform_steps) {
+    std::ostringstream strout;
+    if (const auto* split_step = step.as<SplitStepNode>()) {
+      strout << "SP," << split_step->stage_id << "," << split_step->iter_id << ","
+             << split_step->lengths.size() << "," << split_step->inner_to_outer;
+    } else if (step->IsInstance<FollowSplitStepNode>() ||
+               step->IsInstance<FollowFusedSplitStepNode>() ||
+               step->IsInstance<CacheReadStepNode>() || step->IsInstance<CacheWriteStepNode>() ||
+               step->IsInstance<RfactorStepNode>() || step->IsInstance<ComputeInlineStepNode>()) {
+      dmlc::JSONWriter writer(&strout);
+      writer.BeginArray(false);
+      step->WriteToRecord(&writer);
+      writer.EndArray();
+    } else {
+      continue;
+    }
+    step_signatures.push_back(strout.str());
+  }
+  return step_signatures;
+}
+
+int SketchPolicyNode::GetSketchId(const State& state) const {
+  int sketch_id = -1;
+  const std::vector<std::string> state_step_signatures = GetSketchStepSignatures(state);
+  for (size_t i = 0; i < sketch_step_signatures_.size(); ++i) {
+    const std::vector<std::string>& sketch_step_signatures = sketch_step_signatures_[i];
+    if (sketch_step_signatures.size() > state_step_signatures.size() ||
+        (sketch_id != -1 &&
+         sketch_step_signatures.size() <= sketch_step_signatures_[sketch_id].size())) {
+      continue;
+    }
+    if (std::equal(sketch_step_signatures.begin(), sketch_step_signatures.end(),
+                   state_step_signatures.begin())) {
+      sketch_id = i;
+    }
+  }
+  return sketch_id;
+}
+
+std::vector<int> SketchPolicyNode::GetDroppedSketchIds() const {
+  std::vector<int> dropped_sketch_ids;
+  for (size_t i = 0; i < sketch_dropped_.size(); ++i) {
+    if (sketch_dropped_[i]) {
+      dropped_sketch_ids.push_back(i);
+    }
+  }
+  return dropped_sketch_ids;
+}
+
+/*!
+ * \brief The number of search rounds that a sketch has to be sampled in before
+ *        it can be dropped, so that it is not judged by a handful of samples.
+ */
+constexpr int kSketchMinSampledRoundsToDrop = 2;
+
+void SketchPolicyNode::UpdateSketchBudget(const double prune_threshold) {
+  const size_t num_sketches = sketch_cache_.size();
+  if (sketch_step_signatures_.size() != num_sketches) {
+    sketch_step_signatures_.clear();
+    for (const State& sketch : sketch_cache_) {
+      sketch_step_signatures_.push_back(GetSketchStepSignatures(sketch));
+    }
+    sketch_best_predicted_scores_.assign(num_sketches, 0.);
+    sketch_best_optimistic_scores_.assign(num_sketches, 0.);
+    sketch_best_measured_throughputs_.assign(num_sketches, 0.);
+    sketch_num_sampled_rounds_.assign(num_sketches, 0);
+    sketch_dropped_.assign(num_sketches, false);
+    measured_states_sketch_ids_.clear();
+  }
+  const size_t num_measured_states =
+      std::min(measured_states_vector_.size(), measured_states_throughputs_.size());
+  for (size_t state_id = measured_states_sketch_ids_.size(); state_id < num_measured_states;
+       ++state_id) {
+    const int sketch_id = GetSketchId(measured_states_vector_[state_id]);
+    measured_states_sketch_ids_.push_back(sketch_id);
+    if (sketch_id != -1) {
+      sketch_best_measured_throughputs_[sketch_id] =
+          std::max(sketch_best_measured_throughputs_[sketch_id],
+                   measured_states_throughputs_[state_id]);
+    }
+  }
+
+  // The upper bound of each sketch is the larger of its best optimistic
+  // predicted score (i.e., plus ucb_kappa standard deviations) relative to the
+  // best predicted score among the sketches, and its best measured throughput
+  // relative to the best among the sketches. The sketches that have not been
+  // sampled yet are given the benefit of the doubt.
+  const float max_predicted_score =
+      *std::max_element(sketch_best_predicted_scores_.begin(), sketch_best_predicted_scores_.end());
+  const float max_measured_throughput = *std::max_element(
+      sketch_best_measured_throughputs_.begin(), sketch_best_measured_throughputs_.end());
+  std::vector<float> upper_bounds(num_sketches, 1.);
+  for (size_t i = 0; i < num_sketches; ++i) {
+    if (sketch_num_sampled_rounds_[i] == 0) {
+      continue;
+    }
+    upper_bounds[i] = 0.;
+    if (max_predicted_score > 0) {
+      upper_bounds[i] = std::max(upper_bounds[i],
+                                 sketch_best_optimistic_scores_[i] / max_predicted_score);
+    }
+    if (max_measured_throughput > 0) {
+      upper_bounds[i] = std::max(upper_bounds[i],
+                                 sketch_best_measured_throughputs_[i] / max_measured_throughput);
+    }
+  }
+  const size_t best_sketch_id =
+      std::max_element(upper_bounds.begin(), upper_bounds.end()) - upper_bounds.begin();
+
+  // Drop the dominated sketches (but never the best one), and weigh the rest by
+  // their upper bounds, floored at the threshold to keep exploring them.
+  std::vector<float> sketch_weights(num_sketches, 0.);
+  size_t num_kept_sketches = 0;
+  for (size_t i = 0; i < num_sketches; ++i) {
+    if (!sketch_dropped_[i] && i != best_sketch_id &&
+        sketch_num_sampled_rounds_[i] >= kSketchMinSampledRoundsToDrop &&
+        upper_bounds[i] < prune_threshold) {
+      sketch_dropped_[i] = true;
+      StdCout(verbose) << "Drop sketch " << i << " w/ upper bound " << upper_bounds[i]
+                       << std::endl;
+    }
+    if (!sketch_dropped_[i]) {
+      sketch_weights[i] = std::max(upper_bounds[i], static_cast<float>(prune_threshold));
+      ++num_kept_sketches;
+    }
+  }
+  ComputePrefixSumProb(sketch_weights, &sketch_sample_probs_);
+  StdCout(verbose) << "Sketch Budget\t\t#s: " << num_kept_sketches << "/" << num_sketches
+                   << std::endl;
+}
+
+void SketchPolicyNode::RecordSketchPredictedScores(const Array<State>& states,
+                                                   const std::vector<float>& scores,
+                                                   const std::vector<float>& stds) {
+  CHECK(states.size() == scores.size() && states.size() == stds.size());
+  const double kappa =
+      params.count(SketchParamKey::ucb_kappa) ? GetDoubleParam(params, SketchParamKey::ucb_kappa)
+                                              : 1.;
+  std::vector<bool> is_sampled(sketch_step_signatures_.size(), false);
+  for (size_t i = 0; i < states.size(); ++i) {
+    const int sketch_id = GetSketchId(states[i]);
+    if (sketch_id == -1) {
+      continue;
+    }
+    sketch_best_predicted_scores_[sketch_id] =
+        std::max(sketch_best_predicted_scores_[sketch_id], scores[i]);
+    sketch_best_optimistic_scores_[sketch_id] =
+        std::max(sketch_best_optimistic_scores_[sketch_id],
+                 static_cast<float>(scores[i] + kappa * stds[i]));
+    is_sampled[sketch_id] = true;
+  }
+  for (size_t i = 0; i < is_sampled.size(); ++i) {
+    sketch_num_sampled_rounds_[i] += is_sampled[i];
+  }
+}
+
 /********** PreloadCustomSketchRule **********/
 TVM_REGISTER_OBJECT_TYPE(PreloadCustomSketchRuleNode);
 
@@ -1368,6 +1924,22 @@ TVM_REGISTER_GLOBAL("auto_scheduler.SketchPolicySampleInitialPopulation")
       return init_population;
     });
 
+TVM_REGISTER_GLOBAL("auto_scheduler.SketchPolicyGetSeedStates")
+    .set_body_typed([](SketchPolicy policy) { return policy->GetSeedStates(); });
+
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("auto_scheduler.SketchPolicyGetSketchId")
+    .set_body_typed([](SketchPolicy policy, State state) { return policy->GetSketchId(state); });
+
+TVM_REGISTER_GLOBAL("auto_scheduler.SketchPolicyGetDroppedSketchIds")
+    .set_body_typed([](SketchPolicy policy) {
+      Array<Integer> dropped_sketch_ids;
+      for (const int sketch_id : policy->GetDroppedSketchIds()) {
+        dropped_sketch_ids.push_back(Integer(sketch_id));
+      }
+      return dropped_sketch_ids;
+    });
+
 TVM_REGISTER_GLOBAL("auto_scheduler.SketchPolicyEvolutionarySearch")
     .set_body_typed([](SketchPolicy policy, Array<State> init_population, int out_size) {
       Array<State> states = policy->EvolutionarySearch(init_population, out_size);
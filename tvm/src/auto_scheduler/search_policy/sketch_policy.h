@@ -36,6 +36,7 @@
 #include <tvm/auto_scheduler/cost_model.h>
 #include <tvm/auto_scheduler/search_policy.h>
 
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -85,6 +86,37 @@ struct SketchParamKey {
   static constexpr const char* max_vectorize_size = "max_vectorize_size";
   /*! \brief Whether disable compute location changing. */
   static constexpr const char* disable_change_compute_location = "disable_change_compute_location";
+  // <bojian/DietCode>
+  /*!
+   * \brief The number of workload instances (other than the cherry-picked one)
+   *        to time each state on with a shape-generic build. 0 disables
+   *        multi-shape measurement.
+   */
+  static constexpr const char* num_multi_shape_measure_insts = "num_multi_shape_measure_insts";
+  /*!
+   * \brief How to pick the states to measure: "eps_greedy" (the default), or
+   *        by the upper confidence bound ("ucb") or the expected improvement
+   *        ("ei") of the cost model predictions.
+   */
+  static constexpr const char* batch_selection = "batch_selection";
+  /*! \brief The weight of the standard deviation in the upper confidence bound. */
+  static constexpr const char* ucb_kappa = "ucb_kappa";
+  /*!
+   * \brief The costs of every distinct kernel, and of every KiB of lowered code,
+   *        in the objective of the final dispatch, relative to the mean slowdown
+   *        of the workload instances. Both 0 dispatches by the latency only.
+   */
+  static constexpr const char* dispatcher_kernel_weight = "dispatcher_kernel_weight";
+  static constexpr const char* dispatcher_code_size_weight = "dispatcher_code_size_weight";
+  /*!
+   * \brief Sample the initial population from each sketch in proportion to the
+   *        upper bound of the sketch, i.e., the larger of its best predicted
+   *        score plus ucb_kappa standard deviations and its best measured
+   *        throughput so far, both relative to the best sketch, and drop the
+   *        sketches whose upper bound falls below this threshold. 0 samples the
+   *        sketches evenly and never drops any.
+   */
+  static constexpr const char* sketch_prune_threshold = "sketch_prune_threshold";
 };
 
 class SketchPolicy;
@@ -146,6 +178,14 @@ class SketchPolicyNode : public SearchPolicyNode {
    */
   Array<State> SampleInitPopulation(const Array<State>& sketches);
 
+  // <bojian/DietCode>
+  /*!
+   * \brief Get the best measured states, and then the best states transferred
+   *        from similar tasks, that join the initial population of the
+   *        evolutionary search, within the measured-state share of the population.
+   */
+  Array<State> GetSeedStates();
+
   /*!
    * \brief Perform evolutionary search.
    * \param init_populations The states generated from init population.
@@ -154,6 +194,18 @@ class SketchPolicyNode : public SearchPolicyNode {
    */
   Array<State> EvolutionarySearch(const Array<State>& init_populations, int out_size);
 
+  // <bojian/DietCode>
+  /*!
+   * \brief Get the sketch that a state is sampled from, i.e., the cached sketch
+   *        with the longest structural transform steps that prefix those of the
+   *        state.
+   * \return The index of the sketch in `sketch_cache_`, -1 if there is none.
+   */
+  int GetSketchId(const State& state) const;
+
+  /*! \brief Get the indices of the sketches dropped by the sketch pruning. */
+  std::vector<int> GetDroppedSketchIds() const;
+
   static constexpr const char* _type_key = "auto_scheduler.SketchPolicy";
 
   TVM_DECLARE_FINAL_OBJECT_INFO(SketchPolicyNode, SearchPolicyNode);
@@ -179,6 +231,29 @@ class SketchPolicyNode : public SearchPolicyNode {
                                               const Array<State>& random_states,
                                               int remaining_n_trials);
 
+  // <bojian/DietCode>
+  /*!
+   * \brief Pick states from best states and random states by the upper
+   *        confidence bound or the expected improvement of their predicted
+   *        scores, taken round-robin over the workload instances that the
+   *        states are cherry-picked on for diversity.
+   * \param best_states States picked by cost model.
+   * \param random_states States picked randomly.
+   * \param remaining_n_trials The remaining number of states need to be generated.
+   * \param selection Either "ucb" or "ei".
+   * \return The generated states to be measured, wrapped in MeasureInput.
+   */
+  Array<MeasureInput> PickStatesWithUncertainty(const Array<State>& best_states,
+                                                const Array<State>& random_states,
+                                                int remaining_n_trials,
+                                                const std::string& selection);
+
+  /*!
+   * \brief Mark the state as measured and wrap it in MeasureInput.
+   * \return Whether the state has not been measured before.
+   */
+  bool AddMeasureInput(const State& state, Array<MeasureInput>* inputs);
+
   /*! \brief The number of states to measure per iteration. */
   int num_measure_per_iter_;
 
@@ -188,6 +263,59 @@ class SketchPolicyNode : public SearchPolicyNode {
   /*! \brief The minimul output population of SampleInitPopulation */
   int sample_init_min_pop_;
 
+  // <bojian/DietCode>
+  /*!
+   * \brief The workload instances to time a state on in multi-shape
+   *        measurement, led by the instance that the state is cherry-picked on.
+   */
+  Array<Array<IntImm>> GetMultiShapeMeasureInsts(const State& state) const;
+
+  /*!
+   * \brief Record the throughputs measured on each workload instance of the
+   *        multi-shape measurements, which replace the adapted ones of the
+   *        final dispatch.
+   * \param inputs The measure inputs, the last ones of the measured states.
+   * \param results The measure results.
+   */
+  void RecordMeasuredInstThroughputs(const Array<MeasureInput>& inputs,
+                                     const Array<MeasureResult>& results);
+
+  /*! \brief The measured throughputs, indexed by (state_id, inst_id). */
+  std::map<std::pair<size_t, size_t>, float> measured_inst_throughputs_;
+
+  /*!
+   * \brief Update the upper bounds of the sketches with the newly measured
+   *        states, drop the dominated sketches, and reweigh the sampling of
+   *        the rest by their upper bounds.
+   * \param prune_threshold The upper bound below which a sketch is dropped.
+   */
+  void UpdateSketchBudget(const double prune_threshold);
+
+  /*!
+   * \brief Record the predicted scores of the states sampled from the sketches,
+   *        and the standard deviations of those predictions.
+   */
+  void RecordSketchPredictedScores(const Array<State>& states, const std::vector<float>& scores,
+                                   const std::vector<float>& stds);
+
+  /*! \brief The signatures of the transform steps of each cached sketch. */
+  std::vector<std::vector<std::string>> sketch_step_signatures_;
+  /*! \brief The best predicted score and measured throughput of each sketch so far. */
+  std::vector<float> sketch_best_predicted_scores_, sketch_best_measured_throughputs_;
+  /*!
+   * \brief The best predicted score plus ucb_kappa standard deviations of each
+   *        sketch so far, which bounds what the sketch might still attain.
+   */
+  std::vector<float> sketch_best_optimistic_scores_;
+  /*! \brief The number of search rounds that each sketch has been sampled in. */
+  std::vector<int> sketch_num_sampled_rounds_;
+  /*! \brief Whether each sketch has been dropped. */
+  std::vector<bool> sketch_dropped_;
+  /*! \brief The prefix-sum probabilities of sampling each sketch, empty for even sampling. */
+  std::vector<double> sketch_sample_probs_;
+  /*! \brief The sketches of the measured states accounted in the sketch upper bounds. */
+  std::vector<int> measured_states_sketch_ids_;
+
   friend class SketchPolicy;
 };
 
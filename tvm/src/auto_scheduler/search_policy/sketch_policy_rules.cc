@@ -631,7 +631,7 @@ PopulationGenerationRule::ResultKind InitFillTileSize::Apply(SketchPolicyNode* p
   // Scan the transformation history and randomly fill tiles size for all SplitStep
 
   // <bojian/DietCode> Change how the tile sizes are initialized.
-  if (IsDynTask(policy->search_task)) {
+  if (IsDynTask(policy->search_task) && IsGPUTask(policy->search_task)) {
     std::vector<size_t> split_step_ids;
     for (size_t step_id = 0; step_id < (*state)->transform_steps.size();
          ++step_id) {
@@ -787,7 +787,13 @@ PopulationGenerationRule::ResultKind InitFillTileSize::Apply(SketchPolicyNode* p
         continue;
       }
       ICHECK(ps->extent);
-      int extent = GetIntImm(ps->extent.value());
+      // <bojian/DietCode> Dynamic CPU tasks are tiled for the largest workload
+      // instance, and the smaller ones pay for the padding in the cost model.
+      int extent = IsDynTask(policy->search_task)
+                       ? EvaluateRangeForAllWklInsts(ps->extent.value(),
+                                                     policy->search_task->shape_vars.value(),
+                                                     policy->search_task->wkl_insts).second
+                       : GetIntImm(ps->extent.value());
       const auto& candidate_lens =
           policy->split_memo.GetFactorizationSchemes(extent, ps->lengths.size()
                                                      // , max_innermost_split_factor
@@ -874,7 +880,7 @@ PopulationGenerationRule::ResultKind InitParallel::Apply(SketchPolicyNode* polic
         break;
       }
       to_fuse.push_back(it);
-      parallel_degree *= GetExtent(it);
+      parallel_degree *= GetExtent(policy.search_task, it);
 
       if (parallel_degree > policy.search_task->hardware_params->num_cores * 16) {
         break;
@@ -1037,7 +1043,7 @@ PopulationGenerationRule::ResultKind InitVectorization::Apply(SketchPolicyNode*
         break;
       }
 
-      cum_length_prod *= GetExtent(it);
+      cum_length_prod *= GetExtent(policy->search_task, it);
       if (cum_length_prod > GetIntParam(policy->params, SketchParamKey::max_vectorize_size)) {
         break;
       }
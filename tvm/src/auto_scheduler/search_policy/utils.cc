@@ -24,6 +24,10 @@
 
 #include "utils.h"
 
+#include <tvm/driver/driver_api.h>
+#include <tvm/tir/analysis.h>
+#include <tvm/tir/stmt_functor.h>
+
 #include <algorithm>
 
 namespace tvm {
@@ -400,6 +404,116 @@ void PruneInvalidState(const SearchTask& task, Array<State>* states) {
   }
 }
 
+// <bojian/DietCode>
+namespace {
+
+/*!
+ * \brief Estimate the resource usage of a lowered function from its
+ *        constant-sized allocations.
+ */
+class ResourceUsageEstimator : public tir::StmtVisitor {
+ public:
+  int64_t shared_bytes = 0;  // per thread block
+  int64_t local_bytes = 0;   // per thread
+
+ private:
+  void VisitStmt_(const tir::AllocateNode* op) final {
+    const auto* ptr_type = op->buffer_var->type_annotation.as<PointerTypeNode>();
+    const std::string scope = ptr_type == nullptr ? "" : ptr_type->storage_scope;
+    const int64_t alloc_bytes = static_cast<int64_t>(op->constant_allocation_size()) *
+                                op->dtype.bytes() * op->dtype.lanes();
+    if (scope == "shared") {
+      shared_bytes += alloc_bytes;
+    } else if (scope == "local") {
+      local_bytes += alloc_bytes;
+    }
+    StmtVisitor::VisitStmt_(op);
+  }
+};
+
+}  // namespace anonymous
+
+std::string StaticallyValidateState(const SearchTask& task, const State& state,
+                                    const Array<IntImm>& wkl_inst, double* const penalty) {
+  CHECK(IsDynTask(task));
+  if (penalty != nullptr) {
+    *penalty = 1.;
+  }
+  te::Schedule sch;
+  Array<te::Tensor> tensors;
+  IRModule mod;
+  try {
+    std::tie(sch, tensors) = task->compute_dag.InstantiateAndApplySteps(
+        state, task->shape_vars.value(), ToPrimExprArray(wkl_inst));
+    mod = LowerSchedule(sch, tensors, "main", std::unordered_map<te::Tensor, tir::Buffer>());
+  } catch (const Error& e) {
+    return std::string("Lowering failed: ") + e.what();
+  }
+
+  const HardwareParams& hardware_params = task->hardware_params;
+  std::ostringstream strout;
+  for (const std::pair<GlobalVar, BaseFunc>& kv : mod->functions) {
+    const tir::PrimFunc func = Downcast<tir::PrimFunc>(kv.second);
+    ResourceUsageEstimator estimator;
+    estimator(func->body);
+
+    if (IsGPUTask(task)) {
+      // local arrays are expected to be promoted to registers, anything beyond
+      // the register file of a thread would be spilled
+      const int64_t max_local_bytes =
+          4 * dmlc::GetEnv("DIETCODE_MAX_REGISTERS_PER_THREAD", 255);
+      if (estimator.shared_bytes > hardware_params->max_shared_memory_per_block) {
+        strout << "shared_bytes=" << estimator.shared_bytes << " > "
+               << hardware_params->max_shared_memory_per_block;
+      } else if (estimator.local_bytes > max_local_bytes) {
+        strout << "local_bytes=" << estimator.local_bytes << " > " << max_local_bytes;
+      } else if (!tir::VerifyGPUCode(
+                     func, {{"max_shared_memory_per_block",
+                             hardware_params->max_shared_memory_per_block},
+                            {"max_local_memory_per_block",
+                             hardware_params->max_local_memory_per_block},
+                            {"max_threads_per_block", hardware_params->max_threads_per_block},
+                            {"max_vector_bytes", hardware_params->vector_unit_bytes},
+                            {"max_vthread", hardware_params->max_vthread_extent}})) {
+        strout << "VerifyGPUCode failed";
+      }
+    } else if (penalty != nullptr) {
+      // the local (i.e., cache-write) arrays are expected to stay in the vector
+      // register file, beyond which they are spilled to the (L1-resident)
+      // stack, which slows the state down rather than breaking it
+      const int64_t max_local_bytes =
+          hardware_params->vector_unit_bytes *
+          dmlc::GetEnv("DIETCODE_NUM_VECTOR_REGISTERS", 32);
+      if (estimator.local_bytes > max_local_bytes) {
+        *penalty = std::min(*penalty, static_cast<double>(max_local_bytes) /
+                                          estimator.local_bytes);
+      }
+    }
+    if (!strout.str().empty()) {
+      return strout.str();
+    }
+  }
+  return "";
+}
+
+int64_t EstimateCodeSize(const SearchTask& task, const State& state,
+                         const Array<IntImm>& wkl_inst) {
+  CHECK(IsDynTask(task));
+  IRModule mod;
+  try {
+    te::Schedule sch;
+    Array<te::Tensor> tensors;
+    std::tie(sch, tensors) = task->compute_dag.InstantiateAndApplySteps(
+        state, task->shape_vars.value(), ToPrimExprArray(wkl_inst));
+    mod = LowerSchedule(sch, tensors, "main", std::unordered_map<te::Tensor, tir::Buffer>());
+  } catch (const Error& e) {
+    return -1;
+  }
+  std::ostringstream strout;
+  strout << mod;
+  return static_cast<int64_t>(strout.str().size());
+}
+
 /********** SplitFactorizationMemo **********/
 
 extern bool is_sample_init_population_1st_iter;
@@ -411,6 +525,9 @@ const Array<Array<Integer>>& SplitFactorizationMemo::GetFactorizationSchemes(
     ) {
   QueryKey key = // std::make_tuple(extent, n_lengths, max_innermost_factor);
                  std::make_pair(extent, n_lengths);
+  // <bojian/DietCode> The references to the map elements stay valid after the
+  //                   lock is released, as rehashing does not move them.
+  std::lock_guard<std::mutex> lock(*mutex_);
   const auto& it = memory_.find(key);
   if (it != memory_.end()) {
     return it->second;
@@ -444,7 +561,7 @@ void SplitFactorizationMemo::DfsEnumerate(int now, int remaining_length
       results_->push_back(tmp_stack_);
     }
   } else {
-    for (const auto& f : GetFactors(remaining_length)) {
+    for (const auto& f : GetFactorsLocked(remaining_length)) {
       tmp_stack_.Set(now, Integer(f));
       DfsEnumerate(now + 1, remaining_length / f
                    // , max_innermost_factor
@@ -454,6 +571,11 @@ void SplitFactorizationMemo::DfsEnumerate(int now, int remaining_length
 }
 
 const std::vector<int>& SplitFactorizationMemo::GetFactors(int n) {
+  std::lock_guard<std::mutex> lock(*mutex_);
+  return GetFactorsLocked(n);
+}
+
+const std::vector<int>& SplitFactorizationMemo::GetFactorsLocked(int n) {
   auto it = factor_memory_.find(n);
   if (it != factor_memory_.end()) {
     return it->second;
@@ -1225,6 +1347,15 @@ TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyUtilsHasCacheWriteStage")
 TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyUtilsHasRfactorStage")
     .set_body_typed([](const State& s, int stage_id) { return HasRfactorStage(s, stage_id); });
 
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyUtilsStaticallyValidateState")
+    .set_body_typed([](const SearchTask& task, const State& state,
+                       const Array<IntImm>& wkl_inst) {
+      double penalty;
+      String reason = StaticallyValidateState(task, state, wkl_inst, &penalty);
+      return Array<ObjectRef>{reason, FloatImm(DataType::Float(64), penalty)};
+    });
+
 TVM_REGISTER_GLOBAL("auto_scheduler.SearchPolicyUtilsHasCrossThreadReduction")
     .set_body_typed([](const State& s, int stage_id) {
       return HasCrossThreadReduction(s, stage_id);
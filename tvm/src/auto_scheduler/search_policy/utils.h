@@ -33,6 +33,8 @@
 
 #include <algorithm>
 #include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <tuple>
@@ -332,6 +334,16 @@ inline int64_t GetExtent(const Iterator& it
   return EvaluateRangeForAllWklInsts(it->range->extent, shape_vars, wkl_insts).second;
 }
 
+// <bojian/DietCode>
+/*! \brief Return the extent of an iterator, taking the maximum over the workload instances of a
+ *         dynamic task. */
+inline int64_t GetExtent(const SearchTask& task, const Iterator& it) {
+  if (IsDynTask(task) && it->range.defined()) {
+    return GetExtent(it, task->shape_vars.value(), task->wkl_insts);
+  }
+  return GetExtent(it);
+}
+
 /*! \brief Compute the product of lengths of all space iters and all reduce iters, respectively. */
 inline std::pair<int64_t, int64_t> GetCumulativeSpaceAndReductionLength(
     const Stage& stage
@@ -747,14 +759,19 @@ class SplitFactorizationMemo {
   const std::vector<int>& GetFactors(int n);
 
  private:
+  // <bojian/DietCode> Both require `mutex_` to be held by the caller.
   void DfsEnumerate(int now, int remaining_length
                     // , int max_innermost_factor
                     );
+  const std::vector<int>& GetFactorsLocked(int n);
 
   // <bojian/DietCode>
   int max_innermost_factor_ = 0;
 
   std::unordered_map<QueryKey, Array<Array<Integer>>> memory_;
+  // <bojian/DietCode> Guards the memos, as the mutation rules that query them
+  //                   run in parallel.
+  std::unique_ptr<std::mutex> mutex_ = std::make_unique<std::mutex>();
 
   int n_lengths_;
   Array<Integer> tmp_stack_;
@@ -959,6 +976,30 @@ State FollowTiling(const State& state, int stage_id, const std::vector<int>& spl
 // Prune invalid states and return the results in-place.
 void PruneInvalidState(const SearchTask& task, Array<State>* states);
 
+// <bojian/DietCode>
+/*!
+ * \brief Statically validate a state on a workload instance, by lowering it
+ *        and estimating its resource usage (shared memory per thread block,
+ *        local arrays per thread, and vector register pressure) without any
+ *        code generation.
+ * \param penalty The soft penalty (in (0, 1]) on the throughput of the state,
+ *        for the CPU states whose local arrays spill out of the vector
+ *        register file.
+ * \return The reason why the state is infeasible on the workload instance, or
+ *         an empty string if no hard resource limit is exceeded.
+ */
+std::string StaticallyValidateState(const SearchTask& task, const State& state,
+                                    const Array<IntImm>& wkl_inst,
+                                    double* const penalty = nullptr);
+
+/*!
+ * \brief Estimate the code size of a state on a workload instance, by the
+ *        length of its lowered (and hence unrolled) source.
+ * \return The estimated code size in bytes, or -1 if the lowering fails.
+ */
+int64_t EstimateCodeSize(const SearchTask& task, const State& state,
+                         const Array<IntImm>& wkl_inst);
+
 }  // namespace auto_scheduler
 }  // namespace tvm
 
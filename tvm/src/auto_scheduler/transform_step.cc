@@ -129,46 +129,46 @@ StepNode* Step::CopyOnWrite() {
   CHECK(data_ != nullptr);
   if (!data_.unique()) {
     if (const auto& ps = as<AnnotationStepNode>()) {
-      auto n = make_object<AnnotationStepNode>(*ps);
+      auto n = make_pooled_object<AnnotationStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<FuseStepNode>()) {
-      auto n = make_object<FuseStepNode>(*ps);
+      auto n = make_pooled_object<FuseStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<PragmaStepNode>()) {
-      auto n = make_object<PragmaStepNode>(*ps);
+      auto n = make_pooled_object<PragmaStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<ReorderStepNode>()) {
-      auto n = make_object<ReorderStepNode>(*ps);
+      auto n = make_pooled_object<ReorderStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<SplitStepNode>()) {
-      auto n = make_object<SplitStepNode>(*ps);
+      auto n = make_pooled_object<SplitStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<FollowSplitStepNode>()) {
-      auto n = make_object<FollowSplitStepNode>(*ps);
+      auto n = make_pooled_object<FollowSplitStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<FollowFusedSplitStepNode>()) {
-      auto n = make_object<FollowFusedSplitStepNode>(*ps);
+      auto n = make_pooled_object<FollowFusedSplitStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<StorageAlignStepNode>()) {
-      auto n = make_object<StorageAlignStepNode>(*ps);
+      auto n = make_pooled_object<StorageAlignStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<ComputeAtStepNode>()) {
-      auto n = make_object<ComputeAtStepNode>(*ps);
+      auto n = make_pooled_object<ComputeAtStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<ComputeInlineStepNode>()) {
-      auto n = make_object<ComputeInlineStepNode>(*ps);
+      auto n = make_pooled_object<ComputeInlineStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<ComputeRootStepNode>()) {
-      auto n = make_object<ComputeRootStepNode>(*ps);
+      auto n = make_pooled_object<ComputeRootStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<CacheReadStepNode>()) {
-      auto n = make_object<CacheReadStepNode>(*ps);
+      auto n = make_pooled_object<CacheReadStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<CacheWriteStepNode>()) {
-      auto n = make_object<CacheWriteStepNode>(*ps);
+      auto n = make_pooled_object<CacheWriteStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else if (const auto& ps = as<RfactorStepNode>()) {
-      auto n = make_object<RfactorStepNode>(*ps);
+      auto n = make_pooled_object<RfactorStepNode>(*ps);
       ObjectPtr<Object>(std::move(n)).swap(data_);
     } else {
       LOG(FATAL) << "Invalid step: " << (*this);
@@ -328,7 +328,7 @@ String StepPrintAsPythonAPI(const Step& step, Array<te::Stage>* stages,
 
 /********** Annotation **********/
 AnnotationStep::AnnotationStep(int stage_id, int iter_id, IteratorAnnotation ann) {
-  auto node = make_object<AnnotationStepNode>();
+  auto node = make_pooled_object<AnnotationStepNode>();
   node->stage_id = stage_id;
   node->iter_id = iter_id;
   node->annotation = ann;
@@ -336,7 +336,7 @@ AnnotationStep::AnnotationStep(int stage_id, int iter_id, IteratorAnnotation ann
 }
 
 AnnotationStep::AnnotationStep(dmlc::JSONReader* reader) {
-  auto node = make_object<AnnotationStepNode>();
+  auto node = make_pooled_object<AnnotationStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -463,7 +463,7 @@ String AnnotationStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Fuse **********/
 FuseStep::FuseStep(int stage_id, const Array<Integer>& fused_ids) {
-  auto node = make_object<FuseStepNode>();
+  auto node = make_pooled_object<FuseStepNode>();
   node->stage_id = stage_id;
   for (const auto& x : fused_ids) {
     ICHECK(x->IsInstance<IntImmNode>());
@@ -473,7 +473,7 @@ FuseStep::FuseStep(int stage_id, const Array<Integer>& fused_ids) {
 }
 
 FuseStep::FuseStep(dmlc::JSONReader* reader) {
-  auto node = make_object<FuseStepNode>();
+  auto node = make_pooled_object<FuseStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -637,7 +637,7 @@ String FuseStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Pragma **********/
 PragmaStep::PragmaStep(int stage_id, int iter_id, String pragma_type) {
-  auto node = make_object<PragmaStepNode>();
+  auto node = make_pooled_object<PragmaStepNode>();
   node->stage_id = stage_id;
   node->iter_id = iter_id;
   node->pragma_type = std::move(pragma_type);
@@ -645,7 +645,7 @@ PragmaStep::PragmaStep(int stage_id, int iter_id, String pragma_type) {
 }
 
 PragmaStep::PragmaStep(dmlc::JSONReader* reader) {
-  auto node = make_object<PragmaStepNode>();
+  auto node = make_pooled_object<PragmaStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -748,7 +748,7 @@ String PragmaStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Reorder **********/
 ReorderStep::ReorderStep(int stage_id, const Array<Integer>& after_ids) {
-  auto node = make_object<ReorderStepNode>();
+  auto node = make_pooled_object<ReorderStepNode>();
   node->stage_id = stage_id;
   for (const auto& x : after_ids) {
     ICHECK(x->IsInstance<IntImmNode>());
@@ -758,7 +758,7 @@ ReorderStep::ReorderStep(int stage_id, const Array<Integer>& after_ids) {
 }
 
 ReorderStep::ReorderStep(dmlc::JSONReader* reader) {
-  auto node = make_object<ReorderStepNode>();
+  auto node = make_pooled_object<ReorderStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -989,7 +989,7 @@ String PrintSplitAsPythonAPI(Array<te::Stage>* stages, StageToAxesMap* stage_to_
 
 SplitStep::SplitStep(int stage_id, int iter_id, Optional<PrimExpr> extent,
                      const Array<Optional<Integer>>& lengths, bool inner_to_outer) {
-  auto node = make_object<SplitStepNode>();
+  auto node = make_pooled_object<SplitStepNode>();
   node->stage_id = stage_id;
   // Extent can be a irreducible expression in some special cases
   
@@ -1013,7 +1013,7 @@ SplitStep::SplitStep(int stage_id, int iter_id, Optional<PrimExpr> extent,
 }
 
 SplitStep::SplitStep(dmlc::JSONReader* reader) {
-  auto node = make_object<SplitStepNode>();
+  auto node = make_pooled_object<SplitStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1092,7 +1092,7 @@ String SplitStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Follow Split **********/
 FollowSplitStep::FollowSplitStep(int stage_id, int iter_id, int src_step_id, int n_split) {
-  auto node = make_object<FollowSplitStepNode>();
+  auto node = make_pooled_object<FollowSplitStepNode>();
   node->stage_id = stage_id;
   node->iter_id = iter_id;
   node->src_step_id = src_step_id;
@@ -1150,7 +1150,7 @@ Array<Optional<Integer>> FollowSplitStepNode::ExtractSplitLengths(
 }
 
 FollowSplitStep::FollowSplitStep(dmlc::JSONReader* reader) {
-  auto node = make_object<FollowSplitStepNode>();
+  auto node = make_pooled_object<FollowSplitStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1190,7 +1190,7 @@ String FollowSplitStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 FollowFusedSplitStep::FollowFusedSplitStep(int stage_id, int iter_id,
                                            const Array<Integer>& src_step_ids, int level,
                                            bool factor_or_nparts) {
-  auto node = make_object<FollowFusedSplitStepNode>();
+  auto node = make_pooled_object<FollowFusedSplitStepNode>();
   node->stage_id = stage_id;
   node->iter_id = iter_id;
   node->src_step_ids = src_step_ids;
@@ -1200,7 +1200,7 @@ FollowFusedSplitStep::FollowFusedSplitStep(int stage_id, int iter_id,
 }
 
 FollowFusedSplitStep::FollowFusedSplitStep(dmlc::JSONReader* reader) {
-  auto node = make_object<FollowFusedSplitStepNode>();
+  auto node = make_pooled_object<FollowFusedSplitStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1270,7 +1270,7 @@ String FollowFusedSplitStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Storage Align **********/
 StorageAlignStep::StorageAlignStep(int stage_id, int iter_id, int factor, int offset) {
-  auto node = make_object<StorageAlignStepNode>();
+  auto node = make_pooled_object<StorageAlignStepNode>();
   node->stage_id = stage_id;
   node->iter_id = iter_id;
   node->factor = factor;
@@ -1279,7 +1279,7 @@ StorageAlignStep::StorageAlignStep(int stage_id, int iter_id, int factor, int of
 }
 
 StorageAlignStep::StorageAlignStep(dmlc::JSONReader* reader) {
-  auto node = make_object<StorageAlignStepNode>();
+  auto node = make_pooled_object<StorageAlignStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1337,7 +1337,7 @@ String StorageAlignStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Compute At **********/
 ComputeAtStep::ComputeAtStep(int stage_id, int target_stage_id, int target_iter_id) {
-  auto node = make_object<ComputeAtStepNode>();
+  auto node = make_pooled_object<ComputeAtStepNode>();
   node->stage_id = stage_id;
   node->target_stage_id = target_stage_id;
   node->target_iter_id = target_iter_id;
@@ -1345,7 +1345,7 @@ ComputeAtStep::ComputeAtStep(int stage_id, int target_stage_id, int target_iter_
 }
 
 ComputeAtStep::ComputeAtStep(dmlc::JSONReader* reader) {
-  auto node = make_object<ComputeAtStepNode>();
+  auto node = make_pooled_object<ComputeAtStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1410,13 +1410,13 @@ String ComputeAtStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Compute Inline **********/
 ComputeInlineStep::ComputeInlineStep(int stage_id) {
-  auto node = make_object<ComputeInlineStepNode>();
+  auto node = make_pooled_object<ComputeInlineStepNode>();
   node->stage_id = stage_id;
   data_ = std::move(node);
 }
 
 ComputeInlineStep::ComputeInlineStep(dmlc::JSONReader* reader) {
-  auto node = make_object<ComputeInlineStepNode>();
+  auto node = make_pooled_object<ComputeInlineStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1466,13 +1466,13 @@ String ComputeInlineStepNode::PrintAsPythonAPI(Array<te::Stage>* stages,
 
 /********** Compute Root **********/
 ComputeRootStep::ComputeRootStep(int stage_id) {
-  auto node = make_object<ComputeRootStepNode>();
+  auto node = make_pooled_object<ComputeRootStepNode>();
   node->stage_id = stage_id;
   data_ = std::move(node);
 }
 
 ComputeRootStep::ComputeRootStep(dmlc::JSONReader* reader) {
-  auto node = make_object<ComputeRootStepNode>();
+  auto node = make_pooled_object<ComputeRootStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1562,7 +1562,7 @@ Array<Step> GetFormerStageModifiableSteps(Step current_step, const Array<Step>&
 /********** Cache Read **********/
 CacheReadStep::CacheReadStep(int stage_id, String scope_name,
                              const Array<Integer>& reader_stage_ids) {
-  auto node = make_object<CacheReadStepNode>();
+  auto node = make_pooled_object<CacheReadStepNode>();
   node->stage_id = stage_id;
   node->scope_name = std::move(scope_name);
   node->reader_stage_ids = reader_stage_ids;
@@ -1570,7 +1570,7 @@ CacheReadStep::CacheReadStep(int stage_id, String scope_name,
 }
 
 CacheReadStep::CacheReadStep(dmlc::JSONReader* reader) {
-  auto node = make_object<CacheReadStepNode>();
+  auto node = make_pooled_object<CacheReadStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1674,14 +1674,14 @@ String CacheReadStepNode::PrintAsPythonAPI(Array<te::Stage>* stages, StageToAxes
 
 /********** Cache Write **********/
 CacheWriteStep::CacheWriteStep(int stage_id, String scope_name) {
-  auto node = make_object<CacheWriteStepNode>();
+  auto node = make_pooled_object<CacheWriteStepNode>();
   node->stage_id = stage_id;
   node->scope_name = std::move(scope_name);
   data_ = std::move(node);
 }
 
 CacheWriteStep::CacheWriteStep(dmlc::JSONReader* reader) {
-  auto node = make_object<CacheWriteStepNode>();
+  auto node = make_pooled_object<CacheWriteStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -1804,7 +1804,7 @@ String CacheWriteStepNode::PrintAsPythonAPI(Array<te::Stage>* stages, StageToAxe
 
 /********** Rfactor **********/
 RfactorStep::RfactorStep(int stage_id, int iter_id, int factor_iter_id) {
-  auto node = make_object<RfactorStepNode>();
+  auto node = make_pooled_object<RfactorStepNode>();
   node->stage_id = stage_id;
   node->iter_id = iter_id;
   node->factor_iter_id = factor_iter_id;
@@ -1812,7 +1812,7 @@ RfactorStep::RfactorStep(int stage_id, int iter_id, int factor_iter_id) {
 }
 
 RfactorStep::RfactorStep(dmlc::JSONReader* reader) {
-  auto node = make_object<RfactorStepNode>();
+  auto node = make_pooled_object<RfactorStepNode>();
   bool s;
   s = reader->NextArrayItem();
   ICHECK(s);
@@ -27,6 +27,8 @@
 // <bojian/DietCode>
 #include <algorithm>
 #include <functional>
+#include <limits>
+#include <numeric>
 
 
 namespace tvm {
@@ -38,135 +40,220 @@ NullStream& NullStream::Global() {
 }
 
 
-extern bool enable_verbose_logging;
+std::vector<std::vector<size_t>>
+TopKDispatcher::RankStates(const std::vector<float>& scores, const size_t num_states,
+                           const size_t max_k) {
+  const size_t num_instances = scores.size() / num_states;
+  const size_t rank_len = std::min(max_k, num_states);
+  std::vector<std::vector<size_t>> inst_rankings(num_instances);
+
+  for (size_t inst_id = 0; inst_id < num_instances; ++inst_id) {
+    // ∀inst, sort its most-preferred states, with ties broken by the state ID
+    std::vector<size_t>& ranking = inst_rankings[inst_id];
+    ranking.resize(num_states);
+    std::iota(ranking.begin(), ranking.end(), 0);
+    const float* const inst_scores = &scores[inst_id * num_states];
+    std::partial_sort(ranking.begin(), ranking.begin() + rank_len, ranking.end(),
+                      [inst_scores](const size_t LHS, const size_t RHS) {
+                        return inst_scores[LHS] > inst_scores[RHS] ||
+                               (inst_scores[LHS] == inst_scores[RHS] && LHS < RHS);
+                      });
+    ranking.resize(rank_len);
+  }
+  return inst_rankings;
+}
 
 std::unordered_map<size_t, size_t>
-TopKDispatcher::dispatch(const std::vector<float>& scores,
-                         const size_t num_states) {
-  const size_t num_instances = scores.size() / num_states;
+TopKDispatcher::DispatchTopK(const std::vector<float>& scores,
+                             const size_t num_states,
+                             const std::vector<std::vector<size_t>>& inst_rankings,
+                             const size_t k,
+                             std::unordered_set<size_t>* const selected_states) {
+  const size_t num_instances = inst_rankings.size();
   std::unordered_map<size_t, size_t> disp_map_to_ret;
 
-  size_t k = 0;
   // instance dispatch initial status
   std::unordered_set<size_t> inst_disp_init_remainder;
 
   for (size_t inst_id = 0; inst_id < num_instances; ++inst_id) {
+    CHECK(k <= inst_rankings[inst_id].size());
     inst_disp_init_remainder.insert(inst_id);
   }
 
-  struct ScoreboardItem {
-    size_t state_id;
-    float  score;
-  };
-
-  auto scoreboard_item_gt_cmp = [](const ScoreboardItem& LHS,
-                                   const ScoreboardItem& RHS) {
-    return LHS.score > RHS.score;
-  };
+  // Now that all the instances have their most-preferred states ready, we now
+  // choose the minimum set that could cover all the candidates.
+  
+  // make a copy of the dispatch status
+  std::unordered_set<size_t> inst_disp_remainder(inst_disp_init_remainder);
+  selected_states->clear();
+
+  // keep iterating until all the iterators have been dispatched
+  while (!inst_disp_remainder.empty()) {
+    // count the number of votes per state [state_id → vote_cnt]
+    std::unordered_map<size_t, float> votes;
+
+    for (const size_t inst_id : inst_disp_remainder) {
+      for (size_t rank = 0; rank < k; ++rank) {
+        const size_t state_id = inst_rankings[inst_id][rank];
+        votes[state_id] += scores[inst_id * num_states + state_id];
+      }  // for (rank ∈ range(k))
+    }    // for (inst_id ∈ inst_disp_remainder)
+
+    // pick the state_id with the maximum accumulated score
+    const auto& votes_max_it = 
+        std::max_element(votes.begin(), votes.end(),
+                         [](const std::pair<size_t, float>& LHS,
+                            const std::pair<size_t, float>& RHS)
+                           -> bool {
+                           return LHS.second < RHS.second;
+                         }
+                         );
+    selected_states->insert(votes_max_it->first);
+
+    std::unordered_set<size_t> inst_disp_remainder_copy = inst_disp_remainder;
+
+    for (const size_t inst_id : inst_disp_remainder) {
+      const std::vector<size_t>& ranking = inst_rankings[inst_id];
+      if (std::find(ranking.begin(), ranking.begin() + k, votes_max_it->first) !=
+          ranking.begin() + k) {
+        inst_disp_remainder_copy.erase(inst_id);
+        disp_map_to_ret[inst_id] = votes_max_it->first;
+      }
+    }    // for (inst_id ∈ inst_disp_remainder)
+    inst_disp_remainder = std::move(inst_disp_remainder_copy);
+  }  // while (!inst_disp_remainder.empty())
 
-  while (true) {
-    ++k;  // increment the number of candidates selected
-    disp_map_to_ret.clear();
+  return disp_map_to_ret;
+}
 
-    typedef std::vector<ScoreboardItem> Scoreboard;
-    std::unordered_map<size_t, Scoreboard> inst_topK_candidates;
 
-    for (size_t inst_id = 0; inst_id < num_instances; ++inst_id) {
-      if (enable_verbose_logging) {
-        LOG(INFO) << "inst_id=" << inst_id;
+std::unordered_map<size_t, size_t>
+TopKDispatcher::dispatch(const std::vector<float>& scores,
+                         const size_t num_states,
+                         const std::vector<int64_t>& state_code_sizes,
+                         const std::vector<float>& inst_weights) {
+  const size_t num_instances = scores.size() / num_states;
+  const bool multi_objective = kernel_weight_ != 0. || code_size_weight_ != 0.;
+  if (code_size_weight_ != 0.) {
+    CHECK(state_code_sizes.size() == num_states)
+        << "The code sizes of the states are required by the code size weight";
+  }
+  std::vector<float> best_scores(num_instances, 0.);
+  for (size_t inst_id = 0; inst_id < num_instances; ++inst_id) {
+    for (size_t state_id = 0; state_id < num_states; ++state_id) {
+      best_scores[inst_id] = std::max(best_scores[inst_id],
+                                      scores[inst_id * num_states + state_id]);
+    }
+  }
+  // the objective of a dispatch, lower is better
+  auto f_objective = [&](const std::unordered_map<size_t, size_t>& disp_map,
+                         const std::unordered_set<size_t>& selected_states) -> double {
+    double slowdown = 0., total_weight = 0.;
+    for (const std::pair<const size_t, size_t>& inst_state_pair : disp_map) {
+      const size_t inst_id = inst_state_pair.first;
+      const float score = scores[inst_id * num_states + inst_state_pair.second];
+      if (score <= 0.) {
+        return std::numeric_limits<double>::infinity();
       }
-      // ∀inst, pick its k most-preferred states
-      Scoreboard& topK_candidates = inst_topK_candidates[inst_id];
-      for (size_t state_id = 0; state_id < num_states; ++state_id) {
-        const float score = scores[inst_id * num_states + state_id];
-        if (topK_candidates.size() < k) {
-          topK_candidates.push_back(ScoreboardItem{state_id, score});
-          // no need to invoke push_heap here because the scoreboard is not yet full
-          // std::push_heap(topK_candidates.begin(), topK_candidates.end(),
-          //                scoreboard_item_gt_cmp);
-        } else {
-          if (score > topK_candidates.front().score) {
-            // if (enable_verbose_logging) {
-            //   LOG(INFO) << "min score before popping="
-            //             << topK_candidates.front().score << " w/ "
-            //                "state_id=" << topK_candidates.front().state_id;
-            // }
-            std::pop_heap(topK_candidates.begin(), topK_candidates.end(),
-                          scoreboard_item_gt_cmp);
-            topK_candidates.back() = ScoreboardItem{state_id, score};
-            std::push_heap(topK_candidates.begin(), topK_candidates.end(),
-                           scoreboard_item_gt_cmp);
-            if (enable_verbose_logging) {
-              LOG(INFO) << "min score =>" << topK_candidates.front().score
-                        << " w/ " "state_id="
-                        << topK_candidates.front().state_id;
-            }
-          }  // if (score > topK_candidates.front().score)
-        }    // if (topK_candidates.size() < k)
-      }      // for (state_id ∈ range(num_states))
-    }        // for (inst_id ∈ range(num_instances))
-    // Now that all the instances have their most-preferred states ready, we now
-    // choose the minimum set that could cover all the candidates.
-    
-    // make a copy of the dispatch status
-    std::unordered_set<size_t> inst_disp_remainder(inst_disp_init_remainder);
-    std::unordered_set<size_t> selected_states;
-
-    // keep iterating until all the iterators have been dispatched
-    while (!inst_disp_remainder.empty()) {
-      // count the number of votes per state [state_id → vote_cnt]
-      std::unordered_map<size_t, float> votes;
-
-      for (const size_t inst_id : inst_disp_remainder) {
-        for (const ScoreboardItem& cand : inst_topK_candidates[inst_id]) {
-          auto votes_it = votes.find(cand.state_id);
-          if (votes_it == votes.end()) {
-            votes[cand.state_id] = 0.;
-          }
-          votes[cand.state_id] += scores[inst_id * num_states + cand.state_id];
-        }  // for (cand ∈ inst_topK_candidates[inst_id])
-      }    // for (inst_id ∈ inst_disp_remainder)
-
-      // pick the state_id with the maximum accumulated score
-      const auto& votes_max_it = 
-          std::max_element(votes.begin(), votes.end(),
-                           [](const std::pair<size_t, float>& LHS,
-                              const std::pair<size_t, float>& RHS)
-                             -> bool {
-                             return LHS.second < RHS.second;
-                           }
-                           );
-      selected_states.insert(votes_max_it->first);
-
-      std::unordered_set<size_t> inst_disp_remainder_copy = inst_disp_remainder;
-
-      for (const size_t inst_id : inst_disp_remainder) {
-        Scoreboard& topK_candidates = inst_topK_candidates[inst_id];
-
-        Scoreboard::iterator topK_candidates_it;
-        for (topK_candidates_it  = topK_candidates.begin();
-             topK_candidates_it != topK_candidates.end();
-             ++topK_candidates_it) {
-          if (topK_candidates_it->state_id == votes_max_it->first) {
-            break;
-          }
-        }
-        if (topK_candidates_it != topK_candidates.end()) {
-          inst_disp_remainder_copy.erase(inst_id);
-          disp_map_to_ret[inst_id] = votes_max_it->first;
-        }
-      }    // for (inst_id ∈ inst_disp_remainder)
-      inst_disp_remainder = std::move(inst_disp_remainder_copy);
-    }  // while (!inst_disp_remainder.empty())
+      const double weight = inst_weights.empty() ? 1. : inst_weights[inst_id];
+      slowdown += weight * best_scores[inst_id] / score;
+      total_weight += weight;
+    }
+    double objective = total_weight == 0. ? 0. : slowdown / total_weight;
+    objective += kernel_weight_ * selected_states.size();
+    if (code_size_weight_ != 0.) {
+      for (const size_t state_id : selected_states) {
+        objective += code_size_weight_ * state_code_sizes[state_id] / 1024.;
+      }
+    }
+    return objective;
+  };
 
+  std::unordered_map<size_t, size_t> disp_map_to_ret;
+  std::unordered_set<size_t> selected_states;
+  size_t best_k = 0, best_num_states = 0;
+  double best_objective = std::numeric_limits<double>::infinity();
+
+  // The states are ranked once for all the values of k, each of which only
+  // looks at the top-k prefix of the rankings. k is capped by the kernel limit
+  // to keep the sweep bounded.
+  const size_t max_k = std::min(num_states, max_num_states_);
+  const std::vector<std::vector<size_t>> inst_rankings =
+      RankStates(scores, num_states, max_k);
+  size_t num_invalid_ks = 0;
+
+  for (size_t k = 1; k <= max_k; ++k) {
+    std::unordered_map<size_t, size_t> disp_map =
+        DispatchTopK(scores, num_states, inst_rankings, k, &selected_states);
     if (selected_states.size() > max_num_states_) {
-      LOG(WARNING) << "The number of selected states is greater than "
-                   << max_num_states_ << ", hence is not valid";
-    } else {
+      ++num_invalid_ks;
+      continue;
+    }
+    if (!multi_objective) {
+      best_k = k;
+      best_num_states = selected_states.size();
+      disp_map_to_ret = std::move(disp_map);
+      break;
+    }
+    // Larger k's trade the latency for fewer kernels. Keep sweeping until
+    // there is only one kernel left.
+    const double objective = f_objective(disp_map, selected_states);
+    if (best_k == 0 || objective < best_objective) {
+      best_k = k;
+      best_num_states = selected_states.size();
+      best_objective = objective;
+      disp_map_to_ret = std::move(disp_map);
+    }
+    if (selected_states.size() <= 1) {
       break;
     }
   }
-  LOG(INFO) << "k=" << k;
+  if (num_invalid_ks != 0) {
+    LOG(WARNING) << num_invalid_ks << " value(s) of k select more than " << max_num_states_
+                 << " states, hence are not valid";
+  }
+  if (best_k == 0 && max_k != 0) {
+    // Fall back to the plain top-K states on the accumulated scores, and
+    // dispatch every instance to its best one among them.
+    LOG(WARNING) << "No valid value of k, falling back to the top-" << max_num_states_
+                 << " states on the accumulated scores";
+    std::vector<double> acc_scores(num_states, 0.);
+    for (size_t inst_id = 0; inst_id < num_instances; ++inst_id) {
+      const double weight = inst_weights.empty() ? 1. : inst_weights[inst_id];
+      for (size_t state_id = 0; state_id < num_states; ++state_id) {
+        acc_scores[state_id] += weight * scores[inst_id * num_states + state_id];
+      }
+    }
+    std::vector<size_t> topK_states(num_states);
+    std::iota(topK_states.begin(), topK_states.end(), 0);
+    std::partial_sort(topK_states.begin(), topK_states.begin() + max_k, topK_states.end(),
+                      [&acc_scores](const size_t LHS, const size_t RHS) {
+                        return acc_scores[LHS] > acc_scores[RHS] ||
+                               (acc_scores[LHS] == acc_scores[RHS] && LHS < RHS);
+                      });
+    topK_states.resize(max_k);
+    selected_states.clear();
+    for (size_t inst_id = 0; inst_id < num_instances; ++inst_id) {
+      size_t best_state_id = topK_states.front();
+      for (const size_t state_id : topK_states) {
+        if (scores[inst_id * num_states + state_id] >
+            scores[inst_id * num_states + best_state_id]) {
+          best_state_id = state_id;
+        }
+      }
+      disp_map_to_ret[inst_id] = best_state_id;
+      selected_states.insert(best_state_id);
+    }
+    best_num_states = selected_states.size();
+    if (multi_objective) {
+      best_objective = f_objective(disp_map_to_ret, selected_states);
+    }
+  }
+  LOG(INFO) << "k=" << best_k << ", #states=" << best_num_states;
+  if (multi_objective) {
+    LOG(INFO) << "objective=" << best_objective << " w/ kernel_weight=" << kernel_weight_
+              << ", code_size_weight=" << code_size_weight_;
+  }
   return disp_map_to_ret;
 }
 
@@ -52,6 +52,7 @@
 #include <tvm/tir/stmt_functor.h>
 
 #include <sstream>
+#include <unordered_set>
 
 
 namespace std {
@@ -569,12 +570,48 @@ class SyntheticExprReplacer : public tir::StmtExprMutator {
 struct TopKDispatcher {
  private:
   size_t max_num_states_;
+  // <bojian/DietCode> weights of the multi-objective dispatch
+  double kernel_weight_, code_size_weight_;
+
+  /*!
+   * \brief Rank the (at most max_k) most-preferred states of every instance.
+   */
+  static std::vector<std::vector<size_t>>
+  RankStates(const std::vector<float>& scores, const size_t num_states, const size_t max_k);
+  /*!
+   * \brief Dispatch every instance to one of its k most-preferred states, with
+   *        the selected states greedily covering all the instances.
+   */
+  std::unordered_map<size_t, size_t>
+  DispatchTopK(const std::vector<float>& scores, const size_t num_states,
+               const std::vector<std::vector<size_t>>& inst_rankings,
+               const size_t k, std::unordered_set<size_t>* const selected_states);
  public:
-  TopKDispatcher(const size_t max_num_states = 128)
-      : max_num_states_(max_num_states) {}
-
+  /*!
+   * \param kernel_weight The cost of every distinct kernel in the objective.
+   * \param code_size_weight The cost of every KiB of code in the objective.
+   *
+   * Both costs are relative to the (instance-weighted) mean slowdown of the
+   * instances w.r.t. their best states. If any of them is non-zero, all the
+   * values of k are swept and the dispatch that minimizes the objective is
+   * picked, rather than the one with the smallest valid k.
+   */
+  TopKDispatcher(const size_t max_num_states = 128,
+                 const double kernel_weight = 0.,
+                 const double code_size_weight = 0.)
+      : max_num_states_(max_num_states), kernel_weight_(kernel_weight),
+        code_size_weight_(code_size_weight) {}
+
+  /*!
+   * \param scores The scores of the states on the instances [num_insts x num_states].
+   * \param state_code_sizes The code size of each state in bytes, required
+   *        only if the code size weight is non-zero.
+   * \param inst_weights The weight of each instance, uniform if empty.
+   */
   std::unordered_map<size_t, size_t>
-  dispatch(const std::vector<float>& scores, const size_t num_states);
+  dispatch(const std::vector<float>& scores, const size_t num_states,
+           const std::vector<int64_t>& state_code_sizes = {},
+           const std::vector<float>& inst_weights = {});
 
 
   std::tuple<std::unordered_map<size_t, size_t>,
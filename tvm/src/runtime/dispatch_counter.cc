@@ -0,0 +1,123 @@
+// <bojian/DietCode>
+/*!
+ * \file dispatch_counter.cc
+ * \brief The per-leaf call counters of the lowered dynamic-shape dispatchers.
+ */
+#include <tvm/runtime/c_backend_api.h>
+#include <tvm/runtime/container/shape_tuple.h>
+#include <tvm/runtime/registry.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tvm {
+namespace runtime {
+namespace {
+
+// Same as `auto_scheduler::DispatchTable::kMaxNumLeaves`.
+constexpr int kMaxNumDispatchLeaves = 256;
+
+struct DispatchCounters {
+  std::array<std::atomic<uint64_t>, kMaxNumDispatchLeaves> counts{};
+  // The leaf that each workload instance is dispatched to, guarded by the
+  // registry lock.
+  std::vector<int64_t> inst_leaf_ids;
+
+  void Reset() {
+    for (std::atomic<uint64_t>& count : counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+/*!
+ * \brief The counters of every dispatcher, by name. The counters are never
+ *        freed, so that the serving threads can keep pointers to them.
+ */
+class DispatchCounterRegistry {
+ public:
+  static DispatchCounterRegistry* Global() {
+    static DispatchCounterRegistry* inst = new DispatchCounterRegistry();
+    return inst;
+  }
+
+  DispatchCounters* Get(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<DispatchCounters>& counters = counters_[name];
+    if (counters == nullptr) {
+      counters.reset(new DispatchCounters());
+    }
+    return counters.get();
+  }
+
+  void SetInstLeafIds(const std::string& name, std::vector<int64_t> inst_leaf_ids) {
+    DispatchCounters* const counters = Get(name);
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters->inst_leaf_ids = std::move(inst_leaf_ids);
+    counters->Reset();
+  }
+
+  std::vector<int64_t> GetInstLeafIds(const std::string& name) {
+    DispatchCounters* const counters = Get(name);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counters->inst_leaf_ids;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::unique_ptr<DispatchCounters>> counters_;
+};
+
+}  // namespace
+
+TVM_REGISTER_GLOBAL("runtime.GetDispatchCounts").set_body_typed([](const String& name) {
+  const DispatchCounters* const counters = DispatchCounterRegistry::Global()->Get(name);
+  std::vector<int64_t> counts;
+  for (const std::atomic<uint64_t>& count : counters->counts) {
+    counts.push_back(count.load(std::memory_order_relaxed));
+  }
+  // Trim the leaves that have never been dispatched to.
+  while (!counts.empty() && counts.back() == 0) {
+    counts.pop_back();
+  }
+  return ShapeTuple(counts);
+});
+
+TVM_REGISTER_GLOBAL("runtime.ResetDispatchCounts").set_body_typed([](const String& name) {
+  DispatchCounterRegistry::Global()->Get(name)->Reset();
+});
+
+TVM_REGISTER_GLOBAL("runtime.SetDispatchInstLeafIds")
+    .set_body_typed([](const String& name, const ShapeTuple& inst_leaf_ids) {
+      DispatchCounterRegistry::Global()->SetInstLeafIds(
+          name, std::vector<int64_t>(inst_leaf_ids.begin(), inst_leaf_ids.end()));
+    });
+
+TVM_REGISTER_GLOBAL("runtime.GetDispatchInstLeafIds").set_body_typed([](const String& name) {
+  return ShapeTuple(DispatchCounterRegistry::Global()->GetInstLeafIds(name));
+});
+
+}  // namespace runtime
+}  // namespace tvm
+
+int TVMBackendCountDispatch(const char* name, int leaf_id) {
+  using tvm::runtime::DispatchCounterRegistry;
+  using tvm::runtime::DispatchCounters;
+  if (leaf_id < 0 || leaf_id >= tvm::runtime::kMaxNumDispatchLeaves) {
+    return -1;
+  }
+  // The registry is only locked when a thread switches between dispatchers.
+  thread_local std::string cached_name;
+  thread_local DispatchCounters* cached_counters = nullptr;
+  if (cached_counters == nullptr || cached_name != name) {
+    cached_name = name;
+    cached_counters = DispatchCounterRegistry::Global()->Get(cached_name);
+  }
+  cached_counters->counts[leaf_id].fetch_add(1, std::memory_order_relaxed);
+  return 0;
+}
@@ -292,6 +292,12 @@ TVM_REGISTER_GLOBAL("runtime.TVMArrayAllocWithScope").set_body([](TVMArgs args,
   *ret = ndarray;
 });
 
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("runtime.TVMArrayCreateView").set_body_typed([](NDArray array,
+                                                                     ShapeTuple shape) {
+  return array.CreateView(shape, array->dtype);
+});
+
 int TVMArrayFree(TVMArrayHandle handle) {
   API_BEGIN();
   NDArray::Internal::FFIDecRef(handle);
@@ -26,11 +26,20 @@
 #include <tvm/runtime/profiling.h>
 #include <tvm/runtime/registry.h>
 
+#include <cmath>
 #include <cstring>
 #include <memory>
 #if defined(_M_X64) || defined(__x86_64__)
 #include <immintrin.h>
 #endif
+// <bojian/DietCode>
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "rpc_endpoint.h"
 #include "rpc_session.h"
@@ -342,6 +351,35 @@ inline void CPUCacheFlush(int begin_index, const TVMArgs& args) {
   }
 }
 
+/*!
+ * \brief Time one `repeat` of the measurement, with `number` increased until
+ *        the `repeat` lasts for at least `min_repeat_ms`.
+ * \return The average time cost (in seconds) of one run.
+ */
+inline double TimeOneRepeat(const PackedFunc& pf, Device dev, const TVMArgs& args, int* number,
+                            int min_repeat_ms) {
+  TVMRetValue temp;
+  double duration_ms = 0.0;
+
+  do {
+    if (duration_ms > 0.0) {
+      *number = static_cast<int>(std::max((min_repeat_ms / (duration_ms / *number) + 1),
+                                          *number * 1.618));  // 1.618 is chosen by random
+    }
+
+    Timer t = Timer::Start(dev);
+    // start timing
+    for (int i = 0; i < *number; ++i) {
+      pf.CallPacked(args, &temp);
+    }
+    t->Stop();
+    int64_t t_nanos = t->SyncAndGetElapsedNanos();
+    duration_ms = t_nanos / 1e6;
+  } while (duration_ms < min_repeat_ms);
+
+  return duration_ms / 1e3 / *number;
+}
+
 PackedFunc WrapTimeEvaluator(PackedFunc pf, Device dev, int number, int repeat, int min_repeat_ms,
                              PackedFunc f_preproc) {
   ICHECK(pf != nullptr);
@@ -365,26 +403,77 @@ PackedFunc WrapTimeEvaluator(PackedFunc pf, Device dev, int number, int repeat,
       if (f_preproc != nullptr) {
         f_preproc.CallPacked(args, &temp);
       }
-      double duration_ms = 0.0;
+      double speed = TimeOneRepeat(pf, dev, args, &number, min_repeat_ms);
+      os.write(reinterpret_cast<char*>(&speed), sizeof(speed));
+    }
 
-      do {
-        if (duration_ms > 0.0) {
-          number = static_cast<int>(std::max((min_repeat_ms / (duration_ms / number) + 1),
-                                             number * 1.618));  // 1.618 is chosen by random
-        }
+    std::string blob = os.str();
+    TVMByteArray arr;
+    arr.size = blob.length();
+    arr.data = blob.data();
+    // return the time.
+    *rv = arr;
+  };
+  return PackedFunc(ftimer);
+}
 
-        Timer t = Timer::Start(dev);
-        // start timing
-        for (int i = 0; i < number; ++i) {
-          pf.CallPacked(args, &temp);
-        }
-        t->Stop();
-        int64_t t_nanos = t->SyncAndGetElapsedNanos();
-        duration_ms = t_nanos / 1e6;
-      } while (duration_ms < min_repeat_ms);
+// <bojian/DietCode>
+namespace {
+
+/*!
+ * \brief The two-sided 95% quantile of Student's t-distribution with `dof`
+ *        degrees of freedom.
+ */
+double StudentT95(const int dof) {
+  static const double kTable[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                                  2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                                  2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                  2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+  const int kTableSize = sizeof(kTable) / sizeof(kTable[0]);
+  ICHECK_GE(dof, 1);
+  return dof <= kTableSize ? kTable[dof - 1] : 1.96;
+}
+
+}  // namespace anonymous
 
-      double speed = duration_ms / 1e3 / number;
+PackedFunc WrapAdaptiveTimeEvaluator(PackedFunc pf, Device dev, int number, int min_repeat,
+                                     int max_repeat, int min_repeat_ms, double rel_ci_width,
+                                     double upper_bound, PackedFunc f_preproc) {
+  ICHECK(pf != nullptr);
+  ICHECK_GE(min_repeat, 2) << "At least 2 repeats are needed to estimate the variance";
+  ICHECK_GE(max_repeat, min_repeat);
+
+  auto ftimer = [pf, dev, number, min_repeat, max_repeat, min_repeat_ms, rel_ci_width,
+                 upper_bound, f_preproc](TVMArgs args, TVMRetValue* rv) mutable {
+    TVMRetValue temp;
+    std::ostringstream os;
+    // skip first time call, to activate lazy compilation components.
+    pf.CallPacked(args, &temp);
+
+    DeviceAPI::Get(dev)->StreamSync(dev, nullptr);
+
+    // Welford's online mean and variance
+    double mean = 0.0, m2 = 0.0;
+    for (int i = 1; i <= max_repeat; ++i) {
+      if (f_preproc != nullptr) {
+        f_preproc.CallPacked(args, &temp);
+      }
+      double speed = TimeOneRepeat(pf, dev, args, &number, min_repeat_ms);
       os.write(reinterpret_cast<char*>(&speed), sizeof(speed));
+
+      double delta = speed - mean;
+      mean += delta / i;
+      m2 += delta * (speed - mean);
+      if (i < min_repeat) {
+        continue;
+      }
+      double ci_half_width = StudentT95(i - 1) * std::sqrt(m2 / (i - 1) / i);
+      if (ci_half_width <= rel_ci_width * mean) {
+        break;
+      }
+      if (upper_bound > 0.0 && mean - ci_half_width > upper_bound) {
+        break;
+      }
     }
 
     std::string blob = os.str();
@@ -397,6 +486,146 @@ PackedFunc WrapTimeEvaluator(PackedFunc pf, Device dev, int number, int repeat,
   return PackedFunc(ftimer);
 }
 
+// <bojian/DietCode>
+namespace {
+
+#ifdef __linux__
+/*!
+ * \brief The counter of one hardware event over all the threads of the process
+ *        (including the workers of the thread pool), which is invalid if the
+ *        event is not supported or perf_event_open is not permitted.
+ */
+class PerfEventCounter {
+ public:
+  PerfEventCounter(const uint32_t type, const uint64_t config) {
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) {
+      return;
+    }
+    while (const dirent* entry = readdir(dir)) {
+      if (entry->d_name[0] == '.') {
+        continue;
+      }
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      const int fd = static_cast<int>(
+          syscall(__NR_perf_event_open, &attr, std::atoi(entry->d_name), -1, -1, 0));
+      if (fd >= 0) {
+        fds_.push_back(fd);
+      }
+    }
+    closedir(dir);
+  }
+  ~PerfEventCounter() {
+    for (const int fd : fds_) {
+      close(fd);
+    }
+  }
+  PerfEventCounter(const PerfEventCounter&) = delete;
+  PerfEventCounter& operator=(const PerfEventCounter&) = delete;
+
+  bool valid() const { return !fds_.empty(); }
+  void Start() {
+    for (const int fd : fds_) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  void Stop() {
+    for (const int fd : fds_) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+  /*!
+   * \brief The count summed over the threads, scaled up for the time that the
+   *        counter has been multiplexed out.
+   */
+  double Read() const {
+    double count = 0.;
+    for (const int fd : fds_) {
+      // value, time enabled, time running
+      uint64_t values[3];
+      if (read(fd, values, sizeof(values)) == sizeof(values) && values[2] > 0) {
+        count += static_cast<double>(values[0]) * values[1] / values[2];
+      }
+    }
+    return count;
+  }
+
+ private:
+  std::vector<int> fds_;
+};
+
+constexpr uint64_t PerfCacheMissEvent(const uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+/*! \brief The (type, config) of the events, in the order of the evaluator's results. */
+const std::pair<uint32_t, uint64_t> kPerfEvents[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PerfCacheMissEvent(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, PerfCacheMissEvent(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+#endif  // __linux__
+
+}  // namespace anonymous
+
+PackedFunc WrapPerfCounterEvaluator(PackedFunc pf, Device dev, int number,
+                                    PackedFunc f_preproc) {
+  ICHECK(pf != nullptr);
+  ICHECK_EQ(static_cast<int>(dev.device_type), static_cast<int>(kDLCPU))
+      << "The hardware counters are only available on CPU";
+  ICHECK_GE(number, 1);
+
+  auto fcounter = [pf, number, f_preproc](TVMArgs args, TVMRetValue* rv) {
+    TVMRetValue temp;
+    std::ostringstream os;
+    // skip first time call, to activate lazy compilation components and to
+    // launch the thread pool, whose workers have to exist to be counted.
+    pf.CallPacked(args, &temp);
+    if (f_preproc != nullptr) {
+      f_preproc.CallPacked(args, &temp);
+    }
+#ifdef __linux__
+    std::vector<std::unique_ptr<PerfEventCounter>> counters;
+    for (const std::pair<uint32_t, uint64_t>& event : kPerfEvents) {
+      counters.emplace_back(new PerfEventCounter(event.first, event.second));
+    }
+    for (std::unique_ptr<PerfEventCounter>& counter : counters) {
+      counter->Start();
+    }
+    for (int i = 0; i < number; ++i) {
+      pf.CallPacked(args, &temp);
+    }
+    for (std::unique_ptr<PerfEventCounter>& counter : counters) {
+      counter->Stop();
+    }
+    for (const std::unique_ptr<PerfEventCounter>& counter : counters) {
+      double count = counter->valid() ? counter->Read() / number : -1.;
+      os.write(reinterpret_cast<char*>(&count), sizeof(count));
+    }
+#else
+    LOG(FATAL) << "The hardware counters are only available on Linux";
+#endif
+
+    std::string blob = os.str();
+    TVMByteArray arr;
+    arr.size = blob.length();
+    arr.data = blob.data();
+    *rv = arr;
+  };
+  return PackedFunc(fcounter);
+}
+
 TVM_REGISTER_GLOBAL("runtime.RPCTimeEvaluator")
     .set_body_typed([](Optional<Module> opt_mod, std::string name, int device_type, int device_id,
                        int number, int repeat, int min_repeat_ms, std::string f_preproc_name) {
@@ -434,6 +663,47 @@ TVM_REGISTER_GLOBAL("runtime.RPCTimeEvaluator")
       }
     });
 
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("runtime.AdaptiveTimeEvaluator")
+    .set_body_typed([](Module m, std::string name, int device_type, int device_id, int number,
+                       int min_repeat, int max_repeat, int min_repeat_ms, double rel_ci_width,
+                       double upper_bound, std::string f_preproc_name) {
+      ICHECK_NE(std::string(m->type_key()), "rpc")
+          << "The adaptive time evaluator is only available for local modules";
+      Device dev;
+      dev.device_type = static_cast<DLDeviceType>(device_type);
+      dev.device_id = device_id;
+      PackedFunc f_preproc;
+      if (!f_preproc_name.empty()) {
+        auto* pf_preproc = runtime::Registry::Get(f_preproc_name);
+        ICHECK(pf_preproc != nullptr)
+            << "Cannot find " << f_preproc_name << " in the global function";
+        f_preproc = *pf_preproc;
+      }
+      return WrapAdaptiveTimeEvaluator(m.GetFunction(name, false), dev, number, min_repeat,
+                                       max_repeat, min_repeat_ms, rel_ci_width, upper_bound,
+                                       f_preproc);
+    });
+
+// <bojian/DietCode>
+TVM_REGISTER_GLOBAL("runtime.PerfCounterEvaluator")
+    .set_body_typed([](Module m, std::string name, int device_type, int device_id, int number,
+                       std::string f_preproc_name) {
+      ICHECK_NE(std::string(m->type_key()), "rpc")
+          << "The hardware counters are only available for local modules";
+      Device dev;
+      dev.device_type = static_cast<DLDeviceType>(device_type);
+      dev.device_id = device_id;
+      PackedFunc f_preproc;
+      if (!f_preproc_name.empty()) {
+        auto* pf_preproc = runtime::Registry::Get(f_preproc_name);
+        ICHECK(pf_preproc != nullptr)
+            << "Cannot find " << f_preproc_name << " in the global function";
+        f_preproc = *pf_preproc;
+      }
+      return WrapPerfCounterEvaluator(m.GetFunction(name, false), dev, number, f_preproc);
+    });
+
 TVM_REGISTER_GLOBAL("cache_flush_cpu_non_first_arg").set_body([](TVMArgs args, TVMRetValue* rv) {
   CPUCacheFlush(1, args);
 });
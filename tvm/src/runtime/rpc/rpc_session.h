@@ -305,6 +305,44 @@ struct RemoteSpace {
 PackedFunc WrapTimeEvaluator(PackedFunc f, Device dev, int number, int repeat, int min_repeat_ms,
                              PackedFunc f_preproc = nullptr);
 
+// <bojian/DietCode>
+/*!
+ * \brief Wrap a timer function that, unlike WrapTimeEvaluator, repeats the
+ *        measurement only until the mean time cost is known well enough.
+ * \param f The function argument.
+ * \param dev The device.
+ * \param number The number of times to run this function for taking average.
+ * \param min_repeat The minimum number of times to repeat the measurement.
+ * \param max_repeat The maximum number of times to repeat the measurement.
+ * \param min_repeat_ms The minimum duration of one `repeat` in milliseconds.
+ * \param rel_ci_width The repeats stop once the half-width of the 95%
+ *        confidence interval on the mean falls below `rel_ci_width` of the mean.
+ * \param upper_bound The repeats also stop once the lower end of the
+ *        confidence interval exceeds `upper_bound` (in seconds), i.e., once the
+ *        function is known to be slower than that. Non-positive to disable.
+ * \param f_preproc The function to be executed before each `repeat`.
+ * \return f_timer A timer function, whose result contains as many costs as
+ *         the number of repeats that have been run.
+ */
+PackedFunc WrapAdaptiveTimeEvaluator(PackedFunc f, Device dev, int number, int min_repeat,
+                                     int max_repeat, int min_repeat_ms, double rel_ci_width,
+                                     double upper_bound, PackedFunc f_preproc = nullptr);
+
+// <bojian/DietCode>
+/*!
+ * \brief Wrap a function that counts the hardware events (with perf_event on
+ *        Linux) of running the function, over all the threads of the process.
+ * \param f The function argument.
+ * \param dev The device, which must be CPU.
+ * \param number The number of times to run this function for taking average.
+ * \param f_preproc The function to be executed before the counted runs.
+ * \return f_counter A counter function, whose result contains the average
+ *         number of cycles, instructions, L1D load misses, LLC load misses and
+ *         branch misses per run, -1 for the events that cannot be counted.
+ */
+PackedFunc WrapPerfCounterEvaluator(PackedFunc f, Device dev, int number,
+                                    PackedFunc f_preproc = nullptr);
+
 /*!
  * \brief Create a Global RPC module that refers to the session.
  * \param sess The RPC session of the global module.
@@ -22,9 +22,18 @@
  * \brief An implementation to run loop in parallel.
  */
 #include <tvm/runtime/logging.h>
+#include <tvm/runtime/registry.h>
 #include <tvm/support/parallel_for.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -93,5 +102,226 @@ void parallel_for(int begin, int end, const std::function<void(int)>& f, int ste
   }
 }
 
+namespace {
+
+/*! \brief A parallel loop whose indexes are claimed in chunks by the threads of the pool. */
+class ParallelForJob {
+ public:
+  ParallelForJob(int begin, int end, int step, int grain_size, int num_threads,
+                 const std::function<void(int)>& f)
+      : begin_(begin),
+        step_(step),
+        num_iters_((end - begin + step - 1) / step),
+        grain_size_(grain_size),
+        num_threads_(num_threads),
+        f_(f) {
+    ICHECK_GT(step, 0) << "Infinite loop condition with begin: " << begin << " end: " << end
+                       << " step: " << step;
+    num_iters_ = std::max(num_iters_, 0);
+  }
+
+  /*!
+   * \brief Claim a chunk of the loop and run it.
+   * \return The number of indexes that have been run, 0 if all the chunks have been claimed.
+   */
+  int RunChunk() {
+    int start = next_.load(), chunk_size;
+    do {
+      if (start >= num_iters_) {
+        return 0;
+      }
+      chunk_size = grain_size_ > 0 ? grain_size_
+                                   : std::max(1, (num_iters_ - start) / (2 * num_threads_));
+      chunk_size = std::min(chunk_size, num_iters_ - start);
+    } while (!next_.compare_exchange_weak(start, start + chunk_size));
+
+    for (int i = start; i < start + chunk_size; ++i) {
+      try {
+        f_(begin_ + i * step_);
+      } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (error_msg_.empty()) {
+          error_msg_ = e.what();
+        }
+      }
+    }
+    finished_.fetch_add(chunk_size);
+    return chunk_size;
+  }
+
+  bool Done() const { return finished_.load() >= num_iters_; }
+
+  std::string GetErrorMsg() {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    return error_msg_;
+  }
+
+ private:
+  int begin_, step_, num_iters_, grain_size_, num_threads_;
+  const std::function<void(int)>& f_;
+  /*! \brief The next iteration to be claimed, and the number of finished iterations. */
+  std::atomic<int> next_{0}, finished_{0};
+  std::mutex error_mutex_;
+  std::string error_msg_;
+};
+
+/*!
+ * \brief A persistent pool of worker threads that steal the chunks of the running loops, the
+ * most recently posted (i.e., the innermost) ones first.
+ */
+class WorkStealingPool {
+ public:
+  static WorkStealingPool* Global() {
+    static WorkStealingPool pool;
+    return &pool;
+  }
+
+  ~WorkStealingPool() { StopWorkers(); }
+
+  int NumThreads() const { return num_threads_; }
+
+  void SetNumThreads(const int num_threads) {
+    ICHECK_GT(num_threads, 0) << "The number of threads must be positive";
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ICHECK_EQ(num_running_jobs_, 0)
+          << "Cannot change the number of threads while a parallel_for_dynamic is running";
+    }
+    StopWorkers();
+    num_threads_ = num_threads;
+    StartWorkers();
+  }
+
+  void Run(int begin, int end, int step, int grain_size, const std::function<void(int)>& f) {
+    auto job = std::make_shared<ParallelForJob>(begin, end, step, grain_size, num_threads_, f);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+      ++num_running_jobs_;
+    }
+    cv_.notify_all();
+
+    // The calling thread works on its own loop first, and then helps the other loops (e.g., the
+    // ones nested in the stragglers of its own) until its own loop is done.
+    while (RunChunkOf(job)) {
+    }
+    while (!job->Done()) {
+      std::shared_ptr<ParallelForJob> other_job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, &job]() { return job->Done() || !jobs_.empty(); });
+        if (job->Done()) {
+          break;
+        }
+        other_job = jobs_.back();
+      }
+      RunChunkOf(other_job);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --num_running_jobs_;
+    }
+    std::string error_msg = job->GetErrorMsg();
+    if (!error_msg.empty()) {
+      LOG(FATAL) << "Parallel_for error with " << error_msg;
+    }
+  }
+
+ private:
+  WorkStealingPool() {
+    const char* num_threads_str = std::getenv("TVM_PARALLEL_FOR_NUM_THREADS");
+    num_threads_ = num_threads_str != nullptr ? std::atoi(num_threads_str)
+                                              : static_cast<int>(std::thread::hardware_concurrency());
+    num_threads_ = std::max(num_threads_, 1);
+    StartWorkers();
+  }
+
+  /*!
+   * \brief Run a chunk of the job.
+   * \return False (and retire the job) if all the chunks of the job have been claimed.
+   */
+  bool RunChunkOf(const std::shared_ptr<ParallelForJob>& job) {
+    if (job->RunChunk() == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto job_iter = std::find(jobs_.begin(), jobs_.end(), job);
+      if (job_iter != jobs_.end()) {
+        jobs_.erase(job_iter);
+      }
+      return false;
+    }
+    if (job->Done()) {
+      // Wake up the thread that waits for the job. The lock makes sure that the notification
+      // does not slip in between its check and its wait.
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      cv_.notify_all();
+    }
+    return true;
+  }
+
+  void WorkerLoop() {
+    while (true) {
+      std::shared_ptr<ParallelForJob> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+          return;
+        }
+        job = jobs_.back();
+      }
+      RunChunkOf(job);
+    }
+  }
+
+  /*! \brief Start the workers. The calling thread of each loop is the remaining one. */
+  void StartWorkers() {
+    stop_ = false;
+    for (int i = 0; i < num_threads_ - 1; ++i) {
+      workers_.emplace_back([this]() { WorkerLoop(); });
+    }
+  }
+
+  void StopWorkers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+    workers_.clear();
+  }
+
+  int num_threads_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  /*! \brief The loops that still have chunks to be claimed. */
+  std::deque<std::shared_ptr<ParallelForJob>> jobs_;
+  int num_running_jobs_{0};
+  bool stop_{false};
+};
+
+}  // namespace
+
+void parallel_for_dynamic(int begin, int end, const std::function<void(int)>& f, int step,
+                          int grain_size) {
+  if (begin >= end) {
+    return;
+  }
+  WorkStealingPool::Global()->Run(begin, end, step, grain_size, f);
+}
+
+void SetParallelForNumThreads(int num_threads) {
+  WorkStealingPool::Global()->SetNumThreads(num_threads);
+}
+
+int GetParallelForNumThreads() { return WorkStealingPool::Global()->NumThreads(); }
+
+TVM_REGISTER_GLOBAL("support.SetParallelForNumThreads").set_body_typed(SetParallelForNumThreads);
+
+TVM_REGISTER_GLOBAL("support.GetParallelForNumThreads").set_body_typed(GetParallelForNumThreads);
+
 }  // namespace support
 }  // namespace tvm
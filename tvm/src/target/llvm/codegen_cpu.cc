@@ -765,6 +765,48 @@ llvm::Value* CodeGenCPU::CreateCallTracePacked(const CallNode* op) {
   return phi_rvalue;
 }
 
+// <bojian/DietCode>
+llvm::Value* CodeGenCPU::CreateCallCPacked(const CallNode* op) {
+  ICHECK_EQ(op->args.size(), 5U);
+  std::string func_name = op->args[0].as<StringImmNode>()->value;
+  int64_t begin = op->args[3].as<IntImmNode>()->value, end = op->args[4].as<IntImmNode>()->value;
+  ICHECK_GE(end - begin, 0);
+  // The callee follows the packed function calling convention (see MakePackedAPI) and is
+  // resolved by its symbol, hence it either lives in the same module or gets linked in.
+  llvm::FunctionType* ftype = llvm::FunctionType::get(
+      t_int_, {t_void_p_, t_void_p_, t_int_, t_void_p_, t_void_p_, t_void_p_}, false);
+  llvm::Function* callee = module_->getFunction(func_name);
+  if (callee == nullptr) {
+    callee = llvm::Function::Create(ftype, llvm::Function::ExternalLinkage, func_name,
+                                    module_.get());
+  }
+  ICHECK(callee->getFunctionType() == ftype)
+      << "Function " << func_name << " does not follow the packed function calling convention";
+  llvm::Value* stack_value = MakeValue(op->args[1]);
+  llvm::Value* stack_tcode = MakeValue(op->args[2]);
+  llvm::Value* arg_value = builder_->CreateInBoundsGEP(
+      builder_->CreatePointerCast(stack_value, t_tvm_value_->getPointerTo()), ConstInt32(begin));
+  llvm::Value* arg_tcode = CreateBufferPtr(DataType::Int(32), stack_tcode, ConstInt32(begin));
+  llvm::Value* ret_value = builder_->CreateInBoundsGEP(
+      builder_->CreatePointerCast(stack_value, t_tvm_value_->getPointerTo()), ConstInt32(end));
+  llvm::Value* ret_tcode = CreateBufferPtr(DataType::Int(32), stack_tcode, ConstInt32(end));
+  CheckCallSuccess(builder_->CreateCall(
+      callee, {builder_->CreatePointerCast(arg_value, t_void_p_),
+               builder_->CreatePointerCast(arg_tcode, t_void_p_), ConstInt32(end - begin),
+               builder_->CreatePointerCast(ret_value, t_void_p_),
+               builder_->CreatePointerCast(ret_tcode, t_void_p_),
+               llvm::Constant::getNullValue(t_void_p_)}));
+  DataType r_api_type = tir::APIType(op->dtype);
+  llvm::Value* load_ptr =
+      builder_->CreatePointerCast(ret_value, DTypeToLLVMType(r_api_type)->getPointerTo());
+#if TVM_LLVM_VERSION >= 110
+  llvm::Value* rvalue = builder_->CreateAlignedLoad(load_ptr, llvm::Align(8));
+#else
+  llvm::Value* rvalue = builder_->CreateAlignedLoad(load_ptr, 8);
+#endif
+  return CreateCast(r_api_type, op->dtype, rvalue);
+}
+
 llvm::Value* CodeGenCPU::RuntimeTVMFuncCall() {
   if (f_tvm_func_call_ != nullptr) return f_tvm_func_call_;
   return GetContextPtr(gv_tvm_func_call_);
@@ -857,6 +899,8 @@ llvm::Value* CodeGenCPU::CreateIntrinsic(const CallNode* op) {
     return CreateCallPacked(op);
   } else if (op->op.same_as(builtin::tvm_call_trace_packed_lowered())) {
     return CreateCallTracePacked(op);
+  } else if (op->op.same_as(builtin::tvm_call_cpacked_lowered())) {  // <bojian/DietCode>
+    return CreateCallCPacked(op);
   } else if (op->op.same_as(builtin::tvm_static_handle())) {
     return CreateStaticHandle();
   } else if (op->op.same_as(builtin::tvm_throw_last_error())) {
@@ -26,6 +26,7 @@
 #include <iomanip>
 
 #include "../../arith/pattern_match.h"
+#include "../../support/str_escape.h"
 
 // <bojian/DietCode>
 #include <dmlc/parameter.h>
@@ -485,7 +486,10 @@ void CodeGenC::VisitExpr_(const FloatImmNode* op, std::ostream& os) {  // NOLINT
   PrintConst(op, os, this);
 }
 void CodeGenC::VisitExpr_(const StringImmNode* op, std::ostream& os) {  // NOLINT(*)
-  os << "\"" << op->value << "\"";
+  // <bojian/DietCode> Escape the string so that it can carry arbitrary bytes,
+  // e.g., the leaf tables of the dynamic-shape dispatchers. The octal escapes
+  // are unambiguous regardless of the characters that follow them.
+  os << "\"" << support::StrEscape(op->value.data(), op->value.size(), true) << "\"";
 }
 
 template <typename T>
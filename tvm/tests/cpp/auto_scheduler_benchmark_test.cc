@@ -0,0 +1,284 @@
+// <bojian/DietCode>
+/*!
+ * \brief Microbenchmarks of the auto-scheduler internals on synthetic dynamic
+ *        workloads, reporting the throughput of each phase of a search round.
+ *
+ * The benchmarks only search (i.e., nothing is built or run), and hence run on
+ * CPU-only machines even though the dynamic tasks target CUDA. The number of
+ * workload instances and the population size are read from the environment
+ * variables DIETCODE_BENCHMARK_NUM_WKL_INSTS and DIETCODE_BENCHMARK_POPULATION.
+ *
+ * The benchmarks are too slow for the unit tests and hence disabled by default,
+ * run them with
+ *
+ *   ./auto_scheduler_benchmark_test --gtest_also_run_disabled_tests
+ */
+#include <dmlc/parameter.h>
+#include <gtest/gtest.h>
+#include <tvm/auto_scheduler/compute_dag.h>
+#include <tvm/auto_scheduler/cost_model.h>
+#include <tvm/auto_scheduler/feature.h>
+#include <tvm/auto_scheduler/object_pool.h>
+#include <tvm/auto_scheduler/search_task.h>
+#include <tvm/runtime/registry.h>
+#include <tvm/te/operation.h>
+#include <tvm/tir/dyn_shape_var.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../src/auto_scheduler/search_policy/sketch_policy.h"
+#include "../../src/auto_scheduler/utils.h"
+
+using namespace tvm;
+using namespace tvm::auto_scheduler;
+
+namespace {
+
+/*!
+ * \brief A cost model that scores every state the same and adapts the scores
+ *        to the workload instances with the analytic penalties, so that the
+ *        benchmarks do not depend on the Python-side cost models.
+ */
+class SyntheticCostModelNode : public CostModelNode {
+ public:
+  void Update(const Array<MeasureInput>& inputs, const Array<MeasureResult>& results) final {}
+
+  void Predict(const SearchTask& task, const Array<State>& states,
+               std::vector<float>* scores) final {
+    scores->assign(states.size(), 1.);
+  }
+
+  void PredictForAllInstances(const SearchTask& task, const Array<State>& states,
+                              std::vector<float>* const occupancy_penalty,
+                              std::vector<float>* const padding_penalty,
+                              std::vector<float>* const scores) final {
+    scores->assign(task->wkl_insts.size() * states.size(), 0.);
+    occupancy_penalty->assign(scores->size(), 1.);
+    padding_penalty->assign(scores->size(), 1.);
+    for (size_t inst_id = 0; inst_id < task->wkl_insts.size(); ++inst_id) {
+      for (size_t state_id = 0; state_id < states.size(); ++state_id) {
+        const size_t i = inst_id * states.size() + state_id;
+        AdaptStateToWorkload(task, states[state_id], task->wkl_insts[inst_id], 1.,
+                             &(*occupancy_penalty)[i], &(*padding_penalty)[i],
+                             &(*scores)[i]);
+      }
+    }
+  }
+
+  static constexpr const char* _type_key = "auto_scheduler.SyntheticCostModel";
+  TVM_DECLARE_FINAL_OBJECT_INFO(SyntheticCostModelNode, CostModelNode);
+};
+
+/*!
+ * \brief Make the task from the output tensors, with the dynamic sequence
+ *        length T evenly spread over [1, 128] among the workload instances.
+ */
+SearchTask MakeDynTask(const Array<te::Tensor>& tensors, const String& workload_key,
+                       const tir::DynShapeVar& T) {
+  const int num_wkl_insts = dmlc::GetEnv("DIETCODE_BENCHMARK_NUM_WKL_INSTS", 8);
+  CHECK_GT(num_wkl_insts, 0);
+  Array<Array<IntImm>> wkl_insts;
+  Array<FloatImm> wkl_inst_weights;
+  for (int i = 0; i < num_wkl_insts; ++i) {
+    const int64_t t = std::max<int64_t>(1, 128 * (i + 1) / num_wkl_insts);
+    wkl_insts.push_back({IntImm(DataType::Int(32), t)});
+    wkl_inst_weights.push_back(FloatImm(DataType::Float(32), 1.));
+  }
+  // The default hardware parameters of a V100-class GPU, which do not have to
+  // be queried from the device.
+  HardwareParams hardware_params(80, 16, 64, 49152, 65536, 1024, 8, 32);
+  return SearchTask(ComputeDAG(tensors), workload_key, Target("cuda"), Target("llvm"),
+                    hardware_params, LayoutRewriteOption::NoRewrite, {},
+                    Array<tir::DynShapeVar>{T}, wkl_insts, wkl_inst_weights);
+}
+
+SearchTask MakeDenseTask() {
+  tir::DynShapeVar T("T");
+  const int I = 768, H = 2304;
+  te::Tensor X = te::placeholder({T, I}, DataType::Float(32), "X");
+  te::Tensor W = te::placeholder({H, I}, DataType::Float(32), "W");
+  tir::IterVar k = te::reduce_axis(Range(0, I), "k");
+  te::Tensor Y = te::compute(
+      {T, H}, [&](tir::Var i, tir::Var j) { return sum(X[i][k] * W[j][k], {k}); }, "Y");
+  return MakeDynTask({X, W, Y}, "dietcode_benchmark_dense", T);
+}
+
+SearchTask MakeBatchMatmulTask() {
+  tir::DynShapeVar T("T");
+  const int B = 12, D = 64;
+  te::Tensor X = te::placeholder({B, T, D}, DataType::Float(32), "X");
+  te::Tensor Y = te::placeholder({B, T, D}, DataType::Float(32), "Y");
+  tir::IterVar k = te::reduce_axis(Range(0, D), "k");
+  te::Tensor Z = te::compute(
+      {B, T, T},
+      [&](tir::Var b, tir::Var i, tir::Var j) { return sum(X[b][i][k] * Y[b][j][k], {k}); },
+      "Z");
+  return MakeDynTask({X, Y, Z}, "dietcode_benchmark_batch_matmul", T);
+}
+
+Map<String, ObjectRef> MakeSketchParams() {
+  const int population = dmlc::GetEnv("DIETCODE_BENCHMARK_POPULATION", 2048);
+  // Same as the DEFAULT_PARAMS of the Python SketchPolicy.
+  return {{"eps_greedy", FloatImm(DataType::Float(64), 0.05)},
+          {"retry_search_one_round_on_empty", Integer(1)},
+          {"sample_init_min_population", Integer(50)},
+          {"sample_init_use_measured_ratio", FloatImm(DataType::Float(64), 0.2)},
+          {"evolutionary_search_population", Integer(population)},
+          {"evolutionary_search_num_iters", Integer(4)},
+          {"evolutionary_search_mutation_prob", FloatImm(DataType::Float(64), 0.85)},
+          {"cpu_multi_level_tiling_structure", String("SSRSRS")},
+          {"gpu_multi_level_tiling_structure", String("SSSRRSRS")},
+          {"max_innermost_split_factor", Integer(64)},
+          {"max_vectorize_size", Integer(16)},
+          {"disable_change_compute_location", Integer(0)},
+          {"num_multi_shape_measure_insts", Integer(0)},
+          {"batch_selection", String("eps_greedy")},
+          {"ucb_kappa", FloatImm(DataType::Float(64), 1.)},
+          {"dispatcher_kernel_weight", FloatImm(DataType::Float(64), 0.)},
+          {"dispatcher_code_size_weight", FloatImm(DataType::Float(64), 0.)},
+          {"sketch_prune_threshold", FloatImm(DataType::Float(64), 0.)}};
+}
+
+/*!
+ * \brief Make a fresh DAG from the tensors, with a schedule replay cache of
+ *        cache_size entries (i.e., disabled if 0).
+ */
+ComputeDAG MakeComputeDAG(const Array<te::Tensor>& tensors, const int cache_size) {
+  const char* const env_name = "DIETCODE_SCHED_REPLAY_CACHE_SIZE";
+  const char* const env_value = getenv(env_name);
+  const std::string old_cache_size = env_value == nullptr ? "" : env_value;
+  setenv(env_name, std::to_string(cache_size).c_str(), 1);
+  ComputeDAG dag(tensors);
+  if (env_value == nullptr) {
+    unsetenv(env_name);
+  } else {
+    setenv(env_name, old_cache_size.c_str(), 1);
+  }
+  return dag;
+}
+
+template <typename FPhase>
+double TimePhase(FPhase f_phase) {
+  auto tic = std::chrono::high_resolution_clock::now();
+  f_phase();
+  auto toc = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(toc - tic).count();
+}
+
+void ReportPhase(const std::string& phase, const size_t num_items, const double seconds) {
+  std::cout << std::setw(32) << phase << std::setw(12) << num_items << std::setw(16)
+            << seconds * 1e3 << std::setw(16) << num_items / seconds << std::endl;
+}
+
+/*!
+ * \brief Run the phases of a search round one after another, each on the
+ *        output of the previous ones.
+ */
+void BenchmarkSearchRound(const SearchTask& task) {
+  SketchPolicy policy(task, CostModel(make_object<SyntheticCostModelNode>()),
+                      MakeSketchParams(), 0, 0, NullOpt);
+  const int population =
+      GetIntParam(policy->params, SketchParamKey::EvolutionarySearch::population);
+  const int num_iters =
+      GetIntParam(policy->params, SketchParamKey::EvolutionarySearch::num_iters);
+  Array<State> sketches = policy->GenerateSketches();
+  ASSERT_FALSE(sketches.empty());
+
+  std::cout << task->workload_key << " w/ " << task->wkl_insts.size()
+            << " workload instances" << std::endl
+            << std::setw(32) << "phase" << std::setw(12) << "#items" << std::setw(16)
+            << "time (ms)" << std::setw(16) << "items/s" << std::endl;
+
+  Array<State> init_population, best_states;
+  {
+    SearchRoundScope search_round_scope;
+    double seconds = TimePhase([&]() {
+      init_population = policy->SampleInitPopulation(sketches);
+    });
+    ASSERT_FALSE(init_population.empty());
+    ReportPhase("SampleInitPopulation", init_population.size(), seconds);
+
+    seconds = TimePhase([&]() {
+      best_states = policy->EvolutionarySearch(init_population, 64);
+    });
+    ASSERT_FALSE(best_states.empty());
+    // Every iteration mutates and scores the whole population.
+    ReportPhase("EvolutionarySearch", static_cast<size_t>(population) * (num_iters + 1),
+                seconds);
+  }
+
+  std::vector<std::vector<float>> features;
+  double seconds = TimePhase([&]() {
+    GetPerStoreFeaturesFromStates(init_population, task, 0, 5, &features);
+  });
+  EXPECT_EQ(features.size(), init_population.size());
+  ReportPhase("GetPerStoreFeaturesFromStates", init_population.size(), seconds);
+
+  const PackedFunc* adapt_states_to_workloads =
+      runtime::Registry::Get("auto_scheduler.AdaptStatesToWorkloads");
+  ASSERT_NE(adapt_states_to_workloads, nullptr);
+  Array<FloatImm> scores;
+  for (size_t i = 0; i < init_population.size(); ++i) {
+    scores.push_back(FloatImm(DataType::Float(32), 1.));
+  }
+  Array<runtime::NDArray> adapted;
+  seconds = TimePhase([&]() {
+    adapted = (*adapt_states_to_workloads)(task, init_population, scores);
+  });
+  const size_t num_adapted = task->wkl_insts.size() * init_population.size();
+  ReportPhase("AdaptStatesToWorkloads", num_adapted, seconds);
+
+  ASSERT_EQ(adapted.size(), 3);
+  const float* adapted_scores = static_cast<const float*>(adapted[2]->data);
+  std::vector<float> adapted_score_vec(adapted_scores, adapted_scores + num_adapted);
+  std::unordered_map<size_t, size_t> inst_disp_map;
+  seconds = TimePhase([&]() {
+    inst_disp_map = TopKDispatcher().dispatch(adapted_score_vec, init_population.size());
+  });
+  EXPECT_EQ(inst_disp_map.size(), task->wkl_insts.size());
+  ReportPhase("TopKDispatcher", num_adapted, seconds);
+
+  // Replay the steps on fresh DAGs with and without the schedule replay cache:
+  // first the initial population, which only misses the cache, then the same
+  // states again, which only hit it, and finally the evolved children, which
+  // share the prefixes of their steps with the initial population.
+  for (const int cache_size : {0, 1024}) {
+    const ComputeDAG dag = MakeComputeDAG(task->compute_dag->tensors, cache_size);
+    ASSERT_EQ(dag->replay_cache == nullptr, cache_size == 0);
+    const std::string suffix = cache_size == 0 ? " w/o cache" : " w/ cache";
+    for (const std::pair<const char*, const Array<State>*>& phase :
+         std::vector<std::pair<const char*, const Array<State>*>>{
+             {"ApplySteps(fresh)", &init_population},
+             {"ApplySteps(repeated)", &init_population},
+             {"ApplySteps(evolved)", &best_states}}) {
+      seconds = TimePhase([&]() {
+        for (const State& state : *phase.second) {
+          dag.ApplySteps(state->transform_steps);
+        }
+      });
+      ReportPhase(phase.first + suffix, phase.second->size(), seconds);
+    }
+  }
+}
+
+}  // namespace anonymous
+
+TEST(AutoSchedulerBenchmark, DISABLED_DynamicDense) {
+  BenchmarkSearchRound(MakeDenseTask());
+}
+
+TEST(AutoSchedulerBenchmark, DISABLED_DynamicBatchMatmul) {
+  BenchmarkSearchRound(MakeBatchMatmulTask());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  testing::FLAGS_gtest_death_test_style = "threadsafe";
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,525 @@
+// <bojian/DietCode>
+#include <gtest/gtest.h>
+#include <tvm/auto_scheduler/dietcode.h>
+#include <tvm/driver/driver_api.h>
+#include <tvm/ir/transform.h>
+#include <tvm/runtime/c_backend_api.h>
+#include <tvm/runtime/container/shape_tuple.h>
+#include <tvm/runtime/registry.h>
+#include <tvm/te/operation.h>
+#include <tvm/tir/builtin.h>
+#include <tvm/tir/function.h>
+#include <tvm/tir/stmt_functor.h>
+#include <tvm/tir/dyn_shape_var.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "../../src/auto_scheduler/search_policy/empty_policy.h"
+#include "../../src/auto_scheduler/utils.h"
+
+using namespace tvm;
+using namespace tvm::auto_scheduler;
+
+namespace {
+
+Array<Array<IntImm>> MakeWklInsts(const std::vector<std::vector<int64_t>>& shapes) {
+  Array<Array<IntImm>> wkl_insts;
+  for (const std::vector<int64_t>& shape : shapes) {
+    Array<IntImm> wkl_inst;
+    for (const int64_t dim : shape) {
+      wkl_inst.push_back(IntImm(DataType::Int(32), dim));
+    }
+    wkl_insts.push_back(wkl_inst);
+  }
+  return wkl_insts;
+}
+
+/*!
+ * \brief Build the exact tree that dispatches each of the T x I instances to a
+ *        distinct candidate.
+ */
+DecisionTreeNode MakeExactTree(const Array<tir::DynShapeVar>& shape_vars,
+                               const int64_t num_t, const int64_t num_i,
+                               Array<Array<IntImm>>* const wkl_insts) {
+  std::vector<std::vector<int64_t>> shapes;
+  for (int64_t t = 1; t <= num_t; ++t) {
+    for (int64_t i = 1; i <= num_i; ++i) {
+      shapes.push_back({t * 8, i * 128});
+    }
+  }
+  *wkl_insts = MakeWklInsts(shapes);
+  Array<StateVer> candidates;
+  std::vector<float> adapted_flops(shapes.size() * shapes.size(), 0.);
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    candidates.push_back(StateVer(i, 0));
+    adapted_flops[i * shapes.size() + i] = 1.;
+  }
+  return BuildDispatchDecisionTree(shape_vars, *wkl_insts,
+                                   std::vector<float>(shapes.size(), 1.),
+                                   adapted_flops, candidates, 0., 16);
+}
+
+/*!
+ * \brief The tree in the form of the host code that the tree dispatch lowers
+ *        to, i.e., nested comparisons on the shape values.
+ */
+struct FlatTreeNode {
+  int var_id = -1;  // -1 for the leaves
+  int64_t threshold = 0;
+  int if_node = -1, else_node = -1, leaf = -1;
+};
+
+int FlattenTree(const DecisionTreeNodeNode* const tree_node,
+                const Array<tir::DynShapeVar>& shape_vars,
+                std::vector<FlatTreeNode>* const flat_tree, int* const depth) {
+  const int node_id = flat_tree->size();
+  flat_tree->emplace_back();
+  if (!tree_node->predicate) {
+    (*flat_tree)[node_id].leaf = tree_node->state_ver.value()->major->value;
+    *depth = 0;
+    return node_id;
+  }
+  const auto* predicate = tree_node->predicate.value().as<tir::LENode>();
+  for (size_t k = 0; k < shape_vars.size(); ++k) {
+    if (predicate->a.same_as(shape_vars[k])) {
+      (*flat_tree)[node_id].var_id = k;
+    }
+  }
+  (*flat_tree)[node_id].threshold = Downcast<IntImm>(predicate->b)->value;
+  int if_depth, else_depth;
+  int if_node = FlattenTree(tree_node->if_node, shape_vars, flat_tree, &if_depth),
+      else_node = FlattenTree(tree_node->else_node, shape_vars, flat_tree, &else_depth);
+  (*flat_tree)[node_id].if_node = if_node;
+  (*flat_tree)[node_id].else_node = else_node;
+  *depth = std::max(if_depth, else_depth) + 1;
+  return node_id;
+}
+
+int WalkFlatTree(const std::vector<FlatTreeNode>& flat_tree,
+                 const std::vector<int64_t>& shape_values) {
+  int node_id = 0;
+  while (flat_tree[node_id].var_id != -1) {
+    const FlatTreeNode& node = flat_tree[node_id];
+    node_id = shape_values[node.var_id] <= node.threshold ? node.if_node : node.else_node;
+  }
+  return flat_tree[node_id].leaf;
+}
+
+}  // namespace anonymous
+
+TEST(DispatchDecisionTree, ExactSplit) {
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T"), tir::DynShapeVar("I")};
+  Array<Array<IntImm>> wkl_insts =
+      MakeWklInsts({{5, 768}, {10, 768}, {15, 768}, {20, 768}});
+  Array<StateVer> candidates{StateVer(0, 0), StateVer(1, 0)};
+  // The first two instances can only go to the first candidate and vice versa.
+  std::vector<float> adapted_flops{1., 0.,
+                                   1., 0.,
+                                   0., 1.,
+                                   0., 1.};
+  DecisionTreeNode tree = BuildDispatchDecisionTree(
+      shape_vars, wkl_insts, {1., 1., 1., 1.}, adapted_flops, candidates, 0.);
+  ASSERT_TRUE(tree->predicate);
+  const auto* predicate = tree->predicate.value().as<tir::LENode>();
+  ASSERT_NE(predicate, nullptr);
+  EXPECT_TRUE(predicate->a.same_as(shape_vars[0]));
+  EXPECT_EQ(Downcast<IntImm>(predicate->b)->value, 10);
+  ASSERT_TRUE(tree->if_node->state_ver);
+  ASSERT_TRUE(tree->else_node->state_ver);
+  EXPECT_EQ(tree->if_node->state_ver.value()->major->value, 0);
+  EXPECT_EQ(tree->else_node->state_ver.value()->major->value, 1);
+  EXPECT_EQ(GetDecisionTreeStateVers(tree).size(), 2);
+}
+
+TEST(DispatchDecisionTree, MisdispatchCostThreshold) {
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T")};
+  Array<Array<IntImm>> wkl_insts = MakeWklInsts({{8}, {16}, {24}, {32}});
+  Array<StateVer> candidates{StateVer(0, 0), StateVer(1, 0)};
+  // The first candidate is at most 10% slower than the second one.
+  std::vector<float> adapted_flops{1.,  0.5,
+                                   1.,  0.5,
+                                   1.,  1.1,
+                                   1.,  1.1};
+  std::vector<float> weights{1., 1., 1., 1.};
+
+  DecisionTreeNode tree = BuildDispatchDecisionTree(
+      shape_vars, wkl_insts, weights, adapted_flops, candidates, 0.1);
+  ASSERT_FALSE(tree->predicate);
+  EXPECT_EQ(tree->state_ver.value()->major->value, 0);
+
+  tree = BuildDispatchDecisionTree(
+      shape_vars, wkl_insts, weights, adapted_flops, candidates, 0.);
+  ASSERT_TRUE(tree->predicate);
+  EXPECT_EQ(GetDecisionTreeStateVers(tree).size(), 2);
+}
+
+TEST(DispatchTable, ConsistentWithTree) {
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T"), tir::DynShapeVar("I")};
+  Array<Array<IntImm>> wkl_insts;
+  DecisionTreeNode tree = MakeExactTree(shape_vars, 6, 3, &wkl_insts);
+  DispatchTable table(tree, shape_vars);
+  ASSERT_TRUE(table.defined());
+  EXPECT_EQ(table.leaves.size(), wkl_insts.size());
+
+  std::vector<FlatTreeNode> flat_tree;
+  int depth;
+  FlattenTree(tree.get(), shape_vars, &flat_tree, &depth);
+  // The instances as well as the shapes in between them have to be dispatched
+  // the same way.
+  for (int64_t t = 1; t <= 6 * 8 + 4; ++t) {
+    for (int64_t i = 1; i <= 3 * 128 + 64; i += 16) {
+      std::vector<int64_t> shape_values{t, i};
+      EXPECT_EQ(table.Lookup(shape_values)->major->value,
+                WalkFlatTree(flat_tree, shape_values));
+    }
+  }
+  // Trees that are too large are not flattened.
+  EXPECT_FALSE(DispatchTable(tree, shape_vars, 4).defined());
+}
+
+TEST(DispatchTable, LowerToLeafTableAndJumpChain) {
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T"), tir::DynShapeVar("I")};
+  Array<Array<IntImm>> wkl_insts;
+  DecisionTreeNode tree = MakeExactTree(shape_vars, 6, 3, &wkl_insts);
+  DispatchTable table(tree, shape_vars);
+  ASSERT_TRUE(table.defined());
+
+  te::Tensor X = te::placeholder({shape_vars[0], shape_vars[1]}, DataType::Float(32), "X");
+  const runtime::PackedFunc* make_host_dispatcher =
+      runtime::Registry::Get("auto_scheduler.MakeHostDispatcher");
+  ASSERT_NE(make_host_dispatcher, nullptr);
+  IRModule mod = (*make_host_dispatcher)(Array<te::Tensor>{X}, shape_vars, tree,
+                                         String("default_function"), String("table"));
+  tir::PrimFunc dispatcher = Downcast<tir::PrimFunc>(mod->Lookup("default_function"));
+
+  std::string leaf_table;
+  size_t num_leaf_tests = 0;
+  tir::PostOrderVisit(dispatcher->body, [&leaf_table, &num_leaf_tests](const ObjectRef& node) {
+    if (const auto* let = node.as<tir::LetStmtNode>()) {
+      if (const auto* str = let->value.as<tir::StringImmNode>()) {
+        leaf_table = str->value;
+      }
+    } else if (const auto* if_then_else = node.as<tir::IfThenElseNode>()) {
+      // Every kernel call is guarded by a single equality test on the leaf.
+      const auto* eq = if_then_else->condition.as<tir::EQNode>();
+      ASSERT_NE(eq, nullptr);
+      EXPECT_EQ(eq->a.as<tir::VarNode>()->name_hint, "dispatch_leaf");
+      ++num_leaf_tests;
+    }
+  });
+  ASSERT_EQ(leaf_table.size(), table.cell_leaf_ids.size());
+  for (size_t c = 0; c < table.cell_leaf_ids.size(); ++c) {
+    EXPECT_EQ(static_cast<uint8_t>(leaf_table[c]), table.cell_leaf_ids[c]);
+  }
+  EXPECT_EQ(num_leaf_tests, table.leaves.size() - 1);
+}
+
+namespace {
+
+/*!
+ * \brief Build the host dispatcher of the tree into an LLVM module, together
+ *        with the kernels `default_function_{major}_0`, each of which computes
+ *        `Y[0] = X[0] + major`.
+ */
+runtime::Module BuildHostDispatcher(const DecisionTreeNode& tree,
+                                    const Array<tir::DynShapeVar>& shape_vars,
+                                    const String& dispatch_mode,
+                                    const bool count_dispatches = true) {
+  te::Tensor X = te::placeholder({1}, DataType::Float(32), "X");
+  IRModule mod;
+  for (const StateVer& state_ver : GetDecisionTreeStateVers(tree)) {
+    const int64_t major = state_ver->major->value;
+    te::Tensor Y = te::compute(
+        {1}, [&](tir::Var i) { return X[i] + static_cast<float>(major); }, "Y");
+    Array<ObjectRef> args{X, Y};
+    args.insert(args.end(), shape_vars.begin(), shape_vars.end());
+    std::unordered_map<te::Tensor, tir::Buffer> binds;
+    mod->Update(LowerSchedule(te::create_schedule({Y->op}), args,
+                              "default_function_" + std::to_string(major) + "_0", binds));
+  }
+  te::Tensor Y = te::placeholder({1}, DataType::Float(32), "Y");
+  tvm::transform::PassContext pass_ctx = tvm::transform::PassContext::Create();
+  pass_ctx->config.Set("auto_scheduler.count_dispatches", Bool(count_dispatches));
+  With<tvm::transform::PassContext> scope(pass_ctx);
+  const runtime::PackedFunc* make_host_dispatcher =
+      runtime::Registry::Get("auto_scheduler.MakeHostDispatcher");
+  CHECK(make_host_dispatcher != nullptr);
+  IRModule dispatcher_mod = (*make_host_dispatcher)(
+      Array<te::Tensor>{X, Y}, shape_vars, tree, String("default_function"), dispatch_mode);
+  mod->Update(dispatcher_mod);
+  return build(mod, Target("llvm"), Target("llvm"));
+}
+
+}  // namespace anonymous
+
+TEST(DispatchTable, LoweredModuleDispatchesLikeTree) {
+  if (runtime::Registry::Get("target.build.llvm") == nullptr) {
+    GTEST_SKIP() << "LLVM is not enabled";
+  }
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T"), tir::DynShapeVar("I")};
+  Array<Array<IntImm>> wkl_insts;
+  DecisionTreeNode tree = MakeExactTree(shape_vars, 6, 3, &wkl_insts);
+  std::vector<FlatTreeNode> flat_tree;
+  int depth;
+  FlattenTree(tree.get(), shape_vars, &flat_tree, &depth);
+
+  runtime::NDArray X = runtime::NDArray::Empty({1}, DataType::Float(32), {kDLCPU, 0}),
+                   Y = runtime::NDArray::Empty({1}, DataType::Float(32), {kDLCPU, 0});
+  static_cast<float*>(X->data)[0] = 0.f;
+  for (const char* dispatch_mode : {"tree", "table"}) {
+    runtime::Module mod = BuildHostDispatcher(tree, shape_vars, dispatch_mode);
+    if (std::string(dispatch_mode) == "table") {
+      // The chain of tests on the leaf index is folded into a switch.
+      EXPECT_NE(mod->GetSource("ll").find("switch "), std::string::npos);
+    }
+    runtime::PackedFunc dispatcher = mod.GetFunction("default_function");
+    ASSERT_NE(dispatcher, nullptr);
+    for (int64_t t = 1; t <= 6 * 8 + 4; t += 3) {
+      for (int64_t i = 1; i <= 3 * 128 + 64; i += 32) {
+        dispatcher(X, Y, t, i);
+        EXPECT_EQ(static_cast<float*>(Y->data)[0], WalkFlatTree(flat_tree, {t, i}))
+            << dispatch_mode << " dispatch of (" << t << ", " << i << ")";
+      }
+    }
+  }
+}
+
+/*!
+ * \brief Benchmark of the dispatch overhead of the lowered host modules, with
+ *        the tree dispatch and with the table dispatch (with and without the
+ *        per-leaf counters), w.r.t. the tree depth. Each call includes the
+ *        PackedFunc call overhead and a one-element kernel. It is disabled by
+ *        default, run it with `--gtest_also_run_disabled_tests`.
+ */
+TEST(DispatchTable, DISABLED_DispatchOverheadBenchmark) {
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T"), tir::DynShapeVar("I")};
+  constexpr size_t kNumQueries = 1 << 12, kNumRepeats = 16;
+  runtime::NDArray X = runtime::NDArray::Empty({1}, DataType::Float(32), {kDLCPU, 0}),
+                   Y = runtime::NDArray::Empty({1}, DataType::Float(32), {kDLCPU, 0});
+  static_cast<float*>(X->data)[0] = 0.f;
+
+  std::cout << std::setw(8) << "#leaves" << std::setw(8) << "depth"
+            << std::setw(16) << "tree (ns)" << std::setw(16) << "table (ns)"
+            << std::setw(20) << "table+count (ns)" << std::endl;
+  for (int64_t num_t = 1; num_t <= 64; num_t *= 4) {
+    Array<Array<IntImm>> wkl_insts;
+    DecisionTreeNode tree = MakeExactTree(shape_vars, num_t, 4, &wkl_insts);
+    ASSERT_TRUE(DispatchTable(tree, shape_vars).defined());
+    std::vector<FlatTreeNode> flat_tree;
+    int depth;
+    FlattenTree(tree.get(), shape_vars, &flat_tree, &depth);
+
+    std::mt19937 rng(0);
+    std::vector<std::pair<int64_t, int64_t>> queries;
+    for (size_t q = 0; q < kNumQueries; ++q) {
+      const Array<IntImm>& wkl_inst = wkl_insts[rng() % wkl_insts.size()];
+      queries.emplace_back(wkl_inst[0]->value, wkl_inst[1]->value);
+    }
+    std::cout << std::setw(8) << wkl_insts.size() << std::setw(8) << depth;
+    for (const std::pair<const char*, bool>& config :
+         {std::make_pair("tree", false), std::make_pair("table", false),
+          std::make_pair("table", true)}) {
+      runtime::Module mod = BuildHostDispatcher(tree, shape_vars, config.first, config.second);
+      runtime::PackedFunc dispatcher = mod.GetFunction("default_function");
+      // Warm up, and check that every query is dispatched to its kernel.
+      for (const std::pair<int64_t, int64_t>& query : queries) {
+        dispatcher(X, Y, query.first, query.second);
+        ASSERT_EQ(static_cast<float*>(Y->data)[0],
+                  WalkFlatTree(flat_tree, {query.first, query.second}));
+      }
+      auto tic = std::chrono::high_resolution_clock::now();
+      for (size_t r = 0; r < kNumRepeats; ++r) {
+        for (const std::pair<int64_t, int64_t>& query : queries) {
+          dispatcher(X, Y, query.first, query.second);
+        }
+      }
+      auto toc = std::chrono::high_resolution_clock::now();
+      std::cout << std::setw(config.second ? 20 : 16)
+                << std::chrono::duration<double, std::nano>(toc - tic).count() /
+                   (kNumQueries * kNumRepeats);
+    }
+    std::cout << std::endl;
+  }
+}
+
+TEST(TopKDispatcher, MultiObjective) {
+  // Each instance prefers a different state, whereas the second state is only
+  // 10% slower on the first instance.
+  std::vector<float> scores{1.0, 0.9,
+                            0.8, 1.0};
+  std::unordered_map<size_t, size_t> disp_map = TopKDispatcher().dispatch(scores, 2);
+  EXPECT_EQ(disp_map[0], 0);
+  EXPECT_EQ(disp_map[1], 1);
+
+  // one kernel fewer is worth the mean slowdown of ~5.6%
+  disp_map = TopKDispatcher(128, 0.1).dispatch(scores, 2);
+  EXPECT_EQ(disp_map[0], 1);
+  EXPECT_EQ(disp_map[1], 1);
+  disp_map = TopKDispatcher(128, 0.01).dispatch(scores, 2);
+  EXPECT_EQ(disp_map[0], 0);
+
+  // and so are 1 KiB of code
+  disp_map = TopKDispatcher(128, 0., 0.1).dispatch(scores, 2, {1024, 1024});
+  EXPECT_EQ(disp_map[0], 1);
+  // unless the first instance weighs much more than the second one
+  disp_map = TopKDispatcher(128, 0., 0.1).dispatch(scores, 2, {1024, 1024}, {20., 1.});
+  EXPECT_EQ(disp_map[0], 0);
+}
+
+TEST(TopKDispatcher, FallBackToTopKStates) {
+  std::vector<float> scores{1.0, 0.9,
+                            0.8, 1.0};
+  // Every value of k picks both states, which exceed the limit of one state.
+  // All the instances then go to the state with the best accumulated score.
+  std::unordered_map<size_t, size_t> disp_map = TopKDispatcher(1).dispatch(scores, 2);
+  ASSERT_EQ(disp_map.size(), 2);
+  EXPECT_EQ(disp_map[0], 1);
+  EXPECT_EQ(disp_map[1], 1);
+}
+
+TEST(DynWklTelemetry, ReportReweighHotSwap) {
+  tir::DynShapeVar T("T");
+  const int I = 64, H = 64;
+  te::Tensor X = te::placeholder({T, I}, DataType::Float(32), "X");
+  te::Tensor W = te::placeholder({H, I}, DataType::Float(32), "W");
+  tir::IterVar k = te::reduce_axis(Range(0, I), "k");
+  te::Tensor Y = te::compute(
+      {T, H}, [&](tir::Var i, tir::Var j) { return sum(X[i][k] * W[j][k], {k}); }, "Y");
+  SearchTask task(ComputeDAG({X, W, Y}), "dietcode_telemetry_dense", Target("llvm"),
+                  Target("llvm"), HardwareParams(4, 64, 64, 0, 0, 0, 0, 0),
+                  LayoutRewriteOption::NoRewrite, {}, Array<tir::DynShapeVar>{T},
+                  MakeWklInsts({{16}, {32}}),
+                  Array<FloatImm>{FloatImm(DataType::Float(32), 1.),
+                                  FloatImm(DataType::Float(32), 1.)});
+  State init_state = task->compute_dag->init_state, split_state = init_state;
+  split_state.split(2, split_state->stages[2]->iters[1], {Integer(16)});
+  const double flop_0 = EstimateFlopForInst(task->compute_dag, task->shape_vars.value(),
+                                            task->wkl_insts[0]),
+               flop_1 = EstimateFlopForInst(task->compute_dag, task->shape_vars.value(),
+                                            task->wkl_insts[1]);
+  // Both instances are predicted to run at 1 GFLOPS.
+  int num_hot_swaps = 0;
+  const String dispatcher_name = "dietcode_telemetry_dense";
+  DynWklTelemetry telemetry(
+      DynWklDispatcher(task, {init_state}, {{0, 0}, {1, 0}}, {1e9f, 1e9f}),
+      TypedPackedFunc<void(DynWklDispatcher)>([&num_hot_swaps](DynWklDispatcher dispatcher) {
+        EXPECT_EQ(dispatcher->states.size(), 2);
+        ++num_hot_swaps;
+      }),
+      dispatcher_name);
+  // Each instance is dispatched to a leaf of its own, as if the dispatcher
+  // were lowered.
+  const runtime::PackedFunc* set_inst_leaf_ids =
+      runtime::Registry::Get("runtime.SetDispatchInstLeafIds");
+  ASSERT_NE(set_inst_leaf_ids, nullptr);
+  (*set_inst_leaf_ids)(dispatcher_name, runtime::ShapeTuple({0, 1}));
+
+  // The first instance runs as predicted, whereas the second one is 4x slower.
+  // The latencies are only recorded on every 10th call.
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(TVMBackendCountDispatch(dispatcher_name.c_str(), 0), 0);
+    ASSERT_EQ(TVMBackendCountDispatch(dispatcher_name.c_str(), 1), 0);
+    if (i % 10 == 0) {
+      telemetry->Record(task->wkl_insts[0], flop_0 / 1e9);
+      telemetry->Record(task->wkl_insts[1], 4 * flop_1 / 1e9);
+    }
+  }
+  Array<Map<String, ObjectRef>> report = telemetry->Report();
+  ASSERT_EQ(report.size(), 2);
+  for (const Map<String, ObjectRef>& shape_report : report) {
+    EXPECT_EQ(Downcast<IntImm>(shape_report["num_samples"])->value, 10);
+    EXPECT_EQ(Downcast<IntImm>(shape_report["leaf_count"])->value, 100);
+    const int64_t wkl_inst_id = Downcast<Integer>(shape_report["wkl_inst_id"])->value;
+    const double flop = wkl_inst_id == 0 ? flop_0 : flop_1;
+    EXPECT_NEAR(Downcast<FloatImm>(shape_report["predicted_latency"])->value, flop / 1e9,
+                1e-9);
+  }
+  Array<Integer> retune_inst_ids = telemetry->SelectRetuneInsts(0.1, 0.8);
+  ASSERT_EQ(retune_inst_ids.size(), 1);
+  EXPECT_EQ(retune_inst_ids[0]->value, 1);
+
+  // Reweigh the instances that the mutations target.
+  EmptyPolicy policy(task, NullOpt);
+  policy->curr_inst_opt_prob = {0.5, 1.};
+  policy->EnqueueRetuneInsts(retune_inst_ids, 3.);
+  ASSERT_EQ(policy->curr_inst_opt_prob.size(), 2);
+  EXPECT_NEAR(policy->curr_inst_opt_prob[0], 0.25, 1e-6);
+
+  // Hot-swap the second instance to a re-tuned state, which resets its
+  // statistics only, and reaches the serving side through the callback.
+  telemetry->HotSwap(
+      DynWklDispatcher(task, {init_state, split_state}, {{0, 0}, {1, 1}}, {1e9f, 1e9f}));
+  EXPECT_EQ(num_hot_swaps, 1);
+  EXPECT_EQ(telemetry->GetDispatcher()->DispatchToState(1).ToStr(), split_state.ToStr());
+  for (const Map<String, ObjectRef>& shape_report : telemetry->Report()) {
+    const int64_t wkl_inst_id = Downcast<Integer>(shape_report["wkl_inst_id"])->value;
+    EXPECT_EQ(Downcast<IntImm>(shape_report["num_samples"])->value,
+              wkl_inst_id == 0 ? 10 : 0);
+  }
+  EXPECT_TRUE(telemetry->SelectRetuneInsts(0.1, 0.8).empty());
+
+  // Instances that are rarely called are not re-tuned, however slow they are.
+  telemetry->Reset();
+  for (int i = 0; i < 100; ++i) {
+    TVMBackendCountDispatch(dispatcher_name.c_str(), 0);
+  }
+  TVMBackendCountDispatch(dispatcher_name.c_str(), 1);
+  telemetry->Record(task->wkl_insts[1], 4 * flop_1 / 1e9);
+  EXPECT_TRUE(telemetry->SelectRetuneInsts(0.1, 0.8).empty());
+  EXPECT_EQ(telemetry->SelectRetuneInsts(0., 0.8).size(), 1);
+}
+
+TEST(DynWklTelemetry, LoweredDispatcherCountsLeaves) {
+  Array<tir::DynShapeVar> shape_vars{tir::DynShapeVar("T"), tir::DynShapeVar("I")};
+  Array<Array<IntImm>> wkl_insts;
+  DecisionTreeNode tree = MakeExactTree(shape_vars, 4, 2, &wkl_insts);
+  Array<StateVer> leaves = GetDecisionTreeStateVers(tree);
+  Array<Integer> inst_leaf_ids = GetDecisionTreeLeafIds(tree, shape_vars, wkl_insts);
+  ASSERT_EQ(inst_leaf_ids.size(), wkl_insts.size());
+  for (size_t i = 0; i < wkl_insts.size(); ++i) {
+    EXPECT_EQ(leaves[inst_leaf_ids[i]->value]->major->value, i);
+  }
+
+  te::Tensor X = te::placeholder({shape_vars[0], shape_vars[1]}, DataType::Float(32), "X");
+  const runtime::PackedFunc* make_host_dispatcher =
+      runtime::Registry::Get("auto_scheduler.MakeHostDispatcher");
+  ASSERT_NE(make_host_dispatcher, nullptr);
+  for (const char* dispatch_mode : {"tree", "table"}) {
+    IRModule mod = (*make_host_dispatcher)(Array<te::Tensor>{X}, shape_vars, tree,
+                                           String("default_function"), String(dispatch_mode));
+    tir::PrimFunc dispatcher = Downcast<tir::PrimFunc>(mod->Lookup("default_function"));
+    // Every kernel call is preceded by counting its leaf.
+    std::vector<int64_t> counted_leaf_ids;
+    tir::PostOrderVisit(dispatcher->body, [&](const ObjectRef& node) {
+      const auto* seq = node.as<tir::SeqStmtNode>();
+      if (seq == nullptr || seq->size() != 2) {
+        return;
+      }
+      const auto* count = seq->seq[0].as<tir::EvaluateNode>()->value.as<tir::CallNode>();
+      const auto* kernel_call =
+          seq->seq[1].as<tir::EvaluateNode>()->value.as<tir::CallNode>();
+      ASSERT_TRUE(count->op.same_as(tir::builtin::call_extern()));
+      EXPECT_EQ(Downcast<tir::StringImm>(count->args[0])->value, "TVMBackendCountDispatch");
+      EXPECT_EQ(Downcast<tir::StringImm>(count->args[1])->value, "default_function");
+      const int64_t leaf_id = Downcast<IntImm>(count->args[2])->value;
+      EXPECT_EQ(Downcast<tir::StringImm>(kernel_call->args[0])->value,
+                "default_function_" + std::to_string(leaves[leaf_id]->major->value) + "_0")
+          << dispatch_mode;
+      counted_leaf_ids.push_back(leaf_id);
+    });
+    std::sort(counted_leaf_ids.begin(), counted_leaf_ids.end());
+    ASSERT_EQ(counted_leaf_ids.size(), leaves.size()) << dispatch_mode;
+    for (size_t leaf_id = 0; leaf_id < leaves.size(); ++leaf_id) {
+      EXPECT_EQ(counted_leaf_ids[leaf_id], leaf_id);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  testing::FLAGS_gtest_death_test_style = "threadsafe";
+  return RUN_ALL_TESTS();
+}
@@ -171,6 +171,32 @@ TEST(ComputeDAG, AccessAnalyzer) {
   }
 }
 
+// <bojian/DietCode>
+TEST(SearchRoundPool, RecycleWithinRound) {
+  const auto& tensors = conv2d_nchw_bn_relu_func(1, 224, 224, 3, 64, 7, 2, 3);
+  const auto& dag = tvm::auto_scheduler::ComputeDAG(tensors);
+  const uint64_t epoch = GetSearchRoundEpoch();
+  {
+    SearchRoundScope search_round_scope;
+    EXPECT_TRUE(IsInSearchRound());
+    const tvm::runtime::Object* freed_state_node;
+    {
+      State s = dag->init_state;
+      s.CopyOnWrite();
+      freed_state_node = s.get();
+    }
+    // The copy that has just been freed is recycled.
+    State s = dag->init_state;
+    s.CopyOnWrite();
+    EXPECT_EQ(s.get(), freed_state_node);
+    const int conv = 3;
+    s.split(conv, s->stages[conv]->iters[0], {tvm::Optional<tvm::Integer>(tvm::Integer(2))});
+    EXPECT_EQ(s->transform_steps.size(), 1);
+  }
+  EXPECT_FALSE(IsInSearchRound());
+  EXPECT_EQ(GetSearchRoundEpoch(), epoch + 1);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   testing::FLAGS_gtest_death_test_style = "threadsafe";
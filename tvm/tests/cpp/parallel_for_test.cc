@@ -119,6 +119,85 @@ TEST(ParallelFor, Exception) {
   ICHECK(exception);
 }
 
+TEST(ParallelForDynamic, Basic) {
+  using tvm::support::parallel_for_dynamic;
+
+  std::vector<int> a(1000, 0);
+  parallel_for_dynamic(0, 1000, [&a](int i) { a[i] = i; });
+  for (int i = 0; i < 1000; i++) {
+    ICHECK_EQ(a[i], i);
+  }
+
+  // Check for step != 1 and for fixed chunk sizes.
+  parallel_for_dynamic(
+      0, 1000, [&a](int i) { a[i] *= 2; }, 2, 7);
+  for (int i = 0; i < 1000; i++) {
+    ICHECK_EQ(a[i], i % 2 == 0 ? 2 * i : i);
+  }
+
+  // Check for empty ranges.
+  parallel_for_dynamic(10, 10, [](int i) { LOG(FATAL) << "unreachable"; });
+}
+
+TEST(ParallelForDynamic, Nested) {
+  using tvm::support::parallel_for_dynamic;
+
+  std::vector<std::vector<int>> a(100, std::vector<int>(100, 0));
+  parallel_for_dynamic(0, 100, [&a](int i) {
+    parallel_for_dynamic(0, 100, [&a, i](int j) { a[i][j] = i * j; });
+  });
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < 100; j++) {
+      ICHECK_EQ(a[i][j], i * j);
+    }
+  }
+}
+
+TEST(ParallelForDynamic, NestedInParallelFor) {
+  using tvm::support::parallel_for;
+  using tvm::support::parallel_for_dynamic;
+
+  std::vector<std::vector<int>> a(100, std::vector<int>(100, 0));
+  parallel_for(0, 100, [&a](int i) {
+    parallel_for_dynamic(0, 100, [&a, i](int j) { a[i][j] = i * j; });
+  });
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < 100; j++) {
+      ICHECK_EQ(a[i][j], i * j);
+    }
+  }
+}
+
+TEST(ParallelForDynamic, Exception) {
+  using tvm::support::parallel_for_dynamic;
+
+  bool exception = false;
+  try {
+    parallel_for_dynamic(0, 100, [](int i) { LOG(FATAL) << "error"; });
+  } catch (const std::exception& e) {
+    exception = true;
+  }
+  ICHECK(exception);
+}
+
+TEST(ParallelForDynamic, NumThreads) {
+  using tvm::support::GetParallelForNumThreads;
+  using tvm::support::parallel_for_dynamic;
+  using tvm::support::SetParallelForNumThreads;
+
+  const int old_num_threads = GetParallelForNumThreads();
+  for (int num_threads : {1, 3}) {
+    SetParallelForNumThreads(num_threads);
+    ICHECK_EQ(GetParallelForNumThreads(), num_threads);
+    std::vector<int> a(100, 0);
+    parallel_for_dynamic(0, 100, [&a](int i) { a[i] = i; });
+    for (int i = 0; i < 100; i++) {
+      ICHECK_EQ(a[i], i);
+    }
+  }
+  SetParallelForNumThreads(old_num_threads);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   testing::FLAGS_gtest_death_test_style = "threadsafe";
@@ -17,6 +17,7 @@
 
 """Test ComputeDAG (replay, infer bound)"""
 import json
+import os
 import pickle
 
 import tvm
@@ -38,6 +39,33 @@ def test_apply_steps():
     tvm.lower(sch, tensors, simple_mode=True)
 
 
+def test_apply_steps_replay_cache():
+    # The replay cache is disabled by default, hence only enable it for the
+    # DAG of the task, and not for the reference ones below.
+    os.environ["DIETCODE_SCHED_REPLAY_CACHE_SIZE"] = "1024"
+    try:
+        task = auto_scheduler.SearchTask(
+            func=matmul_auto_scheduler_test, args=(64, 64, 64), target=tvm.target.Target("llvm")
+        )
+    finally:
+        del os.environ["DIETCODE_SCHED_REPLAY_CACHE_SIZE"]
+    policy = auto_scheduler.SketchPolicy(task, verbose=0)
+    states = policy.sample_initial_population()[:10]
+    # The mutated states share the prefixes of their steps with their parents.
+    states += policy.evolutionary_search(states, 10)
+
+    dag = task.compute_dag
+    for _ in range(2):
+        for state in states:
+            # A fresh DAG replays all the steps from scratch.
+            ref_dag = auto_scheduler.ComputeDAG(list(dag.tensors))
+            sch, tensors = dag.apply_steps_from_state(state)
+            ref_sch, ref_tensors = ref_dag.apply_steps_from_state(state)
+            assert str(tvm.lower(sch, tensors, simple_mode=True)) == str(
+                tvm.lower(ref_sch, ref_tensors, simple_mode=True)
+            )
+
+
 def test_infer_bound():
     dag, s = get_tiled_matmul()
     s = dag.infer_bound_from_state(s)
@@ -151,6 +179,7 @@ def test_invalid_compute_dag():
 
 if __name__ == "__main__":
     test_apply_steps()
+    test_apply_steps_replay_cache()
     test_infer_bound()
     test_estimate_flop()
     test_stage_order()
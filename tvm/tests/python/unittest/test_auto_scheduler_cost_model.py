@@ -22,11 +22,20 @@ import tempfile
 import numpy as np
 
 import tvm
-from tvm import auto_scheduler
+from tvm import auto_scheduler, te, tir
 
 from tvm.testing.auto_scheduler import matmul_auto_scheduler_test
 
 
+@auto_scheduler.register_workload
+def cost_model_dyn_dense(T, I, H):
+    X = te.placeholder((T, I), name="X")
+    W = te.placeholder((H, I), name="W")
+    k = te.reduce_axis((0, I), name="k")
+    Y = te.compute((T, H), lambda i, j: te.sum(X[i, k] * W[j, k], axis=k), name="Y")
+    return [X, W, Y]
+
+
 def get_sample_records(number):
     """Generate a list of random MeasureInput and MeasureResult pairs"""
     N = 128
@@ -79,6 +88,164 @@ def test_xgb_model():
     model.load(tmpfile)
 
 
+def test_shape_normalize_features():
+    from tvm.auto_scheduler.cost_model.xgb_model import (
+        shape_normalize_features,
+        NUM_SHAPE_RELATIVE_FEATURES,
+    )
+
+    mask = np.array([True, False])
+    features = np.empty((2,), dtype=object)
+    features[:] = [np.array([[np.log2(1025), 3.0]]), np.zeros((1, 2))]
+    normalized = shape_normalize_features(features, mask, [1024, 1024], [4096, 4096], 4096)
+    assert normalized[0].shape == (1, 2 + NUM_SHAPE_RELATIVE_FEATURES)
+    np.testing.assert_allclose(normalized[0][0], [0.0, 3.0, 0.25, 1.0, 2.0], atol=1e-6)
+    # the invalid features remain all-zero
+    assert normalized[1].min() == normalized[1].max() == 0
+
+
+def test_xgb_model_shape_normalized_features():
+    task, inputs, results = get_sample_records(50)
+
+    model = auto_scheduler.XGBModel(num_warmup_sample=-1, shape_normalized_features=True)
+    model.update(inputs, results)
+    preds = model.predict(task, [x.state for x in inputs])
+    assert len(preds) == len(inputs)
+
+    costs = [np.mean([x.value for x in res.costs]) for res in results]
+    throughputs = np.min(costs) / costs
+
+    rmse = np.sqrt(np.mean([np.square(pred - label) for pred, label in zip(preds, throughputs)]))
+    assert rmse <= 0.3
+
+
+def test_xgb_model_shape_normalized_features_dyn_task():
+    from tvm.auto_scheduler.dietcode import estimate_flop_for_inst
+    from tvm.auto_scheduler.feature import adapt_states_to_workloads
+
+    T = tir.DynShapeVar("T")
+    wkl_insts = [(16,), (32,), (64,)]
+    task = auto_scheduler.SearchTask(
+        func=cost_model_dyn_dense,
+        args=(T, 64, 64),
+        shape_vars=[T],
+        wkl_insts=wkl_insts,
+        wkl_inst_weights=[1.0] * len(wkl_insts),
+        target="llvm",
+    )
+    policy = auto_scheduler.SketchPolicy(task, verbose=0)
+    states = policy.sample_initial_population()[:30]
+    flop_cts = [estimate_flop_for_inst(task.compute_dag, task.shape_vars, x) for x in wkl_insts]
+
+    # Every other state is also measured on all the workload instances, at the
+    # same throughput as on the instance it is cherry-picked for.
+    inputs, results = [], []
+    for i, state in enumerate(states):
+        cost = np.random.uniform(0.5, 1.0) * 1e-3
+        multi_shape = i % 2 == 0
+        inputs.append(
+            auto_scheduler.MeasureInput(
+                task, state, multi_wkl_insts=wkl_insts if multi_shape else None
+            )
+        )
+        results.append(
+            auto_scheduler.MeasureResult(
+                [cost],
+                0,
+                "",
+                0.1,
+                0,
+                inst_costs=[cost * flop_ct / flop_cts[-1] for flop_ct in flop_cts]
+                if multi_shape
+                else None,
+            )
+        )
+
+    model = auto_scheduler.XGBModel(num_warmup_sample=-1, shape_normalized_features=True)
+    model.update(inputs, results)
+    # One sample per measurement, plus one per instance of the multi-shape ones.
+    assert [len(samples) for samples in model.inputs_sample_cache] == [
+        1 + len(wkl_insts) if i % 2 == 0 else 1 for i in range(len(states))
+    ]
+    # The labels of the per-instance samples are the throughputs on the instances
+    # (in TFLOPS), divided by the adaption penalties.
+    adaption_penalty = adapt_states_to_workloads(task, [states[0]], [1.0])[2][:, 0]
+    for inst_id, (_, label) in enumerate(model.inputs_sample_cache[0][1:]):
+        inst_cost = results[0].inst_costs[inst_id].value
+        expected_label = flop_cts[inst_id] / max(adaption_penalty[inst_id], 1e-6) / inst_cost
+        np.testing.assert_allclose(label, expected_label / 1e12, rtol=1e-5)
+
+    _, _, scores = model.predict_for_all_instances(task, states)
+    assert scores.shape == (len(wkl_insts), len(states))
+    valid = np.all(np.isfinite(scores), axis=0)
+    assert np.any(valid)
+    # The features relate each instance to the one they are extracted on, hence
+    # the predictions differ among the instances.
+    assert not np.allclose(scores[0, valid], scores[-1, valid])
+
+
+def test_xgb_model_ensemble_serialization():
+    task, inputs, results = get_sample_records(50)
+    states = [x.state for x in inputs]
+
+    model = auto_scheduler.XGBModel(num_warmup_sample=-1, num_ensemble_models=2)
+    model.update(inputs, results)
+    scores, stds = model.predict_with_uncertainty(task, states)
+
+    tmpdir = tvm.contrib.utils.tempdir()
+    tmpfile = tmpdir.relpath("ensemble")
+    model.save(tmpfile)
+    loaded_model = auto_scheduler.XGBModel(num_warmup_sample=-1, num_ensemble_models=2)
+    loaded_model.load(tmpfile)
+    assert len(loaded_model.ensemble_bsts) == 2
+    loaded_scores, loaded_stds = loaded_model.predict_with_uncertainty(task, states)
+    np.testing.assert_allclose(loaded_scores, scores, rtol=1e-5)
+    np.testing.assert_allclose(loaded_stds, stds, rtol=1e-5, atol=1e-6)
+
+
+def test_xgb_model_perf_counter_features():
+    from tvm.auto_scheduler.feature import PERF_COUNTER_METRIC_NAMES
+
+    task, inputs, _ = get_sample_records(50)
+    states = [x.state for x in inputs]
+    # The faster programs retire more instructions per cycle.
+    results = []
+    for _ in inputs:
+        cost = np.random.uniform(0.5, 1.0)
+        perf_counters = {
+            "cycles": 1e9,
+            "instructions": 2e9 / cost,
+            "l1d_load_misses": 1e7,
+            "llc_load_misses": 1e6,
+            "branch_misses": 1e5,
+        }
+        results.append(
+            auto_scheduler.MeasureResult([cost], 0, "", 0.1, 0, perf_counters=perf_counters)
+        )
+
+    model = auto_scheduler.XGBModel(num_warmup_sample=-1, perf_counter_targets=True)
+    model.update(inputs, results)
+    assert sorted(model.perf_counter_bsts) == sorted(PERF_COUNTER_METRIC_NAMES)
+    # The throughput model is trained on the metrics as extra features.
+    num_features = model.bst.num_features()
+    assert model.perf_counter_bsts["ipc"].num_features() + len(PERF_COUNTER_METRIC_NAMES) == \
+           num_features
+    preds = model.predict(task, states)
+
+    tmpdir = tvm.contrib.utils.tempdir()
+    tmpfile = tmpdir.relpath("perf_counter")
+    model.save(tmpfile)
+    loaded_model = auto_scheduler.XGBModel(num_warmup_sample=-1, perf_counter_targets=True)
+    loaded_model.load(tmpfile)
+    assert sorted(loaded_model.perf_counter_bsts) == sorted(PERF_COUNTER_METRIC_NAMES)
+    np.testing.assert_allclose(loaded_model.predict(task, states), preds, rtol=1e-5)
+
+
 if __name__ == "__main__":
     test_random_model()
     test_xgb_model()
+    test_shape_normalize_features()
+    test_xgb_model_shape_normalized_features()
+    test_xgb_model_shape_normalized_features_dyn_task()
+    test_xgb_model_ensemble_serialization()
+    test_xgb_model_perf_counter_features()
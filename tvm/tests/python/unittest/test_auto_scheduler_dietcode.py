@@ -0,0 +1,279 @@
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+
+
+"""Test the DietCode workload instance selection"""
+
+import os
+import tempfile
+
+import numpy as np
+
+import tvm
+import tvm.testing
+from tvm import auto_scheduler, te, tir
+
+
+@auto_scheduler.register_workload
+def dietcode_dense(T, I, H):
+    X = te.placeholder((T, I), name="X")
+    W = te.placeholder((H, I), name="W")
+    k = te.reduce_axis((0, I), name="k")
+    Y = te.compute((T, H), lambda i, j: te.sum(X[i, k] * W[j, k], axis=k), name="Y")
+    return [X, W, Y]
+
+
+def test_select_wkl_insts():
+    shape_hist = {(t, 768, h): float(t % 7 + 1) for t in range(1, 129) for h in (768, 3072)}
+    wkl_insts, wkl_inst_weights = auto_scheduler.select_wkl_insts(shape_hist, 8, align=(8, 1, 1))
+
+    assert len(wkl_insts) <= 8
+    assert wkl_insts == sorted(wkl_insts)
+    assert abs(sum(wkl_inst_weights) - sum(shape_hist.values())) < 1e-6
+    # Every observed shape is covered by at least one instance.
+    for shape_tuple in shape_hist:
+        assert any(all(s <= i for s, i in zip(shape_tuple, inst)) for inst in wkl_insts)
+    # Constant dimensions are not inflated.
+    assert all(inst[1] == 768 and inst[2] in (768, 3072) for inst in wkl_insts)
+    assert all(inst[0] % 8 == 0 for inst in wkl_insts)
+
+    # No merging happens when the budget is large enough.
+    wkl_insts, wkl_inst_weights = auto_scheduler.select_wkl_insts({(5,): 1.0, (9,): 2.0}, 4)
+    assert wkl_insts == [(5,), (9,)] and wkl_inst_weights == [1.0, 2.0]
+
+
+def test_load_shape_histogram():
+    with tempfile.TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, "shape_hist.csv")
+        with open(filename, "w") as fout:
+            fout.write("T,I,H,count\n5,768,768,10\n7,768,768,2\n5,768,768,3\n")
+        shape_hist = auto_scheduler.load_shape_histogram(filename)
+        assert shape_hist == {(5, 768, 768): 13.0, (7, 768, 768): 2.0}
+
+        wkl_insts, wkl_inst_weights = auto_scheduler.select_wkl_insts(filename, 1)
+        assert wkl_insts == [(7, 768, 768)] and wkl_inst_weights == [15.0]
+
+
+@tvm.testing.requires_llvm
+def test_statically_validate_state():
+    T = tir.DynShapeVar("T")
+    # 32 vector registers of 16 bytes each
+    hardware_params = auto_scheduler.HardwareParams(vector_unit_bytes=16, target="llvm")
+    task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 16, 8),
+                                     shape_vars=[T], wkl_insts=[(8,), (32,)],
+                                     wkl_inst_weights=[1.0, 1.0], target="llvm",
+                                     hardware_params=hardware_params)
+    state = task.compute_dag.get_init_state()
+    assert auto_scheduler.statically_validate_state(task, state, (32,)) == ("", 1.0)
+
+    # The local array of the cache write stage holds the whole T x 8 output,
+    # which spills out of the vector registers on the second instance and is
+    # hence penalized rather than rejected.
+    state.cache_write(2, "local")
+    assert auto_scheduler.statically_validate_state(task, state, (8,)) == ("", 1.0)
+    reason, penalty = auto_scheduler.statically_validate_state(task, state, (32,))
+    assert reason == "" and abs(penalty - 512. / 1024.) < 1e-6
+
+
+@tvm.testing.requires_llvm
+def test_multi_shape_measure():
+    T = tir.DynShapeVar("T")
+    task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 16, 8),
+                                     shape_vars=[T], wkl_insts=[(8,), (32,)],
+                                     wkl_inst_weights=[1.0, 1.0], target="llvm")
+    state = task.compute_dag.get_init_state()
+    inp = auto_scheduler.MeasureInput(task, state, multi_wkl_insts=[[32], [8]])
+
+    # The multi-shape instances survive the serialization to the workers.
+    recovered_inp = auto_scheduler.measure.MeasureInput.deserialize(inp.serialize())
+    assert [[int(v) for v in wkl_inst] for wkl_inst in recovered_inp.multi_wkl_insts] == \
+           [[32], [8]]
+
+    (build_res,) = auto_scheduler.LocalBuilder().build([inp])
+    assert build_res.error_no == 0, build_res.error_msg
+    (res,) = auto_scheduler.LocalRunner(number=2, repeat=2).run([inp], [build_res])
+    assert res.error_no == 0, res.error_msg
+    assert len(res.costs) == 2
+    assert len(res.inst_costs) == 2
+    assert all(inst_cost.value > 0 for inst_cost in res.inst_costs)
+
+
+@tvm.testing.requires_llvm
+def test_dyn_cpu_task_sample_init_population():
+    T = tir.DynShapeVar("T")
+    task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 64, 64),
+                                     shape_vars=[T], wkl_insts=[(16,), (64,)],
+                                     wkl_inst_weights=[1.0, 1.0], target="llvm")
+    policy = auto_scheduler.SketchPolicy(task, verbose=0)
+    states = policy.sample_initial_population()
+    assert len(states) > 0
+    # The outer loops are parallelized by their extents on the largest workload
+    # instance rather than skipped for being symbolic.
+    for state in states:
+        assert "parallel" in str(state)
+
+
+@tvm.testing.requires_llvm
+def test_task_scheduler_restore_dyn_records():
+    T = tir.DynShapeVar("T")
+    task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 16, 8),
+                                     shape_vars=[T], wkl_insts=[(8,), (32,)],
+                                     wkl_inst_weights=[1.0, 1.0], target="llvm")
+    state = task.compute_dag.get_init_state()
+    cost = 1e-3
+    with tempfile.TemporaryDirectory() as tmpdir:
+        log_file = os.path.join(tmpdir, "dyn_records.json")
+        # The records of the sketch policy do not carry the workload instance,
+        # which is the one that the state is cherry-picked for.
+        auto_scheduler.save_records(
+            log_file, [auto_scheduler.MeasureInput(task, state)],
+            [auto_scheduler.MeasureResult([cost], 0, "", 0.1, 0)])
+        task_scheduler = auto_scheduler.TaskScheduler([task], callbacks=[])
+        task_scheduler._restore_status(log_file, 1)
+
+    (inst_id,) = auto_scheduler.feature.get_cherry_picked_wkl_inst_ids(task, [state])
+    inst_flop_ct = auto_scheduler.dietcode.estimate_flop_for_inst(
+                       task.compute_dag, task.shape_vars, task.wkl_insts[inst_id])
+    # The expected latency assumes that all the instances run at the throughput
+    # of the cherry-picked one.
+    expected_cost = task_scheduler.flop_cts[0] * cost / inst_flop_ct
+    assert abs(task_scheduler.flop_cts[0] - inst_flop_ct) > 1e-6 * inst_flop_ct
+    assert abs(task_scheduler.best_costs[0] - expected_cost) < 1e-6 * expected_cost
+
+
+def test_adaption_penalty_calibration():
+    from tvm.auto_scheduler.feature import adapt_states_to_workloads, \
+        update_adaption_penalty_model, get_adaption_penalty_exponents, \
+        reset_adaption_penalty_model, save_adaption_penalty_model, load_adaption_penalty_model
+
+    T = tir.DynShapeVar("T")
+    wkl_insts = [(16,), (18,), (64,)]
+    hardware_params = auto_scheduler.HardwareParams(num_cores=4, target="llvm")
+    task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 16, 8),
+                                     shape_vars=[T], wkl_insts=wkl_insts,
+                                     wkl_inst_weights=[1.0] * len(wkl_insts), target="llvm",
+                                     hardware_params=hardware_params)
+    state = task.compute_dag.get_init_state()
+    state.split(2, state.stages[2].iters[0], [1, 1, 1, 4])
+
+    reset_adaption_penalty_model()
+    _, _, adapted = adapt_states_to_workloads(task, [state], [1.0])
+    analytic_ratios = adapted[:, 0] / adapted[0, 0]
+    # The measured throughput ratios deviate from the analytic ones quadratically.
+    measured_ratios = analytic_ratios ** 2
+    inst_costs = [auto_scheduler.dietcode.estimate_flop_for_inst(
+                      task.compute_dag, task.shape_vars, wkl_inst) / ratio
+                  for wkl_inst, ratio in zip(wkl_insts, measured_ratios)]
+    inp = auto_scheduler.MeasureInput(task, state, multi_wkl_insts=wkl_insts)
+    res = auto_scheduler.MeasureResult([inst_costs[0]], 0, "", 0.0, 0.0, inst_costs=inst_costs)
+    for _ in range(10):
+        update_adaption_penalty_model([inp], [res])
+
+    assert get_adaption_penalty_exponents(task) != (1.0, 1.0)
+    _, _, calibrated = adapt_states_to_workloads(task, [state], [1.0])
+    calibrated_ratios = calibrated[:, 0] / calibrated[0, 0]
+    for analytic_ratio, calibrated_ratio, measured_ratio in \
+            zip(analytic_ratios, calibrated_ratios, measured_ratios):
+        if analytic_ratio != measured_ratio:
+            assert abs(np.log(calibrated_ratio / measured_ratio)) < \
+                   abs(np.log(analytic_ratio / measured_ratio))
+
+    # The calibration survives a save/load round trip.
+    exponents = get_adaption_penalty_exponents(task)
+    with tempfile.NamedTemporaryFile() as fp:
+        save_adaption_penalty_model(fp.name)
+        reset_adaption_penalty_model()
+        assert get_adaption_penalty_exponents(task) == (1.0, 1.0)
+        load_adaption_penalty_model(fp.name)
+    assert np.allclose(get_adaption_penalty_exponents(task), exponents)
+    reset_adaption_penalty_model()
+
+
+@tvm.testing.requires_llvm
+def test_instantiate_replay_cache():
+    T = tir.DynShapeVar("T")
+    # Only the DAG of the task has the (by default disabled) replay cache.
+    os.environ["DIETCODE_SCHED_REPLAY_CACHE_SIZE"] = "1024"
+    try:
+        task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 16, 8),
+                                         shape_vars=[T], wkl_insts=[(8,), (32,)],
+                                         wkl_inst_weights=[1.0, 1.0], target="llvm")
+    finally:
+        del os.environ["DIETCODE_SCHED_REPLAY_CACHE_SIZE"]
+    state = task.compute_dag.get_init_state()
+    state.split(2, state.stages[2].iters[0], [4])
+    state.split(2, state.stages[2].iters[2], [4])
+    state.reorder(2, [state.stages[2].iters[i] for i in [0, 2, 1, 3, 4]])
+    state.fuse(2, state.stages[2].iters[:2])
+    state.parallel(2, state.stages[2].iters[0])
+
+    dag = task.compute_dag
+    # The snapshots are keyed by the instance, hence alternating between the
+    # instances must not replay the schedule of the other one.
+    for wkl_inst in [(8,), (32,), (8,), (32,)]:
+        ref_dag = auto_scheduler.ComputeDAG(list(dag.tensors))
+        sch, tensors = dag.get_sched_args_pair_on_wkl_inst(state, [T], wkl_inst)
+        ref_sch, ref_tensors = ref_dag.get_sched_args_pair_on_wkl_inst(state, [T], wkl_inst)
+        assert str(tvm.lower(sch, tensors, simple_mode=True)) == str(
+            tvm.lower(ref_sch, ref_tensors, simple_mode=True)
+        )
+
+
+@tvm.testing.requires_llvm
+def test_dyn_wkl_dispatcher_export_library():
+    T = tir.DynShapeVar("T")
+    task = auto_scheduler.SearchTask(func=dietcode_dense, args=(T, 16, 8),
+                                     shape_vars=[T], wkl_insts=[(8,), (32,)],
+                                     wkl_inst_weights=[1.0, 1.0], target="llvm")
+    init_state = task.compute_dag.get_init_state()
+    # two states so that the dispatcher has to branch
+    dispatcher = auto_scheduler.DynWklDispatcher(task, [init_state, init_state],
+                                                 {0: 0, 1: 1})
+
+    for dispatch_mode in ["tree", "table"]:
+        with tvm.transform.PassContext(config={"auto_scheduler.dispatch_mode": dispatch_mode}):
+            mod = dispatcher.build("llvm", name="dense")
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            filename = os.path.join(tmpdir, "dense.so")
+            mod.export_library(filename)
+            loaded_mod = tvm.runtime.load_module(filename)
+
+            dev = tvm.cpu()
+            for t in [8, 32, 20]:
+                X_np = np.random.uniform(size=(t, 16)).astype("float32")
+                W_np = np.random.uniform(size=(8, 16)).astype("float32")
+                X, W = tvm.nd.array(X_np, dev), tvm.nd.array(W_np, dev)
+                Y = tvm.nd.empty((t, 8), "float32", dev)
+                loaded_mod["dense"](X, W, Y, t)
+                tvm.testing.assert_allclose(Y.numpy(), X_np @ W_np.T, rtol=1e-5)
+            # Every call is counted into the leaf that it is dispatched to, and
+            # the counts are reset by every build.
+            counts = tvm.get_global_func("runtime.GetDispatchCounts")("dense")
+            assert sum(counts) == 3
+
+
+if __name__ == "__main__":
+    test_select_wkl_insts()
+    test_load_shape_histogram()
+    test_statically_validate_state()
+    test_multi_shape_measure()
+    test_dyn_cpu_task_sample_init_population()
+    test_task_scheduler_restore_dyn_records()
+    test_adaption_penalty_calibration()
+    test_instantiate_replay_cache()
+    test_dyn_wkl_dispatcher_export_library()
@@ -18,7 +18,7 @@
 
 import tvm
 import pytest
-from tvm.testing.auto_scheduler import matmul_auto_scheduler_test
+from tvm.testing.auto_scheduler import matmul_auto_scheduler_test, StateHashCostModel
 from tvm import auto_scheduler, te
 from tvm.auto_scheduler.cost_model.cost_model import PythonBasedModel
 
@@ -116,6 +116,30 @@ def test_mutate_parallel():
     assert found
 
 
+def test_mutation_deterministic_across_num_threads():
+    """
+    The mutation phase runs in parallel, with one random number generator per
+    slot of the population, hence the search results should not depend on the
+    number of threads.
+    """
+
+    task = auto_scheduler.SearchTask(
+        func=matmul_auto_scheduler_test, args=(64, 64, 64), target=tvm.target.Target("llvm")
+    )
+    old_num_threads = tvm.support.GetParallelForNumThreads()
+    results = []
+    for num_threads in [1, 4]:
+        tvm.support.SetParallelForNumThreads(num_threads)
+        policy = auto_scheduler.SketchPolicy(
+            task, program_cost_model=StateHashCostModel(), seed=1, verbose=0
+        )
+        states = policy.sample_initial_population()[:50]
+        results.append([str(state) for state in policy.evolutionary_search(states, 20)])
+    tvm.support.SetParallelForNumThreads(old_num_threads)
+    assert results[0] == results[1]
+
+
 if __name__ == "__main__":
     test_mutate_tile_size()
     test_mutate_parallel()
+    test_mutation_deterministic_across_num_threads()
@@ -17,16 +17,18 @@
 
 """ Test measurement and log serialization. """
 import json
+import os
 
 import multiprocessing
 import numpy as np
 import tvm
 from tvm import topi
-from tvm import te, auto_scheduler
+from tvm import te, tir, auto_scheduler
 import tempfile
+import time
 import tvm.testing
 import pickle
-from tvm.testing.auto_scheduler import matmul_auto_scheduler_test
+from tvm.testing.auto_scheduler import matmul_auto_scheduler_test, StateHashCostModel
 from tvm.auto_scheduler import workload_registry
 
 
@@ -257,6 +259,94 @@ def test_measure_local_builder_runner():
         assert mress[0].error_no == 0
 
 
+def test_measure_local_runner_perf_counters():
+    if not tvm.testing.device_enabled("llvm"):
+        return
+
+    task = auto_scheduler.SearchTask(
+        func=matmul_auto_scheduler_test, args=(128, 128, 128), target="llvm"
+    )
+    minp = auto_scheduler.MeasureInput(task, task.compute_dag.init_state)
+    bress = auto_scheduler.LocalBuilder().build([minp])
+    assert bress[0].error_no == 0
+    mress = auto_scheduler.LocalRunner(timeout=60, enable_perf_counters=True).run([minp], bress)
+    assert mress[0].error_no == 0
+    # The events that perf_event_open does not permit counting are left out.
+    for name, count in mress[0].perf_counters.items():
+        assert name in tvm.runtime.module.PERF_COUNTER_NAMES
+        assert count.value >= 0
+
+    res = auto_scheduler.MeasureResult(
+        [0.1],
+        0,
+        "",
+        0.2,
+        0,
+        perf_counters={"cycles": 4e9, "instructions": 8e9, "llc_load_misses": 1.6e7},
+    )
+    metrics = auto_scheduler.feature.get_perf_counter_metrics([res])
+    np.testing.assert_allclose(metrics[0, [0, 2]], [2.0, 2.0])
+    assert np.isnan(metrics[0, 1]) and np.isnan(metrics[0, 3])
+
+    # The event counts survive the round trip through the log file.
+    inp = auto_scheduler.MeasureInput(task, task.compute_dag.init_state)
+    _, recovered_res = auto_scheduler.measure_record.load_record_from_string(
+        auto_scheduler.measure_record.dump_record_to_string(inp, res)
+    )
+    assert {str(name): count.value for name, count in recovered_res.perf_counters.items()} == {
+        "cycles": 4e9,
+        "instructions": 8e9,
+        "llc_load_misses": 1.6e7,
+    }
+
+
+def test_reject_outliers():
+    from tvm.auto_scheduler.measure import _reject_outliers
+
+    costs = _reject_outliers([1.0, 1.1, 0.9, 1.0, 5.0])
+    assert sorted(costs) == [0.9, 1.0, 1.0, 1.1]
+    assert _reject_outliers([2.0, 2.0, 2.0]) == (2.0, 2.0, 2.0)
+
+
+def test_measure_local_runner_interleaved():
+    if not tvm.testing.device_enabled("llvm"):
+        return
+
+    task = auto_scheduler.SearchTask(
+        func=matmul_auto_scheduler_test, args=(128, 128, 128), target="llvm"
+    )
+    policy = auto_scheduler.SketchPolicy(task, verbose=0)
+    minps = [
+        auto_scheduler.MeasureInput(task, state)
+        for state in policy.sample_initial_population()[:4]
+    ]
+    bress = auto_scheduler.LocalBuilder().build(minps)
+    mress = auto_scheduler.LocalRunner(timeout=60, interleaved_rounds=5).run(minps, bress)
+    assert len(mress) == len(minps)
+    for bres, mres in zip(bress, mress):
+        if bres.error_no == 0:
+            assert mres.error_no == 0
+            assert 1 <= len(mres.costs) <= 5
+
+    # A batch that hangs is measured again program by program.
+    measure = auto_scheduler.measure
+    call_func_with_timeout = measure.call_func_with_timeout
+
+    def hang_interleaved_batch(worker, timeout, func, args=(), kwargs=None):
+        if func is measure._interleaved_eval_func:
+            return TimeoutError()
+        return call_func_with_timeout(worker, timeout, func, args, kwargs)
+
+    measure.call_func_with_timeout = hang_interleaved_batch
+    try:
+        mress = auto_scheduler.LocalRunner(timeout=60, interleaved_rounds=5).run(minps, bress)
+    finally:
+        measure.call_func_with_timeout = call_func_with_timeout
+    for bres, mres in zip(bress, mress):
+        if bres.error_no == 0:
+            assert mres.error_no == 0, mres.error_msg
+
+
 def test_dag_measure_local_builder_runner():
     if not tvm.testing.device_enabled("llvm"):
         return
@@ -423,6 +513,144 @@ def test_measure_special_inputs_map_by_name_rpc_runner():
         assert mress[0].error_no == 0
 
 
+def test_measure_memo():
+    if not tvm.testing.device_enabled("llvm"):
+        return
+
+    task = auto_scheduler.SearchTask(
+        func=matmul_auto_scheduler_test, args=(64, 64, 64), target="llvm"
+    )
+
+    def tune_with_memo(filename, staleness_window=0.0):
+        memo = auto_scheduler.MeasureMemo(filename, staleness_window)
+        tuning_options = auto_scheduler.TuningOptions(
+            num_measure_trials=2,
+            runner=auto_scheduler.LocalRunner(timeout=60),
+            measure_callbacks=[memo],
+        )
+        search_policy = auto_scheduler.SketchPolicy(
+            task, program_cost_model=StateHashCostModel(), seed=1, verbose=0
+        )
+        task.tune(tuning_options, search_policy=search_policy)
+        return memo
+
+    with tempfile.NamedTemporaryFile() as fp:
+        memo = tune_with_memo(fp.name)
+        assert memo.num_lookups > 0 and memo.num_hits == 0
+        # The second session skips the candidates measured in the first one.
+        memo = tune_with_memo(fp.name)
+        assert memo.num_hits > 0 and memo.hit_rate > 0.0
+        # Stale results are measured again.
+        time.sleep(1)
+        memo = tune_with_memo(fp.name, staleness_window=0.5)
+        assert memo.num_lookups > 0 and memo.num_hits == 0
+
+
+@auto_scheduler.register_workload
+def record_store_dyn_dense(T, I, H):
+    X = te.placeholder((T, I), name="X")
+    W = te.placeholder((H, I), name="W")
+    k = te.reduce_axis((0, I), name="k")
+    Y = te.compute((T, H), lambda i, j: te.sum(X[i, k] * W[j, k], axis=k), name="Y")
+    return [X, W, Y]
+
+
+def test_record_store():
+    tasks = [
+        auto_scheduler.SearchTask(
+            func=matmul_auto_scheduler_test, args=(size, size, size), target="llvm"
+        )
+        for size in [64, 128]
+    ]
+    inputs, results = [], []
+    for task in tasks:
+        for cost in [0.3, 0.1, 0.2, 0.4]:
+            inputs.append(auto_scheduler.MeasureInput(task, task.compute_dag.init_state))
+            results.append(auto_scheduler.MeasureResult([cost], 0, "", 0.2, 1))
+        # The records with errors are never the best ones.
+        inputs.append(auto_scheduler.MeasureInput(task, task.compute_dag.init_state))
+        results.append(auto_scheduler.MeasureResult([0.01], 2, "", 0.2, 1))
+
+    def best_costs(store):
+        return [
+            store.best(task.workload_key, task.target)[1].costs[0].value for task in tasks
+        ]
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, "log.json")
+        auto_scheduler.save_records(filename, inputs[:5], results[:5])
+
+        # The read-only loads do not write the index unless asked to.
+        auto_scheduler.RecordStore(filename, top_k=2)
+        assert not os.path.exists(filename + ".index")
+        store = auto_scheduler.RecordStore(filename, top_k=2, save_index=True)
+        assert os.path.exists(filename + ".index")
+        assert store.best(tasks[1].workload_key, tasks[1].target) is None
+        # Append through the store, and through another writer.
+        store.append(inputs[5:7], results[5:7])
+        auto_scheduler.save_records(filename, inputs[7:], results[7:])
+        np.testing.assert_allclose(best_costs(auto_scheduler.RecordStore(filename)), [0.1, 0.1])
+        # The best records are loaded transparently.
+        best_inp, best_res = auto_scheduler.load_best_record(filename, tasks[0].workload_key)
+        assert best_inp.task.workload_key == tasks[0].workload_key
+        np.testing.assert_allclose(best_res.costs[0].value, 0.1)
+
+        store = auto_scheduler.RecordStore(filename, top_k=2)
+        store.compact()
+        _, results_left = store.records()
+        np.testing.assert_allclose(
+            sorted(res.costs[0].value for res in results_left), [0.1, 0.1, 0.2, 0.2]
+        )
+        records, _ = auto_scheduler.load_records(filename)
+        assert len(list(records)) == 4
+        np.testing.assert_allclose(best_costs(auto_scheduler.RecordStore(filename)), [0.1, 0.1])
+
+        # The index is stale once the indexed bytes are rewritten, even if the
+        # size of the log file is the same.
+        with open(filename) as log_file:
+            log = log_file.read()
+        with open(filename, "w") as log_file:
+            log_file.write(log.replace("[0.1]", "[0.5]"))
+        np.testing.assert_allclose(best_costs(auto_scheduler.RecordStore(filename)), [0.2, 0.2])
+
+    # The records of a dynamic task that do not carry the workload instance are
+    # kept per instance that their states are cherry-picked for, as the costs
+    # on different instances are not comparable.
+    T = tir.DynShapeVar("T")
+    dyn_task = auto_scheduler.SearchTask(
+        func=record_store_dyn_dense,
+        args=(T, 16, 8),
+        shape_vars=[T],
+        wkl_insts=[(8,), (32,)],
+        wkl_inst_weights=[1.0, 1.0],
+        target="llvm",
+    )
+    dyn_states = []
+    for factor in [1, 4, 8, 32]:
+        state = dyn_task.compute_dag.get_init_state()
+        state.split(2, state.stages[2].iters[0], [factor])
+        dyn_states.append(state)
+    inst_ids = auto_scheduler.feature.get_cherry_picked_wkl_inst_ids(dyn_task, dyn_states)
+    dyn_costs = [0.4, 0.3, 0.2, 0.1]
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        filename = os.path.join(tmpdir, "dyn_log.json")
+        auto_scheduler.save_records(
+            filename,
+            [auto_scheduler.MeasureInput(dyn_task, state) for state in dyn_states],
+            [auto_scheduler.MeasureResult([cost], 0, "", 0.2, 1) for cost in dyn_costs],
+        )
+        store = auto_scheduler.RecordStore(filename)
+        assert store.best(dyn_task.workload_key, dyn_task.target) is None
+        for inst_id, wkl_inst in enumerate(dyn_task.wkl_insts):
+            inst_costs = [cost for cost, i in zip(dyn_costs, inst_ids) if i == inst_id]
+            best = store.best(dyn_task.workload_key, dyn_task.target, wkl_inst)
+            if inst_costs:
+                np.testing.assert_allclose(best[1].costs[0].value, min(inst_costs))
+            else:
+                assert best is None
+
+
 if __name__ == "__main__":
     test_record_split_reorder_fuse_annotation()
     test_record_compute_at_root_inline_cache_read_write()
@@ -431,9 +659,14 @@ if __name__ == "__main__":
     test_recover_measure_input()
     test_workload_dis_factor()
     test_measure_local_builder_runner()
+    test_measure_local_runner_perf_counters()
+    test_reject_outliers()
+    test_measure_local_runner_interleaved()
     test_dag_measure_local_builder_runner()
     test_workload_serialization()
     test_measure_local_builder_rpc_runner()
     test_measure_target_host()
     test_measure_special_inputs_map_by_name_local_runner()
     test_measure_special_inputs_map_by_name_rpc_runner()
+    test_measure_memo()
+    test_record_store()
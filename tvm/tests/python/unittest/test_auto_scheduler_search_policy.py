@@ -28,6 +28,7 @@ from tvm import auto_scheduler
 from tvm.auto_scheduler.utils import get_const_tuple
 
 from tvm.testing.auto_scheduler import (
+    StateHashCostModel,
     matmul_auto_scheduler_test,
     zero_rank_compute_auto_scheduler_test,
     zero_rank_reduce_auto_scheduler_test,
@@ -209,6 +210,74 @@ def test_sketch_search_policy_custom_sketch():
     )
 
 
+@tvm.testing.requires_llvm
+def test_sketch_search_policy_uncertainty_batch_selection():
+    class MockCostModel(StateHashCostModel):
+        """A deterministic cost model whose predictions are uncertain."""
+
+        def __init__(self):
+            super().__init__()
+            self.num_uncertainty_calls = 0
+
+        def predict_with_uncertainty(self, task, states):
+            self.num_uncertainty_calls += 1
+            scores = self.predict(task, states)
+            return scores, [1.0 - score for score in scores]
+
+    task = auto_scheduler.SearchTask(
+        func=matmul_auto_scheduler_test, args=(64, 64, 64), target="llvm"
+    )
+    for batch_selection in ["ucb", "ei"]:
+        cost_model = MockCostModel()
+        params = dict(auto_scheduler.SketchPolicy.DEFAULT_PARAMS)
+        params["batch_selection"] = batch_selection
+        search_policy = auto_scheduler.SketchPolicy(
+            task, program_cost_model=cost_model, params=params, seed=1, verbose=0
+        )
+        with tempfile.NamedTemporaryFile() as fp:
+            tuning_options = auto_scheduler.TuningOptions(
+                num_measure_trials=4,
+                num_measures_per_round=2,
+                measure_callbacks=[auto_scheduler.RecordToFile(fp.name)],
+            )
+            task.tune(tuning_options, search_policy=search_policy)
+            inputs, _, _ = auto_scheduler.RecordReader(fp.name).read_lines()
+            assert len(inputs) == 4
+        assert cost_model.num_uncertainty_calls > 0
+
+
+@tvm.testing.requires_llvm
+def test_sketch_search_policy_sketch_pruning():
+    task = auto_scheduler.SearchTask(
+        func=matmul_auto_scheduler_test, args=(64, 64, 64), target="llvm"
+    )
+    params = dict(auto_scheduler.SketchPolicy.DEFAULT_PARAMS)
+    # Drop all but the best sketch once they have been sampled in enough rounds.
+    params["sketch_prune_threshold"] = 1.0
+    search_policy = auto_scheduler.SketchPolicy(
+        task, program_cost_model=StateHashCostModel(), params=params, seed=1, verbose=0
+    )
+    num_sketches = len(search_policy.generate_sketches())
+    assert num_sketches > 1
+    num_measures_per_round = 2
+    with tempfile.NamedTemporaryFile() as fp:
+        tuning_options = auto_scheduler.TuningOptions(
+            num_measure_trials=12,
+            num_measures_per_round=num_measures_per_round,
+            measure_callbacks=[auto_scheduler.RecordToFile(fp.name)],
+        )
+        task.tune(tuning_options, search_policy=search_policy)
+        inputs, _, _ = auto_scheduler.RecordReader(fp.name).read_lines()
+    assert len(inputs) == 12
+
+    dropped_sketch_ids = search_policy.get_dropped_sketch_ids()
+    assert 0 < len(dropped_sketch_ids) < num_sketches
+    # The measured states, evolved ones included, are all traced back to their sketches,
+    # and those of the last round come from the kept sketches only.
+    sketch_ids = [search_policy.get_sketch_id(inp.state) for inp in inputs]
+    assert all(sketch_id != -1 for sketch_id in sketch_ids)
+    assert not set(sketch_ids[-num_measures_per_round:]) & set(dropped_sketch_ids)
+
 if __name__ == "__main__":
     test_workload_registry_empty_policy()
     test_sketch_search_policy_basic()
@@ -218,3 +287,5 @@ if __name__ == "__main__":
     test_sketch_search_policy_cuda_xgbmodel_rpc_runner()
     test_sketch_search_policy_zero_rank()
     test_sketch_search_policy_custom_sketch()
+    test_sketch_search_policy_uncertainty_batch_selection()
+    test_sketch_search_policy_sketch_pruning()
@@ -25,7 +25,7 @@ import tvm
 import tvm.testing
 from tvm import auto_scheduler
 
-from tvm.testing.auto_scheduler import matmul_auto_scheduler_test
+from tvm.testing.auto_scheduler import matmul_auto_scheduler_test, softmax_nm_auto_scheduler_test
 
 
 @tvm.testing.requires_llvm
@@ -139,7 +139,65 @@ def test_task_scheduler_gradient():
         del measure_ctx
 
 
+def test_task_scheduler_structure_tag():
+    from tvm.auto_scheduler.task_scheduler import derive_structure_tag
+
+    dags = [
+        auto_scheduler.ComputeDAG(softmax_nm_auto_scheduler_test(n, m))
+        for n, m in [(16, 64), (32, 128)]
+    ]
+    tag = derive_structure_tag(dags[0])
+    assert tag and tag == derive_structure_tag(dags[1])
+    # untagged compute ops are never considered similar
+    assert derive_structure_tag(auto_scheduler.ComputeDAG(matmul_auto_scheduler_test(8, 8, 8))) == ""
+
+
+@tvm.testing.requires_llvm
+def test_task_scheduler_transfer_learning():
+    from tvm.auto_scheduler.task_scheduler import find_transfer_sources, make_search_policies
+
+    src_task = auto_scheduler.SearchTask(
+        func=softmax_nm_auto_scheduler_test, args=(16, 64), target="llvm"
+    )
+    dst_task = auto_scheduler.SearchTask(
+        func=softmax_nm_auto_scheduler_test, args=(32, 128), target="llvm"
+    )
+    assert src_task.workload_key != dst_task.workload_key
+
+    with tempfile.NamedTemporaryFile() as fp:
+        tuning_options = auto_scheduler.TuningOptions(
+            num_measure_trials=4,
+            num_measures_per_round=2,
+            measure_callbacks=[auto_scheduler.RecordToFile(fp.name)],
+        )
+        src_task.tune(
+            tuning_options, search_policy=auto_scheduler.SketchPolicy(src_task, seed=1, verbose=0)
+        )
+        num_src_records = sum(1 for _, res in auto_scheduler.RecordReader(fp.name)
+                              if res.error_no == 0)
+        assert num_src_records > 0
+
+        src_keys = find_transfer_sources([dst_task], fp.name)
+        assert src_keys == [[src_task.workload_key]]
+
+        # Nothing has been measured on the new task, so the seeds of its initial
+        # population all come from the records of the other workload.
+        (search_policy,) = make_search_policies(
+            "sketch.random", None, [dst_task], 2, 0,
+            transfer_log_file=fp.name, transfer_src_keys=src_keys,
+        )
+        seed_states = search_policy.get_seed_states()
+        assert 0 < len(seed_states) <= num_src_records
+        for state in seed_states:
+            dst_task.compute_dag.apply_steps_from_state(state)
+
+        (search_policy,) = make_search_policies("sketch.random", None, [dst_task], 2, 0)
+        assert len(search_policy.get_seed_states()) == 0
+
+
 if __name__ == "__main__":
     test_task_scheduler_round_robin()
     test_task_scheduler_round_robin_spawn()
     test_task_scheduler_gradient()
+    test_task_scheduler_structure_tag()
+    test_task_scheduler_transfer_learning()
@@ -56,5 +56,44 @@ def test_min_repeat_ms():
     assert ct > 10 + 2
 
 
+def test_adaptive_time_evaluator():
+    @tvm.register_func
+    def my_sleep():
+        """one call lasts for 10 ms"""
+        time.sleep(0.01)
+
+    X = te.compute((), lambda: tvm.tir.call_packed("my_sleep"))
+    s = te.create_schedule(X.op)
+    func = tvm.build(s, [X])
+    x = tvm.nd.empty((), dtype="int32")
+
+    # never tight enough, hence all the repeats
+    ftimer = func.adaptive_time_evaluator(
+        func.entry_name, tvm.cpu(), min_repeat=3, max_repeat=8, rel_ci_width=0.0
+    )
+    prof_res = ftimer(x)
+    assert len(prof_res.results) == 8
+    assert prof_res.mean >= 0.01
+    assert prof_res.variance >= 0
+
+    # the confidence interval of a sleep is tight
+    ftimer = func.adaptive_time_evaluator(
+        func.entry_name, tvm.cpu(), min_repeat=3, max_repeat=100, rel_ci_width=0.5
+    )
+    assert len(ftimer(x).results) < 100
+
+    # provably slower than 1 ms
+    ftimer = func.adaptive_time_evaluator(
+        func.entry_name,
+        tvm.cpu(),
+        min_repeat=3,
+        max_repeat=100,
+        rel_ci_width=0.0,
+        upper_bound=0.001,
+    )
+    assert len(ftimer(x).results) < 100
+
+
 if __name__ == "__main__":
     test_min_repeat_ms()
+    test_adaptive_time_evaluator()